@@ -31,11 +31,16 @@ Feel free to copy, use and enjoy according to the license provided.
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/wait.h>
 
 #include <arpa/inet.h>
 
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 #if HAVE_OPENSSL
 #include <openssl/bio.h>
 #include <openssl/err.h>
@@ -67,6 +72,16 @@ Feel free to copy, use and enjoy according to the license provided.
 #define FIO_POLL_TICK 1000
 #endif
 
+/* Connection data is allocated lazily, in pages of (1 << FIO_FD_PAGE_LOG) */
+#ifndef FIO_FD_PAGE_LOG
+#define FIO_FD_PAGE_LOG 9
+#endif
+
+/* The CPU cache line size, used for aligning and padding hot data */
+#ifndef FIO_MEMORY_CACHE_LINE
+#define FIO_MEMORY_CACHE_LINE 64
+#endif
+
 #ifndef FIO_USE_URGENT_QUEUE
 #define FIO_USE_URGENT_QUEUE 1
 #endif
@@ -145,7 +160,7 @@ typedef void (*fio_uuid_link_fn)(void *);
 typedef struct fio_packet_s fio_packet_s;
 struct fio_packet_s {
   fio_packet_s *next;
-  int (*write_func)(int fd, struct fio_packet_s *packet);
+  ssize_t (*write_func)(int fd, struct fio_packet_s *packet);
   void (*dealloc)(void *buffer);
   union {
     void *buffer;
@@ -155,16 +170,23 @@ struct fio_packet_s {
   uintptr_t length;
 };
 
-/** Connection data (fd_data) */
+/**
+ * Connection data (fd_data) - the reactor's "hot" state.
+ *
+ * Fields used by the reactor's fast path (events, reading, writing, flushing
+ * and the timeout review) fit within a single cache line per connection.
+ */
 typedef struct {
   /* current data to be send */
   fio_packet_s *packet;
   /** the last packet in the queue. */
   fio_packet_s **packet_last;
-  /* Data sent so far */
-  size_t sent;
   /* fd protocol */
   fio_protocol_s *protocol;
+  /** RW hooks. */
+  fio_rw_hook_s *rw_hooks;
+  /** RW udata. */
+  void *rw_udata;
   /* timer handler */
   time_t active;
   /** The number of pending packets that are in the queue. */
@@ -183,17 +205,32 @@ typedef struct {
   uint8_t open;
   /** indicated that the connection should be closed. */
   uint8_t close;
+} fio_fd_data_s;
+
+/** Connection data (fd_cold) - the rarely accessed "cold" state. */
+typedef struct {
+  /* Data sent so far (reviewed when a Slowloris attack is suspected) */
+  size_t sent;
   /** peer address length */
   uint8_t addr_len;
   /** peer address length */
   uint8_t addr[48];
-  /** RW hooks. */
-  fio_rw_hook_s *rw_hooks;
-  /** RW udata. */
-  void *rw_udata;
   /* Objects linked to the UUID */
   fio_uuid_links_s links;
-} fio_fd_data_s;
+} fio_fd_cold_s;
+
+#define FIO_FD_PAGE_SIZE ((uintptr_t)1 << FIO_FD_PAGE_LOG)
+#define FIO_FD_PAGE_MASK (FIO_FD_PAGE_SIZE - 1)
+
+/** A page of connection data, allocated when first accessed. */
+typedef struct {
+  /* connection data (cache line aligned) */
+  fio_fd_data_s info[FIO_FD_PAGE_SIZE];
+  /* rarely accessed connection data */
+  fio_fd_cold_s cold[FIO_FD_PAGE_SIZE];
+  /* the (unaligned) allocation address */
+  void *mem;
+} fio_fd_page_s;
 
 typedef struct {
   struct timespec last_cycle;
@@ -219,10 +256,13 @@ typedef struct {
   uint32_t max_protocol_fd;
   /* timer handler */
   pid_t parent;
+  /* connection data page allocation lock */
+  fio_lock_i page_lock;
 #if FIO_ENGINE_POLL
   struct pollfd *poll;
 #endif
-  fio_fd_data_s info[];
+  /* connection data pages (NULL until first accessed), indexed by fd */
+  fio_fd_page_s *pages[];
 } fio_data_s;
 
 /** The logging level */
@@ -245,8 +285,10 @@ union protocol_metadata_union_u {
   protocol_metadata_s meta;
 };
 
-#define fd_data(fd) (fio_data->info[(uintptr_t)(fd)])
+#define fd_data(fd) (fd_page((fd))->info[(uintptr_t)(fd)&FIO_FD_PAGE_MASK])
 #define uuid_data(uuid) fd_data(fio_uuid2fd((uuid)))
+#define fd_cold(fd) (fd_page((fd))->cold[(uintptr_t)(fd)&FIO_FD_PAGE_MASK])
+#define uuid_cold(uuid) fd_cold(fio_uuid2fd((uuid)))
 #define fd2uuid(fd)                                                            \
   ((intptr_t)((((uintptr_t)(fd)) << 8) | fd_data((fd)).counter))
 
@@ -265,6 +307,52 @@ size_t fio_capa(void) {
   return 0;
 }
 
+/* *****************************************************************************
+Connection data pages (allocated on first use)
+***************************************************************************** */
+
+/* allocates and initializes a missing page of connection data. */
+static fio_fd_page_s *fio_fd_page_new(uintptr_t index) {
+  fio_fd_page_s *page;
+  fio_lock(&fio_data->page_lock);
+  page = fio_data->pages[index];
+  if (page)
+    goto finish;
+  void *mem = fio_mmap(sizeof(*page) + FIO_MEMORY_CACHE_LINE);
+  FIO_ASSERT_ALLOC(mem);
+  /* the connection data starts at a cache line boundary */
+  page = (void *)(((uintptr_t)mem + (FIO_MEMORY_CACHE_LINE - 1)) &
+                  (~((uintptr_t)FIO_MEMORY_CACHE_LINE - 1)));
+  page->mem = mem;
+  for (size_t i = 0; i < FIO_FD_PAGE_SIZE; ++i) {
+    page->info[i] = (fio_fd_data_s){
+        .rw_hooks = (fio_rw_hook_s *)&FIO_DEFAULT_RW_HOOKS,
+        .counter = 1,
+        .packet_last = &page->info[i].packet,
+    };
+  }
+  /* publish the initialized page (readers don't lock) */
+  (void)fio_atomic_xchange(fio_data->pages + index, page);
+finish:
+  fio_unlock(&fio_data->page_lock);
+  return page;
+}
+
+/* returns the page containing the fd's data, allocating it if missing. */
+static inline fio_fd_page_s *fd_page(uintptr_t fd) {
+  fio_fd_page_s *page = fio_data->pages[fd >> FIO_FD_PAGE_LOG];
+  if (page)
+    return page;
+  return fio_fd_page_new(fd >> FIO_FD_PAGE_LOG);
+}
+
+/* returns true if the fd's data was allocated (non-allocating test). */
+#define fd_page_exists(fd) (fio_data->pages[(uintptr_t)(fd) >> FIO_FD_PAGE_LOG])
+
+/* returns the number of pages required for the connection capacity. */
+#define fio_fd_page_count(capa)                                                \
+  ((((uintptr_t)(capa)) + FIO_FD_PAGE_MASK) >> FIO_FD_PAGE_LOG)
+
 /* *****************************************************************************
 Packet allocation (for socket's user-buffer)
 ***************************************************************************** */
@@ -291,7 +379,7 @@ static inline int fio_clear_fd(intptr_t fd, uint8_t is_open) {
   void *rw_udata;
   fio_uuid_links_s links;
   fio_lock(&(fd_data(fd).sock_lock));
-  links = fd_data(fd).links;
+  links = fd_cold(fd).links;
   packet = fd_data(fd).packet;
   protocol = fd_data(fd).protocol;
   rw_hooks = fd_data(fd).rw_hooks;
@@ -304,11 +392,13 @@ static inline int fio_clear_fd(intptr_t fd, uint8_t is_open) {
       .counter = fd_data(fd).counter + 1,
       .packet_last = &fd_data(fd).packet,
   };
+  fd_cold(fd) = (fio_fd_cold_s){.sent = 0};
   if (fio_data->max_protocol_fd < fd) {
     fio_data->max_protocol_fd = fd;
   } else {
     while (fio_data->max_protocol_fd &&
-           !fd_data(fio_data->max_protocol_fd).open)
+           (!fd_page_exists(fio_data->max_protocol_fd) ||
+            !fd_data(fio_data->max_protocol_fd).open))
       --fio_data->max_protocol_fd;
   }
   fio_unlock(&(fd_data(fd).sock_lock));
@@ -444,10 +534,10 @@ void fio_touch(intptr_t uuid) {
 
 /* public API. */
 fio_str_info_s fio_peer_addr(intptr_t uuid) {
-  if (fio_is_closed(uuid) || !uuid_data(uuid).addr_len)
+  if (fio_is_closed(uuid) || !uuid_cold(uuid).addr_len)
     return (fio_str_info_s){.data = NULL, .len = 0, .capa = 0};
-  return (fio_str_info_s){.data = (char *)uuid_data(uuid).addr,
-                          .len = uuid_data(uuid).addr_len,
+  return (fio_str_info_s){.data = (char *)uuid_cold(uuid).addr,
+                          .len = uuid_cold(uuid).addr_len,
                           .capa = 0};
 }
 
@@ -503,7 +593,7 @@ void fio_uuid_link(intptr_t uuid, void *obj, void (*on_close)(void *obj)) {
   fio_lock(&uuid_data(uuid).sock_lock);
   if (!uuid_is_valid(uuid))
     goto locked_invalid;
-  fio_uuid_links_overwrite(&uuid_data(uuid).links, (uintptr_t)obj, on_close,
+  fio_uuid_links_overwrite(&uuid_cold(uuid).links, (uintptr_t)obj, on_close,
                            NULL);
   fio_unlock(&uuid_data(uuid).sock_lock);
   return;
@@ -523,7 +613,7 @@ int fio_uuid_unlink(intptr_t uuid, void *obj) {
     goto locked_invalid;
   /* default object comparison is always true */
   int ret =
-      fio_uuid_links_remove(&uuid_data(uuid).links, (uintptr_t)obj, NULL, NULL);
+      fio_uuid_links_remove(&uuid_cold(uuid).links, (uintptr_t)obj, NULL, NULL);
   if (ret)
     errno = ENOTCONN;
   fio_unlock(&uuid_data(uuid).sock_lock);
@@ -1125,6 +1215,111 @@ error:
   return NULL;
 }
 
+/* *****************************************************************************
+Lock-free read sections (epoch based memory reclamation)
+***************************************************************************** */
+
+typedef struct fio_rcu_node_s {
+  struct fio_rcu_node_s *next;
+  void (*task)(void *);
+  void *arg;
+} fio_rcu_node_s;
+
+/* readers and retired data are grouped by the epoch's parity */
+static struct {
+  volatile uintptr_t epoch;
+  volatile uintptr_t readers[2];
+  fio_rcu_node_s *retired[2];
+  fio_lock_i lock;
+} fio_rcu_data = {.lock = FIO_LOCK_INIT};
+
+/** Marks the beginning of a lock-free read section. */
+uintptr_t fio_rcu_read_lock(void) {
+  for (;;) {
+    const uintptr_t epoch = fio_rcu_data.epoch;
+    fio_atomic_add(fio_rcu_data.readers + (epoch & 1), 1);
+    if (epoch == fio_rcu_data.epoch)
+      return epoch;
+    /* the epoch advanced before we were counted, try again */
+    fio_atomic_sub(fio_rcu_data.readers + (epoch & 1), 1);
+  }
+}
+
+/** Marks the end of a lock-free read section. */
+void fio_rcu_read_unlock(uintptr_t token) {
+  fio_atomic_sub(fio_rcu_data.readers + (token & 1), 1);
+}
+
+/* performs (and frees) a list of retired tasks */
+static void fio_rcu_perform(fio_rcu_node_s *list) {
+  while (list) {
+    fio_rcu_node_s *node = list;
+    list = list->next;
+    node->task(node->arg);
+    fio_free(node);
+  }
+}
+
+/** Schedules `task(arg)` to run after all active read sections are done. */
+void fio_rcu_defer(void (*task)(void *), void *arg) {
+  if (!task)
+    return;
+  fio_rcu_node_s *node = fio_malloc(sizeof(*node));
+  FIO_ASSERT_ALLOC(node);
+  node->task = task;
+  node->arg = arg;
+  fio_rcu_node_s *list[2] = {NULL, NULL};
+  fio_lock(&fio_rcu_data.lock);
+  if (!fio_rcu_data.readers[0] && !fio_rcu_data.readers[1]) {
+    /* no reader can reach data retired earlier, release it now */
+    list[0] = fio_rcu_data.retired[0];
+    list[1] = fio_rcu_data.retired[1];
+    fio_rcu_data.retired[0] = NULL;
+    fio_rcu_data.retired[1] = NULL;
+  }
+  node->next = fio_rcu_data.retired[fio_rcu_data.epoch & 1];
+  fio_rcu_data.retired[fio_rcu_data.epoch & 1] = node;
+  fio_unlock(&fio_rcu_data.lock);
+  fio_rcu_perform(list[0]);
+  fio_rcu_perform(list[1]);
+}
+
+/*
+ * Called once per reactor cycle. Advances the epoch once all the readers of the
+ * previous epoch are done, releasing data retired during the previous epoch.
+ */
+static void fio_rcu_review(void) {
+  fio_rcu_node_s *list = NULL;
+  if (fio_trylock(&fio_rcu_data.lock))
+    return;
+  const uintptr_t next = fio_rcu_data.epoch + 1;
+  if (!fio_rcu_data.readers[next & 1]) {
+    list = fio_rcu_data.retired[next & 1];
+    fio_rcu_data.retired[next & 1] = NULL;
+    fio_atomic_add(&fio_rcu_data.epoch, 1);
+  }
+  fio_unlock(&fio_rcu_data.lock);
+  fio_rcu_perform(list);
+}
+
+/* releases all retired data, ignoring readers (cleanup only) */
+static void fio_rcu_flush(void) {
+  while (fio_rcu_data.retired[0] || fio_rcu_data.retired[1]) {
+    for (int i = 0; i < 2; ++i) {
+      fio_rcu_node_s *list = fio_rcu_data.retired[i];
+      fio_rcu_data.retired[i] = NULL;
+      fio_rcu_perform(list);
+    }
+  }
+}
+
+/* threads belonging to the parent are gone, so are their read sections */
+static void fio_rcu_on_fork(void) {
+  fio_rcu_data.lock = FIO_LOCK_INIT;
+  fio_rcu_data.readers[0] = 0;
+  fio_rcu_data.readers[1] = 0;
+}
+
 /* *****************************************************************************
 Section Start Marker
 
@@ -1585,6 +1780,8 @@ void fio_expected_concurrency(int16_t *threads, int16_t *processes) {
 }
 
 static fio_lock_i fio_fork_lock = FIO_LOCK_INIT;
+/* the number of (root process) threads waiting for a worker to exit */
+static volatile size_t fio_sentinel_count = 0;
 
 /* *****************************************************************************
 Section Start Marker
@@ -2339,12 +2536,12 @@ static void fio_tcp_addr_cpy(int fd, int family, struct sockaddr *addrinfo) {
                 family == AF_INET
                     ? (void *)&(((struct sockaddr_in *)addrinfo)->sin_addr)
                     : (void *)&(((struct sockaddr_in6 *)addrinfo)->sin6_addr),
-                (char *)fd_data(fd).addr, sizeof(fd_data(fd).addr));
+                (char *)fd_cold(fd).addr, sizeof(fd_cold(fd).addr));
   if (result) {
-    fd_data(fd).addr_len = strlen((char *)fd_data(fd).addr);
+    fd_cold(fd).addr_len = strlen((char *)fd_cold(fd).addr);
   } else {
-    fd_data(fd).addr_len = 0;
-    fd_data(fd).addr[0] = 0;
+    fd_cold(fd).addr_len = 0;
+    fd_cold(fd).addr[0] = 0;
   }
 }
 
@@ -2396,10 +2593,10 @@ intptr_t fio_accept(intptr_t srv_uuid) {
   fio_unlock(&fd_data(client).protocol_lock);
   /* copy peer address */
   if (((struct sockaddr *)addrinfo)->sa_family == AF_UNIX) {
-    fd_data(client).addr_len = uuid_data(srv_uuid).addr_len;
-    if (uuid_data(srv_uuid).addr_len) {
-      memcpy(fd_data(client).addr, uuid_data(srv_uuid).addr,
-             uuid_data(srv_uuid).addr_len + 1);
+    fd_cold(client).addr_len = uuid_cold(srv_uuid).addr_len;
+    if (uuid_cold(srv_uuid).addr_len) {
+      memcpy(fd_cold(client).addr, uuid_cold(srv_uuid).addr,
+             uuid_cold(srv_uuid).addr_len + 1);
     }
   } else {
     fio_tcp_addr_cpy(client, ((struct sockaddr *)addrinfo)->sa_family,
@@ -2458,9 +2655,9 @@ static intptr_t fio_unix_socket(const char *address, uint8_t server) {
   fio_lock(&fd_data(fd).protocol_lock);
   fio_clear_fd(fd, 1);
   fio_unlock(&fd_data(fd).protocol_lock);
-  if (addr_len < sizeof(fd_data(fd).addr)) {
-    memcpy(fd_data(fd).addr, address, addr_len + 1); /* copy the NUL byte. */
-    fd_data(fd).addr_len = addr_len;
+  if (addr_len < sizeof(fd_cold(fd).addr)) {
+    memcpy(fd_cold(fd).addr, address, addr_len + 1); /* copy the NUL byte. */
+    fd_cold(fd).addr_len = addr_len;
   }
   return fd2uuid(fd);
 }
@@ -2621,8 +2818,8 @@ static inline void fio_sock_packet_rotate_unsafe(uintptr_t fd) {
   fio_packet_free(packet);
 }
 
-static int fio_sock_write_buffer(int fd, fio_packet_s *packet) {
-  int written = fd_data(fd).rw_hooks->write(
+static ssize_t fio_sock_write_buffer(int fd, fio_packet_s *packet) {
+  ssize_t written = fd_data(fd).rw_hooks->write(
       fd2uuid(fd), fd_data(fd).rw_udata,
       ((uint8_t *)packet->data.buffer + packet->offset), packet->length);
   if (written > 0) {
@@ -2635,7 +2832,7 @@ static int fio_sock_write_buffer(int fd, fio_packet_s *packet) {
   return written;
 }
 
-static int fio_sock_write_from_fd(int fd, fio_packet_s *packet) {
+static ssize_t fio_sock_write_from_fd(int fd, fio_packet_s *packet) {
   ssize_t asked = 0;
   ssize_t sent = 0;
   ssize_t total = 0;
@@ -2678,7 +2875,7 @@ read_error:
 #if USE_SENDFILE_LINUX /* linux sendfile API */
 #include <sys/sendfile.h>
 
-static int fio_sock_sendfile_from_fd(int fd, fio_packet_s *packet) {
+static ssize_t fio_sock_sendfile_from_fd(int fd, fio_packet_s *packet) {
   ssize_t sent;
   sent =
       sendfile64(fd, packet->data.fd, (off_t *)&packet->offset, packet->length);
@@ -2693,7 +2890,7 @@ static int fio_sock_sendfile_from_fd(int fd, fio_packet_s *packet) {
 #elif USE_SENDFILE_BSD || USE_SENDFILE_APPLE /* FreeBSD / Apple API */
 #include <sys/uio.h>
 
-static int fio_sock_sendfile_from_fd(int fd, fio_packet_s *packet) {
+static ssize_t fio_sock_sendfile_from_fd(int fd, fio_packet_s *packet) {
   off_t act_sent = 0;
   ssize_t ret = 0;
   while (packet->length) {
@@ -2725,6 +2922,240 @@ static int (*fio_sock_sendfile_from_fd)(int fd, fio_packet_s *packet) =
 
 #endif
 
+/* *****************************************************************************
+Rope - a segmented String builder for vectored writes
+***************************************************************************** */
+
+#ifndef FIO_ROPE_IOV_LIMIT
+/** The maximum number of segments sent by a single `writev` call. */
+#define FIO_ROPE_IOV_LIMIT 64
+#endif
+
+#ifndef FIO_ROPE_REF_MIN
+/** References to data shorter than this are copied into the Rope. */
+#define FIO_ROPE_REF_MIN 256
+#endif
+
+struct fio_rope_segment_s {
+  fio_rope_segment_s *next;
+  /* referenced data deallocation (NULL for copied or static data) */
+  void (*dealloc)(void *data);
+  char *buf;
+  size_t len;
+  /* writable capacity (0 for referenced data) */
+  size_t capa;
+  char mem[];
+};
+
+/* allocates a writable segment with room for (at least) `len` bytes */
+static fio_rope_segment_s *fio_rope_segment_new(fio_rope_s *rope, size_t len) {
+  size_t size = FIO_ROPE_SEGMENT_SIZE;
+  if (len + sizeof(fio_rope_segment_s) > size)
+    size = len + sizeof(fio_rope_segment_s);
+  fio_rope_segment_s *seg = fio_malloc(size);
+  FIO_ASSERT_ALLOC(seg);
+  *seg = (fio_rope_segment_s){
+      .buf = seg->mem,
+      .capa = size - sizeof(fio_rope_segment_s),
+  };
+  if (rope->tail)
+    rope->tail->next = seg;
+  else
+    rope->head = seg;
+  rope->tail = seg;
+  ++rope->count;
+  return seg;
+}
+
+static inline void fio_rope_segment_free(fio_rope_segment_s *seg) {
+  if (seg->dealloc)
+    seg->dealloc(seg->buf);
+  fio_free(seg);
+}
+
+/**
+ * Copies `len` bytes from `data` to the end of the Rope.
+ *
+ * Returns the Rope's new length.
+ */
+size_t fio_rope_write(fio_rope_s *rope, const void *data, size_t len) {
+  if (!len)
+    return rope->len;
+  fio_rope_segment_s *seg = rope->tail;
+  if (seg && seg->capa > seg->len) {
+    size_t room = seg->capa - seg->len;
+    if (room > len)
+      room = len;
+    memcpy(seg->buf + seg->len, data, room);
+    seg->len += room;
+    rope->len += room;
+    data = (void *)((uintptr_t)data + room);
+    len -= room;
+    if (!len)
+      return rope->len;
+  }
+  seg = fio_rope_segment_new(rope, len);
+  memcpy(seg->buf, data, len);
+  seg->len = len;
+  rope->len += len;
+  return rope->len;
+}
+
+/**
+ * Appends `len` bytes from `data` to the end of the Rope *without* copying the
+ * data.
+ *
+ * Returns the Rope's new length.
+ */
+size_t fio_rope_write_ref(fio_rope_s *rope, const void *data, size_t len,
+                          void (*dealloc)(void *data)) {
+  if (len < FIO_ROPE_REF_MIN) {
+    fio_rope_write(rope, data, len);
+    if (dealloc)
+      dealloc((void *)data);
+    return rope->len;
+  }
+  fio_rope_segment_s *seg = fio_malloc(sizeof(*seg));
+  FIO_ASSERT_ALLOC(seg);
+  *seg = (fio_rope_segment_s){
+      .dealloc = dealloc,
+      .buf = (char *)data,
+      .len = len,
+  };
+  if (rope->tail)
+    rope->tail->next = seg;
+  else
+    rope->head = seg;
+  rope->tail = seg;
+  ++rope->count;
+  rope->len += len;
+  return rope->len;
+}
+
+/**
+ * Writes formatted data to the end of the Rope (see `printf`).
+ *
+ * Returns the Rope's new length.
+ */
+size_t __attribute__((format(printf, 2, 3)))
+fio_rope_printf(fio_rope_s *rope, const char *format, ...) {
+  va_list argv;
+  fio_rope_segment_s *seg = rope->tail;
+  size_t room = (seg && seg->capa > seg->len) ? seg->capa - seg->len : 0;
+  va_start(argv, format);
+  int len = vsnprintf((room ? seg->buf + seg->len : NULL), room, format, argv);
+  va_end(argv);
+  if (len <= 0)
+    return rope->len;
+  if ((size_t)len >= room) {
+    /* vsnprintf needs room for a NUL byte, that won't become part of the data
+     */
+    seg = fio_rope_segment_new(rope, (size_t)len + 1);
+    va_start(argv, format);
+    vsnprintf(seg->buf, (size_t)len + 1, format, argv);
+    va_end(argv);
+  }
+  seg->len += len;
+  rope->len += len;
+  return rope->len;
+}
+
+/**
+ * Copies the Rope's data to `dest`, which must have room for at least
+ * `rope->len` bytes (no NUL byte is written).
+ *
+ * Returns the number of bytes copied.
+ */
+size_t fio_rope_copy(const fio_rope_s *rope, void *dest) {
+  size_t pos = 0;
+  for (fio_rope_segment_s *seg = rope->head; seg; seg = seg->next) {
+    memcpy((char *)dest + pos, seg->buf, seg->len);
+    pos += seg->len;
+  }
+  return pos;
+}
+
+/** Frees the Rope's segments, leaving an empty (reusable) Rope. */
+void fio_rope_free(fio_rope_s *rope) {
+  fio_rope_segment_s *seg = rope->head;
+  while (seg) {
+    fio_rope_segment_s *tmp = seg;
+    seg = seg->next;
+    fio_rope_segment_free(tmp);
+  }
+  *rope = (fio_rope_s)FIO_ROPE_INIT;
+}
+
+/* the packet's `dealloc` callback, for Ropes moved to a socket */
+static void fio_rope_packet_dealloc(void *rope) {
+  fio_rope_free(rope);
+  fio_free(rope);
+}
+
+/*
+ * Consumes `written` bytes from a Rope packet, freeing any segment that was
+ * fully sent. `packet->offset` is the position within the first segment.
+ */
+static void fio_rope_packet_consume(fio_packet_s *packet, size_t written) {
+  fio_rope_s *rope = packet->data.buffer;
+  packet->length -= written;
+  rope->len -= written;
+  written += packet->offset;
+  while (rope->head && written >= rope->head->len) {
+    fio_rope_segment_s *seg = rope->head;
+    written -= seg->len;
+    rope->head = seg->next;
+    --rope->count;
+    fio_rope_segment_free(seg);
+  }
+  if (!rope->head)
+    rope->tail = NULL;
+  packet->offset = written;
+}
+
+/*
+ * Writes a Rope packet. Uses `writev` when the connection uses the default RW
+ * hooks, otherwise the segments are written one by one.
+ */
+static ssize_t fio_sock_write_rope(int fd, fio_packet_s *packet) {
+  fio_rope_s *rope = packet->data.buffer;
+  ssize_t total = 0;
+  ssize_t written;
+  if (fd_data(fd).rw_hooks == &FIO_DEFAULT_RW_HOOKS) {
+    struct iovec iov[FIO_ROPE_IOV_LIMIT];
+    int count = 0;
+    for (fio_rope_segment_s *seg = rope->head;
+         seg && count < FIO_ROPE_IOV_LIMIT; seg = seg->next) {
+      iov[count].iov_base = seg->buf;
+      iov[count].iov_len = seg->len;
+      ++count;
+    }
+    iov[0].iov_base = (char *)iov[0].iov_base + packet->offset;
+    iov[0].iov_len -= packet->offset;
+    written = writev(fd, iov, count);
+    if (written > 0) {
+      fio_rope_packet_consume(packet, (size_t)written);
+      total = written;
+    }
+  } else {
+    do {
+      const size_t len = rope->head->len - packet->offset;
+      written = fd_data(fd).rw_hooks->write(fd2uuid(fd), fd_data(fd).rw_udata,
+                                            rope->head->buf + packet->offset,
+                                            len);
+      if (written <= 0)
+        break;
+      fio_rope_packet_consume(packet, (size_t)written);
+      total += written;
+      if ((size_t)written < len)
+        break;
+    } while (packet->length);
+  }
+  if (!packet->length)
+    fio_sock_packet_rotate_unsafe(fd);
+  return total ? total : written;
+}
+
 /* *****************************************************************************
 Socket / Connection Functions
 ***************************************************************************** */
@@ -2794,6 +3225,23 @@ ssize_t fio_write2_fn(intptr_t uuid, fio_write_args_s options) {
   if (!uuid_is_valid(uuid))
     goto error;
 
+  if (options.is_rope) {
+    /* move the segments to a Rope owned by the packet */
+    fio_rope_s *rope = (fio_rope_s *)options.data.buffer;
+    if (!rope->len) {
+      fio_rope_free(rope);
+      return 0;
+    }
+    fio_rope_s *moved = fio_malloc(sizeof(*moved));
+    FIO_ASSERT_ALLOC(moved);
+    *moved = *rope;
+    *rope = (fio_rope_s)FIO_ROPE_INIT;
+    options.data.buffer = moved;
+    options.length = moved->len;
+    options.offset = 0;
+    options.after.dealloc = fio_rope_packet_dealloc;
+  }
+
   /* create packet */
   fio_packet_s *packet = fio_packet_alloc();
   *packet = (fio_packet_s){
@@ -2809,7 +3257,8 @@ ssize_t fio_write2_fn(intptr_t uuid, fio_write_args_s options) {
         (options.after.dealloc ? options.after.dealloc
                                : (void (*)(void *))fio_sock_perform_close_fd);
   } else {
-    packet->write_func = fio_sock_write_buffer;
+    packet->write_func =
+        (options.is_rope ? fio_sock_write_rope : fio_sock_write_buffer);
     packet->dealloc = (options.after.dealloc ? options.after.dealloc : free);
   }
   /* add packet to outgoing list */
@@ -2847,7 +3296,9 @@ locked_error:
   errno = EBADF;
   return -1;
 error:
-  if (options.after.dealloc) {
+  if (options.is_rope) {
+    fio_rope_free((fio_rope_s *)options.data.buffer);
+  } else if (options.after.dealloc) {
     options.after.dealloc((void *)options.data.buffer);
   }
   errno = EBADF;
@@ -2906,7 +3357,7 @@ void fio_force_close(intptr_t uuid) {
   packet = uuid_data(uuid).packet;
   uuid_data(uuid).packet = NULL;
   uuid_data(uuid).packet_last = &uuid_data(uuid).packet;
-  uuid_data(uuid).sent = 0;
+  uuid_cold(uuid).sent = 0;
   fio_unlock(&uuid_data(uuid).sock_lock);
   while (packet) {
     fio_packet_s *tmp = packet;
@@ -2946,7 +3397,7 @@ ssize_t fio_flush(intptr_t uuid) {
     goto invalid;
   errno = 0;
   ssize_t flushed = 0;
-  int tmp;
+  ssize_t tmp;
   /* start critical section */
   if (fio_trylock(&uuid_data(uuid).sock_lock))
     goto would_block;
@@ -2955,7 +3406,10 @@ ssize_t fio_flush(intptr_t uuid) {
     goto flush_rw_hook;
 
   const fio_packet_s *old_packet = uuid_data(uuid).packet;
-  const size_t old_sent = uuid_data(uuid).sent;
+  const size_t old_sent =
+      (uuid_data(uuid).packet_count >= FIO_SLOWLORIS_LIMIT)
+          ? uuid_cold(uuid).sent
+          : 0;
 
   tmp = uuid_data(uuid).packet->write_func(fio_uuid2fd(uuid),
                                            uuid_data(uuid).packet);
@@ -2965,8 +3419,8 @@ ssize_t fio_flush(intptr_t uuid) {
 
   if (uuid_data(uuid).packet_count >= FIO_SLOWLORIS_LIMIT &&
       uuid_data(uuid).packet == old_packet &&
-      uuid_data(uuid).sent >= old_sent &&
-      (uuid_data(uuid).sent - old_sent) < 32768) {
+      uuid_cold(uuid).sent >= old_sent &&
+      (uuid_cold(uuid).sent - old_sent) < 32768) {
     /* Slowloris attack assumed */
     goto attacked;
   }
@@ -3050,6 +3504,10 @@ size_t fio_flush_all(void) {
     return 0;
   size_t count = 0;
   for (uintptr_t i = 0; i <= fio_data->max_protocol_fd; ++i) {
+    if (!fd_page_exists(i)) {
+      i |= FIO_FD_PAGE_MASK;
+      continue;
+    }
     if ((fd_data(i).open || fd_data(i).packet) && fio_flush(fd2uuid(i)) > 0)
       ++count;
   }
@@ -3494,13 +3952,19 @@ static void fio_on_fork(void) {
   fio_timer_lock = FIO_LOCK_INIT;
   fio_data->lock = FIO_LOCK_INIT;
   fio_defer_on_fork();
+  fio_rcu_on_fork();
   fio_malloc_after_fork();
   fio_poll_init();
   fio_state_callback_on_fork();
 
   /* don't pass open connections belonging to the parent onto the child. */
   const size_t limit = fio_data->capa;
+  fio_data->page_lock = FIO_LOCK_INIT;
   for (size_t i = 0; i < limit; ++i) {
+    if (!fd_page_exists(i)) {
+      i |= FIO_FD_PAGE_MASK;
+      continue;
+    }
     fd_data(i).sock_lock = FIO_LOCK_INIT;
     fd_data(i).protocol_lock = FIO_LOCK_INIT;
     if (fd_data(i).protocol && fd_data(i).open) {
@@ -3529,7 +3993,12 @@ static void __attribute__((destructor)) fio_lib_destroy(void) {
   fio_state_callback_force(FIO_CALL_AT_EXIT);
   fio_state_callback_clear_all();
   fio_defer_perform();
+  fio_rcu_flush();
   fio_poll_close();
+  for (size_t i = 0; i < fio_fd_page_count(fio_data->capa); ++i) {
+    if (fio_data->pages[i])
+      fio_free(fio_data->pages[i]->mem);
+  }
   fio_free(fio_data);
   /* memory library destruction must be last */
   fio_mem_destroy();
@@ -3575,54 +4044,34 @@ static void __attribute__((constructor)) fio_lib_init(void) {
     fio_poll_init();
     /* initialize the cluster engine */
     fio_pubsub_initialize();
-#if DEBUG
-#if FIO_ENGINE_POLL
-    FIO_LOG_INFO("facil.io " FIO_VERSION_STRING " capacity initialization:\n"
-                 "*    Meximum open files %zu out of %zu\n"
-                 "*    Allocating %zu bytes for state handling.\n"
-                 "*    %zu bytes per connection + %zu for state handling.",
-                 capa, (size_t)rlim.rlim_max,
-                 (sizeof(*fio_data) + (capa * (sizeof(*fio_data->poll))) +
-                  (capa * (sizeof(*fio_data->info)))),
-                 (sizeof(*fio_data->poll) + sizeof(*fio_data->info)),
-                 sizeof(*fio_data));
-#else
-    FIO_LOG_INFO("facil.io " FIO_VERSION_STRING " capacity initialization:\n"
-                 "*    Meximum open files %zu out of %zu\n"
-                 "*    Allocating %zu bytes for state handling.\n"
-                 "*    %zu bytes per connection + %zu for state handling.",
-                 capa, (size_t)rlim.rlim_max,
-                 (sizeof(*fio_data) + (capa * (sizeof(*fio_data->info)))),
-                 (sizeof(*fio_data->info)), sizeof(*fio_data));
-#endif
-#endif
   }
 
-#if FIO_ENGINE_POLL
-  /* allocate and initialize main data structures by detected capacity */
-  fio_data = fio_mmap(sizeof(*fio_data) + (capa * (sizeof(*fio_data->poll))) +
-                      (capa * (sizeof(*fio_data->info))));
-  FIO_ASSERT_ALLOC(fio_data);
-  fio_data->capa = capa;
-  fio_data->poll =
-      (void *)((uintptr_t)(fio_data + 1) + (sizeof(fio_data->info[0]) * capa));
-#else
   /* allocate and initialize main data structures by detected capacity */
-  fio_data = fio_mmap(sizeof(*fio_data) + (capa * (sizeof(*fio_data->info))));
+  const size_t state_len =
+      sizeof(*fio_data) +
+#if FIO_ENGINE_POLL
+      (capa * (sizeof(*fio_data->poll))) +
+#endif
+      (fio_fd_page_count(capa) * sizeof(*fio_data->pages));
+  fio_data = fio_mmap(state_len);
   FIO_ASSERT_ALLOC(fio_data);
   fio_data->capa = capa;
+#if FIO_ENGINE_POLL
+  fio_data->poll = (void *)(fio_data->pages + fio_fd_page_count(capa));
+  for (ssize_t i = 0; i < capa; ++i) {
+    fio_data->poll[i].fd = -1;
+  }
 #endif
+  FIO_LOG_DEBUG("facil.io " FIO_VERSION_STRING " capacity initialization:\n"
+                "*    Meximum open files %zu\n"
+                "*    Allocating %zu bytes for state handling.\n"
+                "*    %zu bytes per %zu connections (allocated on demand).",
+                (size_t)capa, state_len, sizeof(fio_fd_page_s),
+                (size_t)FIO_FD_PAGE_SIZE);
   fio_data->parent = getpid();
   fio_data->connection_count = 0;
   fio_mark_time();
 
-  for (ssize_t i = 0; i < capa; ++i) {
-    fio_clear_fd(i, 0);
-#if FIO_ENGINE_POLL
-    fio_data->poll[i].fd = -1;
-#endif
-  }
-
   /* call initialization callbacks */
   fio_state_callback_force(FIO_CALL_ON_INITIALIZE);
   fio_state_callback_clear(FIO_CALL_ON_INITIALIZE);
@@ -3693,9 +4142,16 @@ static void fio_review_timeout(void *arg, void *ignr) {
 finish:
   do {
     fd++;
-  } while (!fd_data(fd).open && (fd <= fio_data->max_protocol_fd));
+    /* `pages[]` ends at `capa`, don't read past it */
+    if ((uintptr_t)fd >= fio_data->capa)
+      break;
+    if (!fd_page_exists(fd))
+      fd |= FIO_FD_PAGE_MASK;
+    else if (fd_data(fd).open)
+      break;
+  } while (fd <= fio_data->max_protocol_fd);
 
-  if (fio_data->max_protocol_fd < fd) {
+  if (fio_data->max_protocol_fd < fd || (uintptr_t)fd >= fio_data->capa) {
     fio_data->need_review = 1;
     return;
   }
@@ -3709,6 +4165,7 @@ static void fio_cycle_schedule_events(void) {
   static time_t last_to_review = 0;
   fio_mark_time();
   fio_timer_schedule();
+  fio_rcu_review();
   if (fio_signal_children_flag) {
     /* hot restart support */
     fio_signal_children_flag = 0;
@@ -3797,6 +4254,10 @@ static void fio_worker_cleanup(void) {
     FIO_LOG_INFO("Server Detected exit signal.");
   fio_state_callback_force(FIO_CALL_ON_SHUTDOWN);
   for (size_t i = 0; i <= fio_data->max_protocol_fd; ++i) {
+    if (!fd_page_exists(i)) {
+      i |= FIO_FD_PAGE_MASK;
+      continue;
+    }
     if (fd_data(i).protocol) {
       fio_defer_push_task(deferred_on_shutdown, (void *)fd2uuid(i), NULL);
     }
@@ -3804,6 +4265,10 @@ static void fio_worker_cleanup(void) {
   fio_defer_push_task(fio_cycle_unwind, NULL, NULL);
   fio_defer_perform();
   for (size_t i = 0; i <= fio_data->max_protocol_fd; ++i) {
+    if (!fd_page_exists(i)) {
+      i |= FIO_FD_PAGE_MASK;
+      continue;
+    }
     if (fd_data(i).protocol || fd_data(i).open) {
       fio_force_close(fd2uuid(i));
     }
@@ -3815,6 +4280,9 @@ static void fio_worker_cleanup(void) {
     fio_defer_perform();
     while (wait(NULL) != -1)
       ;
+    /* the sentinel threads access the process data after `waitpid` returns */
+    while (fio_sentinel_count)
+      fio_reschedule_thread();
   }
   fio_defer_perform();
   fio_state_callback_force(FIO_CALL_ON_FINISH);
@@ -3827,21 +4295,32 @@ static void fio_worker_cleanup(void) {
   }
 }
 
+/* implemented later, assigns the cluster's shared memory rings to workers */
+static void fio_cluster_shm_reserve(void);
+static size_t fio_cluster_shm_assign(pid_t pid);
+static void fio_cluster_shm_release(size_t slot);
+
 static void fio_sentinel_task(void *arg1, void *arg2);
 static void *fio_sentinel_worker_thread(void *arg) {
   errno = 0;
+  fio_cluster_shm_reserve();
   pid_t child = fio_fork();
+  const size_t ring = (child ? fio_cluster_shm_assign(child) : 0);
   /* release fork lock. */
   fio_unlock(&fio_fork_lock);
   if (child == -1) {
+    fio_cluster_shm_release(ring);
     FIO_LOG_FATAL("couldn't spawn worker.");
     perror("\n           errno");
     kill(fio_parent_pid(), SIGINT);
     fio_stop();
+    fio_atomic_sub(&fio_sentinel_count, 1);
     return NULL;
   } else if (child) {
     int status;
     waitpid(child, &status, 0);
+    /* the worker can't use the ring anymore, it's PID might be reused */
+    fio_cluster_shm_release(ring);
 #if DEBUG
     if (fio_data->active) { /* !WIFEXITED(status) || WEXITSTATUS(status) */
       if (!WIFEXITED(status) || WEXITSTATUS(status)) {
@@ -3868,6 +4347,7 @@ static void *fio_sentinel_worker_thread(void *arg) {
       fio_unlock(&fio_fork_lock);
     }
 #endif
+    fio_atomic_sub(&fio_sentinel_count, 1);
   } else {
     fio_on_fork();
     fio_state_callback_force(FIO_CALL_AFTER_FORK);
@@ -3885,8 +4365,11 @@ static void fio_sentinel_task(void *arg1, void *arg2) {
     return;
   fio_state_callback_force(FIO_CALL_BEFORE_FORK);
   fio_lock(&fio_fork_lock); /* will wait for worker thread to release lock. */
+  fio_atomic_add(&fio_sentinel_count, 1);
   void *thrd =
       fio_thread_new(fio_sentinel_worker_thread, (void *)&fio_fork_lock);
+  if (!thrd)
+    fio_atomic_sub(&fio_sentinel_count, 1);
   fio_thread_free(thrd);
   fio_lock(&fio_fork_lock);   /* will wait for worker thread to release lock. */
   fio_unlock(&fio_fork_lock); /* release lock for next fork. */
@@ -4002,6 +4485,63 @@ FIO_FUNC inline uint64_t fio_atol_consume(char **pstr, uint8_t base) {
   return result;
 }
 
+/* converts 8 decimal ASCII digits to their value, without branching (SWAR) */
+FIO_FUNC inline uint64_t fio_atol_8digits(const char *str) {
+  uint64_t v;
+  memcpy(&v, str, 8);
+#if __BIG_ENDIAN__
+  v = fio_bswap64(v); /* the first digit must be in the lowest byte */
+#endif
+  v -= 0x3030303030303030ULL;
+  /* 2 digits per 16 bits (in the low byte) */
+  v = (v * 10) + (v >> 8);
+  /* 8 digits in the high 32 bits: pairs weighted 10^6, 10^4, 10^2, 1 */
+  v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >>
+      32;
+  return v;
+}
+
+/* tests that the 8 bytes at `str` are all decimal digits (stops at NUL) */
+FIO_FUNC inline int fio_atol_is_8digits(const char *str) {
+#define FIO_ATOL_ISDIGIT(i) ((uint8_t)(str[(i)] - '0') < 10)
+  return FIO_ATOL_ISDIGIT(0) && FIO_ATOL_ISDIGIT(1) && FIO_ATOL_ISDIGIT(2) &&
+         FIO_ATOL_ISDIGIT(3) && FIO_ATOL_ISDIGIT(4) && FIO_ATOL_ISDIGIT(5) &&
+         FIO_ATOL_ISDIGIT(6) && FIO_ATOL_ISDIGIT(7);
+#undef FIO_ATOL_ISDIGIT
+}
+
+/*
+ * consumes any base 10 digits in the string, returning their value.
+ *
+ * Stops before a digit that would overflow 64 bits (leaving it unconsumed).
+ */
+FIO_FUNC inline uint64_t fio_atol_consume10(char **pstr) {
+  char *str = *pstr;
+  char *const limit = str + 19; /* up to 19 digits always fit */
+  uint64_t result = 0;
+  if (fio_atol_is_8digits(str)) {
+    result = fio_atol_8digits(str);
+    str += 8;
+    if (fio_atol_is_8digits(str)) {
+      result = (result * 100000000) + fio_atol_8digits(str);
+      str += 8;
+    }
+  }
+  while (str < limit && (uint8_t)(*str - '0') < 10) {
+    result = (result * 10) + (*str - '0');
+    ++str;
+  }
+  /* the 20th digit might overflow */
+  if ((uint8_t)(*str - '0') < 10 &&
+      result <= (UINT64_MAX - (uint8_t)(*str - '0')) / 10) {
+    result = (result * 10) + (*str - '0');
+    ++str;
+  }
+  *pstr = str;
+  return result;
+}
+
 /* returns true if there's data to be skipped */
 FIO_FUNC inline uint8_t fio_atol_skip_test(char **pstr, uint8_t base) {
   return (**pstr >= '0' && **pstr < ('0' + base));
@@ -4112,7 +4652,7 @@ int64_t fio_atol(char **pstr) {
       return 0;
   } else {
     /* base 10 */
-    result = fio_atol_consume(&str, 10);
+    result = fio_atol_consume10(&str);
     if (fio_atol_skip_test(&str, 10)) /* too large for a number */
       return 0;
   }
@@ -4126,7 +4666,7 @@ sign:
 }
 
 /** A helper function that converts between String data to a signed double. */
-double fio_atof(char **pstr) { return strtold(*pstr, pstr); }
+double fio_atof(char **pstr) { return strtod(*pstr, pstr); }
 
 /* *****************************************************************************
 Numbers to Strings
@@ -4260,23 +4800,41 @@ size_t fio_ltoa(char *dest, int64_t num, uint8_t base) {
     break;
   }
   /* Base 10, the default base */
-
-  if (num < 0) {
-    dest[len++] = '-';
-    num = 0 - num;
-  }
-  uint64_t l = 0;
-  while (num) {
-    uint64_t t = num / 10;
-    buf[l++] = '0' + (num - (t * 10));
-    num = t;
-  }
-  while (l) {
-    --l;
-    dest[len++] = buf[l];
+  {
+    /* two digits per division, written from the end of the buffer */
+    static const char digits2[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+    uint64_t n = (uint64_t)num;
+    char *pos = buf + sizeof(buf);
+    if (num < 0) {
+      dest[len++] = '-';
+      n = 0 - n;
+    }
+    while (n >= 100) {
+      const uint64_t t = n / 100;
+      pos -= 2;
+      memcpy(pos, digits2 + ((n - (t * 100)) << 1), 2);
+      n = t;
+    }
+    if (n >= 10) {
+      pos -= 2;
+      memcpy(pos, digits2 + (n << 1), 2);
+    } else {
+      *(--pos) = '0' + (char)n;
+    }
+    memcpy(dest + len, pos, (buf + sizeof(buf)) - pos);
+    len += (buf + sizeof(buf)) - pos;
+    dest[len] = 0;
+    return len;
   }
-  dest[len] = 0;
-  return len;
 
 zero:
   switch (base) {
@@ -4299,6 +4857,727 @@ zero:
   return len;
 }
 
+/* *****************************************************************************
+Float to String - shortest round-trip (Schubfach)
+
+Based on "The Schubfach way to render doubles" by Raffaello Giulietti, as
+implemented in the OpenJDK (`DoubleToDecimal`).
+
+Produces the shortest decimal that reads back (with correct rounding) to the
+same double, choosing the closest such decimal when more than one exists.
+***************************************************************************** */
+
+/* floor(e * log10(2)), for |e| <= 5456721 */
+#define FIO_FTOA_FLOG10POW2(e) ((int)(((int64_t)(e)*661971961083LL) >> 41))
+/* floor(e * log10(3/4) + e * log10(2)), for |e| <= 5456721 */
+#define FIO_FTOA_FLOG10_3Q_POW2(e)                                             \
+  ((int)(((int64_t)(e)*661971961083LL - 274743187321LL) >> 41))
+/* floor(e * log2(10)), for |e| <= 1233 */
+#define FIO_FTOA_FLOG2POW10(e) ((int)(((int64_t)(e)*913124641741LL) >> 38))
+
+#define FIO_FTOA_K_MIN -324
+#define FIO_FTOA_MASK_63 (((uint64_t)1 << 63) - 1)
+
+/**
+ * floor(10^-k * 2^-r) + 1, for k in [-324, 292], where r is chosen so the
+ * result is a 126 bit number (split into 63 bit high and low words).
+ */
+static const uint64_t fio_ftoa_g[][2] = {
+    {0x4F0CEDC95A718DD4ULL, 0x5B01E8B09AA0D1B5ULL},
+    {0x7E7B160EF71C1621ULL, 0x119CA780F767B5EEULL},
+    {0x652F44D8C5B011B4ULL, 0x0E16EC672C52F7F2ULL},
+    {0x50F29D7A37C00E29ULL, 0x581256B8F0425FF5ULL},
+    {0x40C21794F96671BAULL, 0x79A84560C0351991ULL},
+    {0x679CF287F570B5F7ULL, 0x75DA089ACD21C281ULL},
+    {0x52E3F5399126F7F9ULL, 0x44AE6D48A41B0201ULL},
+    {0x424FF76140EBF994ULL, 0x36F1F106E9AF34CDULL},
+    {0x6A198BCECE465C20ULL, 0x57E981A4A918547BULL},
+    {0x54E13CA571D1E34DULL, 0x2CBACE1D541376C9ULL},
+    {0x43E763B78E4182A4ULL, 0x23C8A4E44342C56EULL},
+    {0x6CA56C58E39C043AULL, 0x060DD4A06B9E08B0ULL},
+    {0x56EABD13E9499CFBULL, 0x1E7176E6BC7E6D59ULL},
+    {0x458897432107B0C8ULL, 0x7EC12BEBC9FEBDE1ULL},
+    {0x6F40F20501A5E7A7ULL, 0x7E01DFDFA9979635ULL},
+    {0x5900C19D9AEB1FB9ULL, 0x4B34B319547944F7ULL},
+    {0x4733CE17AF227FC7ULL, 0x55C3C27AA9FA9D93ULL},
+    {0x71EC7CF2B1D0CC72ULL, 0x560603F7765DC8EAULL},
+    {0x5B2397288E40A38EULL, 0x7804CFF92B7E3A55ULL},
+    {0x48E945BA0B66E93FULL, 0x13370CC755FE9511ULL},
+    {0x74A86F90123E41FEULL, 0x51F1AE0BBCCA881BULL},
+    {0x5D538C7341CB67FEULL, 0x74C1580963D539AFULL},
+    {0x4AA93D29016F8665ULL, 0x43CDE0078310FAF3ULL},
+    {0x77752EA8024C0A3CULL, 0x0616333F381B2B1EULL},
+    {0x5F90F22001D66E96ULL, 0x3811C298F9AF55B1ULL},
+    {0x4C73F4E667DEBEDEULL, 0x600E35472E25DE28ULL},
+    {0x7A532170A6313164ULL, 0x3349EED849D6303FULL},
+    {0x61DC1AC084F42783ULL, 0x42A18BE03B11C033ULL},
+    {0x4E49AF006A5CEC69ULL, 0x1BB46FE695A7CCF5ULL},
+    {0x7D42B19A43C7E0A8ULL, 0x2C53E63DBC3FAE55ULL},
+    {0x64355AE1CFD31A20ULL, 0x237651CAFCFFBEAAULL},
+    {0x502AAF1B0CA8E1B3ULL, 0x35F8416F30CC9888ULL},
+    {0x402225AF3D53E7C2ULL, 0x5E603458F3D6E06DULL},
+    {0x669D0918621FD937ULL, 0x4A3386F4B957CD7BULL},
+    {0x52173A79E8197A92ULL, 0x6E8F9F2A2DDFD796ULL},
+    {0x41AC2EC7ECE12EDBULL, 0x720C7F54F17FDFABULL},
+    {0x69137E0CAE3517C6ULL, 0x1CE0CBBB1BFFCC45ULL},
+    {0x540F980A24F74638ULL, 0x171A3C95AFFFD69EULL},
+    {0x433FACD4EA5F6B60ULL, 0x127B63AAF3331218ULL},
+    {0x6B991487DD657899ULL, 0x6A5F05DE51EB5026ULL},
+    {0x5614106CB11DFA14ULL, 0x5518D17EA7EF7352ULL},
+    {0x44DCD9F08DB194DDULL, 0x2A7A41321FF2C2A8ULL},
+    {0x6E2E2980E2B5BAFBULL, 0x5D906850331E043FULL},
+    {0x5824EE00B55E2F2FULL, 0x647386A68F4B3699ULL},
+    {0x4683F19A2AB1BF59ULL, 0x36C2D21ED908F87BULL},
+    {0x70D31C29DDE93228ULL, 0x579E1CFE280E5A5DULL},
+    {0x5A427CEE4B20F4EDULL, 0x2C7E7D98200B7B7EULL},
+    {0x483530BEA280C3F1ULL, 0x09FECAE019A2C932ULL},
+    {0x73884DFDD0CE064EULL, 0x43314499C29E0EB6ULL},
+    {0x5C6D0B3173D8050BULL, 0x4F5A9D47CEE4D891ULL},
+    {0x49F0D5C129799DA2ULL, 0x72AEE4397250AD41ULL},
+    {0x764E22CEA8C295D1ULL, 0x377E39F583B44868ULL},
+    {0x5EA4E8A553CEDE41ULL, 0x12CB61913629D387ULL},
+    {0x4BB72084430BE500ULL, 0x756F8140F8217605ULL},
+    {0x792500D39E796E67ULL, 0x6F18CECE59CF233CULL},
+    {0x60EA670FB1FABEB9ULL, 0x3F470BD847D8E8FDULL},
+    {0x4D885272F4C89894ULL, 0x329F3CAD064720CAULL},
+    {0x7C0D50B7EE0DC0EDULL, 0x37652DE1A3A50143ULL},
+    {0x633DDA2CBE716724ULL, 0x2C50F1814FB73436ULL},
+    {0x4F64AE8A31F45283ULL, 0x3D0D8E010C92902BULL},
+    {0x7F077DA9E986EA6BULL, 0x7B48E334E0EA8045ULL},
+    {0x659F97BB2138BB89ULL, 0x49071C2A4D88669DULL},
+    {0x514C796280FA2FA1ULL, 0x20D27CEEA46D1EE4ULL},
+    {0x4109FAB533FB594DULL, 0x670ECA58838A7F1DULL},
+    {0x680FF788532BC216ULL, 0x0B4ADD5A6C10CB62ULL},
+    {0x533FF939DC2301ABULL, 0x22A24AAEBCDA3C4EULL},
+    {0x4299942E49B59AEFULL, 0x354EA22563E1C9D8ULL},
+    {0x6A8F537D42BC2B18ULL, 0x554A9D089FCFA95AULL},
+    {0x553F75FDCEFCEF46ULL, 0x776EE406E63FBAAEULL},
+    {0x4432C4CB0BFD8C38ULL, 0x5F8BE99F1E996225ULL},
+    {0x6D1E07AB466279F4ULL, 0x327975CB64289D08ULL},
+    {0x574B3955D1E86190ULL, 0x28612B091CED4A6DULL},
+    {0x45D5C777DB204E0DULL, 0x06B4226DB0BDD524ULL},
+    {0x6FBC72595E9A167BULL, 0x24536A491AC95506ULL},
+    {0x59638EADE54811FCULL, 0x1D0F883A7BD44405ULL},
+    {0x4782D88B1DD34196ULL, 0x4A72D361FCA9D004ULL},
+    {0x726AF411C952028AULL, 0x43EAEBCFFAA94CD3ULL},
+    {0x5B88C3416DDB353BULL, 0x4FEF230CC88770A9ULL},
+    {0x493A35CDF17C2A96ULL, 0x0CBF4F3D6D3926EEULL},
+    {0x7529EFAFE8C6AA89ULL, 0x61321862485B717CULL},
+    {0x5DBB262653D22207ULL, 0x675B46B506AF8DFDULL},
+    {0x4AFC1E850FDB4E6CULL, 0x52AF6BC405593E64ULL},
+    {0x77F9CA6E7FC54A47ULL, 0x377F12D33BC1FD6DULL},
+    {0x5FFB085866376E9FULL, 0x45FF42429634CABDULL},
+    {0x4CC8D379EB5F8BB2ULL, 0x6B329B68782A3BCBULL},
+    {0x7ADAEBF64565AC51ULL, 0x2B842BDA59DD2C77ULL},
+    {0x6248BCC5045156A7ULL, 0x3C69BCAEAE4A89F9ULL},
+    {0x4EA0970403744552ULL, 0x6387CA25583BA194ULL},
+    {0x7DCDBE6CD253A21EULL, 0x05A6103BC05F68EDULL},
+    {0x64A498570EA94E7EULL, 0x37B80CFC99E5ED8AULL},
+    {0x5083AD1272210B98ULL, 0x2C933D96E184BE08ULL},
+    {0x40695741F4E73C79ULL, 0x7075CADF1AD09807ULL},
+    {0x670EF2032171FA5CULL, 0x4D8944982AE759A4ULL},
+    {0x52725B35B45B2EB0ULL, 0x3E076A135585E150ULL},
+    {0x41F515C49048F226ULL, 0x64D2BB42AAD1810DULL},
+    {0x698822D41A0E503EULL, 0x07B7920444826815ULL},
+    {0x546CE8A9AE71D9CBULL, 0x1FC60E69D0685344ULL},
+    {0x438A53BAF1F4AE3CULL, 0x196B3EBB0D20429DULL},
+    {0x6C1085F7E9877D2DULL, 0x0F11FDF815006A94ULL},
+    {0x56739E5FEE05FDBDULL, 0x58DB319344005543ULL},
+    {0x45294B7FF19E6497ULL, 0x60AF5ADC3666AA9CULL},
+    {0x6EA878CCB5CA3A8CULL, 0x344BC4938A3DDDC7ULL},
+    {0x5886C70A2B082ED6ULL, 0x5D096A0FA1CB17D2ULL},
+    {0x46D238D4EF39BF12ULL, 0x173ABB3FB4A27975ULL},
+    {0x71505AEE4B8F981DULL, 0x0B912B992103F588ULL},
+    {0x5AA6AF25093FACE4ULL, 0x0940EFADB4032AD3ULL},
+    {0x488558EA6DCC8A50ULL, 0x07672624900288A9ULL},
+    {0x74088E43E2E0DD4CULL, 0x723EA36DB337410EULL},
+    {0x5CD3A5031BE71770ULL, 0x5B654F8AF5C5CDA5ULL},
+    {0x4A42EA68E31F45F3ULL, 0x62B772D5916B0AEBULL},
+    {0x76D1770E38320986ULL, 0x0458B7BC1BDE77DDULL},
+    {0x5F0DF8D82CF4D46BULL, 0x1D13C630164B9318ULL},
+    {0x4C0B2D79BD90A9EFULL, 0x30DC9E8CDEA2DC13ULL},
+    {0x79AB7BF5FC1AA97FULL, 0x0160FDAE31049351ULL},
+    {0x6155FCC4C9AEEDFFULL, 0x1AB3FE24F403A90EULL},
+    {0x4DDE63D0A158BE65ULL, 0x6229981D9002EDA5ULL},
+    {0x7C97061A9BC130A2ULL, 0x69DC2695B337E2A1ULL},
+    {0x63AC04E2163426E8ULL, 0x54B01EDE28F9821BULL},
+    {0x4FBCD0B4DE901F20ULL, 0x43C018B1BA6134E2ULL},
+    {0x7F9481216419CB67ULL, 0x1F99C11C5D68549DULL},
+    {0x6610674DE9AE3C52ULL, 0x4C7B00E37DED107EULL},
+    {0x51A6B90B21583042ULL, 0x09FC00B5FE574065ULL},
+    {0x41522DA2811359CEULL, 0x3B3000919845CD1DULL},
+    {0x68837C3734EBC2E3ULL, 0x784CCDB5C06FAE95ULL},
+    {0x539C635F5D8968B6ULL, 0x2D0A3E2B00595877ULL},
+    {0x42E382B2B13ABA2BULL, 0x3DA1CB5599E11393ULL},
+    {0x6B059DEAB52AC378ULL, 0x629C7888F634EC1EULL},
+    {0x559E17EEF755692DULL, 0x3549FA072B5D89B1ULL},
+    {0x447E798BF91120F1ULL, 0x1107FB38EF7E07C1ULL},
+    {0x6D9728DFF4E834B5ULL, 0x01A65EC17F300C68ULL},
+    {0x57AC20B32A535D5DULL, 0x4E1EB23465C009EDULL},
+    {0x46234D5C21DC4AB1ULL, 0x24E55B5D1E333B24ULL},
+    {0x70387BC69C93AAB5ULL, 0x216EF894FD1EC506ULL},
+    {0x59C6C96BB076222AULL, 0x4DF2607730E56A6CULL},
+    {0x47D23ABC8D2B4E88ULL, 0x3E5B805F5A5121F0ULL},
+    {0x72E9F79415121740ULL, 0x63C59A322A1B697FULL},
+    {0x5BEE5FA9AA74DF67ULL, 0x03047B5B54E2BACCULL},
+    {0x498B7FBAEEC3E5ECULL, 0x0269FC4910B5623DULL},
+    {0x75ABFF917E063CACULL, 0x6A432D41B45569FBULL},
+    {0x5E2332DACB38308AULL, 0x21CF5767C37787FCULL},
+    {0x4B4F5BE23C2CF3A1ULL, 0x67D912B9692C6CCAULL},
+    {0x787EF969F9E185CFULL, 0x595B5128A8471476ULL},
+    {0x60659454C7E79E3FULL, 0x6115DA86ED05A9F8ULL},
+    {0x4D1E1043D31FB1CCULL, 0x4DAB1538BD9E2193ULL},
+    {0x7B634D3951CC4FADULL, 0x62AB552795C9CF52ULL},
+    {0x62B5D7610E3D0C8BULL, 0x0222AA86116E3F75ULL},
+    {0x4EF7DF80D830D6D5ULL, 0x4E822204DABE992AULL},
+    {0x7E59659AF38157BCULL, 0x17369CD49130F510ULL},
+    {0x65145148C2CDDFC9ULL, 0x5F5EE3DD40F3F740ULL},
+    {0x50DD0DD3CF0B196EULL, 0x1918B64A9A5CC5CDULL},
+    {0x40B0D7DCA5A27ABEULL, 0x4746F83BAEB09E3EULL},
+    {0x678159610903F797ULL, 0x253E59F91780FD2FULL},
+    {0x52CDE11A6D9CC612ULL, 0x50FEAE60DF9A6426ULL},
+    {0x423E4DAEBE1704DBULL, 0x5A65584D7FAEB685ULL},
+    {0x69FD4917968B3AF9ULL, 0x10A226E265E4573BULL},
+    {0x54CAA0DFABA29594ULL, 0x0D4E8581EB1D1295ULL},
+    {0x43D54D7FBC821143ULL, 0x243ED134BC174211ULL},
+    {0x6C887BFF94034ED2ULL, 0x06CAE85460253682ULL},
+    {0x56D396661002A574ULL, 0x6BD586A9E6842B9BULL},
+    {0x457611EB40021DF7ULL, 0x09779EEE52035616ULL},
+    {0x6F234FDECCD02FF1ULL, 0x5BF297E3B66BBCEFULL},
+    {0x58E90CB23D73598EULL, 0x165BACB62B8963F3ULL},
+    {0x4720D6F4FDF5E13EULL, 0x451623C4EFA11CC2ULL},
+    {0x71CE24BB2FEFCECAULL, 0x3B569FA17F682E03ULL},
+    {0x5B0B5095BFF30BD5ULL, 0x15DEE61ACC535803ULL},
+    {0x48D5DA11665C0977ULL, 0x2B18B8157042ACCFULL},
+    {0x74895CE8A3C6758BULL, 0x5E8DF355806AAE18ULL},
+    {0x5D3AB0BA1C9EC46FULL, 0x653E5C4466BBBE7AULL},
+    {0x4A955A2E7D4BD059ULL, 0x3765169D1EFC9861ULL},
+    {0x77555D172EDFB3C2ULL, 0x256E8A94FE60F3CFULL},
+    {0x5F777DAC257FC301ULL, 0x6ABED543FEB3F63FULL},
+    {0x4C5F97BCEACC9C01ULL, 0x3BCBDDCFFEF65E99ULL},
+    {0x7A328C6177ADC668ULL, 0x5FAC961997F0975BULL},
+    {0x61C209E792F16B86ULL, 0x7FBD44E1465A12AFULL},
+    {0x4E34D4B9425ABC6BULL, 0x7FCA9D810514DBBFULL},
+    {0x7D21545B9D5DFA46ULL, 0x32DDC8CE6E87C5FFULL},
+    {0x641AA9E2E44B2E9EULL, 0x5BE4A0A525396B32ULL},
+    {0x501554B5836F587EULL, 0x7CB6E6EA842DEF5CULL},
+    {0x4011109135F2AD32ULL, 0x30925255368B25E3ULL},
+    {0x6681B41B89844850ULL, 0x4DB6EA21F0DEA304ULL},
+    {0x52015CE2D469D373ULL, 0x57C5881B2718826AULL},
+    {0x419AB0B576BB0F8FULL, 0x5FD139AF527A01EFULL},
+    {0x68F781225791B27FULL, 0x4C81F5E550C3364AULL},
+    {0x53F9341B79415B99ULL, 0x239B2B1DDA35C508ULL},
+    {0x432DC3492DCDE2E1ULL, 0x02E288E4AE916A6DULL},
+    {0x6B7C6BA849496B01ULL, 0x516A74A1174F10AEULL},
+    {0x55FD22ED076DEF34ULL, 0x4121F6E745D8DA25ULL},
+    {0x44CA82573924BF5DULL, 0x1A8192529E4714EBULL},
+    {0x6E10D08B8EA1322EULL, 0x5D9C1D50FD3E87DDULL},
+    {0x580D73A2D880F4F2ULL, 0x17B01773FDCB9FE4ULL},
+    {0x4671294F139A5D8EULL, 0x4626792997D61984ULL},
+    {0x70B50EE4EC2A2F4AULL, 0x3D0A5B75BFBCF59FULL},
+    {0x5A2A7250BCEE8C3BULL, 0x4A6EAF916630C47FULL},
+    {0x4821F50D63F209C9ULL, 0x21F2260DEB5A36CCULL},
+    {0x736988156CB6760EULL, 0x69837016455D247AULL},
+    {0x5C546CDDF091F80BULL, 0x6E02C011D1175062ULL},
+    {0x49DD23E4C074C66FULL, 0x719BCCDB0DAC404EULL},
+    {0x762E9FD467213D7FULL, 0x68F947C4E2AD33B0ULL},
+    {0x5E8BB3105280FDFFULL, 0x6D94396A4EF0F627ULL},
+    {0x4BA2F5A6A8673199ULL, 0x3E102DEEA58D91B9ULL},
+    {0x7904BC3DDA3EB5C2ULL, 0x3019E3176F48E927ULL},
+    {0x60D09697E1CBC49BULL, 0x4014B5AC590720ECULL},
+    {0x4D73ABACB4A303AFULL, 0x4CDD5E237A6C1A57ULL},
+    {0x7BEC45E12104D2B2ULL, 0x47C8969F2A46908AULL},
+    {0x63236B1A80D0A88EULL, 0x6CA0787F5505406FULL},
+    {0x4F4F88E200A6ED3FULL, 0x0A19F9FF773766BFULL},
+    {0x7EE5A7D0010B1531ULL, 0x5CF65CCBF1F23DFEULL},
+    {0x6584864000D5AA8EULL, 0x172B7D6FF4C1CB32ULL},
+    {0x5136D1CCCD77BBA4ULL, 0x78EF978CC3CE3C28ULL},
+    {0x40F8A7D70AC62FB7ULL, 0x13F2DFA3CFD83020ULL},
+    {0x67F43FBE77A37F8BULL, 0x398499061959E699ULL},
+    {0x5329CC985FB5FFA2ULL, 0x6136E0D1ADE18548ULL},
+    {0x4287D6E04C91994FULL, 0x00F8B3DAF181376DULL},
+    {0x6A72F166E0E8F54BULL, 0x1B27862B1C01F247ULL},
+    {0x5528C11F1A53F76FULL, 0x2F52D1BC1667F506ULL},
+    {0x44209A7F48432C59ULL, 0x0C424163451FF738ULL},
+    {0x6D00F7320D3846F4ULL, 0x7A039BD208332526ULL},
+    {0x5733F8F4D76038C3ULL, 0x7B361641A028EA85ULL},
+    {0x45C32D90AC4CFA36ULL, 0x2F5E78348020BB9EULL},
+    {0x6F9EAF4DE07B29F0ULL, 0x4BCA59ED99CDF8FCULL},
+    {0x594BBF71806287F3ULL, 0x563B7B247B0B2D96ULL},
+    {0x476FCC5ACD1B9FF6ULL, 0x11C92F50626F57ACULL},
+    {0x724C7A2AE1C5CCBDULL, 0x02DB7EE703E55912ULL},
+    {0x5B7061BBE7D17097ULL, 0x1BE2CBEC031DE0DCULL},
+    {0x4926B496530DF3ACULL, 0x164F09899C17E716ULL},
+    {0x750ABA8A1E7CB913ULL, 0x3D4B4275C68CA4F0ULL},
+    {0x5DA22ED4E530940FULL, 0x4AA29B916BA3B726ULL},
+    {0x4AE825771DC07672ULL, 0x6EE87C74561C9285ULL},
+    {0x77D9D58B62CD8A51ULL, 0x3173FA53BCFA8408ULL},
+    {0x5FE177A2B5713B74ULL, 0x278FFB7630C869A0ULL},
+    {0x4CB45FB55DF42F90ULL, 0x1FA662C4F3D387B3ULL},
+    {0x7ABA32BBC986B280ULL, 0x32A3D13B1FB8D91FULL},
+    {0x622E8EFCA1388ECDULL, 0x0EE9742F4C93E0E6ULL},
+    {0x4E8BA596E760723DULL, 0x58BAC3590A0FE71EULL},
+    {0x7DAC3C24A5671D2FULL, 0x412AD228101971C9ULL},
+    {0x6489C9B6EAB8E426ULL, 0x00EF0E8673478E3BULL},
+    {0x506E3AF8BBC71CEBULL, 0x1A58D86B8F6C71C9ULL},
+    {0x40582F2D6305B0BCULL, 0x1513E0560C56C16EULL},
+    {0x66F37EAF04D5E793ULL, 0x3B530089AD579BE2ULL},
+    {0x525C6558D0AB1FA9ULL, 0x15DC006E2446164FULL},
+    {0x41E384470D55B2EDULL, 0x5E4999F1B69E783FULL},
+    {0x696C06D81555EB15ULL, 0x7D428FE92430C065ULL},
+    {0x54566BE0111188DEULL, 0x31020CBA835A3384ULL},
+    {0x4378564CDA746D7EULL, 0x5A680A2ECF7B5C69ULL},
+    {0x6BF3BD47C3ED7BFDULL, 0x770CDD17B25EFA42ULL},
+    {0x565C976C9CBDFCCBULL, 0x1270B0DFC1E59502ULL},
+    {0x4516DF8A16FE63D5ULL, 0x5B8D5A4C9B1E10CEULL},
+    {0x6E8AFF4357FD6C89ULL, 0x127BC3ADC4FCE7B0ULL},
+    {0x586F329C466456D4ULL, 0x0EC96957D0CA52F3ULL},
+    {0x46BF5BB038504576ULL, 0x3F07877973D50F29ULL},
+    {0x71322C4D26E6D58AULL, 0x31A5A58F1FBB4B75ULL},
+    {0x5A8E89D75252446EULL, 0x5AEAEAD8E62F6F91ULL},
+    {0x487207DF750E9D25ULL, 0x2F22557A51BF8C74ULL},
+    {0x73E9A63254E42EA2ULL, 0x1836EF2A1C65AD86ULL},
+    {0x5CBAEB5B771CF21BULL, 0x2CF8BF54E3848AD2ULL},
+    {0x4A2F22AF927D8E7CULL, 0x23FA32AA4F9D3BDBULL},
+    {0x76B1D118EA627D93ULL, 0x5329EAAA18FB92F8ULL},
+    {0x5EF4A74721E86476ULL, 0x0F54BBBB472FA8C6ULL},
+    {0x4BF6EC38E7ED1D2BULL, 0x25DD62FC38F2ED6CULL},
+    {0x798B138E3FE1C845ULL, 0x22FBD1938E517BDFULL},
+    {0x613C0FA4FFE7D36AULL, 0x4F2FDADC71DAC97FULL},
+    {0x4DC9A61D998642BBULL, 0x58F3157D27E23ACCULL},
+    {0x7C75D695C2706AC5ULL, 0x74B82261D969F7ADULL},
+    {0x63917877CEC0556BULL, 0x10934EB4ADEE5FBEULL},
+    {0x4FA793930BCD1122ULL, 0x4075D8908B251965ULL},
+    {0x7F7285B812E1B504ULL, 0x00BC8DB411D4F56EULL},
+    {0x65F537C675815D9CULL, 0x66FD3E29A7DD9125ULL},
+    {0x5190F96B91344AE3ULL, 0x6BFDCB54864ADA84ULL},
+    {0x4140C78940F6A24FULL, 0x6FFE3C439EA2486AULL},
+    {0x6867A5A867F103B2ULL, 0x7FFD2D38FDD073DCULL},
+    {0x53861E2053273628ULL, 0x6664242D97D9F64AULL},
+    {0x42D1B1B375B8F820ULL, 0x51E9B68ADFE191D5ULL},
+    {0x6AE91C5255F4C034ULL, 0x1CA924116635B621ULL},
+    {0x558749DB77F70029ULL, 0x63BA83411E915E81ULL},
+    {0x446C3B15F9926687ULL, 0x6962029A7EDAB201ULL},
+    {0x6D79F82328EA3DA6ULL, 0x0F03375D97C45001ULL},
+    {0x5794C6828721CAEBULL, 0x259C2C4ADFD04001ULL},
+    {0x46109ECED2816F22ULL, 0x5149BD08B30D0001ULL},
+    {0x701A97B150CF1837ULL, 0x3542C80DEB480001ULL},
+    {0x59AEDFC10D7279C5ULL, 0x7768A00B22A00001ULL},
+    {0x47BF19673DF52E37ULL, 0x79208008E8800001ULL},
+    {0x72CB5BD86321E38CULL, 0x5B67334174000001ULL},
+    {0x5BD5E313828182D6ULL, 0x7C528F6790000001ULL},
+    {0x4977E8DC68679BDFULL, 0x16A872B940000001ULL},
+    {0x758CA7C70D7292FEULL, 0x5773EAC200000001ULL},
+    {0x5E0A1FD271287598ULL, 0x45F6556800000001ULL},
+    {0x4B3B4CA85A86C47AULL, 0x04C5112000000001ULL},
+    {0x785EE10D5DA46D90ULL, 0x07A1B50000000001ULL},
+    {0x604BE73DE4838AD9ULL, 0x52E7C40000000001ULL},
+    {0x4D0985CB1D3608AEULL, 0x0F1FD00000000001ULL},
+    {0x7B426FAB61F00DE3ULL, 0x31CC800000000001ULL},
+    {0x629B8C891B267182ULL, 0x5B0A000000000001ULL},
+    {0x4EE2D6D415B85ACEULL, 0x7C08000000000001ULL},
+    {0x7E37BE2022C0914BULL, 0x1340000000000001ULL},
+    {0x64F964E68233A76FULL, 0x2900000000000001ULL},
+    {0x50C783EB9B5C85F2ULL, 0x5400000000000001ULL},
+    {0x409F9CBC7C4A04C2ULL, 0x1000000000000001ULL},
+    {0x6765C793FA10079DULL, 0x0000000000000001ULL},
+    {0x52B7D2DCC80CD2E4ULL, 0x0000000000000001ULL},
+    {0x422CA8B0A00A4250ULL, 0x0000000000000001ULL},
+    {0x69E10DE76676D080ULL, 0x0000000000000001ULL},
+    {0x54B40B1F852BDA00ULL, 0x0000000000000001ULL},
+    {0x43C33C1937564800ULL, 0x0000000000000001ULL},
+    {0x6C6B935B8BBD4000ULL, 0x0000000000000001ULL},
+    {0x56BC75E2D6310000ULL, 0x0000000000000001ULL},
+    {0x4563918244F40000ULL, 0x0000000000000001ULL},
+    {0x6F05B59D3B200000ULL, 0x0000000000000001ULL},
+    {0x58D15E1762800000ULL, 0x0000000000000001ULL},
+    {0x470DE4DF82000000ULL, 0x0000000000000001ULL},
+    {0x71AFD498D0000000ULL, 0x0000000000000001ULL},
+    {0x5AF3107A40000000ULL, 0x0000000000000001ULL},
+    {0x48C2739500000000ULL, 0x0000000000000001ULL},
+    {0x746A528800000000ULL, 0x0000000000000001ULL},
+    {0x5D21DBA000000000ULL, 0x0000000000000001ULL},
+    {0x4A817C8000000000ULL, 0x0000000000000001ULL},
+    {0x7735940000000000ULL, 0x0000000000000001ULL},
+    {0x5F5E100000000000ULL, 0x0000000000000001ULL},
+    {0x4C4B400000000000ULL, 0x0000000000000001ULL},
+    {0x7A12000000000000ULL, 0x0000000000000001ULL},
+    {0x61A8000000000000ULL, 0x0000000000000001ULL},
+    {0x4E20000000000000ULL, 0x0000000000000001ULL},
+    {0x7D00000000000000ULL, 0x0000000000000001ULL},
+    {0x6400000000000000ULL, 0x0000000000000001ULL},
+    {0x5000000000000000ULL, 0x0000000000000001ULL},
+    {0x4000000000000000ULL, 0x0000000000000001ULL},
+    {0x6666666666666666ULL, 0x3333333333333334ULL},
+    {0x51EB851EB851EB85ULL, 0x0F5C28F5C28F5C29ULL},
+    {0x4189374BC6A7EF9DULL, 0x5916872B020C49BBULL},
+    {0x68DB8BAC710CB295ULL, 0x74F0D844D013A92BULL},
+    {0x53E2D6238DA3C211ULL, 0x43F3E0370CDC8755ULL},
+    {0x431BDE82D7B634DAULL, 0x698FE69270B06C44ULL},
+    {0x6B5FCA6AF2BD215EULL, 0x0F4CA41D811A46D4ULL},
+    {0x55E63B88C230E77EULL, 0x3F70834ACDAE9F10ULL},
+    {0x44B82FA09B5A52CBULL, 0x4C5A02A23E254C0DULL},
+    {0x6DF37F675EF6EADFULL, 0x2D5CD10396A21347ULL},
+    {0x57F5FF85E592557FULL, 0x3DE3DA69454E75D3ULL},
+    {0x465E6604B7A84465ULL, 0x7E4FE1EDD10B9175ULL},
+    {0x709709A125DA0709ULL, 0x4A19697C81AC1BEFULL},
+    {0x5A126E1A84AE6C07ULL, 0x54E1213067BCE326ULL},
+    {0x480EBE7B9D58566CULL, 0x43E74DC052FD8285ULL},
+    {0x734ACA5F6226F0ADULL, 0x530BAF9A1E626A6DULL},
+    {0x5C3BD5191B525A24ULL, 0x426FBFAE7EB521F1ULL},
+    {0x49C97747490EAE83ULL, 0x4EBFCC8B9890E7F4ULL},
+    {0x760F253EDB4AB0D2ULL, 0x4ACC7A78F41B0CBAULL},
+    {0x5E72843249088D75ULL, 0x223D2EC729AF3D62ULL},
+    {0x4B8ED0283A6D3DF7ULL, 0x34FDBF05BAF29781ULL},
+    {0x78E480405D7B9658ULL, 0x54C931A2C4B758CFULL},
+    {0x60B6CD004AC94513ULL, 0x5D6DC14F03C5E0A5ULL},
+    {0x4D5F0A66A23A9DA9ULL, 0x31249AA59C9E4D51ULL},
+    {0x7BCB43D769F762A8ULL, 0x4EA0F76F60FD4882ULL},
+    {0x63090312BB2C4EEDULL, 0x254D92BF80CAA068ULL},
+    {0x4F3A68DBC8F03F24ULL, 0x1DD7A89933D54D20ULL},
+    {0x7EC3DAF941806506ULL, 0x62F2A75B86221500ULL},
+    {0x65697BFA9ACD1D9FULL, 0x025BB91604E810CDULL},
+    {0x51212FFBAF0A7E18ULL, 0x684960DE6A5340A4ULL},
+    {0x40E7599625A1FE7AULL, 0x203AB3E521DC33B6ULL},
+    {0x67D88F56A29CCA5DULL, 0x19F7863B696052BDULL},
+    {0x5313A5DEE87D6EB0ULL, 0x7B2C6B62BAB37564ULL},
+    {0x42761E4BED31255AULL, 0x2F56BC4EFBC2C450ULL},
+    {0x6A5696DFE1E83BC3ULL, 0x655793B192D13A1AULL},
+    {0x5512124CB4B9C969ULL, 0x377942F475742E7BULL},
+    {0x440E750A2A2E3ABAULL, 0x5F9435905DF68B96ULL},
+    {0x6CE3EE76A9E3912AULL, 0x65B9EF4D63241289ULL},
+    {0x571CBEC554B60DBBULL, 0x6AFB25D782834207ULL},
+    {0x45B0989DDD5E7163ULL, 0x08C8EB12CECF6806ULL},
+    {0x6F80F42FC8971BD1ULL, 0x5ADB11B7B14BD9A3ULL},
+    {0x5933F68CA078E30EULL, 0x157C0E2C8DD647B5ULL},
+    {0x475CC53D4D2D8271ULL, 0x5DFCD823A4AB6C91ULL},
+    {0x722E086215159D82ULL, 0x632E269F6DDF141BULL},
+    {0x5B5806B4DDAAE468ULL, 0x4F581EE5F17F4349ULL},
+    {0x49133890B1558386ULL, 0x72ACE584C1329C3BULL},
+    {0x74EB8DB44EEF38D7ULL, 0x6AAE3C079B842D2AULL},
+    {0x5D893E29D8BF60ACULL, 0x5558300616035755ULL},
+    {0x4AD431BB13CC4D56ULL, 0x7779C004DE6912ABULL},
+    {0x77B9E92B52E07BBEULL, 0x258F99A163DB5111ULL},
+    {0x5FC7EDBC424D2FCBULL, 0x37A614811CAF740DULL},
+    {0x4C9FF163683DBFD5ULL, 0x7951AA00E3BF900BULL},
+    {0x7A998238A6C932EFULL, 0x754F7667D2CC19ABULL},
+    {0x6214682D523A8F26ULL, 0x2AA5F8530F09AE22ULL},
+    {0x4E76B9BDDB620C1EULL, 0x55519375A5A1581BULL},
+    {0x7D8AC2C95F034697ULL, 0x3BB5B8BC3C3559C5ULL},
+    {0x646F023AB2690545ULL, 0x7C9160969691149EULL},
+    {0x5058CE955B87376BULL, 0x16DAB3ABABA743B2ULL},
+    {0x40470BAAAF9F5F88ULL, 0x78AEF622EFB902F5ULL},
+    {0x66D812AAB29898DBULL, 0x0DE4BD04B2C19E54ULL},
+    {0x524675555BAD4715ULL, 0x57EA30D08F014B76ULL},
+    {0x41D1F7777C8A9F44ULL, 0x4654F3DA0C01092CULL},
+    {0x694FF258C7443207ULL, 0x23BB1FC346680EACULL},
+    {0x543FF513D29CF4D2ULL, 0x4FC8E635D1ECD88AULL},
+    {0x43665DA9754A5D75ULL, 0x263A51C4A7F0AD3BULL},
+    {0x6BD6FC425543C8BBULL, 0x56C3B607731AAEC4ULL},
+    {0x5645969B77696D62ULL, 0x789C919F8F488BD0ULL},
+    {0x4504787C5F878AB5ULL, 0x46E3A7B2D906D640ULL},
+    {0x6E6D8D93CC0C1122ULL, 0x3E390C515B3E239AULL},
+    {0x5857A4763CD6741BULL, 0x4B60D6A77C31B615ULL},
+    {0x46AC8391CA4529AFULL, 0x55E7121F968E2B44ULL},
+    {0x711405B6106EA919ULL, 0x0971B698F0E3786DULL},
+    {0x5A766AF80D255414ULL, 0x078E2BAD8D82C6BDULL},
+    {0x485EBBF9A41DDCDCULL, 0x6C71BC8AD79BD231ULL},
+    {0x73CAC65C39C96161ULL, 0x2D82C7448C2C8382ULL},
+    {0x5CA23849C7D44DE7ULL, 0x3E023903A356CF9BULL},
+    {0x4A1B603B06437185ULL, 0x7E682D9C82ABD949ULL},
+    {0x76923391A39F1C09ULL, 0x4A4048FA6AAC8EDBULL},
+    {0x5EDB5C7482E5B007ULL, 0x55003A61EEF07249ULL},
+    {0x4BE2B05D35848CD2ULL, 0x773361E7F259F507ULL},
+    {0x796AB3C855A0E151ULL, 0x3EB89CA6508FEE71ULL},
+    {0x6122296D114D810DULL, 0x7EFA16EB73A6585BULL},
+    {0x4DB4EDF0DAA4673EULL, 0x3261ABEF8FB846AFULL},
+    {0x7C54AFE7C43A3ECAULL, 0x1D691318E5F3A44BULL},
+    {0x6376F31FD02E98A1ULL, 0x64540F471E5C836FULL},
+    {0x4F925C1973587A1BULL, 0x0376729F4B7D35F3ULL},
+    {0x7F50935BEBC0C35EULL, 0x38BD84321261EFEBULL},
+    {0x65DA0F7CBC9A35E5ULL, 0x13CAD0280EB4BFEFULL},
+    {0x517B3F96FD482B1DULL, 0x5CA240200BC3CCBFULL},
+    {0x412F66126439BC17ULL, 0x63B50019A3030A33ULL},
+    {0x684BD683D38F9359ULL, 0x1F88002904D1A9EAULL},
+    {0x536FDECFDC72DC47ULL, 0x32D3335403DAEE55ULL},
+    {0x42BFE57316C249D2ULL, 0x5BDC291003158B77ULL},
+    {0x6ACCA251BE03A951ULL, 0x12F9DB4CD1BC1258ULL},
+    {0x557081DAFE695440ULL, 0x7594AF70A7C9A847ULL},
+    {0x445A017BFEBAA9CDULL, 0x4476F2C0863AED06ULL},
+    {0x6D5CCF2CCAC442E2ULL, 0x3A57EACDA3917B3CULL},
+    {0x577D728A3BD03581ULL, 0x7B7988A482DAC8FDULL},
+    {0x45FDF53B630CF79BULL, 0x15FAD3B6CF156D97ULL},
+    {0x6FFCBB923814BF5EULL, 0x565E1F8AE4EF15BEULL},
+    {0x5996FC74F9AA32B2ULL, 0x11E4E608B725AAFFULL},
+    {0x47ABFD2A6154F55BULL, 0x27EA51A0928488CCULL},
+    {0x72ACC843CEEE555EULL, 0x7310829A84074146ULL},
+    {0x5BBD6D030BF1DDE5ULL, 0x42739BAED005CDD2ULL},
+    {0x49645735A327E4B7ULL, 0x4EC2E2F24004A4A8ULL},
+    {0x756D5855D1D96DF2ULL, 0x4AD16B1D333AA10CULL},
+    {0x5DF11377DB1457F5ULL, 0x2241227DC2954DA3ULL},
+    {0x4B2742C648DD132AULL, 0x4E9A81FE35443E1CULL},
+    {0x783ED13D4161B844ULL, 0x175D9CC9EED39694ULL},
+    {0x603240FDCDE7C69CULL, 0x7917B0A18BDC7876ULL},
+    {0x4CF500CB0B1FD217ULL, 0x1412F3B46FE39392ULL},
+    {0x7B219ADE7832E9BEULL, 0x535185ED7FD285B6ULL},
+    {0x628148B1F9C25498ULL, 0x42A79E57997537C5ULL},
+    {0x4ECDD3C1949B76E0ULL, 0x3552E512E12A9304ULL},
+    {0x7E161F9C20F8BE33ULL, 0x6EEB081E3510EB39ULL},
+    {0x64DE7FB01A609829ULL, 0x3F226CE4F740BC2EULL},
+    {0x50B1FFC0151A1354ULL, 0x3281F0B72C33C9BEULL},
+    {0x408E66334414DC43ULL, 0x42018D5F568FD498ULL},
+    {0x674A3D1ED354939FULL, 0x1CCF48988A7FBA8DULL},
+    {0x52A1CA7F0F76DC7FULL, 0x30A5D3AD3B99620BULL},
+    {0x421B0865A5F8B065ULL, 0x73B7DC8A96144E6FULL},
+    {0x69C4DA3C3CC11A3CULL, 0x52BFC7442353B0B1ULL},
+    {0x549D7B6363CDAE96ULL, 0x756639034F7626F4ULL},
+    {0x43B12F82B63E2545ULL, 0x4451C735D92B525DULL},
+    {0x6C4EB26ABD303BA2ULL, 0x3A1C71EFC1DEEA2EULL},
+    {0x56A55B889759C94EULL, 0x61B05B2634B254F2ULL},
+    {0x45511606DF7B0772ULL, 0x1AF37C1E908EAA5BULL},
+    {0x6EE8233E325E7250ULL, 0x2B1F2CFDB41776F8ULL},
+    {0x58B9B5CB5B7EC1D9ULL, 0x6F4C23FE29AC5F2DULL},
+    {0x46FAF7D5E2CBCE47ULL, 0x72A34FFE87BD18F1ULL},
+    {0x71918C896ADFB073ULL, 0x04387FFDA5FB5B1BULL},
+    {0x5ADAD6D4557FC05CULL, 0x0360666484C915AFULL},
+    {0x48AF1243779966B0ULL, 0x02B3851D3707448CULL},
+    {0x744B506BF28F0AB3ULL, 0x1DEC082EBE720746ULL},
+    {0x5D090D2328726EF5ULL, 0x64BCD358985B3905ULL},
+    {0x4A6DA41C205B8BF7ULL, 0x6A30A913AD15C738ULL},
+    {0x7715D36033C5ACBFULL, 0x5D1AA81F7B560B8CULL},
+    {0x5F44A919C3048A32ULL, 0x7DAEECE5FC44D609ULL},
+    {0x4C36EDAE359D3B5BULL, 0x7E258A51969D7808ULL},
+    {0x79F17C49EF61F893ULL, 0x16A276E8F0FBF33FULL},
+    {0x618DFD07F2B4C6DCULL, 0x121B9253F3FCC299ULL},
+    {0x4E0B30D328909F16ULL, 0x41AFA84329970214ULL},
+    {0x7CDEB4850DB431BDULL, 0x4F7F739EA8F19CEDULL},
+    {0x63E55D373E29C164ULL, 0x3F99294BBA5AE3F1ULL},
+    {0x4FEAB0F8FE87CDE9ULL, 0x7FADBAA2FB7BE98DULL},
+    {0x7FDDE7F4CA72E30FULL, 0x7F7C5DD1925FDC15ULL},
+    {0x664B1FF7085BE8D9ULL, 0x4C637E4141E649ABULL},
+    {0x51D5B32C06AFED7AULL, 0x704F983434B83AEFULL},
+    {0x4177C2899EF32462ULL, 0x26A6135CF6F9C8BFULL},
+    {0x68BF9DA8FE51D3D0ULL, 0x3DD685618B294132ULL},
+    {0x53CC7E20CB74A973ULL, 0x4B12044E08EDCDC2ULL},
+    {0x4309FE80A2C3BAC2ULL, 0x6F419D0B3A57D7CEULL},
+    {0x6B4330CDD1392AD1ULL, 0x320294DEC3BFBFB0ULL},
+    {0x55CF5A3E40FA88A7ULL, 0x419BAA4BCFCC995AULL},
+    {0x44A5E1CB672ED3B9ULL, 0x1AE2EEA30CA3ADE1ULL},
+    {0x6DD636123EB152C1ULL, 0x77D17DD1ADD2AFCFULL},
+    {0x57DE91A832277567ULL, 0x797464A7BE42263FULL},
+    {0x464BA7B9C1B92AB9ULL, 0x4790508631CE84FFULL},
+    {0x70790C5C6928445CULL, 0x0C1A1A704FB0D4CCULL},
+    {0x59FA7049EDB9D049ULL, 0x567B4859D95A43D6ULL},
+    {0x47FB8D07F161736EULL, 0x11FC39E17AAE9CABULL},
+    {0x732C14D98235857DULL, 0x032D2968C44A9445ULL},
+    {0x5C2343E134F79DFDULL, 0x4F575453D03BA9D1ULL},
+    {0x49B5CFE75D92E4CAULL, 0x72AC4376402FBB0EULL},
+    {0x75EFB30BC8EB07ABULL, 0x0446D256CD192B49ULL},
+    {0x5E595C096D88D2EFULL, 0x1D0575123DADBC3AULL},
+    {0x4B7AB0078AD3DBF2ULL, 0x4A6AC40E97BE302FULL},
+    {0x78C44CD8DE1FC650ULL, 0x771139B0F2C9E6B1ULL},
+    {0x609D0A4718196B73ULL, 0x78DA948D8F07EBC1ULL},
+    {0x4D4A6E9F467ABC5CULL, 0x60AEDD3E0C065634ULL},
+    {0x7BAA4A9870C46094ULL, 0x344AFB9679A3BD20ULL},
+    {0x62EEA2138D69E6DDULL, 0x103BFC78614FCA80ULL},
+    {0x4F254E760ABB1F17ULL, 0x26966393810CA200ULL},
+    {0x7EA21723445E9825ULL, 0x2423D2859B476999ULL},
+    {0x654E78E9037EE01DULL, 0x69B642047C392148ULL},
+    {0x510B93ED9C658017ULL, 0x6E2B680396941AA0ULL},
+    {0x40D60FF149EACCDFULL, 0x71BC53361210154DULL},
+    {0x67BCE64EDCAAE166ULL, 0x1C6085235019BBAEULL},
+    {0x52FD850BE3BBE784ULL, 0x7D1A041C40149625ULL},
+    {0x42646A6FE9631F9DULL, 0x4A7B367D0010781DULL},
+    {0x6A3A43E642383295ULL, 0x5D91F0C8001A59C8ULL},
+    {0x54FB698501C68EDEULL, 0x17A7F3D3334847D4ULL},
+    {0x43FC546A67D20BE4ULL, 0x79532975C2A03976ULL},
+    {0x6CC6ED770C83463BULL, 0x0EEB75893766C256ULL},
+    {0x57058AC5A39C382FULL, 0x25892AD42C523512ULL},
+    {0x459E089E1C7CF9BFULL, 0x37A0EF102374F742ULL},
+    {0x6F6340FCFA618F98ULL, 0x59017E8038BB2536ULL},
+    {0x591C33FD951AD946ULL, 0x7A67986693C8EA91ULL},
+    {0x4749C33144157A9FULL, 0x151FAD1EDCA0BBA8ULL},
+    {0x720F9EB539BBF765ULL, 0x0832AE97C76792A5ULL},
+    {0x5B3FB22A94965F84ULL, 0x068EF21305EC7551ULL},
+    {0x48FFC1BBAA11E603ULL, 0x1ED8C1A8D189F774ULL},
+    {0x74CC692C434FD66BULL, 0x4AF4690E1C0FF253ULL},
+    {0x5D705423690CAB89ULL, 0x225D20D816732843ULL},
+    {0x4AC0434F873D5607ULL, 0x35174D79AB8F5369ULL},
+    {0x779A054C0B955672ULL, 0x21BEE25C45B21F0EULL},
+    {0x5FAE6AA33C77785BULL, 0x3498B5169E2818D8ULL},
+    {0x4C8B888296C5F9E2ULL, 0x5D46F7454B534713ULL},
+    {0x7A78DA6A8AD65C9DULL, 0x7BA4BED545520B52ULL},
+    {0x61FA48553BDEB07EULL, 0x2FB6FF110441A2A8ULL},
+    {0x4E61D37763188D31ULL, 0x72F8CC0D9D014EEDULL},
+    {0x7D6952589E8DAEB6ULL, 0x1E5AE015C80217E1ULL},
+    {0x645441E07ED7BEF8ULL, 0x1848B344A001ACB4ULL},
+    {0x504367E6CBDFCBF9ULL, 0x603A2903B3348A2AULL},
+    {0x4035ECB8A3196FFBULL, 0x002E873628F6D4EEULL},
+    {0x66BCADF43828B32BULL, 0x19E40B89DB2487E3ULL},
+    {0x52308B29C686F5BCULL, 0x14B66FA17C1D3983ULL},
+    {0x41C06F549ED25E30ULL, 0x1091F2E7967DC79CULL},
+    {0x6933E554315096B3ULL, 0x341CB7D8F0C93F5FULL},
+    {0x542984435AA6DEF5ULL, 0x767D5FE0C0A0FF80ULL},
+    {0x435469CF7BB8B25EULL, 0x2B977FE70080CC66ULL},
+    {0x6BBA42E592C11D63ULL, 0x5F58CCA4CD9AE0A3ULL},
+    {0x562E9BEADBCDB11CULL, 0x4C470A1D7148B3B6ULL},
+    {0x44F216557CA48DB0ULL, 0x3D05A1B1276D5C92ULL},
+    {0x6E5023BBFAA0E2B3ULL, 0x7B3C35E83F1560E9ULL},
+    {0x58401C96621A4EF6ULL, 0x2F635E5365AAB3EDULL},
+    {0x4699B0784E7B725EULL, 0x591C4B75EAEEF658ULL},
+    {0x70F5E726E3F8B6FDULL, 0x74FA125644B18A26ULL},
+    {0x5A5E5285832D5F31ULL, 0x43FB41DE9D5AD4EBULL},
+    {0x484B75379C244C27ULL, 0x4FFC34B2177BDD89ULL},
+    {0x73ABEEBF603A1372ULL, 0x4CC6BAB68BF96274ULL},
+    {0x5C898BCC4CFB42C2ULL, 0x0A38955ED6611B90ULL},
+    {0x4A07A309D72F689BULL, 0x21C6DDE5784DAFA7ULL},
+    {0x76729E762518A75EULL, 0x693E2FD58D49190BULL},
+    {0x5EC2185E8413B918ULL, 0x5431BFDE0AA0E0D5ULL},
+    {0x4BCE79E536762DADULL, 0x29C1664B3BB3E711ULL},
+    {0x794A5CA1F0BD15E2ULL, 0x0F9BD6DEC5ECA4E8ULL},
+    {0x61084A1B26FDAB1BULL, 0x2616457F04BD50BAULL},
+    {0x4DA03B48EBFE227CULL, 0x1E783798D09773C8ULL},
+    {0x7C33920E46636A60ULL, 0x30C058F480F252D9ULL},
+    {0x635C74D8384F884DULL, 0x0D66AD9067284247ULL},
+    {0x4F7D2A469372D370ULL, 0x711EF14052869B6CULL},
+    {0x7F2EAA0A85848581ULL, 0x34FE4ECD50D75F14ULL},
+    {0x65BEEE6ED136D134ULL, 0x2A650BD773DF7F43ULL},
+    {0x51658B8BDA9240F6ULL, 0x551DA312C319329CULL},
+    {0x411E093CAEDB672BULL, 0x5DB14F4235ADC217ULL},
+    {0x68300EC77E2BD845ULL, 0x7C4EE536BC49368AULL},
+    {0x5359A56C64EFE037ULL, 0x7D0BEA92303A9208ULL},
+    {0x42AE1DF050BFE693ULL, 0x173CBBA8269541A0ULL},
+    {0x6AB02FE6E79970EBULL, 0x3EC792A6A422029AULL},
+    {0x5559BFEBEC7AC0BCULL, 0x3239421EE9B4CEE1ULL},
+    {0x4447CCBCBD2F0096ULL, 0x5B6101B25490A581ULL},
+    {0x6D3FADFAC84B3424ULL, 0x2BCE691D541AA268ULL},
+    {0x576624C8A03C29B6ULL, 0x563EBA7DDCE21B87ULL},
+    {0x45EB50A08030215EULL, 0x78322ECB171B4939ULL},
+    {0x6FDEE76733803564ULL, 0x59E9E47824F87527ULL},
+    {0x597F1F85C2CCF783ULL, 0x6187E9F9B72D2A86ULL},
+    {0x4798E6049BD72C69ULL, 0x346CBB2E2C242205ULL},
+    {0x728E3CD42C8B7A42ULL, 0x20ADF849E039D007ULL},
+    {0x5BA4FD768A092E9BULL, 0x33BE603B19C7D99FULL},
+    {0x4950CAC53B3A8BAFULL, 0x42FEB3627B0647B3ULL},
+    {0x754E113B91F745E5ULL, 0x5197856A5E7072B8ULL},
+    {0x5DD80DC941929E51ULL, 0x27AC6ABB7EC05BC6ULL},
+    {0x4B133E3A9ADBB1DAULL, 0x52F05562CBCD1638ULL},
+    {0x781EC9F75E2C4FC4ULL, 0x1E4D556ADFAE89F3ULL},
+    {0x6018A192B1BD0C9CULL, 0x7EA444557FBED4C3ULL},
+    {0x4CE0814227CA707DULL, 0x4BB69D1132FF109CULL},
+    {0x7B00CED03FAA4D95ULL, 0x5F8A94E851981A93ULL},
+    {0x62670BD9CC883E11ULL, 0x32D543ED0E134875ULL},
+    {0x4EB8D647D6D364DAULL, 0x5BDDCFF0D80F6D2BULL},
+    {0x7DF48A0C8AEBD491ULL, 0x12FC7FE7C018AEABULL},
+    {0x64C3A1A3A25643A7ULL, 0x28C9FFEC99AD5889ULL},
+    {0x509C814FB511CFB9ULL, 0x0707FFF07AF113A1ULL},
+    {0x407D343FC40E3FC7ULL, 0x1F39998D2F2742E7ULL},
+    {0x672EB9FFA016CC71ULL, 0x7EC28F484B7204A4ULL},
+    {0x528BC7FFB345705BULL, 0x189BA5D36F8E6A1DULL},
+    {0x42096CCC8F6AC048ULL, 0x7A161E42BFA521B1ULL},
+    {0x69A8AE1418AACD41ULL, 0x435696D132A1CF81ULL},
+    {0x5486F1A9AD557101ULL, 0x1C454574288172CEULL},
+    {0x439F27BAF1112734ULL, 0x169DD129BA0128A5ULL},
+    {0x6C31D92B1B4EA520ULL, 0x242FB50F9001DAA1ULL},
+    {0x568E4755AF721DB3ULL, 0x368C90D940017BB4ULL},
+    {0x453E9F77BF8E7E29ULL, 0x120A0D7A999AC95DULL},
+    {0x6ECA98BF98E3FD0EULL, 0x50101590F5C47561ULL},
+    {0x58A213CC7A4FFDA5ULL, 0x26734473F7D05DE8ULL},
+    {0x46E80FD6C83FFE1DULL, 0x6B8F69F65FD9E4B9ULL},
+    {0x71734C8AD9FFFCFCULL, 0x45B24323CC8FD45CULL},
+    {0x5AC2A3A247FFFD96ULL, 0x6AF502830A0CA9E3ULL},
+    {0x489BB61B6CCCCADFULL, 0x08C402026E7087E9ULL},
+    {0x742C569247AE1164ULL, 0x746CD003E3E73FDBULL},
+    {0x5CF04541D2F1A783ULL, 0x76BD73364FEC3315ULL},
+    {0x4A59D101758E1F9CULL, 0x5EFDF5C50CBCF5ABULL},
+    {0x76F61B3588E365C7ULL, 0x4B2FEFA1ADFB22ABULL},
+    {0x5F2B48F7A0B5EB06ULL, 0x08F3261AF195B555ULL},
+    {0x4C22A0C61A2B226BULL, 0x20C284E25ADE2AABULL},
+    {0x79D1013CF6AB6A45ULL, 0x1AD0D49D5E304444ULL},
+    {0x617400FD9222BB6AULL, 0x48A7107DE4F369D0ULL},
+    {0x4DF6673141B562BBULL, 0x53B8D9FE50C2BB0DULL},
+    {0x7CBD71E869223792ULL, 0x52C15CCA1AD12B48ULL},
+    {0x63CAC186BA81C60EULL, 0x75677D6E7BDA8906ULL},
+    {0x4FD5679EFB9B04D8ULL, 0x5DEC645863153A6CULL},
+    {0x7FBBD8FE5F5E6E27ULL, 0x497A3A2704EEC3DFULL},
+};
+
+/* the high 64 bits of a 64x64 bit multiplication */
+static inline uint64_t fio_ftoa_mul_hi(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  return (uint64_t)(((__uint128_t)a * b) >> 64);
+#else
+  const uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+  const uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+  const uint64_t lo_lo = a_lo * b_lo;
+  const uint64_t hi_lo = a_hi * b_lo;
+  const uint64_t lo_hi = a_lo * b_hi;
+  const uint64_t mid = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+  return a_hi * b_hi + (hi_lo >> 32) + (mid >> 32);
+#endif
+}
+
+/* rounds g * cp / 2^127 to odd (the sticky bit marks a non-zero remainder) */
+static inline uint64_t fio_ftoa_rop(uint64_t g1, uint64_t g0, uint64_t cp) {
+  const uint64_t x1 = fio_ftoa_mul_hi(g0, cp);
+  const uint64_t y0 = g1 * cp;
+  const uint64_t y1 = fio_ftoa_mul_hi(g1, cp);
+  const uint64_t z = (y0 >> 1) + x1;
+  const uint64_t vbp = y1 + (z >> 63);
+  return vbp | (((z & FIO_FTOA_MASK_63) + FIO_FTOA_MASK_63) >> 63);
+}
+
+/*
+ * Computes the shortest decimal (`*f` * 10^`*e`) in the rounding interval of
+ * c * 2^q. `dk` corrects the exponent when `c` was scaled by 10.
+ */
+static void fio_ftoa_to_decimal(int q, uint64_t c, int dk, uint64_t *f,
+                                int *e) {
+  const uint64_t out = c & 1;
+  const uint64_t cb = c << 2;
+  const uint64_t cbr = cb + 2;
+  uint64_t cbl;
+  int k;
+  if (c != ((uint64_t)1 << 52) || q == -1074) {
+    cbl = cb - 2;
+    k = FIO_FTOA_FLOG10POW2(q);
+  } else {
+    /* the interval is asymmetric, at the edge of a binade */
+    cbl = cb - 1;
+    k = FIO_FTOA_FLOG10_3Q_POW2(q);
+  }
+  const int h = q + FIO_FTOA_FLOG2POW10(-k) + 2;
+  const uint64_t g1 = fio_ftoa_g[k - FIO_FTOA_K_MIN][0];
+  const uint64_t g0 = fio_ftoa_g[k - FIO_FTOA_K_MIN][1];
+  const uint64_t vb = fio_ftoa_rop(g1, g0, cb << h);
+  const uint64_t vbl = fio_ftoa_rop(g1, g0, cbl << h);
+  const uint64_t vbr = fio_ftoa_rop(g1, g0, cbr << h);
+  const uint64_t s = vb >> 2;
+  if (s >= 100) {
+    /* try a decimal with one less digit */
+    const uint64_t sp10 = 10 * fio_ftoa_mul_hi(s, 115292150460684698ULL << 4);
+    const uint64_t tp10 = sp10 + 10;
+    const int upin = vbl + out <= (sp10 << 2);
+    const int wpin = (tp10 << 2) + out <= vbr;
+    if (upin != wpin) {
+      *f = upin ? sp10 : tp10;
+      *e = k + dk;
+      return;
+    }
+  }
+  const uint64_t t = s + 1;
+  const int uin = vbl + out <= (s << 2);
+  const int win = (t << 2) + out <= vbr;
+  *e = k + dk;
+  if (uin != win) {
+    *f = uin ? s : t;
+    return;
+  }
+  /* both are in the interval, pick the closest (or the even one) */
+  const int64_t cmp = (int64_t)(vb - ((s + t) << 1));
+  *f = (cmp < 0 || (cmp == 0 && !(s & 1))) ? s : t;
+}
+
 /**
  * A helper function that converts between a double to a string.
  *
@@ -4309,6 +5588,10 @@ zero:
  * default to base 10. Prefixes aren't added (i.e., no "0x" or "0b" at the
  * beginning of the string).
  *
+ * Base 10 output is the shortest string that reads back as the same double.
+ * The layout follows `printf`'s "%g" (with up to 17 significant digits),
+ * except that a ".0" suffix is added to whole numbers.
+ *
  * Returns the number of bytes actually written (excluding the NUL
  * terminator).
  */
@@ -4321,31 +5604,125 @@ size_t fio_ftoa(char *dest, double num, uint8_t base) {
     return fio_ltoa(dest, *i, base);
   }
 
-  size_t written = sprintf(dest, "%g", num);
-  uint8_t need_zero = 1;
-  char *start = dest;
-  while (*start) {
-    if (*start == ',') // locale issues?
-      *start = '.';
-    if (*start == '.' || *start == 'e') {
-      need_zero = 0;
-      break;
+  uint64_t bits;
+  memcpy(&bits, &num, sizeof(bits));
+  const uint64_t t = bits & (((uint64_t)1 << 52) - 1);
+  const int bq = (int)((bits >> 52) & 0x7FF);
+  size_t len = 0;
+  uint64_t f;
+  int e;
+
+  if (bq == 0x7FF) {
+    if (t) {
+      memcpy(dest, "NaN", 4);
+      return 3;
+    }
+    if (bits >> 63) {
+      memcpy(dest, "-Infinity", 10);
+      return 9;
     }
-    start++;
+    memcpy(dest, "Infinity", 9);
+    return 8;
   }
-  if (need_zero) {
-    dest[written++] = '.';
-    dest[written++] = '0';
+  if (bits >> 63)
+    dest[len++] = '-';
+  if (bq) {
+    /* normal value: (2^52 | t) * 2^q */
+    const int mq = 1075 - bq;
+    const uint64_t c = ((uint64_t)1 << 52) | t;
+    if (mq > 0 && mq < 53 && ((c >> mq) << mq) == c) {
+      /* a whole number, no rounding required */
+      f = c >> mq;
+      e = 0;
+    } else {
+      fio_ftoa_to_decimal(-mq, c, 0, &f, &e);
+    }
+  } else if (t) {
+    /* sub-normal value, the 2 smallest values need an extra digit */
+    if (t < 3)
+      fio_ftoa_to_decimal(-1074, 10 * t, -1, &f, &e);
+    else
+      fio_ftoa_to_decimal(-1074, t, 0, &f, &e);
+  } else {
+    memcpy(dest + len, "0.0", 4);
+    return len + 3;
   }
-  return written;
-}
-
-/* *****************************************************************************
-Section Start Marker
-
-
-
-
+
+  /* collect the digits (at most 17 after removing trailing zeros) */
+  char buffer[24];
+  char *digits = buffer + sizeof(buffer);
+  while (f && !(f % 10)) {
+    f /= 10;
+    ++e;
+  }
+  do {
+    *(--digits) = '0' + (char)(f % 10);
+    f /= 10;
+  } while (f);
+  const size_t count = (buffer + sizeof(buffer)) - digits;
+  /* the exponent of the first digit */
+  const int x = e + (int)count - 1;
+
+  if (x < -4 || x >= 17) {
+    /* scientific notation: d[.ddd]e[+-]XX */
+    dest[len++] = digits[0];
+    if (count > 1) {
+      dest[len++] = '.';
+      memcpy(dest + len, digits + 1, count - 1);
+      len += count - 1;
+    }
+    dest[len++] = 'e';
+    int ex = x;
+    if (ex < 0) {
+      dest[len++] = '-';
+      ex = 0 - ex;
+    } else {
+      dest[len++] = '+';
+    }
+    if (ex >= 100)
+      dest[len++] = '0' + (ex / 100);
+    dest[len++] = '0' + ((ex / 10) % 10);
+    dest[len++] = '0' + (ex % 10);
+  } else if (x < 0) {
+    /* 0.000ddd */
+    dest[len++] = '0';
+    dest[len++] = '.';
+    for (int i = -1; i > x; --i)
+      dest[len++] = '0';
+    memcpy(dest + len, digits, count);
+    len += count;
+  } else if ((size_t)x + 1 >= count) {
+    /* whole number: ddd000.0 */
+    memcpy(dest + len, digits, count);
+    len += count;
+    for (size_t i = count; i <= (size_t)x; ++i)
+      dest[len++] = '0';
+    dest[len++] = '.';
+    dest[len++] = '0';
+  } else {
+    /* ddd.ddd */
+    memcpy(dest + len, digits, (size_t)x + 1);
+    len += (size_t)x + 1;
+    dest[len++] = '.';
+    memcpy(dest + len, digits + x + 1, count - ((size_t)x + 1));
+    len += count - ((size_t)x + 1);
+  }
+  dest[len] = 0;
+  return len;
+}
+
+#undef FIO_FTOA_FLOG10POW2
+#undef FIO_FTOA_FLOG10_3Q_POW2
+#undef FIO_FTOA_FLOG2POW10
+#undef FIO_FTOA_K_MIN
+#undef FIO_FTOA_MASK_63
+
+/* *****************************************************************************
+Section Start Marker
+
+
+
+
 
 
 
@@ -5102,9 +6479,11 @@ typedef enum fio_cluster_message_type_e {
   FIO_CLUSTER_MSG_SHUTDOWN,
   FIO_CLUSTER_MSG_ERROR,
   FIO_CLUSTER_MSG_PING,
+  FIO_CLUSTER_MSG_SHM,
+  FIO_CLUSTER_MSG_PUBSUB_BATCH,
 } fio_cluster_message_type_e;
 
-typedef struct fio_collection_s fio_collection_s;
+typedef struct fio_collection_shard_s fio_collection_shard_s;
 
 #ifndef __clang__ /* clang might misbehave by assumming non-alignment */
 #pragma pack(1)   /* https://gitter.im/halide/Halide/archives/2018/07/24 */
@@ -5113,8 +6492,11 @@ typedef struct {
   size_t name_len;
   char *name;
   volatile size_t ref;
-  fio_ls_embd_s subscriptions;
-  fio_collection_s *parent;
+  /* subscriptions are kept in an array, so delivery doesn't chase pointers */
+  subscription_s **subs;
+  size_t count;
+  size_t capa;
+  fio_collection_shard_s *parent;
   fio_match_fn match;
   fio_lock_i lock;
 } channel_s;
@@ -5123,7 +6505,8 @@ typedef struct {
 #endif
 
 struct subscription_s {
-  fio_ls_embd_s node;
+  /** the subscription's position in the parent's `subs` array. */
+  size_t pos;
   channel_s *parent;
   void (*on_message)(fio_msg_s *msg);
   void (*on_unsubscribe)(void *udata1, void *udata2);
@@ -5149,7 +6532,9 @@ static channel_s *fio_channel_copy(channel_s *src) {
   if (src->name_len)
     memcpy(dest->name, src->name, src->name_len);
   dest->name[src->name_len] = 0;
-  dest->subscriptions = (fio_ls_embd_s)FIO_LS_INIT(dest->subscriptions);
+  dest->subs = NULL;
+  dest->count = 0;
+  dest->capa = 0;
   dest->ref = 1;
   dest->lock = FIO_LOCK_INIT;
   return dest;
@@ -5160,6 +6545,7 @@ static void fio_channel_free(channel_s *ch) {
     return;
   if (fio_atomic_sub(&ch->ref, 1))
     return;
+  free(ch->subs);
   free(ch);
 }
 /** Increases a channel's reference count. */
@@ -5176,6 +6562,8 @@ static int fio_channel_cmp(channel_s *ch1, channel_s *ch2) {
 /* pub/sub channels and core data sets have a long life, so avoid fio_malloc */
 #define FIO_FORCE_MALLOC_TMP 1
 #define FIO_SET_NAME fio_ch_set
+#define FIO_SET_SWISS 1
+#define FIO_SET_CONCURRENT 1 /* lock-free lookups, writers use the lock */
 #define FIO_SET_OBJ_TYPE channel_s *
 #define FIO_SET_OBJ_COMPARE(o1, o2) fio_channel_cmp((o1), (o2))
 #define FIO_SET_OBJ_DESTROY(obj) fio_channel_free((obj))
@@ -5193,18 +6581,151 @@ static int fio_channel_cmp(channel_s *ch1, channel_s *ch2) {
 #define FIO_SET_OBJ_COMPARE(k1, k2) ((k1) == (k2))
 #include <fio.h>
 
-struct fio_collection_s {
+/* channel changes waiting to be reported (the Set owns a channel reference) */
+#define FIO_FORCE_MALLOC_TMP 1
+#define FIO_SET_NAME fio_churn_set
+#define FIO_SET_OBJ_TYPE channel_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2) fio_channel_cmp((o1), (o2))
+#define FIO_SET_OBJ_DESTROY(obj) fio_channel_free((obj))
+#include <fio.h>
+
+/* *****************************************************************************
+ * Pattern Index - finds candidate patterns without testing all of them
+ **************************************************************************** */
+
+/*
+ * Glob patterns (FIO_MATCH_GLOB) are indexed by their literal prefix (the bytes
+ * before the first wildcard) and their literal suffix (the bytes after the last
+ * wildcard), since a matching channel must start with the first and end with
+ * the second.
+ *
+ * Publishing walks a prefix Radix Tree along the channel name and, for every
+ * prefix found, a Radix Tree of reversed suffixes along the reversed channel
+ * name. Only the patterns found this way are tested with `fio_glob_match`.
+ *
+ * Patterns using any other `fio_match_fn` are tested one by one.
+ *
+ * Publishing reads the index without locking (within a `fio_rcu_read_lock`
+ * read section), while subscriptions (writers) are serialized by the index
+ * lock. Groups are never altered once published - writers replace them with
+ * updated copies and retire the old ones using `fio_rcu_defer`.
+ */
+
+static int fio_glob_match(fio_str_info_s pat, fio_str_info_s ch);
+
+/* patterns sharing the same literal prefix and suffix (read only) */
+typedef struct {
+  size_t count;
+  channel_s *ary[];
+} fio_pattern_group_s;
+
+/* returns a copy of the group (which might be NULL) with the added channel */
+static fio_pattern_group_s *fio_pattern_group_push(fio_pattern_group_s *g,
+                                                   channel_s *ch) {
+  const size_t count = g ? g->count : 0;
+  fio_pattern_group_s *tmp =
+      malloc(sizeof(*tmp) + (sizeof(tmp->ary[0]) * (count + 1)));
+  FIO_ASSERT_ALLOC(tmp);
+  if (count)
+    memcpy(tmp->ary, g->ary, sizeof(tmp->ary[0]) * count);
+  tmp->ary[count] = ch;
+  tmp->count = count + 1;
+  return tmp;
+}
+
+/*
+ * Returns a copy of the group without the channel (NULL if the group would be
+ * empty). Sets `*removed` to 0 if the channel was found.
+ */
+static fio_pattern_group_s *
+fio_pattern_group_remove(fio_pattern_group_s *g, channel_s *ch, int *removed) {
+  size_t i = 0;
+  while (i < g->count && g->ary[i] != ch)
+    ++i;
+  if (i == g->count)
+    return g;
+  *removed = 0;
+  if (g->count == 1)
+    return NULL;
+  fio_pattern_group_s *tmp =
+      malloc(sizeof(*tmp) + (sizeof(tmp->ary[0]) * (g->count - 1)));
+  FIO_ASSERT_ALLOC(tmp);
+  memcpy(tmp->ary, g->ary, sizeof(tmp->ary[0]) * i);
+  memcpy(tmp->ary + i, g->ary + i + 1,
+         sizeof(tmp->ary[0]) * (g->count - 1 - i));
+  tmp->count = g->count - 1;
+  return tmp;
+}
+
+static void fio_pattern_group_free(fio_pattern_group_s *g) { free(g); }
+
+/* frees a retired group (called once concurrent readers are done) */
+static void fio_pattern_group_free_task(void *g) { free(g); }
+
+/* releases the index's reference (called once concurrent readers are done) */
+static void fio_pattern_channel_free_task(void *ch) {
+  fio_channel_free((channel_s *)ch);
+}
+
+#define FIO_RADIX_NAME fio_pattern_suffix_tree
+#define FIO_RADIX_OBJ_TYPE fio_pattern_group_s *
+#define FIO_RADIX_OBJ_DESTROY(g) fio_pattern_group_free((g))
+#define FIO_RADIX_MALLOC(size) malloc((size))
+#define FIO_RADIX_FREE(ptr, size) free((ptr))
+#define FIO_RADIX_CONCURRENT 1
+#include <fio.h>
+
+static void fio_pattern_suffix_tree_free2(fio_pattern_suffix_tree_s *t) {
+  if (!t)
+    return;
+  fio_pattern_suffix_tree_free(t);
+  free(t);
+}
+
+#define FIO_RADIX_NAME fio_pattern_prefix_tree
+#define FIO_RADIX_OBJ_TYPE fio_pattern_suffix_tree_s *
+#define FIO_RADIX_OBJ_DESTROY(t) fio_pattern_suffix_tree_free2((t))
+#define FIO_RADIX_MALLOC(size) malloc((size))
+#define FIO_RADIX_FREE(ptr, size) free((ptr))
+#define FIO_RADIX_CONCURRENT 1
+#include <fio.h>
+
+typedef struct {
+  fio_pattern_prefix_tree_s glob;
+  fio_pattern_group_s *volatile custom;
+  fio_lock_i lock;
+} fio_pattern_index_s;
+
+/* channels are read without locking, `lock` serializes writers */
+struct fio_collection_shard_s {
   fio_ch_set_s channels;
   fio_lock_i lock;
 };
 
+#if !FIO_PUBSUB_SHARDS || FIO_PUBSUB_SHARDS > 256 ||                           \
+    (FIO_PUBSUB_SHARDS & (FIO_PUBSUB_SHARDS - 1))
+#error FIO_PUBSUB_SHARDS must be a power of 2 (up to 256).
+#endif
+
+/* channels are spread between independently locked shards by their hash */
+typedef struct {
+  fio_collection_shard_s shards[FIO_PUBSUB_SHARDS];
+} fio_collection_s;
+
+/* all locks and Sets are zero initialized (FIO_LOCK_INIT / FIO_SET_INIT) */
 #define COLLECTION_INIT                                                        \
-  { .channels = FIO_SET_INIT, .lock = FIO_LOCK_INIT }
+  { .shards = {{.lock = FIO_LOCK_INIT}} }
+
+/** Iterates over a collection's shards (`shard` is the loop's variable). */
+#define FIO_COLLECTION_FOR_SHARD(collection, shard)                            \
+  for (fio_collection_shard_s *shard = (collection)->shards;                   \
+       shard < (collection)->shards + FIO_PUBSUB_SHARDS; ++shard)
 
 static struct {
   fio_collection_s filters;
   fio_collection_s pubsub;
   fio_collection_s patterns;
+  fio_pattern_index_s pattern_index;
   struct {
     fio_engine_set_s set;
     fio_lock_i lock;
@@ -5213,14 +6734,45 @@ static struct {
     fio_meta_ary_s ary;
     fio_lock_i lock;
   } meta;
+  struct {
+    fio_churn_set_s added;
+    fio_churn_set_s removed;
+    fio_lock_i lock;
+    uint8_t scheduled;
+  } churn;
 } fio_postoffice = {
     .filters = COLLECTION_INIT,
     .pubsub = COLLECTION_INIT,
     .patterns = COLLECTION_INIT,
+    .pattern_index.lock = FIO_LOCK_INIT,
     .engines.lock = FIO_LOCK_INIT,
     .meta.lock = FIO_LOCK_INIT,
+    .churn.lock = FIO_LOCK_INIT,
 };
 
+/* selects a shard using a channel's hash (Fibonacci hashing mixes the small
+ * hashes used by filters, so shards don't share the bits used by the Sets) */
+static inline fio_collection_shard_s *
+fio_collection_shard(fio_collection_s *c, uint64_t hashed) {
+  return c->shards +
+         (((hashed * 0x9E3779B97F4A7C15ULL) >> 56) & (FIO_PUBSUB_SHARDS - 1));
+}
+
+/* returns true if the shard belongs to the collection */
+static inline int fio_collection_owns(fio_collection_s *c,
+                                      fio_collection_shard_s *shard) {
+  return shard >= c->shards && shard < c->shards + FIO_PUBSUB_SHARDS;
+}
+
+/* returns the number of channels in a collection */
+static inline size_t fio_collection_count(fio_collection_s *c) {
+  size_t count = 0;
+  FIO_COLLECTION_FOR_SHARD(c, shard) {
+    count += fio_ch_set_count(&shard->channels);
+  }
+  return count;
+}
+
 /** used to contain the message before it's passed to the handler */
 typedef struct {
   fio_msg_s msg;
@@ -5303,8 +6855,9 @@ fio_msg_internal_create(int32_t filter, uint32_t type, fio_str_info_s ch,
   fio_u2str32((uint8_t *)(m + 1) + (sizeof(*m->meta) * t.end) + 8, type);
   fio_u2str32((uint8_t *)(m + 1) + (sizeof(*m->meta) * t.end) + 12,
               (uint32_t)filter);
-  // m->channel.data[ch.len] = 0; /* redundant, fio_malloc is all zero */
-  // m->data.data[data.len] = 0; /* redundant, fio_malloc is all zero */
+  /* NUL terminated (without relying on the allocator's zeroed memory) */
+  m->channel.data[ch.len] = 0;
+  m->data.data[data.len] = 0;
   if (cpy) {
     memcpy(m->channel.data, ch.data, ch.len);
     memcpy(m->data.data, data.data, data.len);
@@ -5350,20 +6903,208 @@ static inline fio_msg_internal_s *fio_msg_internal_dup(fio_msg_internal_s *m) {
   return m;
 }
 
-/** internal helper */
+/**
+ * A mock pub/sub callback for external subscriptions.
+ */
+static void fio_mock_on_message(fio_msg_s *msg) { (void)msg; }
+
+/* *****************************************************************************
+Pattern Index Management
+***************************************************************************** */
+
+/* the length of a glob pattern's literal prefix and literal suffix */
+static void fio_pattern_literals(channel_s *ch, size_t *prefix,
+                                 size_t *suffix) {
+  const char *name = ch->name;
+  size_t len = ch->name_len;
+  size_t pre = 0;
+  while (pre < len && name[pre] != '*' && name[pre] != '?' &&
+         name[pre] != '[' && name[pre] != '\\')
+    ++pre;
+  *prefix = pre;
+  *suffix = 0;
+  if (pre == len)
+    return; /* no wildcards, the whole pattern is a prefix */
+  size_t suf = 0;
+  while (suf < len - pre && name[len - suf - 1] != '*' &&
+         name[len - suf - 1] != '?' && name[len - suf - 1] != '[' &&
+         name[len - suf - 1] != ']' && name[len - suf - 1] != '\\')
+    ++suf;
+  /* a trailing (unterminated) character class has no literal suffix */
+  if (name[len - suf - 1] != '[')
+    *suffix = suf;
+}
+
+/* copies the last `len` bytes of `src`, in reverse order, to `dest` */
+static inline void fio_pattern_reverse(char *dest, const char *src,
+                                       size_t src_len, size_t len) {
+  for (size_t i = 0; i < len; ++i)
+    dest[i] = src[src_len - 1 - i];
+}
+
+/** Adds a new pattern channel to the index (the index holds a reference). */
+static void fio_pattern_index_add(channel_s *ch) {
+  fio_pattern_index_s *idx = &fio_postoffice.pattern_index;
+  fio_channel_dup(ch);
+  if (ch->match != fio_glob_match) {
+    fio_lock(&idx->lock);
+    fio_pattern_group_s *old = idx->custom;
+    fio_pattern_group_s *g = fio_pattern_group_push(old, ch);
+    fio_atomic_release();
+    idx->custom = g;
+    fio_unlock(&idx->lock);
+    if (old)
+      fio_rcu_defer(fio_pattern_group_free_task, old);
+    return;
+  }
+  size_t prefix, suffix;
+  char stack_buffer[128];
+  fio_pattern_literals(ch, &prefix, &suffix);
+  char *reversed = stack_buffer;
+  if (suffix > sizeof(stack_buffer)) {
+    reversed = malloc(suffix);
+    FIO_ASSERT_ALLOC(reversed);
+  }
+  fio_pattern_reverse(reversed, ch->name, ch->name_len, suffix);
+  fio_lock(&idx->lock);
+  fio_pattern_suffix_tree_s *t =
+      fio_pattern_prefix_tree_find(&idx->glob, ch->name, prefix);
+  if (!t) {
+    t = malloc(sizeof(*t));
+    FIO_ASSERT_ALLOC(t);
+    *t = (fio_pattern_suffix_tree_s)FIO_RADIX_INIT;
+    FIO_ASSERT_ALLOC(
+        !fio_pattern_prefix_tree_insert(&idx->glob, ch->name, prefix, t, NULL));
+  }
+  /* the replaced group is destroyed after concurrent readers are done */
+  fio_pattern_group_s *g = fio_pattern_group_push(
+      fio_pattern_suffix_tree_find(t, reversed, suffix), ch);
+  FIO_ASSERT_ALLOC(!fio_pattern_suffix_tree_insert(t, reversed, suffix, g,
+                                                   NULL));
+  fio_unlock(&idx->lock);
+  if (reversed != stack_buffer)
+    free(reversed);
+}
+
+/** Removes a pattern channel from the index, releasing its reference. */
+static void fio_pattern_index_remove(channel_s *ch) {
+  fio_pattern_index_s *idx = &fio_postoffice.pattern_index;
+  int removed = -1;
+  if (ch->match != fio_glob_match) {
+    fio_lock(&idx->lock);
+    fio_pattern_group_s *old = idx->custom;
+    fio_pattern_group_s *g =
+        old ? fio_pattern_group_remove(old, ch, &removed) : NULL;
+    fio_atomic_release();
+    idx->custom = g;
+    fio_unlock(&idx->lock);
+    if (g != old)
+      fio_rcu_defer(fio_pattern_group_free_task, old);
+    goto finish;
+  }
+  size_t prefix, suffix;
+  char stack_buffer[128];
+  fio_pattern_literals(ch, &prefix, &suffix);
+  char *reversed = stack_buffer;
+  if (suffix > sizeof(stack_buffer)) {
+    reversed = malloc(suffix);
+    FIO_ASSERT_ALLOC(reversed);
+  }
+  fio_pattern_reverse(reversed, ch->name, ch->name_len, suffix);
+  fio_lock(&idx->lock);
+  fio_pattern_suffix_tree_s *t =
+      fio_pattern_prefix_tree_find(&idx->glob, ch->name, prefix);
+  fio_pattern_group_s *old =
+      t ? fio_pattern_suffix_tree_find(t, reversed, suffix) : NULL;
+  fio_pattern_group_s *g =
+      old ? fio_pattern_group_remove(old, ch, &removed) : NULL;
+  if (g && g != old) {
+    FIO_ASSERT_ALLOC(
+        !fio_pattern_suffix_tree_insert(t, reversed, suffix, g, NULL));
+  } else if (old && !g) {
+    /* empty groups and trees are destroyed when removed */
+    fio_pattern_suffix_tree_remove(t, reversed, suffix, NULL);
+    if (!fio_pattern_suffix_tree_count(t))
+      fio_pattern_prefix_tree_remove(&idx->glob, ch->name, prefix, NULL);
+  }
+  fio_unlock(&idx->lock);
+  if (reversed != stack_buffer)
+    free(reversed);
+finish:
+  /* concurrent readers might be duplicating the channel */
+  if (!removed)
+    fio_rcu_defer(fio_pattern_channel_free_task, ch);
+}
+
+/** Collects the pattern channels matching a channel name. */
+typedef struct {
+  fio_str_info_s channel;
+  const char *reversed;
+  channel_s **found;
+  size_t count;
+  size_t capa;
+  channel_s **stack_buffer;
+} fio_pattern_found_s;
+
+static void fio_pattern_found_push(fio_pattern_found_s *f, channel_s *ch) {
+  if (f->count == f->capa) {
+    f->capa <<= 1;
+    if (f->found == f->stack_buffer) {
+      f->found = malloc(sizeof(*f->found) * f->capa);
+      FIO_ASSERT_ALLOC(f->found);
+      memcpy(f->found, f->stack_buffer, sizeof(*f->found) * f->count);
+    } else {
+      f->found = realloc(f->found, sizeof(*f->found) * f->capa);
+      FIO_ASSERT_ALLOC(f->found);
+    }
+  }
+  f->found[f->count++] = ch;
+}
+
+static int fio_pattern_index_on_suffix(size_t len, fio_pattern_group_s *g,
+                                       void *f_) {
+  fio_pattern_found_s *f = f_;
+  for (size_t i = 0; i < g->count; ++i) {
+    channel_s *ch = g->ary[i];
+    if (fio_glob_match((fio_str_info_s){.data = ch->name, .len = ch->name_len},
+                       f->channel))
+      fio_pattern_found_push(f, ch);
+  }
+  return 0;
+  (void)len;
+}
 
-static inline ssize_t fio_msg_internal_send_dup(intptr_t uuid,
-                                                fio_msg_internal_s *m) {
-  return fio_write2(uuid, .data.buffer = fio_msg_internal_dup(m),
-                    .offset = (sizeof(*m) + (m->meta_len * sizeof(*m->meta))),
-                    .length = 16 + m->data.len + m->channel.len + 2,
-                    .after.dealloc = fio_msg_internal_free2);
+static int fio_pattern_index_on_prefix(size_t len, fio_pattern_suffix_tree_s *t,
+                                       void *f_) {
+  fio_pattern_found_s *f = f_;
+  /* the suffix can't overlap the prefix */
+  fio_pattern_suffix_tree_each_prefix(t, f->reversed, f->channel.len - len,
+                                      fio_pattern_index_on_suffix, f);
+  return 0;
 }
 
 /**
- * A mock pub/sub callback for external subscriptions.
+ * Collects (and duplicates) the pattern channels that match `f->channel`.
+ *
+ * `f->reversed` must hold the reversed channel name.
  */
-static void fio_mock_on_message(fio_msg_s *msg) { (void)msg; }
+static void fio_pattern_index_find_dup(fio_pattern_found_s *f) {
+  fio_pattern_index_s *idx = &fio_postoffice.pattern_index;
+  const uintptr_t token = fio_rcu_read_lock();
+  fio_pattern_prefix_tree_each_prefix(&idx->glob, f->channel.data,
+                                      f->channel.len,
+                                      fio_pattern_index_on_prefix, f);
+  fio_pattern_group_s *custom = idx->custom;
+  for (size_t i = 0; custom && i < custom->count; ++i) {
+    channel_s *ch = custom->ary[i];
+    if (ch->match((fio_str_info_s){.data = ch->name, .len = ch->name_len},
+                  f->channel))
+      fio_pattern_found_push(f, ch);
+  }
+  for (size_t i = 0; i < f->count; ++i)
+    fio_channel_dup(f->found[i]);
+  fio_rcu_read_unlock(token);
+}
 
 /* *****************************************************************************
 Channel Subscription Management
@@ -5376,11 +7117,13 @@ static void fio_pubsub_on_channel_destroy(channel_s *ch);
 static inline channel_s *fio_filter_dup_lock_internal(channel_s *ch,
                                                       uint64_t hashed,
                                                       fio_collection_s *c) {
-  fio_lock(&c->lock);
-  ch = fio_ch_set_insert(&c->channels, hashed, ch);
+  fio_collection_shard_s *shard = fio_collection_shard(c, hashed);
+  ch->parent = shard;
+  fio_lock(&shard->lock);
+  ch = fio_ch_set_insert(&shard->channels, hashed, ch);
   fio_channel_dup(ch);
   fio_lock(&ch->lock);
-  fio_unlock(&c->lock);
+  fio_unlock(&shard->lock);
   return ch;
 }
 
@@ -5389,7 +7132,6 @@ static channel_s *fio_filter_dup_lock(uint32_t filter) {
   channel_s ch = (channel_s){
       .name = (char *)&filter,
       .name_len = (sizeof(filter)),
-      .parent = &fio_postoffice.filters,
       .ref = 8, /* avoid freeing stack memory */
   };
   return fio_filter_dup_lock_internal(&ch, filter, &fio_postoffice.filters);
@@ -5400,14 +7142,13 @@ static channel_s *fio_channel_dup_lock(fio_str_info_s name) {
   channel_s ch = (channel_s){
       .name = name.data,
       .name_len = name.len,
-      .parent = &fio_postoffice.pubsub,
       .ref = 8, /* avoid freeing stack memory */
   };
   uint64_t hashed_name = FIO_HASH_FN(
       name.data, name.len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
   channel_s *ch_p =
       fio_filter_dup_lock_internal(&ch, hashed_name, &fio_postoffice.pubsub);
-  if (fio_ls_embd_is_empty(&ch_p->subscriptions)) {
+  if (!ch_p->count) {
     fio_pubsub_on_channel_create(ch_p);
   }
   return ch_p;
@@ -5419,7 +7160,6 @@ static channel_s *fio_channel_match_dup_lock(fio_str_info_s name,
   channel_s ch = (channel_s){
       .name = name.data,
       .name_len = name.len,
-      .parent = &fio_postoffice.patterns,
       .match = match,
       .ref = 8, /* avoid freeing stack memory */
   };
@@ -5427,7 +7167,8 @@ static channel_s *fio_channel_match_dup_lock(fio_str_info_s name,
       name.data, name.len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
   channel_s *ch_p =
       fio_filter_dup_lock_internal(&ch, hashed_name, &fio_postoffice.patterns);
-  if (fio_ls_embd_is_empty(&ch_p->subscriptions)) {
+  if (!ch_p->count) {
+    fio_pattern_index_add(ch_p);
     fio_pubsub_on_channel_create(ch_p);
   }
   return ch_p;
@@ -5471,7 +7212,13 @@ subscription_s *fio_subscribe FIO_IGNORE_MACRO(subscribe_args_s args) {
     ch = fio_channel_dup_lock(args.channel);
   }
   s->parent = ch;
-  fio_ls_embd_push(&ch->subscriptions, &s->node);
+  if (ch->count == ch->capa) {
+    ch->capa = ch->capa ? (ch->capa << 1) : 4;
+    ch->subs = realloc(ch->subs, sizeof(*ch->subs) * ch->capa);
+    FIO_ASSERT_ALLOC(ch->subs);
+  }
+  s->pos = ch->count;
+  ch->subs[ch->count++] = s;
   fio_unlock((&ch->lock));
   return s;
 error:
@@ -5490,18 +7237,31 @@ void fio_unsubscribe(subscription_s *s) {
   channel_s *ch = s->parent;
   uint8_t removed = 0;
   fio_lock(&ch->lock);
-  fio_ls_embd_remove(&s->node);
+  /* swap the last subscription into the removed subscription's position */
+  ch->subs[s->pos] = ch->subs[--ch->count];
+  ch->subs[s->pos]->pos = s->pos;
   /* check if channel is done for */
-  if (fio_ls_embd_is_empty(&ch->subscriptions)) {
-    fio_collection_s *c = ch->parent;
-    uint64_t hashed = FIO_HASH_FN(
-        ch->name, ch->name_len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
+  if (!ch->count) {
+    fio_collection_shard_s *c = ch->parent;
+    const int is_filter = fio_collection_owns(&fio_postoffice.filters, c);
+    uint64_t hashed;
+    if (is_filter) {
+      /* filters are hashed by value (see `fio_filter_dup_lock`) */
+      uint32_t filter;
+      memcpy(&filter, ch->name, sizeof(filter));
+      hashed = filter;
+    } else {
+      hashed = FIO_HASH_FN(ch->name, ch->name_len, &fio_postoffice.pubsub,
+                           &fio_postoffice.pubsub);
+    }
     /* lock collection */
     fio_lock(&c->lock);
     /* test again within lock */
-    if (fio_ls_embd_is_empty(&ch->subscriptions)) {
+    if (!ch->count) {
+      if (ch->match)
+        fio_pattern_index_remove(ch);
       fio_ch_set_remove(&c->channels, hashed, ch, NULL);
-      removed = (c != &fio_postoffice.filters);
+      removed = !is_filter;
     }
     fio_unlock(&c->lock);
   }
@@ -5536,32 +7296,122 @@ Engine handling and Management
 static inline void fio_cluster_inform_root_about_channel(channel_s *ch,
                                                          int add);
 
-/* runs in lock(!) let'm all know */
-static void fio_pubsub_on_channel_create(channel_s *ch) {
-  fio_lock(&fio_postoffice.engines.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.engines.set, pos) {
+/* implemented later, informs root process about a batch of channel changes */
+static void fio_cluster_inform_root_about_changes(fio_pubsub_change_s *changes,
+                                                  size_t count);
+
+/* implemented later, informs publishers about the process's subscriptions */
+static void fio_cluster_shm_interest(channel_s *ch, int add);
+
+/* reports the channel changes collected so far to the engines and root */
+static void fio_pubsub_churn_flush(void *ignr_) {
+  fio_lock(&fio_postoffice.churn.lock);
+  fio_churn_set_s added = fio_postoffice.churn.added;
+  fio_churn_set_s removed = fio_postoffice.churn.removed;
+  fio_postoffice.churn.added = (fio_churn_set_s)FIO_SET_INIT;
+  fio_postoffice.churn.removed = (fio_churn_set_s)FIO_SET_INIT;
+  fio_postoffice.churn.scheduled = 0;
+  fio_unlock(&fio_postoffice.churn.lock);
+
+  const size_t count =
+      fio_churn_set_count(&removed) + fio_churn_set_count(&added);
+  if (!count)
+    goto finish;
+  fio_pubsub_change_s *changes = fio_malloc(sizeof(*changes) * count);
+  FIO_ASSERT_ALLOC(changes);
+  size_t i = 0;
+  /* removed channels first, so engines don't hold both old and new */
+  FIO_SET_FOR_LOOP(&removed, pos) {
     if (!pos->hash)
       continue;
-    pos->obj->subscribe(pos->obj,
-                        (fio_str_info_s){.data = ch->name, .len = ch->name_len},
-                        ch->match);
+    changes[i++] = (fio_pubsub_change_s){
+        .channel = {.data = pos->obj->name, .len = pos->obj->name_len},
+        .match = pos->obj->match,
+        .subscribe = 0,
+    };
+  }
+  FIO_SET_FOR_LOOP(&added, pos) {
+    if (!pos->hash)
+      continue;
+    changes[i++] = (fio_pubsub_change_s){
+        .channel = {.data = pos->obj->name, .len = pos->obj->name_len},
+        .match = pos->obj->match,
+        .subscribe = 1,
+    };
   }
-  fio_unlock(&fio_postoffice.engines.lock);
-  fio_cluster_inform_root_about_channel(ch, 1);
-}
 
-/* runs in lock(!) let'm all know */
-static void fio_pubsub_on_channel_destroy(channel_s *ch) {
   fio_lock(&fio_postoffice.engines.lock);
   FIO_SET_FOR_LOOP(&fio_postoffice.engines.set, pos) {
     if (!pos->hash)
       continue;
-    pos->obj->unsubscribe(
-        pos->obj, (fio_str_info_s){.data = ch->name, .len = ch->name_len},
-        ch->match);
+    if (pos->obj->subscribe_batch) {
+      pos->obj->subscribe_batch(pos->obj, changes, count);
+      continue;
+    }
+    for (i = 0; i < count; ++i) {
+      if (changes[i].subscribe)
+        pos->obj->subscribe(pos->obj, changes[i].channel, changes[i].match);
+      else
+        pos->obj->unsubscribe(pos->obj, changes[i].channel, changes[i].match);
+    }
   }
   fio_unlock(&fio_postoffice.engines.lock);
-  fio_cluster_inform_root_about_channel(ch, 0);
+  fio_cluster_inform_root_about_changes(changes, count);
+  fio_free(changes);
+
+finish:
+  fio_churn_set_free(&added);
+  fio_churn_set_free(&removed);
+  (void)ignr_;
+}
+
+/* the deferred task variant of `fio_pubsub_churn_flush` */
+static void fio_pubsub_churn_flush_task(void *ignr_, void *ignr2_) {
+  fio_pubsub_churn_flush(ignr_);
+  (void)ignr2_;
+}
+
+/* the churn window's timer task (changes are reported by `on_finish`) */
+static void fio_pubsub_churn_wait(void *ignr_) { (void)ignr_; }
+
+/* collects a channel change, cancelling an unreported change if one exists */
+static void fio_pubsub_churn_add(channel_s *ch, int add) {
+  fio_churn_set_s *cancel =
+      (add ? &fio_postoffice.churn.removed : &fio_postoffice.churn.added);
+  fio_churn_set_s *insert =
+      (add ? &fio_postoffice.churn.added : &fio_postoffice.churn.removed);
+  uint64_t hashed = FIO_HASH_FN(ch->name, ch->name_len, &fio_postoffice.pubsub,
+                                &fio_postoffice.pubsub);
+  uint8_t schedule;
+  fio_lock(&fio_postoffice.churn.lock);
+  if (fio_churn_set_remove(cancel, hashed, ch, NULL)) {
+    fio_channel_dup(ch);
+    fio_churn_set_insert(insert, hashed, ch);
+  }
+  schedule = !fio_postoffice.churn.scheduled;
+  fio_postoffice.churn.scheduled = 1;
+  fio_unlock(&fio_postoffice.churn.lock);
+  if (!schedule)
+    return;
+  if (FIO_PUBSUB_CHURN_WINDOW && fio_is_running()) {
+    /* `on_finish` is called even if the timer is cleared by `fio_stop` */
+    fio_run_every(FIO_PUBSUB_CHURN_WINDOW, 1, fio_pubsub_churn_wait, NULL,
+                  fio_pubsub_churn_flush);
+    return;
+  }
+  fio_defer(fio_pubsub_churn_flush_task, NULL, NULL);
+}
+
+/* runs in lock(!) let'm all know */
+static void fio_pubsub_on_channel_create(channel_s *ch) {
+  fio_pubsub_churn_add(ch, 1);
+  fio_cluster_shm_interest(ch, 1);
+}
+
+/* runs in lock(!) let'm all know */
+static void fio_pubsub_on_channel_destroy(channel_s *ch) {
+  fio_pubsub_churn_add(ch, 0);
+  fio_cluster_shm_interest(ch, 0);
 }
 
 /**
@@ -5615,26 +7465,30 @@ int fio_pubsub_is_attached(fio_pubsub_engine_s *engine) {
  * exclusive subscription process.
  */
 void fio_pubsub_reattach(fio_pubsub_engine_s *eng) {
-  fio_lock(&fio_postoffice.pubsub.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash)
-      continue;
-    eng->subscribe(
-        eng,
-        (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
-        NULL);
-  }
-  fio_unlock(&fio_postoffice.pubsub.lock);
-  fio_lock(&fio_postoffice.patterns.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
-    if (!pos->hash)
-      continue;
-    eng->subscribe(
-        eng,
-        (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
-        pos->obj->match);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      eng->subscribe(
+          eng,
+          (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
+          NULL);
+    }
+    fio_unlock(&shard->lock);
+  }
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      eng->subscribe(
+          eng,
+          (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
+          pos->obj->match);
+    }
+    fio_unlock(&shard->lock);
   }
-  fio_unlock(&fio_postoffice.patterns.lock);
 }
 
 /* *****************************************************************************
@@ -5672,14 +7526,11 @@ void *fio_message_metadata(fio_msg_s *msg, intptr_t type_id) {
 static channel_s *fio_channel_find_dup_internal(channel_s *ch_tmp,
                                                 uint64_t hashed,
                                                 fio_collection_s *c) {
-  fio_lock(&c->lock);
-  channel_s *ch = fio_ch_set_find(&c->channels, hashed, ch_tmp);
-  if (!ch) {
-    fio_unlock(&c->lock);
-    return NULL;
-  }
+  fio_collection_shard_s *shard = fio_collection_shard(c, hashed);
+  const uintptr_t token = fio_rcu_read_lock();
+  channel_s *ch = fio_ch_set_find(&shard->channels, hashed, ch_tmp);
   fio_channel_dup(ch);
-  fio_unlock(&c->lock);
+  fio_rcu_read_unlock(token);
   return ch;
 }
 
@@ -5707,14 +7558,11 @@ void fio_message_defer(fio_msg_s *msg_) {
   cl->marker = 1;
 }
 
-/* performs the actual callback */
-static void fio_perform_subscription_callback(void *s_, void *msg_) {
-  subscription_s *s = s_;
-  if (fio_trylock(&s->lock)) {
-    fio_defer_push_task(fio_perform_subscription_callback, s_, msg_);
-    return;
-  }
-  fio_msg_internal_s *msg = (fio_msg_internal_s *)msg_;
+/* performs the actual callback, returns -1 if it should be performed later */
+static int fio_subscription_perform(subscription_s *s,
+                                    fio_msg_internal_s *msg) {
+  if (fio_trylock(&s->lock))
+    return -1;
   fio_msg_client_s m = {
       .msg =
           {
@@ -5733,24 +7581,69 @@ static void fio_perform_subscription_callback(void *s_, void *msg_) {
     s->on_message(&m.msg);
   }
   fio_unlock(&s->lock);
-  if (m.marker) {
+  return 0 - (m.marker != 0);
+}
+
+/* performs the callback for a single subscription (busy or deferred) */
+static void fio_perform_subscription_callback(void *s_, void *msg_) {
+  if (fio_subscription_perform(s_, msg_)) {
     fio_defer_push_task(fio_perform_subscription_callback, s_, msg_);
     return;
   }
-  fio_msg_internal_free(msg);
-  fio_subscription_free(s);
+  fio_msg_internal_free(msg_);
+  fio_subscription_free(s_);
+}
+
+/* a message and the subscriptions it's delivered to by a single task */
+typedef struct {
+  fio_msg_internal_s *msg;
+  size_t count;
+  subscription_s *subs[];
+} fio_subscription_batch_s;
+
+/* performs the callback for a batch of subscriptions */
+static void fio_perform_subscription_batch(void *b_, void *ignr) {
+  fio_subscription_batch_s *b = b_;
+  for (size_t i = 0; i < b->count; ++i) {
+    if (fio_subscription_perform(b->subs[i], b->msg)) {
+      /* busy (or deferred), retry on its own */
+      fio_atomic_add(&b->msg->ref, 1);
+      fio_defer_push_task(fio_perform_subscription_callback, b->subs[i],
+                          b->msg);
+      continue;
+    }
+    fio_subscription_free(b->subs[i]);
+  }
+  fio_msg_internal_free(b->msg);
+  fio_free(b);
+  (void)ignr;
 }
 
 /** UNSAFE! publishes a message to a channel, managing the reference counts */
 static void fio_publish2channel(channel_s *ch, fio_msg_internal_s *msg) {
-  FIO_LS_EMBD_FOR(&ch->subscriptions, pos) {
-    subscription_s *s = FIO_LS_EMBD_OBJ(subscription_s, node, pos);
-    if (!s || s->on_message == fio_mock_on_message) {
+  size_t i = 0;
+  while (i < ch->count) {
+    size_t limit = ch->count - i;
+    if (limit > FIO_PUBSUB_BATCH_SIZE)
+      limit = FIO_PUBSUB_BATCH_SIZE;
+    fio_subscription_batch_s *b =
+        fio_malloc(sizeof(*b) + (sizeof(b->subs[0]) * limit));
+    FIO_ASSERT_ALLOC(b);
+    b->msg = msg;
+    b->count = 0;
+    for (limit += i; i < limit; ++i) {
+      subscription_s *s = ch->subs[i];
+      if (s->on_message == fio_mock_on_message)
+        continue;
+      fio_atomic_add(&s->ref, 1);
+      b->subs[b->count++] = s;
+    }
+    if (!b->count) {
+      fio_free(b);
       continue;
     }
-    fio_atomic_add(&s->ref, 1);
     fio_atomic_add(&msg->ref, 1);
-    fio_defer_push_task(fio_perform_subscription_callback, s, msg);
+    fio_defer_push_task(fio_perform_subscription_batch, b, NULL);
   }
   fio_msg_internal_free(msg);
 }
@@ -5770,6 +7663,34 @@ finish:
   fio_channel_free(ch);
 }
 
+/* publishes to all matching pattern channels (see the Pattern Index) */
+static void fio_publish2patterns(fio_msg_internal_s *m) {
+  channel_s *stack_buffer[64];
+  char reversed_buffer[256];
+  fio_pattern_found_s f = {
+      .channel = m->channel,
+      .reversed = reversed_buffer,
+      .found = stack_buffer,
+      .capa = sizeof(stack_buffer) / sizeof(stack_buffer[0]),
+      .stack_buffer = stack_buffer,
+  };
+  if (m->channel.len > sizeof(reversed_buffer)) {
+    f.reversed = malloc(m->channel.len);
+    FIO_ASSERT_ALLOC(f.reversed);
+  }
+  fio_pattern_reverse((char *)f.reversed, m->channel.data, m->channel.len,
+                      m->channel.len);
+  fio_pattern_index_find_dup(&f);
+  for (size_t i = 0; i < f.count; ++i) {
+    fio_defer_push_urgent(fio_publish2channel_task, f.found[i],
+                          fio_msg_internal_dup(m));
+  }
+  if (f.reversed != reversed_buffer)
+    free((char *)f.reversed);
+  if (f.found != stack_buffer)
+    free(f.found);
+}
+
 /** Publishes the message to the current process and frees the strings. */
 static void fio_publish2process(fio_msg_internal_s *m) {
   fio_msg_internal_finalize(m);
@@ -5789,21 +7710,7 @@ static void fio_publish2process(fio_msg_internal_s *m) {
   }
   if (m->filter == 0) {
     /* pattern matching match */
-    fio_lock(&fio_postoffice.patterns.lock);
-    FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, p) {
-      if (!p->hash) {
-        continue;
-      }
-
-      if (p->obj->match(
-              (fio_str_info_s){.data = p->obj->name, .len = p->obj->name_len},
-              m->channel)) {
-        fio_channel_dup(p->obj);
-        fio_defer_push_urgent(fio_publish2channel_task, p->obj,
-                              fio_msg_internal_dup(m));
-      }
-    }
-    fio_unlock(&fio_postoffice.patterns.lock);
+    fio_publish2patterns(m);
   }
 finish:
   fio_msg_internal_free(m);
@@ -5815,6 +7722,19 @@ finish:
 
 #define CLUSTER_READ_BUFFER 16384
 
+/* messages with a larger body are written without copying (not coalesced) */
+#define CLUSTER_COALESCE_LIMIT 4096
+
+/* pending output is written immediately once it reaches this length */
+#define CLUSTER_WRITE_BUFFER 65536
+
+/* the number of channel names remembered by a connection (each direction) */
+#define CLUSTER_DICT_SIZE 256
+
+/* channel names shorter or longer than these aren't added to the dictionary */
+#define CLUSTER_DICT_MIN 4
+#define CLUSTER_DICT_MAX 256
+
 #define FIO_SET_NAME fio_sub_hash
 #define FIO_SET_OBJ_TYPE subscription_s *
 #define FIO_SET_KEY_TYPE fio_str_s
@@ -5842,6 +7762,17 @@ typedef struct cluster_pr_s {
   int32_t filter;
   uint32_t length;
   fio_lock_i lock;
+  /* outgoing frames, written once per cycle (protected by the state lock) */
+  uint8_t out_scheduled;
+  char *out;
+  size_t out_len;
+  size_t out_capa;
+#if FIO_CLUSTER_COMPACT
+  /* the dictionary slot defined by the incoming message (+1, 0 if none) */
+  uint32_t define;
+  fio_str_info_s dict_out[CLUSTER_DICT_SIZE];
+  fio_str_info_s dict_in[CLUSTER_DICT_SIZE];
+#endif
   uint8_t buffer[CLUSTER_READ_BUFFER];
 } cluster_pr_s;
 
@@ -5853,59 +7784,1242 @@ static struct cluster_data_s {
 } cluster_data = {.clients = FIO_LS_INIT(cluster_data.clients),
                   .lock = FIO_LOCK_INIT};
 
-static void fio_cluster_data_cleanup(int delete_file) {
-  if (delete_file && cluster_data.name[0]) {
-#if DEBUG
-    FIO_LOG_DEBUG("(%d) unlinking cluster's Unix socket.", (int)getpid());
-#endif
-    unlink(cluster_data.name);
+/* *****************************************************************************
+ * Cluster Message Framing (coalesced writes)
+ **************************************************************************** */
+
+/*
+ * Messages sent over a cluster connection are appended to the connection's
+ * pending output, which is written once per cycle (a single `write` for many
+ * small messages). Messages with a large body write the body separately,
+ * without copying it.
+ *
+ * When `FIO_CLUSTER_COMPACT` is true, frames start with a byte containing the
+ * message type and flags, followed by varints for the data's length, the
+ * filter (zigzag encoded) and the channel (either a dictionary slot, a slot
+ * being defined followed by the name's length, or the name's length). The
+ * channel name (unless a dictionary slot is used) and the data follow, each
+ * followed by a NUL byte (as in the 16 byte header frame).
+ *
+ * Each direction of a connection has its own dictionary. A channel name is
+ * stored in the slot matching its hash, replacing the slot's previous name, so
+ * both sides of the connection always agree about a slot's name.
+ */
+
+#define CLUSTER_FRAME_FILTER 0x10
+#define CLUSTER_FRAME_DICT_REF 0x20
+#define CLUSTER_FRAME_DICT_DEF 0x40
+#define CLUSTER_FRAME_MAX_HEADER 24
+
+/* the message's cluster type (from the message's frame) */
+static inline uint32_t fio_cluster_msg_type(fio_msg_internal_s *m) {
+  return fio_str2u32((uint8_t *)(m + 1) + (m->meta_len * sizeof(*m->meta)) +
+                     8);
+}
+
+#if FIO_CLUSTER_COMPACT
+/* writes a varint, returning the number of bytes written */
+static inline size_t fio_cluster_varint_write(uint8_t *dest, uint64_t i) {
+  size_t len = 0;
+  while (i > 127) {
+    dest[len++] = (uint8_t)(i | 128);
+    i >>= 7;
   }
-  while (fio_ls_any(&cluster_data.clients)) {
-    intptr_t uuid = (intptr_t)fio_ls_pop(&cluster_data.clients);
-    if (uuid > 0) {
-      fio_close(uuid);
+  dest[len++] = (uint8_t)i;
+  return len;
+}
+
+/* reads a varint, returning the number of bytes read (0 if incomplete) */
+static inline size_t fio_cluster_varint_read(uint64_t *dest, const uint8_t *buf,
+                                             size_t len) {
+  uint64_t i = 0;
+  for (size_t pos = 0; pos < len && pos < 10; ++pos) {
+    i |= ((uint64_t)(buf[pos] & 127)) << (pos * 7);
+    if (!(buf[pos] & 128)) {
+      *dest = i;
+      return pos + 1;
     }
   }
-  cluster_data.uuid = 0;
-  cluster_data.lock = FIO_LOCK_INIT;
-  cluster_data.clients = (fio_ls_s)FIO_LS_INIT(cluster_data.clients);
+  return 0;
 }
 
-static void fio_cluster_cleanup(void *ignore) {
-  /* cleanup the cluster data */
-  fio_cluster_data_cleanup(fio_parent_pid() == getpid());
-  (void)ignore;
+/* the dictionary slot for a channel name (or -1 if not using the dictionary) */
+static inline int32_t fio_cluster_dict_slot(fio_str_info_s ch) {
+  if (ch.len < CLUSTER_DICT_MIN || ch.len > CLUSTER_DICT_MAX)
+    return -1;
+  return (int32_t)(fio_risky_hash(ch.data, ch.len, 0) &
+                   (CLUSTER_DICT_SIZE - 1));
 }
 
-static void fio_cluster_init(void) {
-  fio_cluster_data_cleanup(0);
-  /* create a unique socket name */
-  char *tmp_folder = getenv("TMPDIR");
-  uint32_t tmp_folder_len = 0;
-  if (!tmp_folder || ((tmp_folder_len = (uint32_t)strlen(tmp_folder)) >
-                      (FIO_CLUSTER_NAME_LIMIT - 28))) {
-#ifdef P_tmpdir
-    tmp_folder = (char *)P_tmpdir;
-    if (tmp_folder)
-      tmp_folder_len = (uint32_t)strlen(tmp_folder);
-#else
-    tmp_folder = "/tmp/";
-    tmp_folder_len = 5;
-#endif
-  }
-  if (tmp_folder_len >= (FIO_CLUSTER_NAME_LIMIT - 28)) {
-    tmp_folder_len = 0;
+/* stores a copy of a channel name in a dictionary slot */
+static inline void fio_cluster_dict_set(fio_str_info_s *slot,
+                                        fio_str_info_s ch) {
+  if (slot->capa < ch.len) {
+    free(slot->data);
+    slot->data = malloc(ch.len);
+    FIO_ASSERT_ALLOC(slot->data);
+    slot->capa = ch.len;
   }
-  if (tmp_folder_len) {
-    memcpy(cluster_data.name, tmp_folder, tmp_folder_len);
-    if (cluster_data.name[tmp_folder_len - 1] != '/')
-      cluster_data.name[tmp_folder_len++] = '/';
+  memcpy(slot->data, ch.data, ch.len);
+  slot->len = ch.len;
+}
+
+static void fio_cluster_dict_free(fio_str_info_s *dict) {
+  for (size_t i = 0; i < CLUSTER_DICT_SIZE; ++i) {
+    free(dict[i].data);
+    dict[i] = (fio_str_info_s){.data = NULL};
   }
-  memcpy(cluster_data.name + tmp_folder_len, "facil-io-sock-", 14);
-  tmp_folder_len += 14;
-  tmp_folder_len +=
-      snprintf(cluster_data.name + tmp_folder_len,
-               FIO_CLUSTER_NAME_LIMIT - tmp_folder_len, "%d", (int)getpid());
+}
+#endif
+
+/**
+ * Writes the frame's header to `dest` (at least `CLUSTER_FRAME_MAX_HEADER`
+ * bytes), returning the header's length. Sets `body` to the rest of the frame.
+ *
+ * `c` (the connection) may be NULL, in which case the dictionary isn't used.
+ */
+static size_t fio_cluster_frame_header(cluster_pr_s *c, uint8_t *dest,
+                                       fio_msg_internal_s *m,
+                                       fio_str_info_s *body) {
+  uint8_t *frame = (uint8_t *)(m + 1) + (m->meta_len * sizeof(*m->meta));
+  *body = (fio_str_info_s){.data = (char *)frame + 16,
+                           .len = m->channel.len + m->data.len + 2};
+#if FIO_CLUSTER_COMPACT
+  uint8_t flags = (uint8_t)fio_cluster_msg_type(m);
+  size_t len = 1;
+  len += fio_cluster_varint_write(dest + len, m->data.len);
+  if (m->filter) {
+    flags |= CLUSTER_FRAME_FILTER;
+    len += fio_cluster_varint_write(
+        dest + len,
+        (((uint32_t)m->filter) << 1) ^ ((uint32_t)(m->filter >> 31)));
+  }
+  int32_t slot = (c ? fio_cluster_dict_slot(m->channel) : -1);
+  if (slot >= 0 && c->dict_out[slot].len == m->channel.len &&
+      !memcmp(c->dict_out[slot].data, m->channel.data, m->channel.len)) {
+    flags |= CLUSTER_FRAME_DICT_REF;
+    len += fio_cluster_varint_write(dest + len, (uint64_t)slot);
+    body->data += m->channel.len + 1;
+    body->len -= m->channel.len + 1;
+  } else {
+    if (slot >= 0) {
+      flags |= CLUSTER_FRAME_DICT_DEF;
+      len += fio_cluster_varint_write(dest + len, (uint64_t)slot);
+      fio_cluster_dict_set(c->dict_out + slot, m->channel);
+    }
+    len += fio_cluster_varint_write(dest + len, m->channel.len);
+  }
+  dest[0] = flags;
+  return len;
+#else
+  memcpy(dest, frame, 16);
+  return 16;
+  (void)c;
+#endif
+}
+
+/**
+ * Reads a frame's header, returning the header's length (0 if incomplete).
+ * Sets the connection's expected lengths, type and filter. Sets `ch` if the
+ * channel name is in the dictionary.
+ */
+static size_t fio_cluster_frame_parse(cluster_pr_s *c, const uint8_t *buf,
+                                      size_t len, fio_str_info_s *ch) {
+#if FIO_CLUSTER_COMPACT
+  /* state is only updated once the whole header is available */
+  uint64_t msg_len, tmp;
+  int32_t filter = 0;
+  size_t pos = 1, r;
+  if (!len)
+    return 0;
+  const uint8_t flags = buf[0];
+  if (!(r = fio_cluster_varint_read(&msg_len, buf + pos, len - pos)))
+    return 0;
+  pos += r;
+  if (flags & CLUSTER_FRAME_FILTER) {
+    if (!(r = fio_cluster_varint_read(&tmp, buf + pos, len - pos)))
+      return 0;
+    pos += r;
+    filter = (int32_t)(((uint32_t)tmp >> 1) ^ (~((uint32_t)tmp & 1) + 1));
+  }
+  c->define = 0;
+  if (flags & (CLUSTER_FRAME_DICT_REF | CLUSTER_FRAME_DICT_DEF)) {
+    if (!(r = fio_cluster_varint_read(&tmp, buf + pos, len - pos)))
+      return 0;
+    pos += r;
+    tmp &= (CLUSTER_DICT_SIZE - 1);
+    if (flags & CLUSTER_FRAME_DICT_REF) {
+      *ch = c->dict_in[tmp];
+      c->exp_channel = 0;
+      goto done;
+    }
+    c->define = (uint32_t)tmp + 1;
+  }
+  if (!(r = fio_cluster_varint_read(&tmp, buf + pos, len - pos))) {
+    c->define = 0;
+    return 0;
+  }
+  pos += r;
+  c->exp_channel = (uint32_t)tmp + 1;
+done:
+  c->type = flags & 15;
+  c->filter = filter;
+  c->exp_msg = (uint32_t)msg_len + 1;
+  return pos;
+#else
+  if (len < 16)
+    return 0;
+  c->exp_channel = fio_str2u32(buf) + 1;
+  c->exp_msg = fio_str2u32(buf + 4) + 1;
+  c->type = fio_str2u32(buf + 8);
+  c->filter = (int32_t)fio_str2u32(buf + 12);
+  return 16;
+  (void)ch;
+#endif
+}
+
+/* writes the connection's pending output. Call while holding the state lock */
+static void fio_cluster_out_write(cluster_pr_s *c) {
+  if (!c->out_len)
+    return;
+  fio_write2(c->uuid, .data.buffer = c->out, .length = c->out_len,
+             .after.dealloc = fio_free);
+  c->out = NULL;
+  c->out_len = c->out_capa = 0;
+}
+
+/* appends data to the connection's pending output */
+static void fio_cluster_out_append(cluster_pr_s *c, const void *data,
+                                   size_t len) {
+  if (c->out_len + len > c->out_capa) {
+    size_t capa = c->out_capa ? c->out_capa : 4096;
+    while (capa < c->out_len + len)
+      capa <<= 1;
+    c->out = fio_realloc2(c->out, capa, c->out_len);
+    FIO_ASSERT_ALLOC(c->out);
+    c->out_capa = capa;
+  }
+  memcpy(c->out + c->out_len, data, len);
+  c->out_len += len;
+}
+
+/* writes the pending output of a connection (scheduled once per cycle) */
+static void fio_cluster_out_flush(void *uuid_, void *ignr) {
+  fio_protocol_s *pr =
+      fio_protocol_try_lock((intptr_t)uuid_, FIO_PR_LOCK_STATE);
+  if (!pr) {
+    if (errno != EBADF)
+      fio_defer_push_task(fio_cluster_out_flush, uuid_, ignr);
+    return;
+  }
+  cluster_pr_s *c = (cluster_pr_s *)pr;
+  c->out_scheduled = 0;
+  fio_cluster_out_write(c);
+  fio_protocol_unlock(pr, FIO_PR_LOCK_STATE);
+}
+
+static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_);
+
+/*
+ * writes a self contained frame (doesn't use the dictionary or coalesce).
+ *
+ * The frame is written using a single packet, since other threads might be
+ * sending frames to the same connection while it's connecting.
+ */
+static void fio_cluster_send_frame(intptr_t uuid, fio_msg_internal_s *m) {
+  uint8_t header[CLUSTER_FRAME_MAX_HEADER];
+  fio_str_info_s body;
+  const size_t len = fio_cluster_frame_header(NULL, header, m, &body);
+  char *frame = fio_malloc(len + body.len);
+  FIO_ASSERT_ALLOC(frame);
+  memcpy(frame, header, len);
+  if (body.len)
+    memcpy(frame + len, body.data, body.len);
+  fio_write2(uuid, .data.buffer = frame, .length = len + body.len,
+             .after.dealloc = fio_free);
+}
+
+/* sends a message to a cluster connection (the message isn't consumed) */
+static void fio_cluster_send(intptr_t uuid, fio_msg_internal_s *m) {
+  uint8_t header[CLUSTER_FRAME_MAX_HEADER];
+  fio_str_info_s body;
+  fio_protocol_s *pr;
+  while (!(pr = fio_protocol_try_lock(uuid, FIO_PR_LOCK_STATE))) {
+    if (errno == EBADF) {
+      fio_cluster_send_frame(uuid, m);
+      return;
+    }
+    fio_reschedule_thread();
+  }
+  if (pr->on_data != fio_cluster_on_data) {
+    /* still connecting, the cluster protocol wasn't attached yet */
+    fio_protocol_unlock(pr, FIO_PR_LOCK_STATE);
+    fio_cluster_send_frame(uuid, m);
+    return;
+  }
+  cluster_pr_s *c = (cluster_pr_s *)pr;
+  fio_cluster_out_append(c, header,
+                         fio_cluster_frame_header(c, header, m, &body));
+  if (body.len > CLUSTER_COALESCE_LIMIT) {
+    fio_cluster_out_write(c);
+    fio_write2(uuid, .data.buffer = fio_msg_internal_dup(m),
+               .offset = (size_t)(body.data - (char *)m), .length = body.len,
+               .after.dealloc = fio_msg_internal_free2);
+  } else {
+    fio_cluster_out_append(c, body.data, body.len);
+    if (c->out_len >= CLUSTER_WRITE_BUFFER) {
+      fio_cluster_out_write(c);
+    } else if (!c->out_scheduled) {
+      c->out_scheduled = 1;
+      fio_defer_push_task(fio_cluster_out_flush, (void *)uuid, NULL);
+    }
+  }
+  fio_protocol_unlock(pr, FIO_PR_LOCK_STATE);
+}
+
+/* *****************************************************************************
+ * Shared Memory Transport
+ **************************************************************************** */
+
+#if FIO_CLUSTER_SHM
+#include <sys/eventfd.h>
+
+/*
+ * The root process maps a ring for itself and for every worker slot before
+ * forking. Workers push publications to the root's ring and the root pushes
+ * them to the workers' rings, ringing the consumer's doorbell (an `eventfd`)
+ * when the ring was empty.
+ *
+ * Any thread (in any process) may push, pushes are serialized by the ring's
+ * lock. The lock is a robust process shared mutex, so a worker that dies while
+ * pushing doesn't block the ring (the tail is only updated once a record is
+ * complete). Only the process that claimed the ring pops.
+ *
+ * Records contain the socket's frame (the same 16 byte header, channel and
+ * data), prefixed by the frame's length and the sender's ring. Records are
+ * 8 byte aligned and never wrap around the end of the ring. Frames larger than
+ * `FIO_CLUSTER_SHM_RECORD_LIMIT` are split into pieces, which the consumer
+ * collects (per sender) until the frame is complete. A process pushes the
+ * pieces of a frame before any later message for the same ring, so all
+ * publications use the rings and their order is preserved.
+ *
+ * Only publications use the rings, everything else uses the socket. A worker
+ * keeps its publications until the root acknowledged the worker's ring over
+ * the socket (`FIO_CLUSTER_MSG_SHM`), so ordering is preserved.
+ *
+ * The root process assigns a ring to every worker it forks and releases the
+ * ring once the worker was reaped.
+ *
+ * When routing directly (`FIO_CLUSTER_DIRECT`), every process marks its ring's
+ * bit in a shared interest table, in the bucket of each channel it's subscribed
+ * to (or in the `patterns` mask). Workers push publications straight to the
+ * rings marked for the channel and the root process stops relaying them. Hash
+ * collisions only cost a message the receiving process ignores.
+ *
+ * Workers that have no ring (or weren't linked yet) can't be reached directly.
+ * While the root process has such connections (`unlinked`), workers send their
+ * publications using the socket and the root process relays them.
+ */
+
+/* marks the unused end of the ring (the next record is at the start) */
+#define FIO_CLUSTER_SHM_WRAP ((uint32_t)-1)
+
+/* the largest record (larger frames are split into pieces) */
+#define FIO_CLUSTER_SHM_RECORD_LIMIT (FIO_CLUSTER_SHM_RING_SIZE >> 2)
+
+/* sender flags: the record contains a piece of a frame */
+#define FIO_CLUSTER_SHM_PIECE ((uint32_t)1 << 31)
+/* sender flags: the record contains the first piece of a frame */
+#define FIO_CLUSTER_SHM_FIRST ((uint32_t)1 << 30)
+
+/* the number of channel buckets in the interest table (a power of 2) */
+#define FIO_CLUSTER_SHM_INTEREST 4096
+
+typedef struct {
+  /* consumer owned */
+  volatile size_t head;
+  uint8_t pad0__[64 - sizeof(size_t)];
+  /* producer owned (producers hold the lock) */
+  volatile size_t tail;
+  uint8_t pad1__[64 - sizeof(size_t)];
+  pthread_mutex_t lock;
+  /* the process consuming the ring, 0 if the ring is free */
+  volatile pid_t pid;
+  /* an eventfd, written to when a record is pushed to an empty ring */
+  int bell;
+  uint8_t pad2__[64 - sizeof(pid_t) - sizeof(int)];
+  uint8_t buf[FIO_CLUSTER_SHM_RING_SIZE];
+} fio_cluster_ring_s;
+
+/* the rings interested in a channel's publications (one bit per ring) */
+typedef struct {
+  volatile uint64_t patterns; /* rings with pattern subscriptions */
+  volatile uint64_t unlinked; /* worker connections without a linked ring */
+  volatile uint64_t channels[FIO_CLUSTER_SHM_INTEREST];
+} fio_cluster_interest_s;
+
+/* process local data about the rings we push to */
+typedef struct {
+  /* messages waiting for room in the ring (ordered) */
+  fio_ls_s overflow;
+  /* the part of the first waiting message that was already pushed */
+  size_t offset;
+  /* root only: the worker's cluster connection */
+  intptr_t uuid;
+  fio_lock_i lock;
+  uint8_t flushing;
+} fio_cluster_shm_peer_s;
+
+/* a frame collected from pieces, per sender (process local) */
+typedef struct {
+  uint8_t *frame;
+  size_t len;
+  size_t filled;
+} fio_cluster_shm_pieces_s;
+
+static struct {
+  fio_cluster_ring_s *rings; /* rings[0] belongs to the root process */
+  fio_cluster_shm_peer_s *peers;
+  fio_cluster_shm_pieces_s *pieces; /* frames being collected, per sender */
+  size_t count;    /* the number of rings (workers + 1) */
+  size_t self;     /* the ring we consume (`count` if none) */
+  size_t assigned; /* root: the ring reserved for the next forked worker */
+  uint8_t ready;   /* workers: the root process acknowledged our ring */
+  fio_lock_i consumer;
+  /* workers: publications sent before the root acknowledged our ring */
+  fio_ls_s waiting;
+  fio_lock_i waiting_lock;
+  /* root: guards ring assignment against the rings' destruction */
+  fio_lock_i assign_lock;
+  /* direct routing (NULL when the root process relays publications) */
+  fio_cluster_interest_s *interest;
+  uint32_t *interest_count; /* our subscriptions in each bucket */
+  uint32_t pattern_count;
+  fio_lock_i interest_lock;
+} cluster_shm = {.waiting = FIO_LS_INIT(cluster_shm.waiting)};
+
+/* initializes a ring's (robust, process shared) lock. Returns -1 on error. */
+static int fio_cluster_ring_lock_init(fio_cluster_ring_s *r) {
+  pthread_mutexattr_t attr;
+  int ret = -1;
+  if (pthread_mutexattr_init(&attr))
+    return -1;
+  if (!pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) &&
+      !pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) &&
+      !pthread_mutex_init(&r->lock, &attr))
+    ret = 0;
+  pthread_mutexattr_destroy(&attr);
+  return ret;
+}
+
+/* locks a ring, recovering the lock if its owner died while holding it */
+static inline void fio_cluster_ring_lock(fio_cluster_ring_s *r) {
+  if (pthread_mutex_lock(&r->lock) == EOWNERDEAD) {
+    /* the tail wasn't updated for a partial record, the ring is consistent */
+    pthread_mutex_consistent(&r->lock);
+  }
+}
+
+static inline void fio_cluster_ring_unlock(fio_cluster_ring_s *r) {
+  pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Pushes a record to the ring. Returns -1 if the ring is full.
+ */
+static int fio_cluster_ring_push_record(fio_cluster_ring_s *r, uint32_t sender,
+                                        const uint8_t *data, size_t data_len) {
+  const size_t len = (8 + data_len + 7) & (~(size_t)7);
+  fio_cluster_ring_lock(r);
+  const size_t t = r->tail;
+  size_t pos = t & (FIO_CLUSTER_SHM_RING_SIZE - 1);
+  size_t pad = 0;
+  if (pos + len > FIO_CLUSTER_SHM_RING_SIZE)
+    pad = FIO_CLUSTER_SHM_RING_SIZE - pos;
+  if (t + pad + len - r->head > FIO_CLUSTER_SHM_RING_SIZE) {
+    fio_cluster_ring_unlock(r);
+    return -1;
+  }
+  if (pad) {
+    fio_u2str32(r->buf + pos, FIO_CLUSTER_SHM_WRAP);
+    pos = 0;
+  }
+  fio_u2str32(r->buf + pos, (uint32_t)data_len);
+  fio_u2str32(r->buf + pos + 4, sender);
+  memcpy(r->buf + pos + 8, data, data_len);
+  fio_atomic_release();
+  r->tail = t + pad + len;
+  /* the consumer stores the head before reading the tail, we do the opposite */
+  __sync_synchronize();
+  const size_t h = r->head;
+  fio_cluster_ring_unlock(r);
+  if (h == t && r->bell != -1) {
+    uint64_t one = 1;
+    if (write(r->bell, &one, sizeof(one)) < 0) {
+      /* the counter can't overflow, it's read whenever it's set */
+    }
+  }
+  return 0;
+}
+
+/**
+ * Pushes the message's frame to the ring, starting at `*offset` (the part of
+ * the frame that was already pushed). Frames larger than a record are pushed
+ * in pieces.
+ *
+ * Returns -1 if the ring is full, in which case `*offset` is updated and the
+ * rest of the frame MUST be pushed before any other message from the process.
+ */
+static int fio_cluster_ring_push(fio_cluster_ring_s *r, uint32_t sender,
+                                 fio_msg_internal_s *m, size_t *offset) {
+  const size_t frame_len = 16 + m->channel.len + m->data.len + 2;
+  const uint8_t *frame =
+      (uint8_t *)(m + 1) + (m->meta_len * sizeof(*m->meta));
+  if (frame_len <= FIO_CLUSTER_SHM_RECORD_LIMIT)
+    return fio_cluster_ring_push_record(r, sender, frame, frame_len);
+  while (*offset < frame_len) {
+    size_t len = frame_len - *offset;
+    if (len > FIO_CLUSTER_SHM_RECORD_LIMIT)
+      len = FIO_CLUSTER_SHM_RECORD_LIMIT;
+    if (fio_cluster_ring_push_record(
+            r,
+            sender | FIO_CLUSTER_SHM_PIECE |
+                (*offset ? 0 : FIO_CLUSTER_SHM_FIRST),
+            frame + *offset, len))
+      return -1;
+    *offset += len;
+  }
+  return 0;
+}
+
+/**
+ * Collects a piece of a frame, returning the frame once it's complete (the
+ * frame is freed by the caller using `fio_free`).
+ */
+static uint8_t *fio_cluster_ring_piece(uint32_t sender, const uint8_t *data,
+                                       size_t len) {
+  const uint32_t slot = sender & (~(FIO_CLUSTER_SHM_PIECE | FIO_CLUSTER_SHM_FIRST));
+  if (!cluster_shm.pieces || slot >= cluster_shm.count)
+    return NULL;
+  fio_cluster_shm_pieces_s *p = cluster_shm.pieces + slot;
+  if ((sender & FIO_CLUSTER_SHM_FIRST)) {
+    /* a new frame (a frame left by a worker that died is discarded) */
+    fio_free(p->frame);
+    *p = (fio_cluster_shm_pieces_s){.frame = NULL};
+    if (len < 16)
+      return NULL;
+    p->len = 16 + (size_t)fio_str2u32(data) + (size_t)fio_str2u32(data + 4) + 2;
+    p->frame = fio_malloc(p->len);
+    FIO_ASSERT_ALLOC(p->frame);
+  }
+  if (!p->frame)
+    return NULL;
+  if (len > p->len - p->filled) {
+    FIO_LOG_ERROR("(%d) cluster shared memory frame corrupted", (int)getpid());
+    fio_free(p->frame);
+    *p = (fio_cluster_shm_pieces_s){.frame = NULL};
+    return NULL;
+  }
+  memcpy(p->frame + p->filled, data, len);
+  p->filled += len;
+  if (p->filled < p->len)
+    return NULL;
+  uint8_t *frame = p->frame;
+  *p = (fio_cluster_shm_pieces_s){.frame = NULL};
+  return frame;
+}
+
+/* releases the frames being collected */
+static void fio_cluster_shm_pieces_clear(void) {
+  if (!cluster_shm.pieces)
+    return;
+  for (size_t i = 0; i < cluster_shm.count; ++i) {
+    fio_free(cluster_shm.pieces[i].frame);
+    cluster_shm.pieces[i] = (fio_cluster_shm_pieces_s){.frame = NULL};
+  }
+}
+
+/**
+ * Pops all the records in the ring, calling `handler` with a new message for
+ * each record. Consumer side, calls must be serialized.
+ */
+static size_t fio_cluster_ring_drain(fio_cluster_ring_s *r,
+                                     void (*handler)(uint32_t sender,
+                                                     fio_msg_internal_s *m)) {
+  size_t count = 0;
+  size_t h = r->head;
+  for (;;) {
+    if (h == r->tail) {
+      /* the producer stores the tail before reading the head */
+      r->head = h;
+      __sync_synchronize();
+      if (h == r->tail)
+        break;
+    }
+    fio_atomic_acquire();
+    size_t pos = h & (FIO_CLUSTER_SHM_RING_SIZE - 1);
+    uint32_t len = fio_str2u32(r->buf + pos);
+    if (len == FIO_CLUSTER_SHM_WRAP) {
+      h += FIO_CLUSTER_SHM_RING_SIZE - pos;
+      continue;
+    }
+    uint32_t sender = fio_str2u32(r->buf + pos + 4);
+    uint8_t *frame = r->buf + pos + 8;
+    uint8_t *collected = NULL;
+    if ((sender & FIO_CLUSTER_SHM_PIECE)) {
+      collected = fio_cluster_ring_piece(sender, frame, len);
+      /* the piece was copied, release the room */
+      h += (8 + len + 7) & (~(size_t)7);
+      fio_atomic_release();
+      r->head = h;
+      if (!collected)
+        continue;
+      frame = collected;
+      sender &= ~(FIO_CLUSTER_SHM_PIECE | FIO_CLUSTER_SHM_FIRST);
+    }
+    uint32_t ch_len = fio_str2u32(frame);
+    uint32_t msg_len = fio_str2u32(frame + 4);
+    uint32_t type = fio_str2u32(frame + 8);
+    fio_msg_internal_s *m = fio_msg_internal_create(
+        (int32_t)fio_str2u32(frame + 12), type,
+        (fio_str_info_s){.data = (char *)frame + 16, .len = ch_len},
+        (fio_str_info_s){.data = (char *)frame + 16 + ch_len + 1,
+                         .len = msg_len},
+        (int8_t)(type == FIO_CLUSTER_MSG_JSON ||
+                 type == FIO_CLUSTER_MSG_ROOT_JSON),
+        1);
+    if (collected) {
+      fio_free(collected);
+    } else {
+      h += (8 + len + 7) & (~(size_t)7);
+      /* the record was copied, release the room before handling the message */
+      fio_atomic_release();
+      r->head = h;
+    }
+    handler(sender, m);
+    fio_msg_internal_free(m);
+    ++count;
+  }
+  return count;
+}
+
+/* the message types passed using the rings (publications) */
+static inline int fio_cluster_shm_is_publication(fio_msg_internal_s *m) {
+  return fio_cluster_msg_type(m) <= FIO_CLUSTER_MSG_ROOT_JSON;
+}
+
+/* publications sent to all processes (rather than to a single process) */
+static inline int fio_cluster_shm_is_forward(fio_msg_internal_s *m) {
+  const uint32_t type = fio_cluster_msg_type(m);
+  return type == FIO_CLUSTER_MSG_FORWARD || type == FIO_CLUSTER_MSG_JSON;
+}
+
+/* sets or clears a bit in a shared mask */
+static inline void fio_cluster_shm_mark(volatile uint64_t *mask, uint64_t bit,
+                                        int set) {
+  uint64_t old;
+  do {
+    old = *mask;
+  } while (!fio_atomic_cas(mask, old, (set ? (old | bit) : (old & (~bit)))));
+}
+
+/* the rings interested in a publication */
+static inline uint64_t fio_cluster_shm_interested(fio_msg_internal_s *m) {
+  if (m->filter)
+    return ~(uint64_t)0;
+  const size_t bucket = fio_risky_hash(m->channel.data, m->channel.len, 0) &
+                        (FIO_CLUSTER_SHM_INTEREST - 1);
+  return cluster_shm.interest->channels[bucket] |
+         cluster_shm.interest->patterns;
+}
+
+/* marks (or clears) our ring's interest in a channel */
+static void fio_cluster_shm_interest(channel_s *ch, int add) {
+  if (!cluster_shm.interest || cluster_shm.self >= cluster_shm.count)
+    return;
+  volatile uint64_t *mask = &cluster_shm.interest->patterns;
+  uint32_t *count = &cluster_shm.pattern_count;
+  if (!ch->match) {
+    const size_t bucket =
+        fio_risky_hash(ch->name, ch->name_len, 0) &
+        (FIO_CLUSTER_SHM_INTEREST - 1);
+    mask = cluster_shm.interest->channels + bucket;
+    count = cluster_shm.interest_count + bucket;
+  }
+  fio_lock(&cluster_shm.interest_lock);
+  if (add ? !((*count)++) : (*count && !(--(*count))))
+    fio_cluster_shm_mark(mask, (uint64_t)1 << cluster_shm.self, add);
+  fio_unlock(&cluster_shm.interest_lock);
+}
+
+/* clears a ring's interest in all channels */
+static void fio_cluster_shm_interest_clear(size_t slot) {
+  const uint64_t bit = (uint64_t)1 << slot;
+  fio_cluster_shm_mark(&cluster_shm.interest->patterns, bit, 0);
+  for (size_t i = 0; i < FIO_CLUSTER_SHM_INTEREST; ++i) {
+    if (cluster_shm.interest->channels[i] & bit)
+      fio_cluster_shm_mark(cluster_shm.interest->channels + i, bit, 0);
+  }
+}
+
+/* marks our ring's interest in our (possibly inherited) subscriptions */
+static void fio_cluster_shm_interest_reset(void) {
+  if (!cluster_shm.interest || cluster_shm.self >= cluster_shm.count)
+    return;
+  cluster_shm.interest_lock = FIO_LOCK_INIT;
+  memset(cluster_shm.interest_count, 0,
+         sizeof(*cluster_shm.interest_count) * FIO_CLUSTER_SHM_INTEREST);
+  cluster_shm.pattern_count = 0;
+  fio_cluster_shm_interest_clear(cluster_shm.self);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      fio_cluster_shm_interest(pos->obj, 1);
+    }
+    fio_unlock(&shard->lock);
+  }
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      fio_cluster_shm_interest(pos->obj, 1);
+    }
+    fio_unlock(&shard->lock);
+  }
+}
+
+/* retries pushing messages that didn't fit in a ring */
+static void fio_cluster_shm_flush(void *slot_, void *ignr) {
+  fio_cluster_shm_peer_s *peer = cluster_shm.peers + (uintptr_t)slot_;
+  fio_lock(&peer->lock);
+  while (fio_ls_any(&peer->overflow)) {
+    fio_msg_internal_s *m = (fio_msg_internal_s *)peer->overflow.next->obj;
+    if (fio_data->active && cluster_shm.rings[(uintptr_t)slot_].pid &&
+        fio_cluster_ring_push(cluster_shm.rings + (uintptr_t)slot_,
+                              (uint32_t)cluster_shm.self, m, &peer->offset))
+      break;
+    fio_ls_shift(&peer->overflow);
+    fio_msg_internal_free(m);
+    peer->offset = 0;
+  }
+  peer->flushing = fio_ls_any(&peer->overflow);
+  fio_unlock(&peer->lock);
+  if (peer->flushing)
+    fio_defer_push_task(fio_cluster_shm_flush, slot_, ignr);
+}
+
+/* pushes a message to a ring, queueing it if the ring is full */
+static void fio_cluster_shm_push(size_t slot, fio_msg_internal_s *m) {
+  fio_cluster_shm_peer_s *peer = cluster_shm.peers + slot;
+  fio_lock(&peer->lock);
+  if (fio_ls_is_empty(&peer->overflow)) {
+    /* a partially pushed frame is completed by `fio_cluster_shm_flush` */
+    peer->offset = 0;
+    if (!fio_cluster_ring_push(cluster_shm.rings + slot,
+                               (uint32_t)cluster_shm.self, m, &peer->offset)) {
+      fio_unlock(&peer->lock);
+      return;
+    }
+  }
+  fio_ls_push(&peer->overflow, fio_msg_internal_dup(m));
+  if (!peer->flushing) {
+    peer->flushing = 1;
+    fio_defer_push_task(fio_cluster_shm_flush, (void *)slot, NULL);
+  }
+  fio_unlock(&peer->lock);
+}
+
+/* drops any queued messages, the ring's consumer is gone */
+static void fio_cluster_shm_peer_clear(fio_cluster_shm_peer_s *peer) {
+  fio_lock(&peer->lock);
+  while (fio_ls_any(&peer->overflow))
+    fio_msg_internal_free(fio_ls_shift(&peer->overflow));
+  peer->offset = 0;
+  fio_unlock(&peer->lock);
+}
+
+/**
+ * Worker: routes a publication using the rings. Returns -1 if the socket should
+ * be used instead.
+ */
+static int fio_cluster_shm_route(fio_msg_internal_s *m) {
+  if (!cluster_shm.interest || !fio_cluster_shm_is_forward(m)) {
+    fio_cluster_shm_push(0, m);
+    return 0;
+  }
+  if (cluster_shm.interest->unlinked)
+    return -1; /* some workers can only be reached by the root process */
+  /* route the publication directly to the interested processes */
+  uint64_t mask = fio_cluster_shm_interested(m) &
+                  (~((uint64_t)1 << cluster_shm.self));
+  for (size_t i = 0; mask && i < cluster_shm.count; ++i, mask >>= 1) {
+    if ((mask & 1) && cluster_shm.rings[i].pid > 0)
+      fio_cluster_shm_push(i, m);
+  }
+  return 0;
+}
+
+/**
+ * Worker: sends a message to the root process. Returns -1 if the socket should
+ * be used instead.
+ *
+ * Publications sent before the root process acknowledged our ring are kept
+ * until the acknowledgement arrives (see `fio_cluster_shm_on_ack`).
+ */
+static int fio_cluster_shm_send2root(fio_msg_internal_s *m) {
+  if (cluster_shm.self >= cluster_shm.count || !cluster_shm.self ||
+      !fio_cluster_shm_is_publication(m))
+    return -1;
+  if (!cluster_shm.ready) {
+    if (!fio_data->active)
+      return -1;
+    fio_lock(&cluster_shm.waiting_lock);
+    if (!cluster_shm.ready) {
+      fio_ls_push(&cluster_shm.waiting, fio_msg_internal_dup(m));
+      fio_unlock(&cluster_shm.waiting_lock);
+      return 0;
+    }
+    fio_unlock(&cluster_shm.waiting_lock);
+  }
+  return fio_cluster_shm_route(m);
+}
+
+/**
+ * Root: sends a message to a worker's connection. Returns -1 if the socket
+ * should be used instead. Call while holding `cluster_data.lock`.
+ */
+static int fio_cluster_shm_send2worker(intptr_t uuid, fio_msg_internal_s *m) {
+  if (!cluster_shm.rings || !fio_cluster_shm_is_publication(m))
+    return -1;
+  for (size_t i = 1; i < cluster_shm.count; ++i) {
+    if (cluster_shm.peers[i].uuid == uuid) {
+      if (!cluster_shm.interest || ((fio_cluster_shm_interested(m) >> i) & 1))
+        fio_cluster_shm_push(i, m);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void fio_cluster_server_sender(void *m_, intptr_t avoid_uuid);
+
+/* root: handles a publication from a worker (relaying it, unless direct) */
+static void fio_cluster_shm_on_root_message(uint32_t sender,
+                                            fio_msg_internal_s *m) {
+  if (!cluster_shm.interest && fio_cluster_shm_is_forward(m)) {
+    intptr_t avoid = -1;
+    if (sender && sender < cluster_shm.count)
+      avoid = cluster_shm.peers[sender].uuid;
+    fio_cluster_server_sender(fio_msg_internal_dup(m), avoid);
+  }
+  fio_publish2process(fio_msg_internal_dup(m));
+}
+
+/* worker: handles a publication from the root process */
+static void fio_cluster_shm_on_worker_message(uint32_t sender,
+                                              fio_msg_internal_s *m) {
+  fio_publish2process(fio_msg_internal_dup(m));
+  (void)sender;
+}
+
+/* pops the messages in our ring */
+static void fio_cluster_shm_drain(void) {
+  if (cluster_shm.self >= cluster_shm.count ||
+      (cluster_shm.self && !cluster_shm.ready))
+    return;
+  fio_cluster_ring_s *r = cluster_shm.rings + cluster_shm.self;
+  do {
+    if (fio_trylock(&cluster_shm.consumer))
+      return; /* the consumer reads until the ring is empty */
+    fio_cluster_ring_drain(r, (cluster_shm.self
+                                   ? fio_cluster_shm_on_worker_message
+                                   : fio_cluster_shm_on_root_message));
+    fio_unlock(&cluster_shm.consumer);
+    /*
+     * a producer might have pushed (and rung the bell) after the ring was found
+     * empty but before the lock was released, in which case the `on_data`
+     * event failed to lock the consumer and nobody would read the record.
+     */
+    __sync_synchronize();
+  } while (r->head != r->tail);
+}
+
+static void fio_cluster_shm_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  uint64_t tmp;
+  if (read(fio_uuid2fd(uuid), &tmp, sizeof(tmp)) < 0) {
+    /* EAGAIN - the doorbell was already cleared */
+  }
+  fio_cluster_shm_drain();
+  (void)pr;
+}
+
+static void fio_cluster_shm_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  free(pr);
+  (void)uuid;
+}
+
+/* attaches a copy of our ring's doorbell to the reactor */
+static void fio_cluster_shm_listen(void) {
+  int fd = dup(cluster_shm.rings[cluster_shm.self].bell);
+  if (fd == -1) {
+    FIO_LOG_WARNING("(%d) cluster shared memory doorbell unavailable, using "
+                    "the cluster socket.",
+                    (int)getpid());
+    cluster_shm.self = cluster_shm.count;
+    return;
+  }
+  fio_protocol_s *p = malloc(sizeof(*p));
+  FIO_ASSERT_ALLOC(p);
+  *p = (fio_protocol_s){
+      .on_data = fio_cluster_shm_on_data,
+      .on_shutdown = mock_on_shutdown_eternal,
+      .ping = mock_ping_eternal,
+      .on_close = fio_cluster_shm_on_close,
+  };
+  fio_attach_fd(fd, p);
+}
+
+/* root: releases the shared memory rings */
+static void fio_cluster_shm_destroy(void) {
+  if (!cluster_shm.rings)
+    return;
+  fio_lock(&cluster_shm.assign_lock);
+  for (size_t i = 0; i < cluster_shm.count; ++i) {
+    if (cluster_shm.rings[i].bell != -1)
+      close(cluster_shm.rings[i].bell);
+    fio_cluster_shm_peer_clear(cluster_shm.peers + i);
+  }
+  fio_cluster_shm_pieces_clear();
+  munmap(cluster_shm.rings, sizeof(*cluster_shm.rings) * cluster_shm.count);
+  free(cluster_shm.peers);
+  free(cluster_shm.pieces);
+  if (cluster_shm.interest) {
+    munmap(cluster_shm.interest, sizeof(*cluster_shm.interest));
+    free(cluster_shm.interest_count);
+  }
+  cluster_shm.rings = NULL;
+  cluster_shm.peers = NULL;
+  cluster_shm.pieces = NULL;
+  cluster_shm.interest = NULL;
+  cluster_shm.interest_count = NULL;
+  cluster_shm.count = cluster_shm.self = cluster_shm.assigned = 0;
+  fio_unlock(&cluster_shm.assign_lock);
+}
+
+/* root: maps a ring for the root process and for every worker (pre-fork) */
+static void fio_cluster_shm_init(void) {
+  fio_cluster_shm_destroy();
+  if (fio_data->workers <= 1)
+    return;
+  const size_t count = (size_t)fio_data->workers + 1;
+  void *mem = mmap(NULL, sizeof(*cluster_shm.rings) * count,
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    FIO_LOG_WARNING("cluster shared memory unavailable, using the cluster "
+                    "socket.");
+    return;
+  }
+  cluster_shm.rings = mem;
+  cluster_shm.peers = calloc(count, sizeof(*cluster_shm.peers));
+  cluster_shm.pieces = calloc(count, sizeof(*cluster_shm.pieces));
+  FIO_ASSERT_ALLOC(cluster_shm.peers && cluster_shm.pieces);
+  cluster_shm.count = count;
+  cluster_shm.self = 0;
+  cluster_shm.assigned = count;
+  cluster_shm.ready = 1;
+  cluster_shm.consumer = FIO_LOCK_INIT;
+  for (size_t i = 0; i < count; ++i) {
+    /* the mapping is zeroed, so the indexes are initialized */
+    cluster_shm.rings[i].bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    cluster_shm.peers[i] = (fio_cluster_shm_peer_s){
+        .overflow = FIO_LS_INIT(cluster_shm.peers[i].overflow),
+        .uuid = -1,
+        .lock = FIO_LOCK_INIT,
+    };
+    if (cluster_shm.rings[i].bell == -1 ||
+        fio_cluster_ring_lock_init(cluster_shm.rings + i)) {
+      FIO_LOG_WARNING("cluster shared memory ring unavailable, using the "
+                      "cluster socket.");
+      fio_cluster_shm_destroy();
+      return;
+    }
+  }
+  cluster_shm.rings[0].pid = getpid();
+  if (FIO_CLUSTER_DIRECT && count <= 64) {
+    mem = mmap(NULL, sizeof(*cluster_shm.interest), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED) {
+      cluster_shm.interest = mem;
+      cluster_shm.interest_count =
+          calloc(FIO_CLUSTER_SHM_INTEREST, sizeof(*cluster_shm.interest_count));
+      FIO_ASSERT_ALLOC(cluster_shm.interest_count);
+      fio_cluster_shm_interest_reset();
+    }
+  }
+  fio_cluster_shm_listen();
+}
+
+/* worker: resets the process local data (after forking) */
+static void fio_cluster_shm_on_fork(void) {
+  for (size_t i = 0; i < cluster_shm.count; ++i) {
+    cluster_shm.peers[i].overflow =
+        (fio_ls_s)FIO_LS_INIT(cluster_shm.peers[i].overflow);
+    cluster_shm.peers[i].offset = 0;
+    cluster_shm.peers[i].uuid = -1;
+    cluster_shm.peers[i].lock = FIO_LOCK_INIT;
+    cluster_shm.peers[i].flushing = 0;
+  }
+  fio_cluster_shm_pieces_clear();
+  /* the ring the root process reserved before forking (if any) */
+  cluster_shm.self = cluster_shm.assigned;
+  cluster_shm.assigned = cluster_shm.count;
+  cluster_shm.ready = 0;
+  cluster_shm.consumer = FIO_LOCK_INIT;
+  cluster_shm.waiting = (fio_ls_s)FIO_LS_INIT(cluster_shm.waiting);
+  cluster_shm.waiting_lock = FIO_LOCK_INIT;
+  cluster_shm.assign_lock = FIO_LOCK_INIT;
+}
+
+/* root: reserves a free ring for the worker about to be forked */
+static void fio_cluster_shm_reserve(void) {
+  fio_lock(&cluster_shm.assign_lock);
+  cluster_shm.assigned = cluster_shm.count;
+  for (size_t i = 1; i < cluster_shm.count; ++i) {
+    if (!cluster_shm.rings[i].pid) {
+      cluster_shm.rings[i].pid = -1;
+      cluster_shm.assigned = i;
+      break;
+    }
+  }
+  fio_unlock(&cluster_shm.assign_lock);
+}
+
+/* root: assigns the reserved ring to the forked worker, returning the ring */
+static size_t fio_cluster_shm_assign(pid_t pid) {
+  fio_lock(&cluster_shm.assign_lock);
+  const size_t slot = cluster_shm.assigned;
+  cluster_shm.assigned = cluster_shm.count;
+  if (slot < cluster_shm.count)
+    cluster_shm.rings[slot].pid = (pid > 0 ? pid : 0);
+  fio_unlock(&cluster_shm.assign_lock);
+  return slot;
+}
+
+/* root: releases the ring of a worker that was reaped */
+static void fio_cluster_shm_release(size_t slot) {
+  fio_lock(&cluster_shm.assign_lock);
+  if (slot && slot < cluster_shm.count) {
+    fio_cluster_ring_s *r = cluster_shm.rings + slot;
+    if (cluster_shm.interest)
+      fio_cluster_shm_interest_clear(slot);
+    /* discard records left for the worker */
+    fio_cluster_ring_lock(r);
+    r->head = r->tail;
+    fio_cluster_ring_unlock(r);
+    r->pid = 0;
+  }
+  fio_unlock(&cluster_shm.assign_lock);
+}
+
+/* worker: starts consuming the ring assigned by the root process */
+static void fio_cluster_shm_claim(void) {
+  if (cluster_shm.self >= cluster_shm.count)
+    return;
+  cluster_shm.rings[cluster_shm.self].pid = getpid();
+  fio_cluster_shm_listen();
+  fio_cluster_shm_interest_reset();
+}
+
+/* worker: asks the root process to send publications using our ring */
+static void fio_cluster_shm_attach(intptr_t uuid) {
+  if (cluster_shm.self >= cluster_shm.count)
+    return;
+  char buf[4];
+  fio_u2str32((uint8_t *)buf, (uint32_t)cluster_shm.self);
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_SHM, (fio_str_info_s){.len = 0},
+      (fio_str_info_s){.data = buf, .len = 4}, 0, 1);
+  fio_cluster_send(uuid, m);
+  fio_msg_internal_free(m);
+}
+
+/* root: links a worker's ring to the worker's connection, acknowledging it */
+static void fio_cluster_shm_link(intptr_t uuid, fio_msg_internal_s *m) {
+  if (!cluster_shm.rings || m->data.len != 4)
+    return;
+  uint32_t slot = fio_str2u32(m->data.data);
+  if (!slot || slot >= cluster_shm.count)
+    return;
+  fio_lock(&cluster_data.lock);
+  if (cluster_shm.interest && cluster_shm.peers[slot].uuid != uuid)
+    fio_atomic_sub(&cluster_shm.interest->unlinked, 1);
+  cluster_shm.peers[slot].uuid = uuid;
+  fio_unlock(&cluster_data.lock);
+  /* publications sent after this message will use the ring */
+  fio_cluster_send(uuid, m);
+}
+
+/* root: a worker connected, it can't be reached directly until it's linked */
+static void fio_cluster_shm_on_accept(void) {
+  if (cluster_shm.interest)
+    fio_atomic_add(&cluster_shm.interest->unlinked, 1);
+}
+
+/*
+ * root: unlinks a worker's ring when the worker's connection is closed (the
+ * ring is released once the worker was reaped).
+ */
+static void fio_cluster_shm_unlink(intptr_t uuid) {
+  if (!cluster_shm.rings)
+    return;
+  uint8_t linked = 0;
+  fio_lock(&cluster_data.lock);
+  for (size_t i = 1; i < cluster_shm.count; ++i) {
+    fio_cluster_shm_peer_s *peer = cluster_shm.peers + i;
+    if (peer->uuid != uuid)
+      continue;
+    linked = 1;
+    peer->uuid = -1;
+    fio_cluster_shm_peer_clear(peer);
+  }
+  if (!linked && cluster_shm.interest)
+    fio_atomic_sub(&cluster_shm.interest->unlinked, 1);
+  fio_unlock(&cluster_data.lock);
+}
+
+/* worker: the root process acknowledged our ring, send waiting messages */
+static void fio_cluster_shm_on_ack(void) {
+  fio_lock(&cluster_shm.waiting_lock);
+  while (fio_ls_any(&cluster_shm.waiting)) {
+    fio_msg_internal_s *m = fio_ls_shift(&cluster_shm.waiting);
+    if (fio_cluster_shm_route(m))
+      fio_cluster_send(cluster_data.uuid, m);
+    fio_msg_internal_free(m);
+  }
+  cluster_shm.ready = 1;
+  fio_unlock(&cluster_shm.waiting_lock);
+  fio_cluster_shm_drain();
+}
+
+/* worker: drops messages that were never sent (the worker is exiting) */
+static void fio_cluster_shm_on_exit(void) {
+  fio_lock(&cluster_shm.waiting_lock);
+  while (fio_ls_any(&cluster_shm.waiting))
+    fio_msg_internal_free(fio_ls_shift(&cluster_shm.waiting));
+  fio_unlock(&cluster_shm.waiting_lock);
+  for (size_t i = 0; i < cluster_shm.count; ++i)
+    fio_cluster_shm_peer_clear(cluster_shm.peers + i);
+  fio_cluster_shm_pieces_clear();
+}
+
+/* root: marks the root's ring as closed before the connections are closed */
+static void fio_cluster_shm_stop(void) {
+  if (cluster_shm.rings)
+    fio_atomic_xchange(&cluster_shm.rings[0].pid, 0);
+}
+
+/*
+ * worker: tests if the root process is shutting down.
+ *
+ * The connection might be closed before the shutdown message was read (the
+ * remaining data is discarded once the peer hangs up), which shouldn't be
+ * mistaken for a crash.
+ */
+static int fio_cluster_shm_is_stopping(void) {
+  return cluster_shm.rings && !cluster_shm.rings[0].pid;
+}
+
+#else /* FIO_CLUSTER_SHM */
+
+#define fio_cluster_shm_send2root(m) (-1)
+#define fio_cluster_shm_send2worker(uuid, m) (-1)
+#define fio_cluster_shm_init()
+#define fio_cluster_shm_destroy()
+#define fio_cluster_shm_on_fork()
+#define fio_cluster_shm_claim()
+#define fio_cluster_shm_on_exit()
+#define fio_cluster_shm_attach(uuid)
+#define fio_cluster_shm_link(uuid, m)
+#define fio_cluster_shm_on_accept()
+#define fio_cluster_shm_unlink(uuid)
+#define fio_cluster_shm_on_ack()
+#define fio_cluster_shm_stop()
+#define fio_cluster_shm_is_stopping() 0
+
+static void fio_cluster_shm_interest(channel_s *ch, int add) {
+  (void)ch;
+  (void)add;
+}
+
+static void fio_cluster_shm_reserve(void) {}
+static size_t fio_cluster_shm_assign(pid_t pid) {
+  (void)pid;
+  return 0;
+}
+static void fio_cluster_shm_release(size_t slot) { (void)slot; }
+
+#endif /* FIO_CLUSTER_SHM */
+
+static void fio_cluster_data_cleanup(int delete_file) {
+  if (delete_file && cluster_data.name[0]) {
+#if DEBUG
+    FIO_LOG_DEBUG("(%d) unlinking cluster's Unix socket.", (int)getpid());
+#endif
+    unlink(cluster_data.name);
+  }
+  while (fio_ls_any(&cluster_data.clients)) {
+    intptr_t uuid = (intptr_t)fio_ls_pop(&cluster_data.clients);
+    if (uuid > 0) {
+      fio_close(uuid);
+    }
+  }
+  cluster_data.uuid = 0;
+  cluster_data.lock = FIO_LOCK_INIT;
+  cluster_data.clients = (fio_ls_s)FIO_LS_INIT(cluster_data.clients);
+}
+
+static void fio_cluster_cleanup(void *ignore) {
+  /* cleanup the cluster data */
+  fio_cluster_data_cleanup(fio_parent_pid() == getpid());
+  if (fio_parent_pid() == getpid())
+    fio_cluster_shm_destroy();
+  else
+    fio_cluster_shm_on_exit();
+  (void)ignore;
+}
+
+static void fio_cluster_init(void) {
+  fio_cluster_data_cleanup(0);
+  /* create a unique socket name */
+  char *tmp_folder = getenv("TMPDIR");
+  uint32_t tmp_folder_len = 0;
+  if (!tmp_folder || ((tmp_folder_len = (uint32_t)strlen(tmp_folder)) >
+                      (FIO_CLUSTER_NAME_LIMIT - 28))) {
+#ifdef P_tmpdir
+    tmp_folder = (char *)P_tmpdir;
+    if (tmp_folder)
+      tmp_folder_len = (uint32_t)strlen(tmp_folder);
+#else
+    tmp_folder = "/tmp/";
+    tmp_folder_len = 5;
+#endif
+  }
+  if (tmp_folder_len >= (FIO_CLUSTER_NAME_LIMIT - 28)) {
+    tmp_folder_len = 0;
+  }
+  if (tmp_folder_len) {
+    memcpy(cluster_data.name, tmp_folder, tmp_folder_len);
+    if (cluster_data.name[tmp_folder_len - 1] != '/')
+      cluster_data.name[tmp_folder_len++] = '/';
+  }
+  memcpy(cluster_data.name + tmp_folder_len, "facil-io-sock-", 14);
+  tmp_folder_len += 14;
+  tmp_folder_len +=
+      snprintf(cluster_data.name + tmp_folder_len,
+               FIO_CLUSTER_NAME_LIMIT - tmp_folder_len, "%d", (int)getpid());
   cluster_data.name[tmp_folder_len] = 0;
 
   /* remove if existing */
@@ -5922,6 +9036,8 @@ static inline void fio_cluster_protocol_free(void *pr) { fio_free(pr); }
 
 static uint8_t fio_cluster_on_shutdown(intptr_t uuid, fio_protocol_s *pr_) {
   cluster_pr_s *p = (cluster_pr_s *)pr_;
+  if (!fio_data->is_worker)
+    fio_cluster_shm_stop();
   p->sender(fio_msg_internal_create(0, FIO_CLUSTER_MSG_SHUTDOWN,
                                     (fio_str_info_s){.len = 0},
                                     (fio_str_info_s){.len = 0}, 0, 1),
@@ -5941,12 +9057,17 @@ static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_) {
   i = 0;
   do {
     if (!c->exp_channel && !c->exp_msg) {
-      if (c->length - i < 16)
+      fio_str_info_s ch = {.data = NULL};
+      const size_t header =
+          fio_cluster_frame_parse(c, c->buffer + i, c->length - i, &ch);
+      if (!header) {
+        if (c->length - i >= CLUSTER_FRAME_MAX_HEADER) {
+          FIO_LOG_FATAL("(%d) cluster message header corrupted\n",
+                        (int)getpid());
+          exit(1);
+        }
         break;
-      c->exp_channel = fio_str2u32(c->buffer + i) + 1;
-      c->exp_msg = fio_str2u32(c->buffer + i + 4) + 1;
-      c->type = fio_str2u32(c->buffer + i + 8);
-      c->filter = (int32_t)fio_str2u32(c->buffer + i + 12);
+      }
       if (c->exp_channel) {
         if (c->exp_channel >= (1024 * 1024 * 16) + 1) {
           FIO_LOG_FATAL("(%d) cluster message name too long (16Mb limit): %u\n",
@@ -5966,13 +9087,19 @@ static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_) {
       c->msg = fio_msg_internal_create(
           c->filter, c->type,
           (fio_str_info_s){.data = (char *)(c->msg + 1),
-                           .len = c->exp_channel - 1},
+                           .len = (c->exp_channel ? c->exp_channel - 1
+                                                  : ch.len)},
           (fio_str_info_s){.data = ((char *)(c->msg + 1) + c->exp_channel + 1),
                            .len = c->exp_msg - 1},
           (int8_t)(c->type == FIO_CLUSTER_MSG_JSON ||
                    c->type == FIO_CLUSTER_MSG_ROOT_JSON),
           0);
-      i += 16;
+      if (ch.len) {
+        /* the channel name was taken from the dictionary */
+        memcpy(c->msg->channel.data, ch.data, ch.len);
+        c->msg->channel.data[ch.len] = 0;
+      }
+      i += header;
     }
     if (c->exp_channel) {
       if (c->exp_channel + i > c->length) {
@@ -5990,6 +9117,12 @@ static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_) {
         c->exp_channel = 0;
       }
     }
+#if FIO_CLUSTER_COMPACT
+    if (c->define) {
+      fio_cluster_dict_set(c->dict_in + (c->define - 1), c->msg->channel);
+      c->define = 0;
+    }
+#endif
     if (c->exp_msg) {
       if (c->exp_msg + i > c->length) {
         memcpy(c->msg->data.data + ((c->msg->data.len + 1) - c->exp_msg),
@@ -6020,7 +9153,7 @@ static void fio_cluster_ping(intptr_t uuid, fio_protocol_s *pr_) {
   fio_msg_internal_s *m = fio_msg_internal_create(
       0, FIO_CLUSTER_MSG_PING, (fio_str_info_s){.len = 0},
       (fio_str_info_s){.len = 0}, 0, 1);
-  fio_msg_internal_send_dup(uuid, m);
+  fio_cluster_send(uuid, m);
   fio_msg_internal_free(m);
   (void)pr_;
 }
@@ -6037,9 +9170,14 @@ static void fio_cluster_on_close(intptr_t uuid, fio_protocol_s *pr_) {
       }
     }
     fio_unlock(&cluster_data.lock);
+    fio_cluster_shm_unlink(uuid);
   } else if (fio_data->active) {
     /* no shutdown message received - parent crashed. */
-    if (c->type != FIO_CLUSTER_MSG_SHUTDOWN && fio_is_running()) {
+    if (c->type != FIO_CLUSTER_MSG_SHUTDOWN && fio_is_running() &&
+        fio_cluster_shm_is_stopping()) {
+      /* the shutdown message was discarded with the connection */
+      fio_stop();
+    } else if (c->type != FIO_CLUSTER_MSG_SHUTDOWN && fio_is_running()) {
       FIO_LOG_FATAL("(%d) Parent Process crash detected!", (int)getpid());
       fio_state_callback_force(FIO_CALL_ON_PARENT_CRUSH);
       fio_state_callback_clear(FIO_CALL_ON_PARENT_CRUSH);
@@ -6050,6 +9188,13 @@ static void fio_cluster_on_close(intptr_t uuid, fio_protocol_s *pr_) {
   if (c->msg)
     fio_msg_internal_free(c->msg);
   c->msg = NULL;
+  if (c->out)
+    fio_free(c->out);
+  c->out = NULL;
+#if FIO_CLUSTER_COMPACT
+  fio_cluster_dict_free(c->dict_out);
+  fio_cluster_dict_free(c->dict_in);
+#endif
   fio_sub_hash_free(&c->pubsub);
   fio_cluster_protocol_free(c);
   (void)uuid;
@@ -6088,8 +9233,9 @@ static void fio_cluster_server_sender(void *m_, intptr_t avoid_uuid) {
   fio_lock(&cluster_data.lock);
   FIO_LS_FOR(&cluster_data.clients, pos) {
     if ((intptr_t)pos->obj != -1) {
-      if ((intptr_t)pos->obj != avoid_uuid) {
-        fio_msg_internal_send_dup((intptr_t)pos->obj, m);
+      if ((intptr_t)pos->obj != avoid_uuid &&
+          fio_cluster_shm_send2worker((intptr_t)pos->obj, m)) {
+        fio_cluster_send((intptr_t)pos->obj, m);
       }
     }
   }
@@ -6097,6 +9243,53 @@ static void fio_cluster_server_sender(void *m_, intptr_t avoid_uuid) {
   fio_msg_internal_free(m);
 }
 
+/* root: subscribes to (or unsubscribes from) a channel used by a worker */
+static void fio_cluster_server_subscription(cluster_pr_s *pr,
+                                            fio_str_info_s channel,
+                                            fio_match_fn match, int add) {
+  fio_sub_hash_s *hash = (match ? &pr->patterns : &pr->pubsub);
+  subscription_s *s = NULL;
+  if (add)
+    s = fio_subscribe(.on_message = fio_mock_on_message, .match = match,
+                      .channel = channel);
+  fio_str_s tmp =
+      FIO_STR_INIT_EXISTING(channel.data, channel.len, 0); // don't free
+  uint64_t hashed = FIO_HASH_FN(channel.data, channel.len,
+                                &fio_postoffice.pubsub, &fio_postoffice.pubsub);
+  fio_lock(&pr->lock);
+  if (add)
+    fio_sub_hash_insert(hash, hashed, tmp, s, NULL);
+  else
+    fio_sub_hash_remove(hash, hashed, tmp, NULL);
+  fio_unlock(&pr->lock);
+}
+
+/* root: handles a batch of channel changes (see `fio_cluster_churn_msg`) */
+static void fio_cluster_server_subscription_batch(cluster_pr_s *pr,
+                                                  fio_str_info_s data) {
+  size_t pos = 0;
+  while (pos + 5 <= data.len) {
+    const uint8_t flags = (uint8_t)data.data[pos];
+    fio_str_info_s channel = {.len = fio_str2u32(data.data + pos + 1)};
+    fio_match_fn match = NULL;
+    pos += 5;
+    if ((flags & 2)) {
+      if (pos + 8 > data.len)
+        break;
+      match = (fio_match_fn)fio_str2u64(data.data + pos);
+      pos += 8;
+    }
+    if (channel.len > data.len - pos)
+      break;
+    channel.data = data.data + pos;
+    pos += channel.len;
+    fio_cluster_server_subscription(pr, channel, match, (flags & 1));
+  }
+  if (pos != data.len)
+    FIO_LOG_ERROR("(%d) cluster subscription batch corrupted",
+                  (int)getpid());
+}
+
 static void fio_cluster_server_handler(struct cluster_pr_s *pr) {
   /* what to do? */
   // fprintf(stderr, "-");
@@ -6109,63 +9302,22 @@ static void fio_cluster_server_handler(struct cluster_pr_s *pr) {
     break;
   }
 
-  case FIO_CLUSTER_MSG_PUBSUB_SUB: {
-    subscription_s *s =
-        fio_subscribe(.on_message = fio_mock_on_message, .match = NULL,
-                      .channel = pr->msg->channel);
-    fio_str_s tmp = FIO_STR_INIT_EXISTING(
-        pr->msg->channel.data, pr->msg->channel.len, 0); // don't free
-    fio_lock(&pr->lock);
-    fio_sub_hash_insert(&pr->pubsub,
-                        FIO_HASH_FN(pr->msg->channel.data, pr->msg->channel.len,
-                                    &fio_postoffice.pubsub,
-                                    &fio_postoffice.pubsub),
-                        tmp, s, NULL);
-    fio_unlock(&pr->lock);
-    break;
-  }
-  case FIO_CLUSTER_MSG_PUBSUB_UNSUB: {
-    fio_str_s tmp = FIO_STR_INIT_EXISTING(
-        pr->msg->channel.data, pr->msg->channel.len, 0); // don't free
-    fio_lock(&pr->lock);
-    fio_sub_hash_remove(&pr->pubsub,
-                        FIO_HASH_FN(pr->msg->channel.data, pr->msg->channel.len,
-                                    &fio_postoffice.pubsub,
-                                    &fio_postoffice.pubsub),
-                        tmp, NULL);
-    fio_unlock(&pr->lock);
+  case FIO_CLUSTER_MSG_PUBSUB_SUB: /* fallthrough */
+  case FIO_CLUSTER_MSG_PUBSUB_UNSUB:
+    fio_cluster_server_subscription(pr, pr->msg->channel, NULL,
+                                    pr->type == FIO_CLUSTER_MSG_PUBSUB_SUB);
     break;
-  }
 
-  case FIO_CLUSTER_MSG_PATTERN_SUB: {
-    uintptr_t match = fio_str2u64(pr->msg->data.data);
-    subscription_s *s = fio_subscribe(.on_message = fio_mock_on_message,
-                                      .match = (fio_match_fn)match,
-                                      .channel = pr->msg->channel);
-    fio_str_s tmp = FIO_STR_INIT_EXISTING(
-        pr->msg->channel.data, pr->msg->channel.len, 0); // don't free
-    fio_lock(&pr->lock);
-    fio_sub_hash_insert(&pr->patterns,
-                        FIO_HASH_FN(pr->msg->channel.data, pr->msg->channel.len,
-                                    &fio_postoffice.pubsub,
-                                    &fio_postoffice.pubsub),
-                        tmp, s, NULL);
-    fio_unlock(&pr->lock);
+  case FIO_CLUSTER_MSG_PATTERN_SUB: /* fallthrough */
+  case FIO_CLUSTER_MSG_PATTERN_UNSUB:
+    fio_cluster_server_subscription(
+        pr, pr->msg->channel, (fio_match_fn)fio_str2u64(pr->msg->data.data),
+        pr->type == FIO_CLUSTER_MSG_PATTERN_SUB);
     break;
-  }
 
-  case FIO_CLUSTER_MSG_PATTERN_UNSUB: {
-    fio_str_s tmp = FIO_STR_INIT_EXISTING(
-        pr->msg->channel.data, pr->msg->channel.len, 0); // don't free
-    fio_lock(&pr->lock);
-    fio_sub_hash_remove(&pr->patterns,
-                        FIO_HASH_FN(pr->msg->channel.data, pr->msg->channel.len,
-                                    &fio_postoffice.pubsub,
-                                    &fio_postoffice.pubsub),
-                        tmp, NULL);
-    fio_unlock(&pr->lock);
+  case FIO_CLUSTER_MSG_PUBSUB_BATCH:
+    fio_cluster_server_subscription_batch(pr, pr->msg->data);
     break;
-  }
 
   case FIO_CLUSTER_MSG_ROOT_JSON:
     pr->type = FIO_CLUSTER_MSG_JSON; /* fallthrough */
@@ -6173,6 +9325,10 @@ static void fio_cluster_server_handler(struct cluster_pr_s *pr) {
     fio_publish2process(fio_msg_internal_dup(pr->msg));
     break;
 
+  case FIO_CLUSTER_MSG_SHM:
+    fio_cluster_shm_link(pr->uuid, pr->msg);
+    break;
+
   case FIO_CLUSTER_MSG_SHUTDOWN: /* fallthrough */
   case FIO_CLUSTER_MSG_ERROR:    /* fallthrough */
   case FIO_CLUSTER_MSG_PING:     /* fallthrough */
@@ -6187,6 +9343,8 @@ static void fio_cluster_listen_accept(intptr_t uuid, fio_protocol_s *protocol) {
   /* prevent `accept` backlog in parent */
   intptr_t client;
   while ((client = fio_accept(uuid)) != -1) {
+    /* counted before attaching, since linking might happen on another thread */
+    fio_cluster_shm_on_accept();
     fio_attach(client,
                fio_cluster_protocol_alloc(client, fio_cluster_server_handler,
                                           fio_cluster_server_sender));
@@ -6233,6 +9391,7 @@ static void fio_listen2cluster(void *ignore) {
   FIO_LOG_DEBUG("(%d) Listening to cluster: %s", (int)getpid(),
                 cluster_data.name);
   fio_attach(cluster_data.uuid, p);
+  fio_cluster_shm_init();
   (void)ignore;
 }
 
@@ -6247,6 +9406,9 @@ static void fio_cluster_client_handler(struct cluster_pr_s *pr) {
   case FIO_CLUSTER_MSG_JSON:
     fio_publish2process(fio_msg_internal_dup(pr->msg));
     break;
+  case FIO_CLUSTER_MSG_SHM:
+    fio_cluster_shm_on_ack();
+    break;
   case FIO_CLUSTER_MSG_SHUTDOWN:
     fio_stop();
   case FIO_CLUSTER_MSG_ERROR:         /* fallthrough */
@@ -6257,6 +9419,7 @@ static void fio_cluster_client_handler(struct cluster_pr_s *pr) {
   case FIO_CLUSTER_MSG_PUBSUB_UNSUB:  /* fallthrough */
   case FIO_CLUSTER_MSG_PATTERN_SUB:   /* fallthrough */
   case FIO_CLUSTER_MSG_PATTERN_UNSUB: /* fallthrough */
+  case FIO_CLUSTER_MSG_PUBSUB_BATCH:  /* fallthrough */
 
   default:
     break;
@@ -6264,13 +9427,17 @@ static void fio_cluster_client_handler(struct cluster_pr_s *pr) {
 }
 static void fio_cluster_client_sender(void *m_, intptr_t ignr_) {
   fio_msg_internal_s *m = m_;
+  /* publications wait for the root's acknowledgement in our ring's queue */
+  if (!fio_cluster_shm_send2root(m))
+    goto finish;
   if (!uuid_is_valid(cluster_data.uuid) && fio_data->active) {
     /* delay message delivery until we have a vaild uuid */
     fio_defer_push_task((void (*)(void *, void *))fio_cluster_client_sender, m_,
                         (void *)ignr_);
     return;
   }
-  fio_msg_internal_send_dup(cluster_data.uuid, m);
+  fio_cluster_send(cluster_data.uuid, m);
+finish:
   fio_msg_internal_free(m);
 }
 
@@ -6288,25 +9455,30 @@ static void fio_cluster_on_connect(intptr_t uuid, void *udata) {
   cluster_data.uuid = uuid;
 
   /* inform root about all existing channels */
-  fio_lock(&fio_postoffice.pubsub.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash) {
-      continue;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash) {
+        continue;
+      }
+      fio_cluster_inform_root_about_channel(pos->obj, 1);
     }
-    fio_cluster_inform_root_about_channel(pos->obj, 1);
+    fio_unlock(&shard->lock);
   }
-  fio_unlock(&fio_postoffice.pubsub.lock);
-  fio_lock(&fio_postoffice.patterns.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
-    if (!pos->hash) {
-      continue;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    fio_lock(&shard->lock);
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash) {
+        continue;
+      }
+      fio_cluster_inform_root_about_channel(pos->obj, 1);
     }
-    fio_cluster_inform_root_about_channel(pos->obj, 1);
+    fio_unlock(&shard->lock);
   }
-  fio_unlock(&fio_postoffice.patterns.lock);
 
   fio_attach(uuid, fio_cluster_protocol_alloc(uuid, fio_cluster_client_handler,
                                               fio_cluster_client_sender));
+  fio_cluster_shm_attach(uuid);
   (void)udata;
 }
 /**
@@ -6327,6 +9499,7 @@ static void fio_connect2cluster(void *ignore) {
   if (cluster_data.uuid)
     fio_force_close(cluster_data.uuid);
   cluster_data.uuid = 0;
+  fio_cluster_shm_claim();
   /* this is called for each child, but not for single a process worker. */
   fio_connect(.address = cluster_data.name, .port = NULL,
               .on_connect = fio_cluster_on_connect,
@@ -6387,6 +9560,60 @@ static inline void fio_cluster_inform_root_about_channel(channel_s *ch,
       -1);
 }
 
+/* the size limit for a single batch of channel changes sent to root */
+#define CLUSTER_CHURN_BATCH_LIMIT (1UL << 20)
+
+/*
+ * Creates a batch message for the leading changes, setting `count` to the
+ * number of changes included. Each change is a flag byte (1 = subscribe, 2 =
+ * pattern), a 4 byte name length, the pattern's matching function (8 bytes,
+ * patterns only) and the channel's name.
+ */
+static fio_msg_internal_s *fio_cluster_churn_msg(fio_pubsub_change_s *changes,
+                                                 size_t *count) {
+  /* collect as many changes as fit in a batch (at least one) */
+  size_t len = 0, i = 0;
+  do {
+    len += 5 + (changes[i].match ? 8 : 0) + changes[i].channel.len;
+    ++i;
+  } while (i < *count &&
+           len + 13 + changes[i].channel.len <= CLUSTER_CHURN_BATCH_LIMIT);
+  *count = i;
+  char *buf = fio_malloc(len);
+  FIO_ASSERT_ALLOC(buf);
+  char *pos = buf;
+  for (i = 0; i < *count; ++i) {
+    pos[0] =
+        (char)((changes[i].subscribe ? 1 : 0) | (changes[i].match ? 2 : 0));
+    fio_u2str32(pos + 1, changes[i].channel.len);
+    pos += 5;
+    if (changes[i].match) {
+      fio_u2str64(pos, (uint64_t)(uintptr_t)changes[i].match);
+      pos += 8;
+    }
+    if (changes[i].channel.len)
+      memcpy(pos, changes[i].channel.data, changes[i].channel.len);
+    pos += changes[i].channel.len;
+  }
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_PUBSUB_BATCH, (fio_str_info_s){.len = 0},
+      (fio_str_info_s){.data = buf, .len = len}, 0, 1);
+  fio_free(buf);
+  return m;
+}
+
+static void fio_cluster_inform_root_about_changes(fio_pubsub_change_s *changes,
+                                                  size_t count) {
+  if (!fio_data->is_worker || fio_data->workers == 1 || !cluster_data.uuid)
+    return;
+  while (count) {
+    size_t batch = count;
+    fio_cluster_client_sender(fio_cluster_churn_msg(changes, &batch), -1);
+    changes += batch;
+    count -= batch;
+  }
+}
+
 /* *****************************************************************************
  * Initialization
  **************************************************************************** */
@@ -6401,38 +9628,47 @@ static void fio_cluster_at_exit(void *ignore) {
   /* unlock all */
   fio_pubsub_on_fork();
   /* clear subscriptions of all types */
-  while (fio_ch_set_count(&fio_postoffice.patterns.channels)) {
-    channel_s *ch = fio_ch_set_last(&fio_postoffice.patterns.channels);
-    while (fio_ls_embd_any(&ch->subscriptions)) {
-      subscription_s *sub =
-          FIO_LS_EMBD_OBJ(subscription_s, node, ch->subscriptions.next);
-      fio_unsubscribe(sub);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    while (fio_ch_set_count(&shard->channels)) {
+      channel_s *ch = fio_ch_set_last(&shard->channels);
+      while (ch->count) {
+        fio_unsubscribe(ch->subs[0]);
+      }
+      fio_ch_set_pop(&shard->channels);
     }
-    fio_ch_set_pop(&fio_postoffice.patterns.channels);
   }
 
-  while (fio_ch_set_count(&fio_postoffice.pubsub.channels)) {
-    channel_s *ch = fio_ch_set_last(&fio_postoffice.pubsub.channels);
-    while (fio_ls_embd_any(&ch->subscriptions)) {
-      subscription_s *sub =
-          FIO_LS_EMBD_OBJ(subscription_s, node, ch->subscriptions.next);
-      fio_unsubscribe(sub);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    while (fio_ch_set_count(&shard->channels)) {
+      channel_s *ch = fio_ch_set_last(&shard->channels);
+      while (ch->count) {
+        fio_unsubscribe(ch->subs[0]);
+      }
+      fio_ch_set_pop(&shard->channels);
     }
-    fio_ch_set_pop(&fio_postoffice.pubsub.channels);
   }
 
-  while (fio_ch_set_count(&fio_postoffice.filters.channels)) {
-    channel_s *ch = fio_ch_set_last(&fio_postoffice.filters.channels);
-    while (fio_ls_embd_any(&ch->subscriptions)) {
-      subscription_s *sub =
-          FIO_LS_EMBD_OBJ(subscription_s, node, ch->subscriptions.next);
-      fio_unsubscribe(sub);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.filters, shard) {
+    while (fio_ch_set_count(&shard->channels)) {
+      channel_s *ch = fio_ch_set_last(&shard->channels);
+      while (ch->count) {
+        fio_unsubscribe(ch->subs[0]);
+      }
+      fio_ch_set_pop(&shard->channels);
     }
-    fio_ch_set_pop(&fio_postoffice.filters.channels);
   }
-  fio_ch_set_free(&fio_postoffice.filters.channels);
-  fio_ch_set_free(&fio_postoffice.patterns.channels);
-  fio_ch_set_free(&fio_postoffice.pubsub.channels);
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.filters, shard) {
+    fio_ch_set_free(&shard->channels);
+  }
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    fio_ch_set_free(&shard->channels);
+  }
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    fio_ch_set_free(&shard->channels);
+  }
+  fio_pattern_prefix_tree_free(&fio_postoffice.pattern_index.glob);
+  free(fio_postoffice.pattern_index.custom);
+  fio_postoffice.pattern_index.custom = NULL;
 
   /* clear engines */
   FIO_PUBSUB_DEFAULT = FIO_PUBSUB_CLUSTER;
@@ -6463,35 +9699,48 @@ Cluster forking handler
 ***************************************************************************** */
 
 static void fio_pubsub_on_fork(void) {
-  fio_postoffice.filters.lock = FIO_LOCK_INIT;
-  fio_postoffice.pubsub.lock = FIO_LOCK_INIT;
-  fio_postoffice.patterns.lock = FIO_LOCK_INIT;
+  fio_postoffice.pattern_index.lock = FIO_LOCK_INIT;
   fio_postoffice.engines.lock = FIO_LOCK_INIT;
   fio_postoffice.meta.lock = FIO_LOCK_INIT;
+  fio_postoffice.churn.lock = FIO_LOCK_INIT;
+  /* the parent process reports its own channel changes */
+  fio_churn_set_free(&fio_postoffice.churn.added);
+  fio_churn_set_free(&fio_postoffice.churn.removed);
+  fio_postoffice.churn.scheduled = 0;
   cluster_data.lock = FIO_LOCK_INIT;
   cluster_data.uuid = 0;
-  FIO_SET_FOR_LOOP(&fio_postoffice.filters.channels, pos) {
-    if (!pos->hash)
-      continue;
-    pos->obj->lock = FIO_LOCK_INIT;
-    FIO_LS_EMBD_FOR(&pos->obj->subscriptions, n) {
-      FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
+  fio_cluster_shm_on_fork();
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.filters, shard) {
+    shard->lock = FIO_LOCK_INIT;
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      pos->obj->lock = FIO_LOCK_INIT;
+      for (size_t i = 0; i < pos->obj->count; ++i) {
+        pos->obj->subs[i]->lock = FIO_LOCK_INIT;
+      }
     }
   }
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash)
-      continue;
-    pos->obj->lock = FIO_LOCK_INIT;
-    FIO_LS_EMBD_FOR(&pos->obj->subscriptions, n) {
-      FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    shard->lock = FIO_LOCK_INIT;
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      pos->obj->lock = FIO_LOCK_INIT;
+      for (size_t i = 0; i < pos->obj->count; ++i) {
+        pos->obj->subs[i]->lock = FIO_LOCK_INIT;
+      }
     }
   }
-  FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
-    if (!pos->hash)
-      continue;
-    pos->obj->lock = FIO_LOCK_INIT;
-    FIO_LS_EMBD_FOR(&pos->obj->subscriptions, n) {
-      FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.patterns, shard) {
+    shard->lock = FIO_LOCK_INIT;
+    FIO_SET_FOR_LOOP(&shard->channels, pos) {
+      if (!pos->hash)
+        continue;
+      pos->obj->lock = FIO_LOCK_INIT;
+      for (size_t i = 0; i < pos->obj->count; ++i) {
+        pos->obj->subs[i]->lock = FIO_LOCK_INIT;
+      }
     }
   }
 }
@@ -6772,6 +10021,20 @@ Allocator default settings
 #define FIO_MEMORY_MAX_SLICES_PER_BLOCK                                        \
   (FIO_MEMORY_BLOCK_SLICES - FIO_MEMORY_BLOCK_START_POS)
 
+/* Selects the arena matching the current CPU core (requires `sched_getcpu`) */
+#ifndef FIO_MEMORY_ARENA_PER_CPU
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#define FIO_MEMORY_ARENA_PER_CPU 1
+#else
+#define FIO_MEMORY_ARENA_PER_CPU 0
+#endif
+#endif
+
+/* The byte limit for recycled big allocations (0 disables the cache) */
+#ifndef FIO_MEMORY_BIG_CACHE_LIMIT
+#define FIO_MEMORY_BIG_CACHE_LIMIT (1UL << 23) /* 8Mb */
+#endif
+
 /* *****************************************************************************
 FIO_FORCE_MALLOC handler
 ***************************************************************************** */
@@ -6797,6 +10060,13 @@ void *fio_realloc2(void *ptr, size_t new_size, size_t copy_length) {
 
 void *fio_mmap(size_t size) { return calloc(size, 1); }
 
+fio_region_s *fio_region_enter(fio_region_s *region) {
+  return NULL;
+  (void)region;
+}
+void fio_region_release(fio_region_s *region) { (void)region; }
+void fio_region_reset(fio_region_s *region) { (void)region; }
+
 void fio_malloc_after_fork(void) {}
 void fio_mem_destroy(void) {}
 void fio_mem_init(void) {}
@@ -6993,10 +10263,12 @@ struct block_node_s {
   fio_ls_embd_s node; /* next block */
 };
 
-/* a per-CPU core "arena" for memory allocations  */
+/* a per-CPU core "arena" for memory allocations (one per cache line) */
 typedef struct {
   block_s *block;
   fio_lock_i lock;
+  uint8_t padding[FIO_MEMORY_CACHE_LINE - sizeof(block_s *) -
+                  sizeof(fio_lock_i)];
 } arena_s;
 
 /* The memory allocators persistent state */
@@ -7015,6 +10287,22 @@ static struct {
 /* The per-CPU arena array. */
 static arena_s *arenas;
 
+#if FIO_MEMORY_BIG_CACHE_LIMIT
+/* a cached big allocation, `size` is the allocation's size header */
+typedef struct big_cache_node_s big_cache_node_s;
+struct big_cache_node_s {
+  size_t size;
+  big_cache_node_s *next;
+};
+
+/* The big allocation cache, mappings are binned by the log2 of their size */
+static struct {
+  big_cache_node_s *bins[(sizeof(size_t) << 3) + 1];
+  size_t total; /* bytes held by the cache */
+  fio_lock_i lock;
+} big_cache = {.lock = FIO_LOCK_INIT};
+#endif
+
 /* The per-CPU arena array. */
 static long double on_malloc_zero;
 
@@ -7052,28 +10340,36 @@ static size_t fio_mem_block_count;
 Per-CPU Arena management
 ***************************************************************************** */
 
-/* returned a locked arena. Attempts the preffered arena first. */
+/* returned a locked arena. Attempts the current CPU's arena first. */
 static inline arena_s *arena_lock(arena_s *preffered) {
+#if FIO_MEMORY_ARENA_PER_CPU
+  const int cpu = sched_getcpu();
+  if (cpu >= 0)
+    preffered = arenas + ((size_t)cpu % memory.cores);
+#endif
   if (!preffered)
     preffered = arenas;
   if (!fio_trylock(&preffered->lock))
     return preffered;
+  /* contention (CPU migration / preemption) - cycle from the next arena */
   do {
     arena_s *arena = preffered;
-    for (size_t i = (size_t)(arena - arenas); i < memory.cores; ++i) {
-      if ((preffered == arenas || arena != preffered) &&
-          !fio_trylock(&arena->lock))
+    for (size_t i = 1; i < memory.cores; ++i) {
+      if (++arena == arenas + memory.cores)
+        arena = arenas;
+      if (!fio_trylock(&arena->lock))
         return arena;
-      ++arena;
     }
-    if (preffered == arenas)
-      fio_reschedule_thread();
-    preffered = arenas;
-  } while (1);
+    fio_reschedule_thread();
+  } while (fio_trylock(&preffered->lock));
+  return preffered;
 }
 
 static __thread arena_s *arena_last_used;
 
+/* The calling thread's active memory region (if any) */
+static __thread fio_region_s *region_active;
+
 static void arena_enter(void) { arena_last_used = arena_lock(arena_last_used); }
 
 static inline void arena_exit(void) { fio_unlock(&arena_last_used->lock); }
@@ -7081,11 +10377,15 @@ static inline void arena_exit(void) { fio_unlock(&arena_last_used->lock); }
 /** Clears any memory locks, in case of a system call to `fork`. */
 void fio_malloc_after_fork(void) {
   arena_last_used = NULL;
+  region_active = NULL;
   if (!arenas) {
     return;
   }
   memory.lock = FIO_LOCK_INIT;
   memory.forked = 1;
+#if FIO_MEMORY_BIG_CACHE_LIMIT
+  big_cache.lock = FIO_LOCK_INIT;
+#endif
   for (size_t i = 0; i < memory.cores; ++i) {
     arenas[i].lock = FIO_LOCK_INIT;
   }
@@ -7182,18 +10482,19 @@ static inline block_s *block_new(void) {
   return blk;
 }
 
-/* allocates memory from within a block - called within an arena's lock */
-static inline void *block_slice(uint16_t units) {
-  block_s *blk = arena_last_used->block;
+/* allocates memory from within a block owned by an arena (within the arena's
+ * lock) or by a region (owned by the calling thread) */
+static inline void *block_slice(block_s **owner, uint16_t units) {
+  block_s *blk = *owner;
   if (!blk) {
     /* arena is empty */
     blk = block_new();
-    arena_last_used->block = blk;
+    *owner = blk;
   } else if (blk->pos + units > FIO_MEMORY_MAX_SLICES_PER_BLOCK) {
     /* not enough memory in the block - rotate */
     block_free(blk);
     blk = block_new();
-    arena_last_used->block = blk;
+    *owner = blk;
   }
   if (!blk) {
     /* no system memory available? */
@@ -7207,7 +10508,7 @@ static inline void *block_slice(uint16_t units) {
   if (blk->pos >= FIO_MEMORY_MAX_SLICES_PER_BLOCK) {
     /* ... the block was fully utilized, clear arena */
     block_free(blk);
-    arena_last_used->block = NULL;
+    *owner = NULL;
   }
   return (void *)mem;
 }
@@ -7219,6 +10520,81 @@ static inline void block_slice_free(void *mem) {
   block_free(blk);
 }
 
+/* *****************************************************************************
+Big allocation cache (recycles recently freed system allocations)
+***************************************************************************** */
+
+#if FIO_MEMORY_BIG_CACHE_LIMIT
+
+/* returns the bin for a specific size (the floor of the size's log2) */
+static inline size_t big_cache_bin(size_t size) {
+  size_t bin = 0;
+  while ((size >>= 1))
+    ++bin;
+  return bin;
+}
+
+/* returns a cached mapping of at least `size` bytes (or NULL) */
+static inline size_t *big_cache_pop(size_t size) {
+  size_t bin = big_cache_bin(size);
+  big_cache_node_s *node;
+  fio_lock(&big_cache.lock);
+  /* the size's own bin might hold smaller mappings, the next bin can't */
+  node = big_cache.bins[bin];
+  if (node && node->size >= size)
+    goto found;
+  node = big_cache.bins[++bin];
+  if (node)
+    goto found;
+  fio_unlock(&big_cache.lock);
+  return NULL;
+found:
+  big_cache.bins[bin] = node->next;
+  big_cache.total -= node->size;
+  fio_unlock(&big_cache.lock);
+  /* allocations are always zeroed (the size header remains) */
+  memset(&node->next, 0, size - sizeof(node->size));
+  return (size_t *)node;
+}
+
+/* caches a mapping (returns -1 if the cache is full) */
+static inline int big_cache_push(size_t *mem) {
+  big_cache_node_s *node = (big_cache_node_s *)mem;
+  if (node->size > (FIO_MEMORY_BIG_CACHE_LIMIT >> 2))
+    return -1;
+  const size_t bin = big_cache_bin(node->size);
+  fio_lock(&big_cache.lock);
+  if (big_cache.total + node->size > FIO_MEMORY_BIG_CACHE_LIMIT) {
+    fio_unlock(&big_cache.lock);
+    return -1;
+  }
+  node->next = big_cache.bins[bin];
+  big_cache.bins[bin] = node;
+  big_cache.total += node->size;
+  fio_unlock(&big_cache.lock);
+  return 0;
+}
+
+/* returns all the cached mappings to the system */
+static void big_cache_clear(void) {
+  fio_lock(&big_cache.lock);
+  for (size_t i = 0; i < (sizeof(size_t) << 3) + 1; ++i) {
+    while (big_cache.bins[i]) {
+      big_cache_node_s *node = big_cache.bins[i];
+      big_cache.bins[i] = node->next;
+      sys_free(node, node->size);
+    }
+  }
+  big_cache.total = 0;
+  fio_unlock(&big_cache.lock);
+}
+
+#else
+#define big_cache_pop(size) ((size_t *)NULL)
+#define big_cache_push(mem) (-1)
+#define big_cache_clear()
+#endif
+
 /* *****************************************************************************
 Non-Block allocations (direct from the system)
 ***************************************************************************** */
@@ -7226,18 +10602,24 @@ Non-Block allocations (direct from the system)
 /* allocates directly from the system adding size header - no lock required. */
 static inline void *big_alloc(size_t size) {
   size = sys_round_size(size + 16);
-  size_t *mem = sys_alloc(size, 1);
+  size_t *mem = big_cache_pop(size);
+  if (mem)
+    goto found;
+  mem = sys_alloc(size, 1);
   if (!mem)
     goto error;
   *mem = size;
+found:
   return (void *)(((uintptr_t)mem) + 16);
 error:
   return NULL;
 }
 
-/* reads size header and frees memory back to the system */
+/* reads size header and frees memory back to the system (or the cache) */
 static inline void big_free(void *ptr) {
   size_t *mem = (void *)(((uintptr_t)ptr) - 16);
+  if (!big_cache_push(mem))
+    return;
   sys_free(mem, *mem);
 }
 
@@ -7301,7 +10683,8 @@ static void fio_mem_init(void) {
   if (cpu_count <= 0)
     cpu_count = 8;
   memory.cores = cpu_count;
-  arenas = big_alloc(sizeof(*arenas) * cpu_count);
+  /* page aligned, so each arena owns a whole cache line */
+  arenas = sys_alloc(sys_round_size(sizeof(*arenas) * cpu_count), 1);
   FIO_ASSERT_ALLOC(arenas);
   block_free(block_new());
   pthread_atfork(NULL, NULL, fio_malloc_after_fork);
@@ -7313,6 +10696,8 @@ static void fio_mem_destroy(void) {
 
   FIO_MEMORY_PRINT_BLOCK_STAT();
 
+  big_cache_clear();
+
   for (size_t i = 0; i < memory.cores; ++i) {
     if (arenas[i].block)
       block_free(arenas[i].block);
@@ -7330,7 +10715,7 @@ static void fio_mem_destroy(void) {
     fio_memory_dump_missing();
 #endif
   }
-  big_free(arenas);
+  sys_free(arenas, sys_round_size(sizeof(*arenas) * memory.cores));
   arenas = NULL;
 }
 /* *****************************************************************************
@@ -7353,8 +10738,10 @@ void *fio_malloc(size_t size) {
   }
   /* ceiling for 16 byte alignement, translated to 16 byte units */
   size = (size >> 4) + (!!(size & 15));
+  if (region_active)
+    return block_slice((block_s **)&region_active->block, size);
   arena_enter();
-  void *mem = block_slice(size);
+  void *mem = block_slice(&arena_last_used->block, size);
   arena_exit();
   return mem;
 }
@@ -7427,6 +10814,50 @@ void *fio_mmap(size_t size) {
   return big_alloc(size);
 }
 
+/* *****************************************************************************
+Memory regions (allocations that share a lifetime)
+***************************************************************************** */
+
+/**
+ * Sets the calling thread's active memory region, returning the previously
+ * active region (or NULL).
+ */
+fio_region_s *fio_region_enter(fio_region_s *region) {
+  fio_region_s *old = region_active;
+  region_active = region;
+  return old;
+}
+
+/**
+ * Releases the region's hold on it's memory block.
+ */
+void fio_region_release(fio_region_s *region) {
+  if (!region || !region->block)
+    return;
+  block_free(region->block);
+  region->block = NULL;
+}
+
+/**
+ * Discards all of the region's allocations at once, keeping it's memory block.
+ */
+void fio_region_reset(fio_region_s *region) {
+  if (!region || !region->block)
+    return;
+  block_s *blk = region->block;
+  /* only the owning thread slices the block, so the count can't grow */
+  const uint16_t ref = blk->ref;
+  fio_atomic_acquire();
+  if (ref != 1) {
+    /* objects outlived the reset, allocations continue after them */
+    return;
+  }
+  /* unused memory is always zero, so only the used part is cleared */
+  memset((void *)((uintptr_t)blk + (FIO_MEMORY_BLOCK_START_POS << 4)), 0,
+         ((size_t)blk->pos - FIO_MEMORY_BLOCK_START_POS) << 4);
+  blk->pos = FIO_MEMORY_BLOCK_START_POS;
+}
+
 /* *****************************************************************************
 FIO_OVERRIDE_MALLOC - override glibc / library malloc
 ***************************************************************************** */
@@ -7681,6 +11112,34 @@ uint64_t fio_siphash13(const void *data, size_t len, uint64_t key1,
   return fio_siphash_xy(data, len, 1, 3, key1, key2);
 }
 
+/* *****************************************************************************
+SHA-1 / SHA-256 - hardware acceleration (SHA-NI) detection
+***************************************************************************** */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(FIO_SHA_NO_SHANI)
+#define FIO_SHA_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+/** Returns 1 if the CPU supports the SHA extensions (tested once). */
+static int fio_sha_shani_available(void) {
+  static int available = -1;
+  if (available == -1) {
+    unsigned int a, b, c, d;
+    int tmp = 0;
+    /* SHA (leaf 7, EBX bit 29), SSSE3 and SSE4.1 (leaf 1, ECX bits 9, 19) */
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1U << 29)) &&
+        __get_cpuid(1, &a, &b, &c, &d) && (c & (1U << 9)) && (c & (1U << 19)))
+      tmp = 1;
+    available = tmp;
+  }
+  return available;
+}
+#else
+#define FIO_SHA_SHANI 0
+#endif
+
 /* *****************************************************************************
 SHA-1
 ***************************************************************************** */
@@ -7812,6 +11271,84 @@ static inline void fio_sha1_perform_all_rounds(fio_sha1_s *s,
   s->digest.i[0] += a;
 }
 
+#if FIO_SHA_SHANI
+/* performs 4 SHA-1 rounds (group `k` of 20), updating the message schedule */
+#define FIO_SHA1_SHANI_ROUNDS4(k)                                              \
+  if ((k) < 4) {                                                               \
+    msg[(k)] = _mm_shuffle_epi8(                                               \
+        _mm_loadu_si128((const __m128i *)(data + ((k) << 4))), mask);          \
+  }                                                                            \
+  if ((k) == 0)                                                                \
+    e[0] = _mm_add_epi32(e[0], msg[0]);                                        \
+  else                                                                         \
+    e[(k)&1] = _mm_sha1nexte_epu32(e[(k)&1], msg[(k)&3]);                      \
+  e[((k) + 1) & 1] = abcd;                                                     \
+  if ((k) >= 3 && (k) <= 18)                                                   \
+    msg[((k) + 1) & 3] = _mm_sha1msg2_epu32(msg[((k) + 1) & 3], msg[(k)&3]);   \
+  abcd = _mm_sha1rnds4_epu32(abcd, e[(k)&1], (k) / 5);                         \
+  if ((k) >= 1 && (k) <= 16)                                                   \
+    msg[((k) + 3) & 3] = _mm_sha1msg1_epu32(msg[((k) + 3) & 3], msg[(k)&3]);   \
+  if ((k) >= 2 && (k) <= 17)                                                   \
+    msg[((k) + 2) & 3] = _mm_xor_si128(msg[((k) + 2) & 3], msg[(k)&3]);
+
+/** Processes `count` 64 byte blocks using the SHA extensions. */
+static __attribute__((target("sha,sse4.1"))) void
+fio_sha1_perform_blocks_shani(fio_sha1_s *s, const uint8_t *data,
+                              size_t count) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128((const __m128i *)s->digest.i), 0x1B);
+  __m128i e_start = _mm_set_epi32((int)s->digest.i[4], 0, 0, 0);
+  __m128i msg[4], e[2];
+  while (count--) {
+    const __m128i abcd_start = abcd;
+    e[0] = e_start;
+    FIO_SHA1_SHANI_ROUNDS4(0);
+    FIO_SHA1_SHANI_ROUNDS4(1);
+    FIO_SHA1_SHANI_ROUNDS4(2);
+    FIO_SHA1_SHANI_ROUNDS4(3);
+    FIO_SHA1_SHANI_ROUNDS4(4);
+    FIO_SHA1_SHANI_ROUNDS4(5);
+    FIO_SHA1_SHANI_ROUNDS4(6);
+    FIO_SHA1_SHANI_ROUNDS4(7);
+    FIO_SHA1_SHANI_ROUNDS4(8);
+    FIO_SHA1_SHANI_ROUNDS4(9);
+    FIO_SHA1_SHANI_ROUNDS4(10);
+    FIO_SHA1_SHANI_ROUNDS4(11);
+    FIO_SHA1_SHANI_ROUNDS4(12);
+    FIO_SHA1_SHANI_ROUNDS4(13);
+    FIO_SHA1_SHANI_ROUNDS4(14);
+    FIO_SHA1_SHANI_ROUNDS4(15);
+    FIO_SHA1_SHANI_ROUNDS4(16);
+    FIO_SHA1_SHANI_ROUNDS4(17);
+    FIO_SHA1_SHANI_ROUNDS4(18);
+    FIO_SHA1_SHANI_ROUNDS4(19);
+    e_start = _mm_sha1nexte_epu32(e[0], e_start);
+    abcd = _mm_add_epi32(abcd, abcd_start);
+    data += 64;
+  }
+  _mm_storeu_si128((__m128i *)s->digest.i, _mm_shuffle_epi32(abcd, 0x1B));
+  s->digest.i[4] = (uint32_t)_mm_extract_epi32(e_start, 3);
+}
+#undef FIO_SHA1_SHANI_ROUNDS4
+#endif
+
+/** Processes `count` 64 byte blocks (using SHA-NI when available). */
+static inline void fio_sha1_perform_blocks(fio_sha1_s *s, const uint8_t *data,
+                                           size_t count) {
+#if FIO_SHA_SHANI
+  if (fio_sha_shani_available()) {
+    fio_sha1_perform_blocks_shani(s, data, count);
+    return;
+  }
+#endif
+  while (count--) {
+    fio_sha1_perform_all_rounds(s, data);
+    data += 64;
+  }
+}
+
 /**
 Initialize or reset the `sha1` object. This must be performed before hashing
 data using sha1.
@@ -7839,15 +11376,15 @@ void fio_sha1_write(fio_sha1_s *s, const void *data, size_t len) {
     memcpy(s->buffer + in_buffer, data, partial);
     len -= partial;
     data = (void *)((uintptr_t)data + partial);
-    fio_sha1_perform_all_rounds(s, s->buffer);
+    fio_sha1_perform_blocks(s, s->buffer, 1);
   }
-  while (len >= 64) {
-    fio_sha1_perform_all_rounds(s, data);
-    data = (void *)((uintptr_t)data + 64);
-    len -= 64;
+  if (len >= 64) {
+    fio_sha1_perform_blocks(s, data, len >> 6);
+    data = (void *)((uintptr_t)data + (len & (~(size_t)63)));
+    len &= 63;
   }
   if (len) {
-    memcpy(s->buffer + in_buffer, data, len);
+    memcpy(s->buffer, data, len);
   }
   return;
 }
@@ -7856,7 +11393,7 @@ char *fio_sha1_result(fio_sha1_s *s) {
   size_t in_buffer = s->length & 63;
   if (in_buffer > 55) {
     memcpy(s->buffer + in_buffer, sha1_padding, 64 - in_buffer);
-    fio_sha1_perform_all_rounds(s, s->buffer);
+    fio_sha1_perform_blocks(s, s->buffer, 1);
     memcpy(s->buffer, sha1_padding + 1, 56);
   } else if (in_buffer != 55) {
     memcpy(s->buffer + in_buffer, sha1_padding, 56 - in_buffer);
@@ -7868,7 +11405,7 @@ char *fio_sha1_result(fio_sha1_s *s) {
   uint64_t *len = (uint64_t *)(s->buffer + 56);
   *len = s->length << 3;
   *len = fio_lton64(*len);
-  fio_sha1_perform_all_rounds(s, s->buffer);
+  fio_sha1_perform_blocks(s, s->buffer, 1);
 
   /* change back to little endian */
   s->digest.i[0] = fio_ntol32(s->digest.i[0]);
@@ -8133,6 +11670,94 @@ static inline void fio_sha2_perform_all_rounds(fio_sha2_s *s,
   }
 }
 
+#if FIO_SHA_SHANI
+/* performs 4 SHA-256 rounds (group `k` of 16), updating the message schedule */
+#define FIO_SHA256_SHANI_ROUNDS4(k)                                            \
+  if ((k) < 4) {                                                               \
+    msg[(k)] = _mm_shuffle_epi8(                                               \
+        _mm_loadu_si128((const __m128i *)(data + ((k) << 4))), mask);          \
+  }                                                                            \
+  tmp = _mm_add_epi32(                                                         \
+      msg[(k)&3],                                                              \
+      _mm_loadu_si128((const __m128i *)(sha2_256_words + ((k) << 2))));        \
+  state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);                         \
+  if ((k) >= 3 && (k) <= 14) {                                                 \
+    msg[((k) + 1) & 3] = _mm_add_epi32(                                        \
+        msg[((k) + 1) & 3],                                                    \
+        _mm_alignr_epi8(msg[(k)&3], msg[((k) + 3) & 3], 4));                   \
+    msg[((k) + 1) & 3] =                                                       \
+        _mm_sha256msg2_epu32(msg[((k) + 1) & 3], msg[(k)&3]);                  \
+  }                                                                            \
+  state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E)); \
+  if ((k) >= 1 && (k) <= 12)                                                   \
+    msg[((k) + 3) & 3] = _mm_sha256msg1_epu32(msg[((k) + 3) & 3], msg[(k)&3]);
+
+/** Processes `count` 64 byte SHA-256 blocks using the SHA extensions. */
+static __attribute__((target("sha,sse4.1"))) void
+fio_sha2_256_perform_blocks_shani(fio_sha2_s *s, const uint8_t *data,
+                                  size_t count) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  /* the SHA extensions expect the state as ABEF / CDGH */
+  __m128i tmp = _mm_shuffle_epi32(
+      _mm_loadu_si128((const __m128i *)s->digest.i32), 0xB1); /* CDAB */
+  __m128i state1 = _mm_shuffle_epi32(
+      _mm_loadu_si128((const __m128i *)(s->digest.i32 + 4)), 0x1B); /* EFGH */
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);         /* CDGH */
+  __m128i msg[4];
+  while (count--) {
+    const __m128i abef = state0;
+    const __m128i cdgh = state1;
+    FIO_SHA256_SHANI_ROUNDS4(0);
+    FIO_SHA256_SHANI_ROUNDS4(1);
+    FIO_SHA256_SHANI_ROUNDS4(2);
+    FIO_SHA256_SHANI_ROUNDS4(3);
+    FIO_SHA256_SHANI_ROUNDS4(4);
+    FIO_SHA256_SHANI_ROUNDS4(5);
+    FIO_SHA256_SHANI_ROUNDS4(6);
+    FIO_SHA256_SHANI_ROUNDS4(7);
+    FIO_SHA256_SHANI_ROUNDS4(8);
+    FIO_SHA256_SHANI_ROUNDS4(9);
+    FIO_SHA256_SHANI_ROUNDS4(10);
+    FIO_SHA256_SHANI_ROUNDS4(11);
+    FIO_SHA256_SHANI_ROUNDS4(12);
+    FIO_SHA256_SHANI_ROUNDS4(13);
+    FIO_SHA256_SHANI_ROUNDS4(14);
+    FIO_SHA256_SHANI_ROUNDS4(15);
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
+  }
+  tmp = _mm_shuffle_epi32(state0, 0x1B);               /* FEBA */
+  state1 = _mm_shuffle_epi32(state1, 0xB1);            /* DCHG */
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);         /* DCBA */
+  state1 = _mm_alignr_epi8(state1, tmp, 8);            /* HGFE */
+  _mm_storeu_si128((__m128i *)s->digest.i32, state0);
+  _mm_storeu_si128((__m128i *)(s->digest.i32 + 4), state1);
+}
+#undef FIO_SHA256_SHANI_ROUNDS4
+#endif
+
+/**
+Processes `count` blocks (64 or 128 bytes, according to the variant), using
+SHA-NI for SHA-224 / SHA-256 when available.
+*/
+static inline void fio_sha2_perform_blocks(fio_sha2_s *s, const uint8_t *data,
+                                           size_t count) {
+#if FIO_SHA_SHANI
+  if (!(s->type & 1) && fio_sha_shani_available()) {
+    fio_sha2_256_perform_blocks_shani(s, data, count);
+    return;
+  }
+#endif
+  const size_t block = (s->type & 1) ? 128 : 64;
+  while (count--) {
+    fio_sha2_perform_all_rounds(s, data);
+    data += block;
+  }
+}
+
 /**
 Initialize/reset the SHA-2 object.
 
@@ -8249,15 +11874,15 @@ void fio_sha2_write(fio_sha2_s *s, const void *data, size_t len) {
       memcpy(s->buffer + in_buffer, data, partial);
       len -= partial;
       data = (void *)((uintptr_t)data + partial);
-      fio_sha2_perform_all_rounds(s, s->buffer);
+      fio_sha2_perform_blocks(s, s->buffer, 1);
     }
-    while (len >= 128) {
-      fio_sha2_perform_all_rounds(s, data);
-      data = (void *)((uintptr_t)data + 128);
-      len -= 128;
+    if (len >= 128) {
+      fio_sha2_perform_blocks(s, data, len >> 7);
+      data = (void *)((uintptr_t)data + (len & (~(size_t)127)));
+      len &= 127;
     }
     if (len) {
-      memcpy(s->buffer + in_buffer, data, len);
+      memcpy(s->buffer, data, len);
     }
     return;
   }
@@ -8276,15 +11901,15 @@ void fio_sha2_write(fio_sha2_s *s, const void *data, size_t len) {
     memcpy(s->buffer + in_buffer, data, partial);
     len -= partial;
     data = (void *)((uintptr_t)data + partial);
-    fio_sha2_perform_all_rounds(s, s->buffer);
+    fio_sha2_perform_blocks(s, s->buffer, 1);
   }
-  while (len >= 64) {
-    fio_sha2_perform_all_rounds(s, data);
-    data = (void *)((uintptr_t)data + 64);
-    len -= 64;
+  if (len >= 64) {
+    fio_sha2_perform_blocks(s, data, len >> 6);
+    data = (void *)((uintptr_t)data + (len & (~(size_t)63)));
+    len &= 63;
   }
   if (len) {
-    memcpy(s->buffer + in_buffer, data, len);
+    memcpy(s->buffer, data, len);
   }
   return;
 }
@@ -8303,7 +11928,7 @@ char *fio_sha2_result(fio_sha2_s *s) {
 
     if (in_buffer > 111) {
       memcpy(s->buffer + in_buffer, sha2_padding, 128 - in_buffer);
-      fio_sha2_perform_all_rounds(s, s->buffer);
+      fio_sha2_perform_blocks(s, s->buffer, 1);
       memcpy(s->buffer, sha2_padding + 1, 112);
     } else if (in_buffer != 111) {
       memcpy(s->buffer + in_buffer, sha2_padding, 112 - in_buffer);
@@ -8329,7 +11954,7 @@ char *fio_sha2_result(fio_sha2_s *s) {
     uint64_t *len = (uint64_t *)(s->buffer + 112);
     len[0] = s->length.words[0];
     len[1] = s->length.words[1];
-    fio_sha2_perform_all_rounds(s, s->buffer);
+    fio_sha2_perform_blocks(s, s->buffer, 1);
 
     /* change back to little endian */
     s->digest.i64[0] = fio_ntol64(s->digest.i64[0]);
@@ -8366,7 +11991,7 @@ char *fio_sha2_result(fio_sha2_s *s) {
   size_t in_buffer = s->length.words[0] & 63;
   if (in_buffer > 55) {
     memcpy(s->buffer + in_buffer, sha2_padding, 64 - in_buffer);
-    fio_sha2_perform_all_rounds(s, s->buffer);
+    fio_sha2_perform_blocks(s, s->buffer, 1);
     memcpy(s->buffer, sha2_padding + 1, 56);
   } else if (in_buffer != 55) {
     memcpy(s->buffer + in_buffer, sha2_padding, 56 - in_buffer);
@@ -8378,7 +12003,7 @@ char *fio_sha2_result(fio_sha2_s *s) {
   uint64_t *len = (uint64_t *)(s->buffer + 56);
   *len = s->length.words[0] << 3;
   *len = fio_lton64(*len);
-  fio_sha2_perform_all_rounds(s, s->buffer);
+  fio_sha2_perform_blocks(s, s->buffer, 1);
 
   /* change back to little endian, if required */
 
@@ -8426,14 +12051,15 @@ s.length.times {|i| a[s[i]] = i };
 s = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+,".bytes;
 s.length.times {|i| a[s[i]] = i };
 s = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_".bytes;
-s.length.times {|i| a[s[i]] = i }; a.map!{ |i| i.to_i }; a
+s.length.times {|i| a[s[i]] = i }; a.map!{ |i| i.to_i };
+a['A'.ord] = 64; a # 0 marks invalid data, so 'A' is stored as 64 (64 & 63 == 0)
 
 */
 static unsigned base64_decodes[] = {
     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
     0,  0,  0,  0,  0,  62, 63, 62, 0,  63, 52, 53, 54, 55, 56, 57, 58, 59, 60,
-    61, 0,  0,  0,  64, 0,  0,  0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10,
+    61, 0,  0,  0,  64, 0,  0,  0,  64, 1,  2,  3,  4,  5,  6,  7,  8,  9,  10,
     11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 0,  0,  0,  0,
     63, 0,  26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42,
     43, 44, 45, 46, 47, 48, 49, 50, 51, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
@@ -8447,6 +12073,220 @@ static unsigned base64_decodes[] = {
 };
 #define BITVAL(x) (base64_decodes[(x)] & 63)
 
+/* *****************************************************************************
+Base64 - SIMD kernels (SSSE3 / AVX2, runtime dispatched)
+***************************************************************************** */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(FIO_BASE64_NO_SIMD)
+#define FIO_BASE64_SIMD 1
+#include <immintrin.h>
+
+/* 0 = portable, 1 = SSSE3, 2 = AVX2 (-1 = not tested yet) */
+static int fio_base64_simd = -1;
+
+/** Returns the SIMD level supported by the CPU (tested once). */
+static inline int fio_base64_simd_level(void) {
+  if (fio_base64_simd == -1) {
+    __builtin_cpu_init();
+    fio_base64_simd = __builtin_cpu_supports("avx2")
+                          ? 2
+                          : (__builtin_cpu_supports("ssse3") ? 1 : 0);
+  }
+  return fio_base64_simd;
+}
+
+/* a 128 bit constant, repeated in each lane */
+#define FIO_BASE64_LANES_mm(a, b, c, d) _mm_set_epi32(a, b, c, d)
+#define FIO_BASE64_LANES_mm256(a, b, c, d)                                       \
+  _mm256_set_epi32(a, b, c, d, a, b, c, d)
+
+/* 12 bytes (in each 128 bit lane) => 16 indexes (Wojciech Muła's method) */
+#define FIO_BASE64_ENC_SPLIT(pfx, si, in)                                         \
+  do {                                                                         \
+    in = pfx##_shuffle_epi8(                                             \
+        in, FIO_BASE64_LANES##pfx(0x0a0b090a, 0x07080607, 0x04050304,       \
+                                    0x01020001));                              \
+    in = pfx##_or_##si(                                              \
+        pfx##_mulhi_epu16(                                               \
+            pfx##_and_##si(in, pfx##_set1_epi32(0x0fc0fc00)),  \
+            pfx##_set1_epi32(0x04000040)),                               \
+        pfx##_mullo_epi16(                                               \
+            pfx##_and_##si(in, pfx##_set1_epi32(0x003f03f0)),  \
+            pfx##_set1_epi32(0x01000010)));                              \
+  } while (0)
+
+/* indexes => characters, `enc62` / `enc63` select the variant */
+#define FIO_BASE64_ENC_MAP(pfx, si, in, enc62, enc63)                             \
+  do {                                                                         \
+    __typeof__(in) off_ = pfx##_set1_epi8(65);                             \
+    off_ = pfx##_add_epi8(                                               \
+        off_, pfx##_and_##si(                                        \
+                  pfx##_cmpgt_epi8(in, pfx##_set1_epi8(25)),       \
+                  pfx##_set1_epi8(6)));                                  \
+    off_ = pfx##_add_epi8(                                               \
+        off_, pfx##_and_##si(                                        \
+                  pfx##_cmpgt_epi8(in, pfx##_set1_epi8(51)),       \
+                  pfx##_set1_epi8(-75)));                                \
+    off_ = pfx##_add_epi8(                                               \
+        off_, pfx##_and_##si(                                        \
+                  pfx##_cmpeq_epi8(in, pfx##_set1_epi8(62)),       \
+                  enc62));                                                     \
+    off_ = pfx##_add_epi8(                                               \
+        off_, pfx##_and_##si(                                        \
+                  pfx##_cmpeq_epi8(in, pfx##_set1_epi8(63)),       \
+                  enc63));                                                     \
+    in = pfx##_add_epi8(in, off_);                                       \
+  } while (0)
+
+/* characters => 6 bit values, `valid` marks the characters in the alphabet */
+#define FIO_BASE64_DEC_MAP(pfx, si, in, valid)                                    \
+  do {                                                                         \
+    const __typeof__(in) u_ = pfx##_and_##si(                          \
+        pfx##_cmpgt_epi8(in, pfx##_set1_epi8('A' - 1)),            \
+        pfx##_cmpgt_epi8(pfx##_set1_epi8('Z' + 1), in));           \
+    const __typeof__(in) l_ = pfx##_and_##si(                          \
+        pfx##_cmpgt_epi8(in, pfx##_set1_epi8('a' - 1)),            \
+        pfx##_cmpgt_epi8(pfx##_set1_epi8('z' + 1), in));           \
+    const __typeof__(in) d_ = pfx##_and_##si(                          \
+        pfx##_cmpgt_epi8(in, pfx##_set1_epi8('0' - 1)),            \
+        pfx##_cmpgt_epi8(pfx##_set1_epi8('9' + 1), in));           \
+    const __typeof__(in) s62_ = pfx##_or_##si(                         \
+        pfx##_cmpeq_epi8(in, pfx##_set1_epi8('+')),                \
+        pfx##_cmpeq_epi8(in, pfx##_set1_epi8('-')));               \
+    const __typeof__(in) s63_ = pfx##_or_##si(                         \
+        pfx##_or_##si(                                               \
+            pfx##_cmpeq_epi8(in, pfx##_set1_epi8('/')),            \
+            pfx##_cmpeq_epi8(in, pfx##_set1_epi8(','))),           \
+        pfx##_cmpeq_epi8(in, pfx##_set1_epi8('_')));               \
+    valid = pfx##_or_##si(                                           \
+        pfx##_or_##si(pfx##_or_##si(u_, l_), d_),          \
+        pfx##_or_##si(s62_, s63_));                                  \
+    in = pfx##_or_##si(                                              \
+        pfx##_or_##si(                                               \
+            pfx##_and_##si(                                          \
+                u_, pfx##_sub_epi8(in, pfx##_set1_epi8(65))),      \
+            pfx##_and_##si(                                          \
+                l_, pfx##_sub_epi8(in, pfx##_set1_epi8(71)))),     \
+        pfx##_or_##si(                                               \
+            pfx##_or_##si(                                           \
+                pfx##_and_##si(                                      \
+                    d_, pfx##_add_epi8(in, pfx##_set1_epi8(4))),   \
+                pfx##_and_##si(s62_, pfx##_set1_epi8(62))),    \
+            pfx##_and_##si(s63_, pfx##_set1_epi8(63))));       \
+  } while (0)
+
+/* 16 values (in each 128 bit lane) => 12 bytes, followed by 4 zero bytes */
+#define FIO_BASE64_DEC_PACK(pfx, si, in)                                          \
+  do {                                                                         \
+    in = pfx##_maddubs_epi16(in, pfx##_set1_epi32(0x01400140));    \
+    in = pfx##_madd_epi16(in, pfx##_set1_epi32(0x00011000));       \
+    in = pfx##_shuffle_epi8(                                             \
+        in, FIO_BASE64_LANES##pfx(-1, 0x0c0d0e08, 0x090a0405, 0x06000102));  \
+  } while (0)
+
+/**
+Encodes `blocks` 12 byte blocks into 16 characters each. Blocks are encoded
+from last to first, allowing for in-place encoding.
+
+At least 4 bytes must be readable past the last block.
+*/
+static __attribute__((target("ssse3"))) void
+fio_base64_encode_ssse3(char *target, const char *data, size_t blocks,
+                        const char *base64_encodes) {
+  const __m128i enc62 = _mm_set1_epi8(base64_encodes[62] - 58);
+  const __m128i enc63 = _mm_set1_epi8(base64_encodes[63] - 59);
+  while (blocks) {
+    --blocks;
+    __m128i in = _mm_loadu_si128((const __m128i *)(data + (blocks * 12)));
+    FIO_BASE64_ENC_SPLIT(_mm, si128, in);
+    FIO_BASE64_ENC_MAP(_mm, si128, in, enc62, enc63);
+    _mm_storeu_si128((__m128i *)(target + (blocks << 4)), in);
+  }
+}
+
+/** Same as fio_base64_encode_ssse3, processing two blocks at a time. */
+static __attribute__((target("avx2"))) void
+fio_base64_encode_avx2(char *target, const char *data, size_t blocks,
+                       const char *base64_encodes) {
+  const __m256i enc62 = _mm256_set1_epi8(base64_encodes[62] - 58);
+  const __m256i enc63 = _mm256_set1_epi8(base64_encodes[63] - 59);
+  while (blocks >= 2) {
+    blocks -= 2;
+    const char *pos = data + (blocks * 12);
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)pos)),
+        _mm_loadu_si128((const __m128i *)(pos + 12)), 1);
+    FIO_BASE64_ENC_SPLIT(_mm256, si256, in);
+    FIO_BASE64_ENC_MAP(_mm256, si256, in, enc62, enc63);
+    _mm256_storeu_si256((__m256i *)(target + (blocks << 4)), in);
+  }
+  if (blocks) {
+    __m128i in = _mm_loadu_si128((const __m128i *)data);
+    FIO_BASE64_ENC_SPLIT(_mm, si128, in);
+    FIO_BASE64_ENC_MAP(_mm, si128, in, _mm256_castsi256_si128(enc62),
+                       _mm256_castsi256_si128(enc63));
+    _mm_storeu_si128((__m128i *)target, in);
+  }
+}
+
+/**
+Decodes 16 character blocks for as long as `len` allows and the blocks contain
+only Base64 characters (no padding, white space or invalid data).
+
+Writes 16 bytes for every 12 decoded bytes, so at least 4 extra bytes must be
+writable. Returns the number of characters consumed.
+*/
+static __attribute__((target("ssse3"))) size_t
+fio_base64_decode_ssse3(char *target, const char *encoded, size_t len) {
+  const char *const start = encoded;
+  while (len >= 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)encoded);
+    __m128i valid;
+    FIO_BASE64_DEC_MAP(_mm, si128, in, valid);
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+      break;
+    FIO_BASE64_DEC_PACK(_mm, si128, in);
+    _mm_storeu_si128((__m128i *)target, in);
+    target += 12;
+    encoded += 16;
+    len -= 16;
+  }
+  return (size_t)(encoded - start);
+}
+
+/** Same as fio_base64_decode_ssse3, processing 32 characters at a time. */
+static __attribute__((target("avx2"))) size_t
+fio_base64_decode_avx2(char *target, const char *encoded, size_t len) {
+  const char *const start = encoded;
+  while (len >= 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)encoded);
+    __m256i valid;
+    FIO_BASE64_DEC_MAP(_mm256, si256, in, valid);
+    if (_mm256_movemask_epi8(valid) != -1)
+      break;
+    FIO_BASE64_DEC_PACK(_mm256, si256, in);
+    _mm_storeu_si128((__m128i *)target, _mm256_castsi256_si128(in));
+    _mm_storeu_si128((__m128i *)(target + 12),
+                     _mm256_extracti128_si256(in, 1));
+    target += 24;
+    encoded += 32;
+    len -= 32;
+  }
+  return (size_t)(encoded - start) +
+         fio_base64_decode_ssse3(target, encoded, len);
+}
+
+#undef FIO_BASE64_LANES_mm
+#undef FIO_BASE64_LANES_mm256
+#undef FIO_BASE64_ENC_SPLIT
+#undef FIO_BASE64_ENC_MAP
+#undef FIO_BASE64_DEC_MAP
+#undef FIO_BASE64_DEC_PACK
+#else
+#define FIO_BASE64_SIMD 0
+#endif
+
 /*
  * The actual encoding logic. The map can be switched for encoding variations.
  */
@@ -8459,6 +12299,12 @@ static inline int fio_base64_encode_internal(char *target, const char *data,
   const int target_size = (groups + (mod != 0)) * 4;
   char *writer = target + target_size - 1;
   const char *reader = data + len - 1;
+  /* groups at the head of the data, left for the SIMD kernels */
+  int simd_blocks = 0;
+#if FIO_BASE64_SIMD
+  if (len >= 16 && fio_base64_simd_level())
+    simd_blocks = (len - 4) / 12;
+#endif
   writer[1] = 0;
   switch (mod) {
   case 2: {
@@ -8477,6 +12323,7 @@ static inline int fio_base64_encode_internal(char *target, const char *data,
     *(writer--) = base64_encodes[(tmp1 >> 2) & 63];
   } break;
   }
+  groups -= simd_blocks * 4;
   while (groups) {
     groups--;
     const char tmp3 = *(reader--);
@@ -8487,6 +12334,14 @@ static inline int fio_base64_encode_internal(char *target, const char *data,
     *(writer--) = base64_encodes[(((tmp1 & 3) << 4) | ((tmp2 >> 4) & 15))];
     *(writer--) = base64_encodes[(tmp1 >> 2) & 63];
   }
+#if FIO_BASE64_SIMD
+  if (simd_blocks == 0)
+    return target_size;
+  if (fio_base64_simd == 2)
+    fio_base64_encode_avx2(target, data, simd_blocks, base64_encodes);
+  else
+    fio_base64_encode_ssse3(target, data, simd_blocks, base64_encodes);
+#endif
   return target_size;
 }
 
@@ -8559,6 +12414,26 @@ int fio_base64_decode(char *target, char *encoded, int base64_len) {
     encoded++;
   }
   while (base64_len >= 4) {
+#if FIO_BASE64_SIMD
+    /* leave room for the kernels' 4 byte overrun (target is len/4*3+3) */
+    if (base64_len >= 24 && fio_base64_simd_level()) {
+      size_t consumed =
+          (fio_base64_simd == 2 && base64_len >= 48)
+              ? fio_base64_decode_avx2(target, encoded, base64_len - 16)
+              : fio_base64_decode_ssse3(target, encoded, base64_len - 8);
+      encoded += consumed;
+      base64_len -= consumed;
+      target += (consumed >> 2) * 3;
+      written += (consumed >> 2) * 3;
+      // skip white space (as if the groups were decoded one by one)
+      while (consumed && base64_len && isspace((*(uint8_t *)encoded))) {
+        base64_len--;
+        encoded++;
+      }
+      if (base64_len < 4)
+        break;
+    }
+#endif
     if (!base64_len) {
       return written;
     }
@@ -8633,8 +12508,10 @@ finish:
       target--;
       written--;
     }
-    if (written < 0)
+    if (written < 0) {
+      target -= written;
       written = 0;
+    }
   }
   *target = 0;
   return written;
@@ -8853,6 +12730,7 @@ Testing Strings
 
 #ifndef H_FIO_STR_H
 #define fio_str_test()
+#define fio_str_utf8_test()
 #else
 
 static int fio_str_test_dealloc_counter = 0;
@@ -9165,6 +13043,144 @@ FIO_FUNC inline void fio_str_test(void) {
   }
   fprintf(stderr, "* passed.\n");
 }
+
+/* the original (decode every code point) validation, used as a reference */
+FIO_FUNC size_t fio_str_utf8_test_reference(const char *data, size_t len) {
+  if (!len)
+    return 1;
+  const char *const end = data + len;
+  int32_t c = 0;
+  do {
+    FIO_STR_UTF8_CODE_POINT(data, end, c);
+  } while (c > 0 && data < end);
+  return data == end && c >= 0;
+}
+
+/* writes a random mix of (mostly valid) UTF-8 data, returns the length */
+FIO_FUNC size_t fio_str_utf8_test_fill(uint8_t *buf, size_t limit) {
+  static const char *sequences[] = {
+      "a",       "\x7F",     "\xC2\xA9",         "\xDF\xBF",
+      "\xE2\x82\xAC",        "\xE0\xA4\xB9",     "\xEF\xBF\xBF",
+      "\xF0\x9F\x92\x97",    "\xF4\x8F\xBF\xBF", "\xC0\x80",
+      "\xE0\x80\x80",        "\xF0\x80\x80\x80", "\xC0\x81",
+      "\xF7\xBF\xBF\xBF",    "\xED\xA0\x80",
+  };
+  size_t len = 0;
+  while (len + 4 < limit) {
+    const uint64_t r = fio_rand64();
+    switch (r & 15) {
+    case 0: /* a random byte */
+      buf[len++] = (uint8_t)(r >> 8);
+      break;
+    case 1: /* a NUL byte (rare) */
+      if (((r >> 8) & 15) == 0)
+        buf[len++] = 0;
+      break;
+    case 2: /* a run of ASCII */
+    case 3:
+    case 4:
+      for (size_t i = 0; i < ((r >> 8) & 31) && len + 4 < limit; ++i)
+        buf[len++] = 'A' + (i & 15);
+      break;
+    default: {
+      const char *s = sequences[(r >> 8) % (sizeof(sequences) / sizeof(*sequences))];
+      /* valid sequences are more common than broken ones */
+      if ((r >> 16) % 16 == 0 && s[1]) {
+        buf[len++] = (uint8_t)s[0]; /* truncated sequence */
+        break;
+      }
+      while (*s)
+        buf[len++] = (uint8_t)*s++;
+    }
+    }
+  }
+  return len;
+}
+
+/**
+ * Tests the vectorized UTF-8 validation against the reference validation.
+ */
+FIO_FUNC void fio_str_utf8_test(void) {
+  fprintf(stderr, "=== Testing UTF-8 validation (%s)\n",
+#if FIO_STR_UTF8_AVX2
+          fio_str_utf8_has_avx2() ? "AVX2 + SSE2" :
+#endif
+#if defined(__SSE2__)
+                                  "SSE2"
+#else
+                                  "scalar"
+#endif
+  );
+  uint8_t buf[1024];
+  size_t valid = 0;
+  for (size_t i = 0; i < 30000; ++i) {
+    size_t len = fio_str_utf8_test_fill(buf, 8 + (fio_rand64() % 1000));
+    size_t expected = fio_str_utf8_test_reference((char *)buf, len);
+    fio_str_s s = FIO_STR_INIT_EXISTING((char *)buf, len, 0);
+    valid += expected;
+    FIO_ASSERT(fio_str_utf8_valid(&s) == expected &&
+                   fio_str_utf8_valid_scalar((char *)buf, len) == expected,
+               "UTF-8 validation differs from reference (%zu bytes)", len);
+#if defined(__SSE2__)
+    FIO_ASSERT(fio_str_utf8_valid_sse2((char *)buf, len) == expected,
+               "SSE2 UTF-8 validation differs from reference (%zu bytes)",
+               len);
+#endif
+#if FIO_STR_UTF8_AVX2
+    if (fio_str_utf8_has_avx2())
+      FIO_ASSERT(fio_str_utf8_valid_avx2((char *)buf, len) == expected,
+                 "AVX2 UTF-8 validation differs from reference (%zu bytes)",
+                 len);
+#endif
+    /* every prefix of a short input (truncation at every block offset) */
+    if (i < 64) {
+      for (size_t j = 0; j <= len; ++j) {
+        fio_str_s sub = FIO_STR_INIT_EXISTING((char *)buf, j, 0);
+        FIO_ASSERT(fio_str_utf8_valid(&sub) ==
+                       fio_str_utf8_test_reference((char *)buf, j),
+                   "UTF-8 validation differs from reference (prefix %zu)", j);
+      }
+    }
+  }
+  FIO_ASSERT(valid && valid < 30000, "UTF-8 test data isn't mixed (%zu)",
+             valid);
+#if NODEBUG
+  {
+    const size_t len = 1 << 20;
+    char *data = malloc(len);
+    FIO_ASSERT_ALLOC(data);
+    for (size_t i = 0; i < len; ++i)
+      data[i] = 'a' + (i % 26);
+    for (size_t i = 0; i < len; i += 64)
+      memcpy(data + i, "\xE2\x82\xAC", 3);
+    struct {
+      const char *name;
+      size_t (*fn)(const char *, size_t);
+    } tests[] = {
+      {"reference", fio_str_utf8_test_reference},
+      {"scalar", fio_str_utf8_valid_scalar},
+#if defined(__SSE2__)
+      {"SSE2", fio_str_utf8_valid_sse2},
+#endif
+#if FIO_STR_UTF8_AVX2
+      {(fio_str_utf8_has_avx2() ? "AVX2" : NULL), fio_str_utf8_valid_avx2},
+#endif
+      {NULL, NULL},
+    };
+    for (size_t t = 0; tests[t].name; ++t) {
+      clock_t start = clock();
+      for (size_t r = 0; r < 64; ++r) {
+        FIO_ASSERT(tests[t].fn(data, len), "UTF-8 benchmark data invalid");
+        __asm__ volatile("" ::: "memory");
+      }
+      fprintf(stderr, "\t- %-9s 64MiB validated in %zu ms\n", tests[t].name,
+              (size_t)(clock() - start) / (CLOCKS_PER_SEC / 1000));
+    }
+    free(data);
+  }
+#endif
+  fprintf(stderr, "* passed.\n");
+}
 #endif
 
 /* *****************************************************************************
@@ -9193,6 +13209,9 @@ FIO_FUNC void fio_malloc_test(void) {
   sys_free(mem2, FIO_MEMORY_BLOCK_SIZE * 2);
   fprintf(stderr, "=== Testing facil.io memory allocator's internal data.\n");
   FIO_ASSERT(arenas, "Missing arena data - library not initialized!");
+  FIO_ASSERT(sizeof(*arenas) == FIO_MEMORY_CACHE_LINE &&
+                 !((uintptr_t)arenas & (FIO_MEMORY_CACHE_LINE - 1)),
+             "arenas should be aligned and padded to a cache line!");
   fio_free(NULL); /* fio_free(NULL) shouldn't crash... */
   mem = fio_malloc(1);
   FIO_ASSERT(mem, "fio_malloc failed to allocate memory!\n");
@@ -9298,6 +13317,20 @@ FIO_FUNC void fio_malloc_test(void) {
   fio_free(mem);
   FIO_ASSERT(((uintptr_t)mem & FIO_MEMORY_BLOCK_MASK) == 16,
              "fio_realloc (big) memory isn't aligned!\n");
+#if FIO_MEMORY_BIG_CACHE_LIMIT
+  {
+    mem = fio_malloc(FIO_MEMORY_BLOCK_SIZE);
+    FIO_ASSERT(mem, "fio_malloc failed to FIO_MEMORY_BLOCK_SIZE bytes!\n");
+    memset(mem, 'a', FIO_MEMORY_BLOCK_SIZE);
+    fio_free(mem);
+    mem2 = fio_calloc(FIO_MEMORY_BLOCK_SIZE, 1);
+    FIO_ASSERT(mem == mem2, "big allocation wasn't recycled by the cache!\n");
+    for (uintptr_t i = 0; i < FIO_MEMORY_BLOCK_SIZE; ++i) {
+      FIO_ASSERT(mem2[i] == 0, "recycled big allocation wasn't zeroed!\n");
+    }
+    fio_free(mem2);
+  }
+#endif
 
   {
     void *m0 = fio_malloc(0);
@@ -9316,6 +13349,55 @@ FIO_FUNC void fio_malloc_test(void) {
     FIO_ASSERT(new_pool_size == pool_size,
                "fio_free of fio_mmap went to memory pool!\n");
   }
+  {
+    fio_region_s region = FIO_REGION_INIT;
+    FIO_ASSERT(!fio_region_enter(&region), "a region was already active?!\n");
+    mem = fio_malloc(16);
+    mem2 = fio_malloc(16);
+    FIO_ASSERT(fio_region_enter(NULL) == &region,
+               "fio_region_enter didn't return the active region!\n");
+    FIO_ASSERT(mem && mem2 == mem + 16 &&
+                   ((uintptr_t)mem & (~FIO_MEMORY_BLOCK_MASK)) ==
+                       (uintptr_t)region.block,
+               "region allocations should be sliced from the region!\n");
+    FIO_ASSERT(!arena_last_used || arena_last_used->block != region.block,
+               "region block shouldn't be owned by an arena!\n");
+    fio_region_release(&region);
+    FIO_ASSERT(!region.block, "fio_region_release didn't release block!\n");
+    mem[0] = 'a'; /* objects outlive the region until freed */
+    mem2[0] = 'b';
+    fio_free(mem);
+    fio_free(mem2);
+  }
+  {
+    fio_region_s region = FIO_REGION_INIT;
+    fio_region_enter(&region);
+    mem = fio_malloc(16);
+    mem2 = fio_malloc(64);
+    fio_region_enter(NULL);
+    void *blk = region.block;
+    memset(mem2, 'a', 64);
+    fio_free(mem);
+    fio_free(mem2);
+    fio_region_reset(&region);
+    FIO_ASSERT(region.block == blk, "fio_region_reset should keep the block!\n");
+    fio_region_enter(&region);
+    char *mem3 = fio_malloc(80);
+    fio_region_enter(NULL);
+    FIO_ASSERT(mem3 == mem, "fio_region_reset should reuse the memory!\n");
+    for (size_t i = 0; i < 80; ++i)
+      FIO_ASSERT(!mem3[i], "fio_region_reset memory isn't zeroed!\n");
+    fio_region_reset(&region);
+    fio_region_enter(&region);
+    mem = fio_malloc(16);
+    fio_region_enter(NULL);
+    FIO_ASSERT(mem == mem3 + 80,
+               "fio_region_reset should keep the memory of live objects!\n");
+    mem3[0] = 'a';
+    fio_free(mem3);
+    fio_free(mem);
+    fio_region_release(&region);
+  }
 
   fprintf(stderr, "* passed.\n");
 }
@@ -9536,6 +13618,132 @@ FIO_FUNC void fio_socket_test(void) {
   fprintf(stderr, "* passed.\n");
 }
 
+/* *****************************************************************************
+Testing Rope (segmented String builder)
+***************************************************************************** */
+
+static size_t fio_rope_test_deallocated = 0;
+FIO_FUNC void fio_rope_test_dealloc(void *data) {
+  ++fio_rope_test_deallocated;
+  (void)data;
+}
+
+/* a write hook that writes up to 1000 bytes at a time */
+FIO_FUNC ssize_t fio_rope_test_hook_write(intptr_t uuid, void *udata,
+                                          const void *buf, size_t count) {
+  if (count > 1000)
+    count = 1000;
+  return write(fio_uuid2fd(uuid), buf, count);
+  (void)udata;
+}
+
+/* fills both the Rope and the String with the same (multi segment) data */
+FIO_FUNC void fio_rope_test_fill(fio_rope_s *rope, fio_str_s *str,
+                                 char *ref, size_t ref_len) {
+  for (size_t i = 0; i < 4096; ++i) {
+    fio_rope_printf(rope, "%zu,", i);
+    fio_str_printf(str, "%zu,", i);
+  }
+  fio_rope_write_ref(rope, ref, ref_len, fio_rope_test_dealloc);
+  fio_str_write(str, ref, ref_len);
+  fio_rope_write_ref(rope, "short", 5, fio_rope_test_dealloc);
+  fio_str_write(str, "short", 5);
+  fio_rope_write(rope, ref, ref_len);
+  fio_str_write(str, ref, ref_len);
+  fio_rope_write(rope, "!", 1);
+  fio_str_write(str, "!", 1);
+}
+
+/* sends the Rope through `uuid`, reading it from `fd` */
+FIO_FUNC void fio_rope_test_send(intptr_t uuid, int fd, fio_rope_s *rope,
+                                 fio_str_s *expected) {
+  const size_t len = fio_str_len(expected);
+  char *buf = malloc(len + 1);
+  size_t pos = 0;
+  FIO_ASSERT_ALLOC(buf);
+  FIO_ASSERT(!fio_write_rope(uuid, rope) && !rope->len && !rope->head &&
+                 !rope->tail,
+             "fio_write_rope should move the data, leaving an empty Rope");
+  for (size_t i = 0; pos < len && i < (1 << 20); ++i) {
+    fio_flush(uuid);
+    ssize_t r = read(fd, buf + pos, len + 1 - pos);
+    if (r > 0)
+      pos += r;
+  }
+  FIO_ASSERT(pos == len, "Rope socket write length error (%zu != %zu)", pos,
+             len);
+  FIO_ASSERT(!memcmp(buf, fio_str_data(expected), len),
+             "Rope socket write data error");
+  FIO_ASSERT(!fio_pending(uuid), "Rope packet should have been released");
+  free(buf);
+}
+
+FIO_FUNC void fio_rope_test(void) {
+  fprintf(stderr, "=== Testing Rope (segmented String builder)\n");
+  const size_t ref_len = (FIO_ROPE_SEGMENT_SIZE * 3) + 17;
+  char *ref = malloc(ref_len);
+  FIO_ASSERT_ALLOC(ref);
+  for (size_t i = 0; i < ref_len; ++i)
+    ref[i] = 'a' + (i % 26);
+  fio_rope_s rope = FIO_ROPE_INIT;
+  fio_str_s expected = FIO_STR_INIT;
+  fio_rope_test_deallocated = 0;
+  fio_rope_test_fill(&rope, &expected, ref, ref_len);
+  FIO_ASSERT(fio_rope_test_deallocated == 1,
+             "short references should be copied (and deallocated)");
+  FIO_ASSERT(rope.len == fio_str_len(&expected),
+             "Rope length error (%zu != %zu)", rope.len,
+             fio_str_len(&expected));
+  FIO_ASSERT(rope.count > 3, "Rope should have multiple segments (%zu)",
+             rope.count);
+  {
+    char *flat = malloc(rope.len);
+    FIO_ASSERT_ALLOC(flat);
+    FIO_ASSERT(fio_rope_copy(&rope, flat) == rope.len &&
+                   !memcmp(flat, fio_str_data(&expected), rope.len),
+               "Rope data error");
+    free(flat);
+  }
+  fio_rope_free(&rope);
+  FIO_ASSERT(!rope.len && !rope.count && !rope.head && !rope.tail &&
+                 fio_rope_test_deallocated == 2,
+             "Rope free error");
+  /* writing to an invalid connection frees the Rope */
+  fio_rope_test_fill(&rope, &expected, ref, ref_len);
+  FIO_ASSERT(fio_write_rope(-1, &rope) == -1 && !rope.len && !rope.head &&
+                 fio_rope_test_deallocated == 4,
+             "fio_write_rope to an invalid uuid should free the Rope");
+  fio_str_resize(&expected, 0);
+  /* vectored writes (default hooks) and segment by segment writes */
+  {
+    int fds[2];
+    FIO_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds),
+               "socketpair failed");
+    fio_set_non_block(fds[0]);
+    fio_set_non_block(fds[1]);
+    intptr_t uuid = fio_fd2uuid(fds[0]);
+    FIO_ASSERT(uuid != -1, "fio_fd2uuid failed");
+    fio_rope_test_fill(&rope, &expected, ref, ref_len);
+    fio_rope_test_send(uuid, fds[1], &rope, &expected);
+    FIO_ASSERT(fio_rope_test_deallocated == 6,
+               "Rope references should be deallocated once sent (%zu)",
+               fio_rope_test_deallocated);
+    fio_str_resize(&expected, 0);
+    static fio_rw_hook_s hooks = {.write = fio_rope_test_hook_write};
+    fio_rw_hook_set(uuid, &hooks, NULL);
+    fio_rope_test_fill(&rope, &expected, ref, ref_len);
+    fio_rope_test_send(uuid, fds[1], &rope, &expected);
+    FIO_ASSERT(fio_rope_test_deallocated == 8,
+               "Rope references should be deallocated once sent (hooks)");
+    fio_force_close(uuid);
+    close(fds[1]);
+  }
+  fio_str_free(&expected);
+  free(ref);
+  fio_defer_perform();
+  fprintf(stderr, "* passed.\n");
+}
+
 /* *****************************************************************************
 Testing listening socket
 ***************************************************************************** */
@@ -9906,21 +14114,1150 @@ FIO_FUNC void fio_set_test(void) {
                   end_bad - start_bad, end_ok - start_ok);
     fio_set_attack_free(&as);
 
-    /* partial collision attack */
-    start_bad = clock();
-    for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
-      fio_set_attack_insert(&as, ((i << 20) | 1), i + 1);
+    /* partial collision attack */
+    start_bad = clock();
+    for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
+      fio_set_attack_insert(&as, ((i << 20) | 1), i + 1);
+    }
+    end_bad = clock();
+    FIO_ASSERT(fio_set_attack_count(&as) == FIO_SET_TEST_COUNT,
+               "partial collision resolusion failed, not enough inserts!");
+    FIO_LOG_DEBUG("set partial collision attack final count/capa = %zu / %zu",
+                  fio_set_attack_count(&as), fio_set_attack_capa(&as));
+    FIO_LOG_DEBUG("set partial collision attack timing impact (attack vs. "
+                  "normal) %zu vs. %zu",
+                  end_bad - start_bad, end_ok - start_ok);
+    fio_set_attack_free(&as);
+  }
+}
+
+#define FIO_SET_NAME fio_set_swiss
+#define FIO_SET_OBJ_COMPARE(a, b) ((a) == (b))
+#define FIO_SET_OBJ_TYPE uintptr_t
+#define FIO_SET_SWISS 1
+#include <fio.h>
+
+#if NODEBUG
+FIO_FUNC void fio_set_swiss_speed_test(void) {
+  const uintptr_t count = (FIO_SET_TEST_COUNT << 1);
+  fio_set_attack_s d = FIO_SET_INIT;
+  fio_set_swiss_s w = FIO_SET_INIT;
+  clock_t start, end;
+  uintptr_t found = 0;
+#define FIO_SET_SPEED_TEST(name, set)                                          \
+  start = clock();                                                             \
+  for (uintptr_t i = 1; i <= count; ++i)                                       \
+    name##_insert(&(set), fio_risky_hash(&i, sizeof(i), 0), i);                \
+  end = clock();                                                               \
+  fprintf(stderr, "\t%-16s insert %zu objects: %zu\n", #name, (size_t)count,   \
+          (size_t)(end - start));                                              \
+  start = clock();                                                             \
+  for (int r = 0; r < 4; ++r)                                                  \
+    for (uintptr_t i = 1; i <= count; ++i)                                     \
+      found += (name##_find(&(set), fio_risky_hash(&i, sizeof(i), 0), i) == i); \
+  end = clock();                                                               \
+  fprintf(stderr, "\t%-16s find (x4) hits:     %zu\n", #name,                 \
+          (size_t)(end - start));                                              \
+  start = clock();                                                             \
+  for (uintptr_t i = count + 1; i <= (count << 1); ++i)                        \
+    found += (name##_find(&(set), fio_risky_hash(&i, sizeof(i), 0), i) == i); \
+  end = clock();                                                               \
+  fprintf(stderr, "\t%-16s find misses:        %zu\n", #name,                 \
+          (size_t)(end - start));                                              \
+  start = clock();                                                             \
+  for (uintptr_t i = 1; i <= count; ++i)                                       \
+    name##_remove(&(set), fio_risky_hash(&i, sizeof(i), 0), i, NULL);          \
+  end = clock();                                                               \
+  fprintf(stderr, "\t%-16s remove:             %zu\n", #name,                 \
+          (size_t)(end - start));                                              \
+  name##_free(&(set));
+
+  fprintf(stderr, "* Set speed test, default vs. control byte probing "
+                  "(CPU clock units):\n");
+  FIO_SET_SPEED_TEST(fio_set_attack, d);
+  FIO_SET_SPEED_TEST(fio_set_swiss, w);
+#undef FIO_SET_SPEED_TEST
+  FIO_ASSERT(found == (count << 3), "Set speed test lookup error (%zu)",
+             (size_t)found);
+}
+#endif
+
+/* mostly random hashes, with some partial collisions */
+FIO_FUNC uintptr_t fio_set_swiss_test_hash(uintptr_t i) {
+  return (i & 7) ? fio_risky_hash(&i, sizeof(i), 0) : (i << 16);
+}
+
+FIO_FUNC void fio_set_swiss_test(void) {
+  fio_set_swiss_s s = FIO_SET_INIT;
+  fio_set_attack_s d = FIO_SET_INIT;
+  fprintf(stderr, "* Testing Set control byte probing (FIO_SET_SWISS).\n");
+  for (uintptr_t i = 1; i < 16; ++i) {
+    FIO_ASSERT(fio_byte_group_match((uint8_t *)"0123456789abcdef",
+                                    "0123456789abcdef"[i]) == (1 << i),
+               "fio_byte_group_match error for byte %zu", (size_t)i);
+  }
+  FIO_ASSERT(!fio_byte_group_match((uint8_t *)"0123456789abcdef", 0),
+             "fio_byte_group_match false positive");
+  fio_set_swiss_insert(&s, 1, 1);
+  FIO_ASSERT(fio_set_swiss_capa(&s) >= 16,
+             "control byte probing requires groups of 16 slots");
+  fio_set_swiss_free(&s);
+  /* compare against the default implementation, using a mixed workload */
+  for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; ++i) {
+    uintptr_t h = fio_set_swiss_test_hash(i);
+    fio_set_swiss_insert(&s, h, i);
+    fio_set_attack_insert(&d, h, i);
+    if (!(i & 3)) {
+      uintptr_t r = i >> 1;
+      uintptr_t rh = fio_set_swiss_test_hash(r);
+      FIO_ASSERT(fio_set_swiss_remove(&s, rh, r, NULL) ==
+                     fio_set_attack_remove(&d, rh, r, NULL),
+                 "control byte Set removal != default Set removal");
+    }
+  }
+  FIO_ASSERT(fio_set_swiss_count(&s) == fio_set_attack_count(&d),
+             "control byte Set count != default Set count (%zu != %zu)",
+             fio_set_swiss_count(&s), fio_set_attack_count(&d));
+  for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; ++i) {
+    uintptr_t h = fio_set_swiss_test_hash(i);
+    FIO_ASSERT(fio_set_swiss_find(&s, h, i) == fio_set_attack_find(&d, h, i),
+               "control byte Set find != default Set find (%zu)", (size_t)i);
+  }
+  {
+    /* ordering is preserved */
+    fio_set_attack__ordered_s_ *o = d.ordered;
+    FIO_SET_FOR_LOOP(&s, pos) {
+      if (!pos->hash)
+        continue;
+      while (!o->hash)
+        ++o;
+      FIO_ASSERT(pos->obj == o->obj, "control byte Set order error");
+      ++o;
+    }
+  }
+  fio_set_swiss_free(&s);
+  fio_set_attack_free(&d);
+  /* full collision attack */
+  for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
+    fio_set_swiss_insert(&s, 1, i + 1);
+  }
+  FIO_ASSERT(fio_set_swiss_count(&s) != FIO_SET_TEST_COUNT,
+             "control byte Set attack success! too many full-collisions!");
+  fio_set_swiss_free(&s);
+  /* partial collision attack */
+  for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
+    fio_set_swiss_insert(&s, ((i << 20) | 1), i + 1);
+  }
+  FIO_ASSERT(fio_set_swiss_count(&s) == FIO_SET_TEST_COUNT,
+             "control byte Set partial collision resolution failed");
+  fio_set_swiss_free(&s);
+#if NODEBUG
+  fio_set_swiss_speed_test();
+#endif
+}
+
+/* *****************************************************************************
+Concurrent Set (lock-free readers) Testing
+***************************************************************************** */
+
+#define FIO_SET_NAME fio_set_concurrent
+#define FIO_SET_SWISS 1
+#define FIO_SET_OBJ_COMPARE(a, b) ((a) == (b))
+#define FIO_SET_OBJ_TYPE uintptr_t
+#define FIO_SET_CONCURRENT 1
+#include <fio.h>
+
+#define FIO_SET_CONCURRENT_TEST_KEYS 1024
+
+static struct {
+  fio_set_concurrent_s set;
+  volatile uintptr_t done;
+  volatile uintptr_t errors;
+  volatile uintptr_t lookups;
+} fio_set_concurrent_data = {.set = FIO_SET_INIT};
+
+FIO_FUNC void fio_rcu_test_task(void *counter) {
+  fio_atomic_add((uintptr_t *)counter, 1);
+}
+
+/* even keys are never removed, odd keys come and go */
+FIO_FUNC void *fio_set_concurrent_reader(void *ignr) {
+  uintptr_t lookups = 0;
+  while (!fio_set_concurrent_data.done) {
+    for (uintptr_t i = 1; i < FIO_SET_CONCURRENT_TEST_KEYS; ++i) {
+      const uintptr_t token = fio_rcu_read_lock();
+      uintptr_t found =
+          fio_set_concurrent_find(&fio_set_concurrent_data.set, i, i);
+      fio_rcu_read_unlock(token);
+      if ((found && found != i) || (!found && !(i & 1)))
+        fio_atomic_add(&fio_set_concurrent_data.errors, 1);
+      ++lookups;
+    }
+  }
+  fio_atomic_add(&fio_set_concurrent_data.lookups, lookups);
+  return ignr;
+}
+
+FIO_FUNC void fio_set_concurrent_test(void) {
+  fprintf(stderr, "=== Testing lock-free read sections and concurrent Set\n");
+  {
+    uintptr_t counter = 0;
+    const uintptr_t token = fio_rcu_read_lock();
+    fio_rcu_defer(fio_rcu_test_task, &counter);
+    for (int i = 0; i < 4; ++i)
+      fio_rcu_review();
+    FIO_ASSERT(!counter, "retired data released during an active read section");
+    fio_rcu_read_unlock(token);
+    fio_rcu_review();
+    fio_rcu_review();
+    FIO_ASSERT(counter == 1, "retired data wasn't released (%zu)",
+               (size_t)counter);
+    /* without active read sections, retiring releases earlier retired data */
+    fio_rcu_defer(fio_rcu_test_task, &counter);
+    fio_rcu_defer(fio_rcu_test_task, &counter);
+    FIO_ASSERT(counter == 2, "retired data wasn't released by fio_rcu_defer");
+    fio_rcu_review();
+    fio_rcu_review();
+  }
+  fio_set_concurrent_s *s = &fio_set_concurrent_data.set;
+  for (uintptr_t i = 2; i < FIO_SET_CONCURRENT_TEST_KEYS; i += 2)
+    fio_set_concurrent_insert(s, i, i);
+  {
+    /* rehashing publishes a new table, readers keep using the old one */
+    const uintptr_t token = fio_rcu_read_lock();
+    fio_set_concurrent_s snapshot;
+    const uintptr_t seq = fio_set_concurrent_read_begin(s, &snapshot);
+    fio_set_concurrent_rehash(s);
+    FIO_ASSERT(!fio_set_concurrent_read_retry(s, seq),
+               "concurrent Set readers should ignore a rehash");
+    FIO_ASSERT(snapshot.ordered != s->ordered,
+               "concurrent Set rehash didn't publish a new table");
+    size_t count = 0;
+    FIO_SET_FOR_LOOP(&snapshot, pos) {
+      if (pos->hash)
+        ++count;
+    }
+    FIO_ASSERT(count == fio_set_concurrent_count(s),
+               "concurrent Set's retired table was altered (%zu/%zu)", count,
+               fio_set_concurrent_count(s));
+    fio_rcu_read_unlock(token);
+  }
+  void *threads[4];
+  for (size_t i = 0; i < 4; ++i) {
+    threads[i] = fio_thread_new(fio_set_concurrent_reader, NULL);
+    FIO_ASSERT(threads[i], "couldn't start reader thread");
+  }
+  /* a single writer, so no lock is required */
+  for (size_t round = 0; round < 256; ++round) {
+    for (uintptr_t i = 1; i < FIO_SET_CONCURRENT_TEST_KEYS; i += 2)
+      fio_set_concurrent_insert(s, i, i);
+    for (uintptr_t i = 1; i < FIO_SET_CONCURRENT_TEST_KEYS; i += 2)
+      fio_set_concurrent_remove(s, i, i, NULL);
+    if (!(round & 15))
+      fio_set_concurrent_compact(s);
+    fio_rcu_review();
+  }
+  fio_set_concurrent_data.done = 1;
+  for (size_t i = 0; i < 4; ++i)
+    fio_thread_join(threads[i]);
+  FIO_ASSERT(!fio_set_concurrent_data.errors,
+             "concurrent Set readers got bad results (%zu errors in %zu)",
+             (size_t)fio_set_concurrent_data.errors,
+             (size_t)fio_set_concurrent_data.lookups);
+  FIO_ASSERT(fio_set_concurrent_count(s) ==
+                 ((FIO_SET_CONCURRENT_TEST_KEYS >> 1) - 1),
+             "concurrent Set count error");
+  FIO_LOG_DEBUG("concurrent Set - %zu lock-free lookups during writes",
+                (size_t)fio_set_concurrent_data.lookups);
+  fio_set_concurrent_free(s);
+  fio_rcu_review();
+  fio_rcu_review();
+  fio_rcu_review();
+  fprintf(stderr, "* passed.\n");
+}
+#undef FIO_SET_CONCURRENT_TEST_KEYS
+
+/* *****************************************************************************
+Ring Buffer Testing
+***************************************************************************** */
+
+FIO_FUNC intptr_t fio_ring_test_destroyed = 0;
+
+#define FIO_RING_NAME fio_ring_spsc
+#define FIO_RING_TYPE uintptr_t
+#define FIO_RING_DESTROY(o) (++fio_ring_test_destroyed)
+#include <fio.h>
+
+#define FIO_RING_NAME fio_ring_mpsc
+#define FIO_RING_TYPE uintptr_t
+#define FIO_RING_DESTROY(o) (++fio_ring_test_destroyed)
+#define FIO_RING_MPSC 1
+#include <fio.h>
+
+#define FIO_RING_TEST_PRODUCERS 4
+
+static struct {
+  fio_ring_spsc_s spsc;
+  fio_ring_mpsc_s mpsc;
+  uintptr_t count;
+  size_t batch;
+} fio_ring_test_data;
+
+/* the producers push `(n << 3) | producer_id` with n starting at 1 */
+FIO_FUNC void *fio_ring_spsc_producer(void *ignr) {
+  uintptr_t batch[64];
+  uintptr_t n = 1;
+  while (n <= fio_ring_test_data.count) {
+    if (fio_ring_test_data.batch <= 1) {
+      if (fio_ring_spsc_push(&fio_ring_test_data.spsc, (n << 3)))
+        fio_reschedule_thread();
+      else
+        ++n;
+      continue;
+    }
+    size_t len = 0;
+    while (len < fio_ring_test_data.batch &&
+           n + len <= fio_ring_test_data.count) {
+      batch[len] = (n + len) << 3;
+      ++len;
+    }
+    size_t pushed = fio_ring_spsc_push_batch(&fio_ring_test_data.spsc, batch,
+                                             len);
+    if (!pushed)
+      fio_reschedule_thread();
+    n += pushed;
+  }
+  (void)ignr;
+  return NULL;
+}
+
+FIO_FUNC void *fio_ring_mpsc_producer(void *id_) {
+  uintptr_t batch[64];
+  const uintptr_t id = (uintptr_t)id_;
+  uintptr_t n = 1;
+  while (n <= fio_ring_test_data.count) {
+    if (fio_ring_test_data.batch <= 1 || (n & 1)) {
+      if (fio_ring_mpsc_push(&fio_ring_test_data.mpsc, (n << 3) | id))
+        fio_reschedule_thread();
+      else
+        ++n;
+      continue;
+    }
+    size_t len = 0;
+    while (len < fio_ring_test_data.batch &&
+           n + len <= fio_ring_test_data.count) {
+      batch[len] = ((n + len) << 3) | id;
+      ++len;
+    }
+    size_t pushed = fio_ring_mpsc_push_batch(&fio_ring_test_data.mpsc, batch,
+                                             len);
+    if (!pushed)
+      fio_reschedule_thread();
+    n += pushed;
+  }
+  return NULL;
+}
+
+/* consumes and validates the objects pushed by the producer thread(s) */
+FIO_FUNC void fio_ring_test_consume(uint8_t mpsc, size_t producers) {
+  uintptr_t batch[64];
+  uintptr_t expected[FIO_RING_TEST_PRODUCERS];
+  uintptr_t total = 0;
+  for (size_t i = 0; i < producers; ++i)
+    expected[i] = 1;
+  while (total < fio_ring_test_data.count * producers) {
+    size_t len;
+    if (fio_ring_test_data.batch <= 1) {
+      len = !(mpsc ? fio_ring_mpsc_pop(&fio_ring_test_data.mpsc, batch)
+                   : fio_ring_spsc_pop(&fio_ring_test_data.spsc, batch));
+    } else {
+      len = mpsc ? fio_ring_mpsc_pop_batch(&fio_ring_test_data.mpsc, batch,
+                                           fio_ring_test_data.batch)
+                 : fio_ring_spsc_pop_batch(&fio_ring_test_data.spsc, batch,
+                                           fio_ring_test_data.batch);
+    }
+    if (!len) {
+      fio_reschedule_thread();
+      continue;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      const uintptr_t id = batch[i] & 7;
+      FIO_ASSERT(id < producers && (batch[i] >> 3) == expected[id],
+                 "Ring Buffer order error (producer %zu, %zu != %zu)",
+                 (size_t)id, (size_t)(batch[i] >> 3), (size_t)expected[id]);
+      ++expected[id];
+    }
+    total += len;
+  }
+}
+
+FIO_FUNC void fio_ring_test_run(uint8_t mpsc, size_t producers) {
+  void *threads[FIO_RING_TEST_PRODUCERS];
+  for (size_t i = 0; i < producers; ++i) {
+    threads[i] = fio_thread_new(mpsc ? fio_ring_mpsc_producer
+                                     : fio_ring_spsc_producer,
+                                (void *)(uintptr_t)i);
+    FIO_ASSERT(threads[i], "couldn't start producer thread");
+  }
+  fio_ring_test_consume(mpsc, producers);
+  for (size_t i = 0; i < producers; ++i)
+    fio_thread_join(threads[i]);
+  FIO_ASSERT(!(mpsc ? fio_ring_mpsc_count(&fio_ring_test_data.mpsc)
+                    : fio_ring_spsc_count(&fio_ring_test_data.spsc)),
+             "Ring Buffer should be empty");
+}
+
+#if NODEBUG
+FIO_FUNC double fio_ring_test_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + ((double)t.tv_nsec / 1000000000.0);
+}
+
+FIO_FUNC void fio_ring_speed_test(void) {
+  const size_t batches[] = {1, 64};
+  uintptr_t tmp[64] = {0};
+  fprintf(stderr, "* Ring Buffer speed test (million objects per second):\n");
+  fio_ring_test_data.count = (1UL << 20);
+  for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); ++b) {
+    double start;
+    fio_ring_test_data.batch = batches[b];
+    /* a single thread, measuring the cost of the operations themselves */
+    start = fio_ring_test_time();
+    for (size_t i = 0; i < (fio_ring_test_data.count << 2); i += 128) {
+      for (size_t j = 0; j < 128; j += batches[b]) {
+        if (batches[b] == 1)
+          fio_ring_spsc_push(&fio_ring_test_data.spsc, j);
+        else
+          fio_ring_spsc_push_batch(&fio_ring_test_data.spsc, tmp, batches[b]);
+      }
+      for (size_t j = 0; j < 128; j += batches[b]) {
+        if (batches[b] == 1)
+          fio_ring_spsc_pop(&fio_ring_test_data.spsc, tmp);
+        else
+          fio_ring_spsc_pop_batch(&fio_ring_test_data.spsc, tmp, batches[b]);
+      }
+    }
+    fprintf(stderr, "\tSPSC, same thread, batch %-2zu: %.2f\n", batches[b],
+            (double)(fio_ring_test_data.count << 2) /
+                ((fio_ring_test_time() - start) * 1000000.0));
+    start = fio_ring_test_time();
+    fio_ring_test_run(0, 1);
+    fprintf(stderr, "\tSPSC, 1 producer,  batch %-2zu: %.2f\n", batches[b],
+            (double)fio_ring_test_data.count /
+                ((fio_ring_test_time() - start) * 1000000.0));
+    start = fio_ring_test_time();
+    fio_ring_test_run(1, FIO_RING_TEST_PRODUCERS);
+    fprintf(stderr, "\tMPSC, %d producers, batch %-2zu: %.2f\n",
+            FIO_RING_TEST_PRODUCERS, batches[b],
+            (double)(fio_ring_test_data.count * FIO_RING_TEST_PRODUCERS) /
+                ((fio_ring_test_time() - start) * 1000000.0));
+  }
+}
+#endif
+
+FIO_FUNC void fio_ring_test(void) {
+  fprintf(stderr, "=== Testing Ring Buffer (SPSC / MPSC)\n");
+  fio_ring_spsc_s *s = &fio_ring_test_data.spsc;
+  fio_ring_mpsc_s *m = &fio_ring_test_data.mpsc;
+  uintptr_t tmp[16];
+  uintptr_t o = 0;
+  FIO_ASSERT(!fio_ring_spsc_init(s, 5) && !fio_ring_mpsc_init(m, 5),
+             "Ring Buffer initialization failed");
+  FIO_ASSERT(fio_ring_spsc_capa(s) == 8 && fio_ring_mpsc_capa(m) == 8,
+             "Ring Buffer capacity should be rounded up to a power of 2");
+  for (uintptr_t i = 1; i <= 8; ++i) {
+    FIO_ASSERT(!fio_ring_spsc_push(s, i) && !fio_ring_mpsc_push(m, i),
+               "Ring Buffer push failed before capacity was reached");
+  }
+  FIO_ASSERT(fio_ring_spsc_push(s, 9) && fio_ring_mpsc_push(m, 9),
+             "Ring Buffer push should fail when full");
+  FIO_ASSERT(!fio_ring_spsc_push_batch(s, tmp, 4) &&
+                 !fio_ring_mpsc_push_batch(m, tmp, 4),
+             "Ring Buffer batch push should fail when full");
+  FIO_ASSERT(fio_ring_spsc_count(s) == 8 && fio_ring_mpsc_count(m) == 8,
+             "Ring Buffer count error");
+  for (uintptr_t i = 1; i <= 8; ++i) {
+    FIO_ASSERT(!fio_ring_spsc_pop(s, &o) && o == i,
+               "SPSC Ring Buffer pop error (%zu != %zu)", (size_t)o,
+               (size_t)i);
+    FIO_ASSERT(!fio_ring_mpsc_pop(m, &o) && o == i,
+               "MPSC Ring Buffer pop error (%zu != %zu)", (size_t)o,
+               (size_t)i);
+  }
+  FIO_ASSERT(fio_ring_spsc_pop(s, &o) && fio_ring_mpsc_pop(m, &o),
+             "Ring Buffer pop should fail when empty");
+  FIO_ASSERT(!fio_ring_spsc_pop_batch(s, tmp, 16) &&
+                 !fio_ring_mpsc_pop_batch(m, tmp, 16),
+             "Ring Buffer batch pop should fail when empty");
+  /* wrap around using partial batches */
+  {
+    uintptr_t pushed = 1, popped = 1;
+    for (size_t round = 0; round < 1024; ++round) {
+      size_t len = (round % 7) + 1;
+      for (size_t i = 0; i < len; ++i)
+        tmp[i] = pushed + i;
+      size_t n = fio_ring_spsc_push_batch(s, tmp, len);
+      FIO_ASSERT(fio_ring_mpsc_push_batch(m, tmp, len) == n,
+                 "SPSC and MPSC batch push results differ");
+      FIO_ASSERT(n == len || fio_ring_spsc_count(s) == 8,
+                 "Ring Buffer batch push stopped before full");
+      pushed += n;
+      len = (round % 5) + 1;
+      n = fio_ring_spsc_pop_batch(s, tmp, len);
+      for (size_t i = 0; i < n; ++i) {
+        FIO_ASSERT(tmp[i] == popped + i, "SPSC batch pop order error");
+      }
+      FIO_ASSERT(fio_ring_mpsc_pop_batch(m, tmp, len) == n,
+                 "SPSC and MPSC batch pop results differ");
+      for (size_t i = 0; i < n; ++i) {
+        FIO_ASSERT(tmp[i] == popped + i, "MPSC batch pop order error");
+      }
+      popped += n;
+    }
+    FIO_ASSERT(pushed > 1024, "Ring Buffer batch test didn't move enough data");
+    fio_ring_test_destroyed = 0;
+    fio_ring_spsc_free(s);
+    fio_ring_mpsc_free(m);
+    FIO_ASSERT((uintptr_t)fio_ring_test_destroyed == ((pushed - popped) << 1),
+               "Ring Buffer free should destroy remaining objects (%zu != %zu)",
+               (size_t)fio_ring_test_destroyed,
+               (size_t)((pushed - popped) << 1));
+    FIO_ASSERT(!fio_ring_spsc_capa(s) && !fio_ring_mpsc_capa(m),
+               "Ring Buffer not reset after free");
+  }
+  /* threaded hand-off, using both single and batch operations */
+  FIO_ASSERT(!fio_ring_spsc_init(s, 256) && !fio_ring_mpsc_init(m, 256),
+             "Ring Buffer initialization failed");
+  fio_ring_test_data.count = (1UL << 16);
+  for (size_t batch = 1; batch <= 64; batch <<= 3) {
+    fio_ring_test_data.batch = batch;
+    fio_ring_test_run(0, 1);
+    fio_ring_test_run(1, FIO_RING_TEST_PRODUCERS);
+  }
+#if NODEBUG
+  fio_ring_speed_test();
+#endif
+  fio_ring_spsc_free(s);
+  fio_ring_mpsc_free(m);
+  fprintf(stderr, "* passed.\n");
+}
+#undef FIO_RING_TEST_PRODUCERS
+
+/* *****************************************************************************
+Radix Tree Testing
+***************************************************************************** */
+
+FIO_FUNC intptr_t fio_radix_test_destroyed = 0;
+
+#define FIO_RADIX_NAME fio_radix_test
+#define FIO_RADIX_OBJ_TYPE uintptr_t
+#define FIO_RADIX_OBJ_DESTROY(o) (++fio_radix_test_destroyed)
+#include <fio.h>
+
+/* an equivalent Hash Map, used for validation and speed comparison */
+typedef struct {
+  const char *buf;
+  size_t len;
+} fio_radix_test_key_s;
+
+#define FIO_SET_NAME fio_radix_test_map
+#define FIO_SET_KEY_TYPE fio_radix_test_key_s
+#define FIO_SET_KEY_COMPARE(k1, k2)                                            \
+  ((k1).len == (k2).len && (!(k1).len || !memcmp((k1).buf, (k2).buf, (k1).len)))
+#define FIO_SET_OBJ_TYPE uintptr_t
+#include <fio.h>
+
+/* generates `count` route-like keys, returns the key array (free both) */
+FIO_FUNC fio_radix_test_key_s *fio_radix_test_keys(size_t count,
+                                                   char **buffer) {
+  static const char *words[] = {"users", "posts", "api",     "static",
+                                "css",   "js",    "comments", "admin"};
+  fio_radix_test_key_s *keys = malloc(sizeof(*keys) * count);
+  char *buf = malloc(count * 64);
+  FIO_ASSERT_ALLOC(keys && buf);
+  *buffer = buf;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t r = fio_rand64();
+    int len = snprintf(buf, 64, "/%s/%u/%s/%x", words[r & 7],
+                       (unsigned)((r >> 3) & 1023), words[(r >> 13) & 7],
+                       (unsigned)i);
+    keys[i] = (fio_radix_test_key_s){.buf = buf, .len = (size_t)len};
+    buf += len + 1;
+  }
+  return keys;
+}
+
+/* the key is only valid during the callback, so the last key is copied */
+typedef struct {
+  char buf[128];
+  size_t len;
+  size_t count;
+} fio_radix_test_each_s;
+
+FIO_FUNC int fio_radix_test_each_task(const char *key, size_t len,
+                                      uintptr_t obj, void *arg) {
+  fio_radix_test_each_s *last = arg;
+  if (last->count) {
+    size_t min = len < last->len ? len : last->len;
+    int cmp = memcmp(last->buf, key, min);
+    FIO_ASSERT(cmp < 0 || (!cmp && last->len < len),
+               "Radix Tree iteration isn't ordered (%s after %s)", key,
+               last->buf);
+  }
+  FIO_ASSERT(strlen(key) == len && len < sizeof(last->buf) && obj,
+             "Radix Tree iteration data error");
+  memcpy(last->buf, key, len + 1);
+  last->len = len;
+  ++last->count;
+  return 0;
+}
+
+/* prefixes must be reported from the shortest to the longest */
+FIO_FUNC int fio_radix_test_each_prefix_task(size_t len, uintptr_t obj,
+                                             void *arg) {
+  fio_radix_test_each_s *last = arg;
+  FIO_ASSERT(obj && (!last->count || last->len < len),
+             "Radix Tree prefix iteration order error");
+  last->len = len;
+  ++last->count;
+  return 0;
+}
+
+FIO_FUNC int fio_radix_test_each_stop(const char *key, size_t len,
+                                      uintptr_t obj, void *arg) {
+  (void)key;
+  (void)len;
+  (void)obj;
+  return (--*(size_t *)arg) ? 0 : -1;
+}
+
+#if NODEBUG
+FIO_FUNC void fio_radix_speed_test_round(const size_t count,
+                                         const size_t rounds) {
+  char *buffer;
+  fio_radix_test_key_s *keys = fio_radix_test_keys(count, &buffer);
+  fio_radix_test_s tree = FIO_RADIX_INIT;
+  fio_radix_test_map_s map = FIO_SET_INIT;
+  uintptr_t found = 0;
+  clock_t start, end;
+  fprintf(stderr, "* Radix Tree vs. Hash Map speed test, %zu keys x %zu "
+                  "lookups (CPU clock units):\n",
+          count, rounds);
+  start = clock();
+  for (size_t i = 0; i < count; ++i)
+    fio_radix_test_insert(&tree, keys[i].buf, keys[i].len, i + 1, NULL);
+  end = clock();
+  fprintf(stderr, "\tRadix Tree insert:           %zu\n",
+          (size_t)(end - start));
+  start = clock();
+  for (size_t i = 0; i < count; ++i)
+    fio_radix_test_map_insert(&map,
+                              fio_risky_hash(keys[i].buf, keys[i].len, 0),
+                              keys[i], i + 1, NULL);
+  end = clock();
+  fprintf(stderr, "\tHash Map insert:             %zu\n",
+          (size_t)(end - start));
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r)
+    for (size_t i = 0; i < count; ++i)
+      found += (fio_radix_test_find(&tree, keys[i].buf, keys[i].len) == i + 1);
+  end = clock();
+  fprintf(stderr, "\tRadix Tree find hits:        %zu\n",
+          (size_t)(end - start));
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r)
+    for (size_t i = 0; i < count; ++i)
+      found += (fio_radix_test_map_find(
+                    &map, fio_risky_hash(keys[i].buf, keys[i].len, 0),
+                    keys[i]) == i + 1);
+  end = clock();
+  fprintf(stderr, "\tHash Map find hits:          %zu\n",
+          (size_t)(end - start));
+  /* misses include the NUL byte, which isn't a part of any key */
+  start = clock();
+  for (size_t i = 0; i < count; ++i)
+    found += !fio_radix_test_find(&tree, keys[i].buf, keys[i].len + 1);
+  end = clock();
+  fprintf(stderr, "\tRadix Tree find misses:      %zu\n",
+          (size_t)(end - start));
+  start = clock();
+  for (size_t i = 0; i < count; ++i) {
+    fio_radix_test_key_s k = {.buf = keys[i].buf, .len = keys[i].len + 1};
+    found += !fio_radix_test_map_find(&map, fio_risky_hash(k.buf, k.len, 0), k);
+  }
+  end = clock();
+  fprintf(stderr, "\tHash Map find misses:        %zu\n",
+          (size_t)(end - start));
+  start = clock();
+  for (size_t i = 0; i < count; ++i) {
+    size_t match_len;
+    found += (fio_radix_test_find_prefix(&tree, keys[i].buf, keys[i].len,
+                                         &match_len) == i + 1);
+  }
+  end = clock();
+  fprintf(stderr, "\tRadix Tree longest prefix:   %zu\n",
+          (size_t)(end - start));
+  FIO_ASSERT(found == count * ((rounds << 1) + 3),
+             "Radix Tree speed test lookup error (%zu)", (size_t)found);
+  fio_radix_test_free(&tree);
+  fio_radix_test_map_free(&map);
+  free(keys);
+  free(buffer);
+}
+
+FIO_FUNC void fio_radix_speed_test(void) {
+  /* a routing table sized tree (cache resident) and a large tree */
+  fio_radix_speed_test_round(256, 4096);
+  fio_radix_speed_test_round((1UL << 18), 4);
+}
+#endif
+
+FIO_FUNC void fio_radix_test(void) {
+  fprintf(stderr, "=== Testing Radix Tree\n");
+  fio_radix_test_s t = FIO_RADIX_INIT;
+  size_t match_len = 0;
+  FIO_ASSERT(!fio_radix_test_find(&t, "x", 1) &&
+                 !fio_radix_test_find_prefix(&t, "x", 1, &match_len) &&
+                 !fio_radix_test_match(&t, "x", 1) &&
+                 fio_radix_test_remove(&t, "x", 1, NULL),
+             "empty Radix Tree should find nothing");
+  /* exact and longest prefix lookups */
+  fio_radix_test_insert(&t, "/", 1, 1, NULL);
+  fio_radix_test_insert(&t, "/static/", 8, 2, NULL);
+  fio_radix_test_insert(&t, "/static/css/", 12, 3, NULL);
+  fio_radix_test_insert(&t, "/stats", 6, 4, NULL);
+  FIO_ASSERT(fio_radix_test_count(&t) == 4, "Radix Tree count error");
+  FIO_ASSERT(fio_radix_test_find(&t, "/static/", 8) == 2 &&
+                 fio_radix_test_find(&t, "/stats", 6) == 4 &&
+                 !fio_radix_test_find(&t, "/stat", 5) &&
+                 !fio_radix_test_find(&t, "/static/css", 11),
+             "Radix Tree exact lookup error");
+  FIO_ASSERT(fio_radix_test_find_prefix(&t, "/static/css/main.css", 20,
+                                        &match_len) == 3 &&
+                 match_len == 12,
+             "Radix Tree longest prefix error (deepest)");
+  FIO_ASSERT(fio_radix_test_find_prefix(&t, "/static/js/main.js", 18,
+                                        &match_len) == 2 &&
+                 match_len == 8,
+             "Radix Tree longest prefix error (mid-label mismatch)");
+  FIO_ASSERT(fio_radix_test_find_prefix(&t, "/statistics", 11, &match_len) ==
+                     1 &&
+                 match_len == 1,
+             "Radix Tree longest prefix error (shortest)");
+  FIO_ASSERT(!fio_radix_test_find_prefix(&t, "static", 6, &match_len) &&
+                 !match_len,
+             "Radix Tree longest prefix should fail");
+  {
+    fio_radix_test_each_s last = {.count = 0};
+    FIO_ASSERT(fio_radix_test_each_prefix(&t, "/static/css/main.css", 20,
+                                          fio_radix_test_each_prefix_task,
+                                          &last) == 3 &&
+                   last.count == 3 && last.len == 12,
+               "Radix Tree prefix iteration error");
+    last = (fio_radix_test_each_s){.count = 0};
+    FIO_ASSERT(fio_radix_test_each_prefix(&t, "/stat", 5,
+                                          fio_radix_test_each_prefix_task,
+                                          &last) == 1 &&
+                   last.len == 1,
+               "Radix Tree prefix iteration error (mid-label)");
+  }
+  {
+    uintptr_t old = 0;
+    fio_radix_test_destroyed = 0;
+    fio_radix_test_insert(&t, "/stats", 6, 5, &old);
+    FIO_ASSERT(old == 4 && fio_radix_test_destroyed == 1 &&
+                   fio_radix_test_find(&t, "/stats", 6) == 5 &&
+                   fio_radix_test_count(&t) == 4,
+               "Radix Tree overwrite error");
+  }
+  /* wildcard segments */
+  fio_radix_test_insert(&t, "/users/*/posts", 14, 10, NULL);
+  fio_radix_test_insert(&t, "/users/me/posts", 15, 11, NULL);
+  fio_radix_test_insert(&t, "/users/*", 8, 12, NULL);
+  fio_radix_test_insert(&t, "*", 1, 13, NULL);
+  FIO_ASSERT(fio_radix_test_match(&t, "/users/42/posts", 15) == 10,
+             "Radix Tree wildcard match error");
+  FIO_ASSERT(fio_radix_test_match(&t, "/users/me/posts", 15) == 11,
+             "Radix Tree literal segment should be preferred");
+  FIO_ASSERT(fio_radix_test_match(&t, "/users/mel/posts", 16) == 10,
+             "Radix Tree wildcard should match after a partial literal");
+  FIO_ASSERT(fio_radix_test_match(&t, "/users/42", 9) == 12 &&
+                 fio_radix_test_match(&t, "/users/me", 9) == 12,
+             "Radix Tree wildcard match error (last segment)");
+  FIO_ASSERT(!fio_radix_test_match(&t, "/users//posts", 13) &&
+                 !fio_radix_test_match(&t, "/users/42/comments", 18) &&
+                 !fio_radix_test_match(&t, "/users/", 7),
+             "Radix Tree wildcard shouldn't match");
+  FIO_ASSERT(fio_radix_test_match(&t, "abc", 3) == 13 &&
+                 !fio_radix_test_match(&t, "a/b", 3),
+             "Radix Tree root wildcard error");
+  FIO_ASSERT(fio_radix_test_match(&t, "/static/", 8) == 2 &&
+                 !fio_radix_test_find(&t, "/users/42", 9),
+             "Radix Tree match / find confusion");
+  /* prefixed iteration */
+  {
+    fio_radix_test_each_s last = {.count = 0};
+    FIO_ASSERT(fio_radix_test_each(&t, "/users/", 7, fio_radix_test_each_task,
+                                   &last) == 3,
+               "Radix Tree prefixed iteration count error");
+    last.count = 0;
+    FIO_ASSERT(fio_radix_test_each(&t, "/sta", 4, fio_radix_test_each_task,
+                                   &last) == 3,
+               "Radix Tree mid-label prefixed iteration count error");
+    last.count = 0;
+    FIO_ASSERT(!fio_radix_test_each(&t, "/x", 2, fio_radix_test_each_task,
+                                    &last),
+               "Radix Tree prefixed iteration should find nothing");
+    size_t stop = 2;
+    FIO_ASSERT(fio_radix_test_each(&t, NULL, 0, fio_radix_test_each_stop,
+                                   &stop) == 2,
+               "Radix Tree iteration should stop when the task returns -1");
+  }
+  fio_radix_test_destroyed = 0;
+  fio_radix_test_free(&t);
+  FIO_ASSERT(fio_radix_test_destroyed == 8 && !t.root &&
+                 !fio_radix_test_count(&t),
+             "Radix Tree free error");
+  /* random keys, compared against a Hash Map */
+  {
+    const size_t count = 4096;
+    char *buffer;
+    fio_radix_test_key_s *keys = fio_radix_test_keys(count, &buffer);
+    fio_radix_test_map_s map = FIO_SET_INIT;
+    for (size_t i = 0; i < count; ++i) {
+      fio_radix_test_insert(&t, keys[i].buf, keys[i].len, i + 1, NULL);
+      fio_radix_test_map_insert(&map,
+                                fio_risky_hash(keys[i].buf, keys[i].len, 0),
+                                keys[i], i + 1, NULL);
+    }
+    for (size_t i = 0; i < count; i += 3) {
+      uintptr_t old = 0;
+      FIO_ASSERT(!fio_radix_test_remove(&t, keys[i].buf, keys[i].len, &old) &&
+                     old == i + 1,
+                 "Radix Tree remove error");
+      FIO_ASSERT(fio_radix_test_remove(&t, keys[i].buf, keys[i].len, NULL),
+                 "Radix Tree removed a missing key");
+      fio_radix_test_map_remove(&map,
+                                fio_risky_hash(keys[i].buf, keys[i].len, 0),
+                                keys[i], NULL);
+    }
+    /* removing a prefix of existing keys (no object) must fail */
+    FIO_ASSERT(fio_radix_test_remove(&t, keys[1].buf, keys[1].len - 1, NULL),
+               "Radix Tree removed an inner node");
+    FIO_ASSERT(fio_radix_test_count(&t) == fio_radix_test_map_count(&map),
+               "Radix Tree count differs from Hash Map (%zu != %zu)",
+               fio_radix_test_count(&t), fio_radix_test_map_count(&map));
+    for (size_t i = 0; i < count; ++i) {
+      FIO_ASSERT(fio_radix_test_find(&t, keys[i].buf, keys[i].len) ==
+                     fio_radix_test_map_find(
+                         &map, fio_risky_hash(keys[i].buf, keys[i].len, 0),
+                         keys[i]),
+                 "Radix Tree lookup differs from Hash Map (%s)", keys[i].buf);
+    }
+    fio_radix_test_each_s last = {.count = 0};
+    FIO_ASSERT(fio_radix_test_each(&t, NULL, 0, fio_radix_test_each_task,
+                                   &last) == fio_radix_test_count(&t),
+               "Radix Tree iteration count error");
+    for (size_t i = 0; i < count; ++i) {
+      fio_radix_test_remove(&t, keys[i].buf, keys[i].len, NULL);
+    }
+    FIO_ASSERT(!fio_radix_test_count(&t) && t.root && !t.root->count,
+               "Radix Tree nodes left after removing all keys");
+    fio_radix_test_free(&t);
+    fio_radix_test_map_free(&map);
+    free(keys);
+    free(buffer);
+  }
+#if NODEBUG
+  fio_radix_speed_test();
+#endif
+  fprintf(stderr, "* passed.\n");
+}
+
+#define FIO_RADIX_NAME fio_radix_concurrent
+#define FIO_RADIX_OBJ_TYPE uintptr_t
+#define FIO_RADIX_OBJ_DESTROY(o) fio_atomic_add(&fio_radix_test_destroyed, 1)
+#define FIO_RADIX_CONCURRENT 1
+#include <fio.h>
+
+#define FIO_RADIX_CONCURRENT_TEST_KEYS 512
+
+static struct {
+  fio_radix_concurrent_s tree;
+  volatile uintptr_t done;
+  volatile uintptr_t errors;
+  volatile uintptr_t lookups;
+} fio_radix_concurrent_data = {.tree = FIO_RADIX_INIT};
+
+/* even keys are never removed, odd keys come and go (splitting labels) */
+FIO_FUNC void *fio_radix_concurrent_reader(void *ignr) {
+  uintptr_t lookups = 0;
+  char buf[32];
+  while (!fio_radix_concurrent_data.done) {
+    for (uintptr_t i = 1; i < FIO_RADIX_CONCURRENT_TEST_KEYS; ++i) {
+      size_t len = (size_t)snprintf(buf, sizeof(buf), "k/%zu/x", (size_t)i);
+      size_t match_len = 0;
+      const uintptr_t token = fio_rcu_read_lock();
+      uintptr_t found = fio_radix_concurrent_find(
+          &fio_radix_concurrent_data.tree, buf, len - 2);
+      uintptr_t prefix = fio_radix_concurrent_find_prefix(
+          &fio_radix_concurrent_data.tree, buf, len, &match_len);
+      fio_rcu_read_unlock(token);
+      if ((found && found != i) || (!found && !(i & 1)) ||
+          (!(i & 1) && (prefix != i || match_len != len - 2)))
+        fio_atomic_add(&fio_radix_concurrent_data.errors, 1);
+      ++lookups;
+    }
+  }
+  fio_atomic_add(&fio_radix_concurrent_data.lookups, lookups);
+  return ignr;
+}
+
+FIO_FUNC void fio_radix_concurrent_test(void) {
+  fprintf(stderr, "=== Testing concurrent Radix Tree\n");
+  fio_radix_concurrent_s *t = &fio_radix_concurrent_data.tree;
+  char buf[32];
+  fio_radix_test_destroyed = 0;
+  for (uintptr_t i = 2; i < FIO_RADIX_CONCURRENT_TEST_KEYS; i += 2) {
+    size_t len = (size_t)snprintf(buf, sizeof(buf), "k/%zu", (size_t)i);
+    fio_radix_concurrent_insert(t, buf, len, i, NULL);
+  }
+  void *threads[4];
+  for (size_t i = 0; i < 4; ++i) {
+    threads[i] = fio_thread_new(fio_radix_concurrent_reader, NULL);
+    FIO_ASSERT(threads[i], "couldn't start reader thread");
+  }
+  /* a single writer, so no lock is required */
+  for (size_t round = 0; round < 128; ++round) {
+    for (uintptr_t i = 1; i < FIO_RADIX_CONCURRENT_TEST_KEYS; i += 2) {
+      size_t len = (size_t)snprintf(buf, sizeof(buf), "k/%zu", (size_t)i);
+      fio_radix_concurrent_insert(t, buf, len, i, NULL);
+    }
+    for (uintptr_t i = 1; i < FIO_RADIX_CONCURRENT_TEST_KEYS; i += 2) {
+      size_t len = (size_t)snprintf(buf, sizeof(buf), "k/%zu", (size_t)i);
+      fio_radix_concurrent_remove(t, buf, len, NULL);
+    }
+    fio_rcu_review();
+  }
+  fio_radix_concurrent_data.done = 1;
+  for (size_t i = 0; i < 4; ++i)
+    fio_thread_join(threads[i]);
+  FIO_ASSERT(!fio_radix_concurrent_data.errors,
+             "concurrent Radix Tree lookups failed (%zu errors in %zu)",
+             (size_t)fio_radix_concurrent_data.errors,
+             (size_t)fio_radix_concurrent_data.lookups);
+  FIO_ASSERT(fio_radix_concurrent_count(t) ==
+                 ((FIO_RADIX_CONCURRENT_TEST_KEYS >> 1) - 1),
+             "concurrent Radix Tree count error");
+  FIO_LOG_DEBUG("concurrent Radix Tree - %zu lock-free lookups during writes",
+                (size_t)fio_radix_concurrent_data.lookups);
+  fio_radix_concurrent_free(t);
+  for (int i = 0; i < 3; ++i)
+    fio_rcu_review();
+  FIO_ASSERT(fio_radix_test_destroyed ==
+                 (intptr_t)((FIO_RADIX_CONCURRENT_TEST_KEYS >> 1) * 129 - 1),
+             "concurrent Radix Tree objects should be destroyed (%zu)",
+             (size_t)fio_radix_test_destroyed);
+  fprintf(stderr, "* passed.\n");
+}
+#undef FIO_RADIX_CONCURRENT_TEST_KEYS
+
+/* *****************************************************************************
+Cache Testing
+***************************************************************************** */
+
+FIO_FUNC intptr_t fio_cache_test_destroyed = 0;
+FIO_FUNC uint64_t fio_cache_test_time = 1;
+
+#define FIO_CACHE_NAME fio_cache_test
+#define FIO_CACHE_OBJ_TYPE uintptr_t
+#define FIO_CACHE_OBJ_DESTROY(o) (++fio_cache_test_destroyed)
+#define FIO_CACHE_TIME_MS() (fio_cache_test_time)
+#include <fio.h>
+
+#define FIO_CACHE_NAME fio_cache_test_lfu
+#define FIO_CACHE_OBJ_TYPE uintptr_t
+#define FIO_CACHE_OBJ_DESTROY(o) (++fio_cache_test_destroyed)
+#define FIO_CACHE_TIME_MS() (fio_cache_test_time)
+#define FIO_CACHE_TINYLFU 1
+#include <fio.h>
+
+#if NODEBUG
+/* a skewed (Zipf like) key stream, where a few keys get most of the hits */
+FIO_FUNC uintptr_t fio_cache_speed_test_key(uint64_t *state, size_t keys) {
+  *state = (*state * 6364136223846793005ULL) + 1442695040888963407ULL;
+  uint64_t r = (*state >> 33); /* uniform in [0, 2^31) */
+  /* raising a uniform value to the 4th power skews it towards low keys */
+  r = (r * r) >> 31;
+  r = (r * r) >> 31;
+  return (uintptr_t)((r * keys) >> 31) + 1;
+}
+
+FIO_FUNC void fio_cache_speed_test(void) {
+  const size_t keys = 1 << 16;
+  const size_t capa = 1 << 10;
+  const size_t ops = 1 << 22;
+  fio_cache_test_s lru = FIO_CACHE_INIT(capa, 0);
+  fio_cache_test_lfu_s lfu = FIO_CACHE_INIT(capa, 0);
+  struct timespec start, end;
+  uint64_t state = 1;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ops; ++i) {
+    uintptr_t k = fio_cache_speed_test_key(&state, keys);
+    if (!fio_cache_test_get(&lru, k, k))
+      fio_cache_test_put(&lru, k, k, k, 1, 0);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fprintf(stderr,
+          "\t- LRU     %zu get/put ops: %zu us, hit rate %.2f%%\n",
+          ops,
+          (size_t)((end.tv_sec - start.tv_sec) * 1000000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000),
+          (100.0 * lru.stats.hits) / ops);
+  state = 1;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ops; ++i) {
+    uintptr_t k = fio_cache_speed_test_key(&state, keys);
+    if (!fio_cache_test_lfu_get(&lfu, k, k))
+      fio_cache_test_lfu_put(&lfu, k, k, k, 1, 0);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fprintf(stderr,
+          "\t- TinyLFU %zu get/put ops: %zu us, hit rate %.2f%%\n",
+          ops,
+          (size_t)((end.tv_sec - start.tv_sec) * 1000000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000),
+          (100.0 * lfu.stats.hits) / ops);
+  fio_cache_test_free(&lru);
+  fio_cache_test_lfu_free(&lfu);
+}
+#endif
+
+FIO_FUNC void fio_cache_test(void) {
+  fprintf(stderr, "=== Testing Cache (LRU / TinyLFU)\n");
+  fio_cache_test_s c = FIO_CACHE_INIT(4, 0);
+  fio_cache_test_destroyed = 0;
+  /* LRU order */
+  for (uintptr_t i = 1; i <= 4; ++i)
+    FIO_ASSERT(!fio_cache_test_put(&c, i, i, i * 10, 1, 0),
+               "Cache put failed");
+  FIO_ASSERT(fio_cache_test_count(&c) == 4 && fio_cache_test_bytes(&c) == 4,
+             "Cache count / bytes error");
+  FIO_ASSERT(fio_cache_test_get(&c, 1, 1) == 10, "Cache get error");
+  FIO_ASSERT(!fio_cache_test_put(&c, 5, 5, 50, 1, 0), "Cache put failed");
+  FIO_ASSERT(fio_cache_test_count(&c) == 4 && fio_cache_test_destroyed == 1,
+             "Cache should have evicted a single object");
+  FIO_ASSERT(!fio_cache_test_get(&c, 2, 2),
+             "Cache should have evicted the least recently used object");
+  FIO_ASSERT(fio_cache_test_get(&c, 1, 1) == 10 &&
+                 fio_cache_test_get(&c, 3, 3) == 30 &&
+                 fio_cache_test_get(&c, 5, 5) == 50,
+             "Cache evicted the wrong object");
+  /* overwrite */
+  FIO_ASSERT(!fio_cache_test_put(&c, 3, 3, 33, 2, 0) &&
+                 fio_cache_test_get(&c, 3, 3) == 33 &&
+                 fio_cache_test_count(&c) == 4 &&
+                 fio_cache_test_bytes(&c) == 5 &&
+                 fio_cache_test_destroyed == 2,
+             "Cache overwrite error");
+  /* remove */
+  {
+    uintptr_t old = 0;
+    FIO_ASSERT(!fio_cache_test_remove(&c, 3, 3, &old) && old == 33 &&
+                   fio_cache_test_count(&c) == 3 &&
+                   fio_cache_test_bytes(&c) == 3,
+               "Cache remove error");
+    FIO_ASSERT(fio_cache_test_remove(&c, 3, 3, NULL),
+               "Cache removed a missing object");
+  }
+  /* stats */
+  {
+    fio_cache_test_stats_s s = fio_cache_test_stats(&c);
+    FIO_ASSERT(s.hits == 5 && s.misses == 1 && s.evictions == 1,
+               "Cache stats error (%zu hits, %zu misses, %zu evictions)",
+               s.hits, s.misses, s.evictions);
+  }
+  /* TTL */
+  fio_cache_test_time = 1000;
+  FIO_ASSERT(!fio_cache_test_put(&c, 7, 7, 70, 1, 100) &&
+                 !fio_cache_test_put(&c, 8, 8, 80, 1, 200),
+             "Cache put (TTL) failed");
+  fio_cache_test_time = 1099;
+  FIO_ASSERT(fio_cache_test_get(&c, 7, 7) == 70,
+             "Cache object expired too soon");
+  fio_cache_test_time = 1100;
+  FIO_ASSERT(!fio_cache_test_get(&c, 7, 7) && c.stats.expired == 1,
+             "Cache object should have expired");
+  fio_cache_test_time = 1200;
+  FIO_ASSERT(fio_cache_test_expire(&c) == 1 && !fio_cache_test_get(&c, 8, 8) &&
+                 c.stats.expired == 2,
+             "Cache expire sweep error");
+  fio_cache_test_time = 1;
+  fio_cache_test_destroyed = 0;
+  fio_cache_test_free(&c);
+  FIO_ASSERT(fio_cache_test_destroyed == 2 && !fio_cache_test_count(&c) &&
+                 !fio_cache_test_bytes(&c) && !c.head && !c.tail,
+             "Cache free error (%zu)", (size_t)fio_cache_test_destroyed);
+  /* byte limit */
+  c = (fio_cache_test_s)FIO_CACHE_INIT(0, 100);
+  fio_cache_test_destroyed = 0;
+  for (uintptr_t i = 1; i <= 10; ++i)
+    fio_cache_test_put(&c, i, i, i, 10, 0);
+  FIO_ASSERT(fio_cache_test_bytes(&c) == 100 && fio_cache_test_count(&c) == 10,
+             "Cache byte accounting error");
+  FIO_ASSERT(!fio_cache_test_put(&c, 11, 11, 11, 35, 0) &&
+                 fio_cache_test_bytes(&c) == 95 &&
+                 fio_cache_test_count(&c) == 7 &&
+                 fio_cache_test_destroyed == 4 &&
+                 !fio_cache_test_get(&c, 4, 4) &&
+                 fio_cache_test_get(&c, 5, 5) == 5,
+             "Cache byte limit eviction error");
+  FIO_ASSERT(fio_cache_test_put(&c, 12, 12, 12, 101, 0) &&
+                 !fio_cache_test_get(&c, 12, 12) &&
+                 fio_cache_test_count(&c) == 7 && c.stats.rejected == 1,
+             "Cache should reject objects larger than the byte limit");
+  FIO_ASSERT(!fio_cache_test_put(&c, 5, 5, 55, 70, 0) &&
+                 fio_cache_test_bytes(&c) <= 100 &&
+                 fio_cache_test_get(&c, 5, 5) == 55,
+             "Cache overwrite (growing object) error");
+  fio_cache_test_free(&c);
+  /* TinyLFU admission */
+  {
+    fio_cache_test_lfu_s lfu = FIO_CACHE_INIT(8, 0);
+    fio_cache_test_destroyed = 0;
+    for (uintptr_t i = 1; i <= 8; ++i)
+      fio_cache_test_lfu_put(&lfu, i, i, i, 1, 0);
+    /* make the existing objects popular */
+    for (size_t round = 0; round < 8; ++round)
+      for (uintptr_t i = 1; i <= 8; ++i)
+        fio_cache_test_lfu_get(&lfu, i, i);
+    /* a scan of one-hit objects shouldn't flush the cache */
+    for (uintptr_t i = 100; i < 200; ++i) {
+      FIO_ASSERT(!fio_cache_test_lfu_get(&lfu, i, i),
+                 "TinyLFU returned an uncached object");
+      fio_cache_test_lfu_put(&lfu, i, i, i, 1, 0);
     }
-    end_bad = clock();
-    FIO_ASSERT(fio_set_attack_count(&as) == FIO_SET_TEST_COUNT,
-               "partial collision resolusion failed, not enough inserts!");
-    FIO_LOG_DEBUG("set partial collision attack final count/capa = %zu / %zu",
-                  fio_set_attack_count(&as), fio_set_attack_capa(&as));
-    FIO_LOG_DEBUG("set partial collision attack timing impact (attack vs. "
-                  "normal) %zu vs. %zu",
-                  end_bad - start_bad, end_ok - start_ok);
-    fio_set_attack_free(&as);
+    for (uintptr_t i = 1; i <= 8; ++i)
+      FIO_ASSERT(fio_cache_test_lfu_get(&lfu, i, i) == i,
+                 "TinyLFU admitted a one-hit object over a popular one");
+    FIO_ASSERT(lfu.stats.rejected == 100 && !fio_cache_test_destroyed,
+               "TinyLFU admission stats error (%zu)", lfu.stats.rejected);
+    /* a new object that becomes popular is eventually admitted */
+    for (size_t round = 0; round < 16; ++round)
+      fio_cache_test_lfu_get(&lfu, 300, 300);
+    FIO_ASSERT(!fio_cache_test_lfu_put(&lfu, 300, 300, 300, 1, 0) &&
+                   fio_cache_test_lfu_get(&lfu, 300, 300) == 300 &&
+                   fio_cache_test_destroyed == 1,
+               "TinyLFU should admit a popular object");
+    fio_cache_test_lfu_free(&lfu);
+    FIO_ASSERT(fio_cache_test_destroyed == 9 && !lfu.sketch,
+               "TinyLFU free error");
   }
+#if NODEBUG
+  fio_cache_speed_test();
+#endif
+  fprintf(stderr, "* passed.\n");
 }
 
 /* *****************************************************************************
@@ -9958,11 +15295,84 @@ FIO_FUNC void fio_riskyhash_speed_test(void) {
   }
 }
 
+/* short keys of mixed lengths - a loop over fio_risky_hash vs. the batch API */
+FIO_FUNC void fio_riskyhash_batch_speed_test(void) {
+  uint8_t buffer[4096];
+  const void *keys[1024];
+  size_t lens[1024];
+  uint64_t results[1024];
+  fio_rand_bytes(buffer, sizeof(buffer));
+  for (size_t i = 0; i < 1024; ++i) {
+    lens[i] = 4 + (fio_rand64() % 36);
+    keys[i] = buffer + (fio_rand64() % (sizeof(buffer) - 40));
+  }
+  for (int batch = 0; batch < 2; ++batch) {
+    for (size_t cycles = 256;;) {
+      clock_t start = clock();
+      for (size_t i = cycles; i > 0; i--) {
+        if (batch) {
+          fio_risky_hash_batch(results, keys, lens, 1024, i);
+        } else {
+          for (size_t k = 0; k < 1024; ++k)
+            results[k] = fio_risky_hash(keys[k], lens[k], i);
+        }
+        __asm__ volatile("" ::: "memory");
+      }
+      clock_t end = clock();
+      if ((end - start) >= (CLOCKS_PER_SEC >> 1)) {
+        fprintf(stderr, "%-20s %8.2f ns per key\n",
+                (batch ? "fio_risky_hash_batch" : "fio_risky_hash loop"),
+                ((end - start) * 1000000000.0 / CLOCKS_PER_SEC) /
+                    (cycles * 1024.0));
+        break;
+      }
+      cycles <<= 1;
+    }
+  }
+}
+
+/* the streaming and batch APIs must produce the one-shot results */
+FIO_FUNC void fio_riskyhash_stream_test(void) {
+  uint8_t buffer[1031];
+  const void *keys[67];
+  size_t lens[67];
+  uint64_t results[67];
+  fio_rand_bytes(buffer, sizeof(buffer));
+  fprintf(stderr, "* Testing Risky Hash streaming / batch API.\n");
+  for (size_t len = 0; len < sizeof(buffer); ++len) {
+    const uint64_t expected = fio_risky_hash(buffer, len, len);
+    fio_risky_s r = fio_risky_init(len);
+    for (size_t pos = 0, step = 1; pos < len; step = (step * 3) % 37) {
+      const size_t part = (len - pos < step) ? len - pos : step;
+      fio_risky_write(&r, buffer + pos, part);
+      pos += part;
+      FIO_ASSERT(fio_risky_result(&r) == fio_risky_hash(buffer, pos, len),
+                 "Risky Hash streaming result error (%zu/%zu bytes)", pos,
+                 len);
+    }
+    FIO_ASSERT(fio_risky_result(&r) == expected,
+               "Risky Hash streaming result error (%zu bytes)", len);
+  }
+  for (size_t i = 0; i < 67; ++i) {
+    lens[i] = (fio_rand64() % 80);
+    keys[i] = buffer + (fio_rand64() % (sizeof(buffer) - 80));
+  }
+  for (size_t count = 0; count <= 67; ++count) {
+    fio_risky_hash_batch(results, keys, lens, count, count);
+    for (size_t i = 0; i < count; ++i)
+      FIO_ASSERT(results[i] == fio_risky_hash(keys[i], lens[i], count),
+                 "Risky Hash batch result error (%zu of %zu)", i, count);
+  }
+}
+
 FIO_FUNC void fio_riskyhash_test(void) {
   fprintf(stderr, "===================================\n");
+  fio_riskyhash_stream_test();
 #if NODEBUG
   fio_riskyhash_speed_test();
+  fio_riskyhash_batch_speed_test();
 #else
+  (void)fio_riskyhash_batch_speed_test;
   fprintf(stderr, "fio_risky_hash speed test skipped (debug mode is slow)\n");
   fio_str_info_s str1 =
       (fio_str_info_s){.data = "nothing_is_really_here1", .len = 23};
@@ -10333,15 +15743,15 @@ FIO_FUNC void fio_sha2_test(void) {
   if (strcmp(expect, got))
     goto error;
 
-  // s = fio_sha2_init(SHA_256);
-  // str = "The quick brown fox jumps over the lazy dog";
-  // fio_sha2_write(&s, str, strlen(str));
-  // expect =
-  //     "\xd7\xa8\xfb\xb3\x07\xd7\x80\x94\x69\xca\x9a\xbc\xb0\x08\x2e\x4f"
-  //     "\x8d\x56\x51\xe4\x6d\x3c\xdb\x76\x2d\x02\xd0\xbf\x37\xc9\xe5\x92";
-  // got = fio_sha2_result(&s);
-  // if (strcmp(expect, got))
-  //   goto error;
+  s = fio_sha2_init(SHA_256);
+  str = "The quick brown fox jumps over the lazy dog";
+  fio_sha2_write(&s, str, strlen(str));
+  expect =
+      "\xd7\xa8\xfb\xb3\x07\xd7\x80\x94\x69\xca\x9a\xbc\xb0\x08\x2e\x4f"
+      "\x8d\x56\x51\xe4\x6d\x3c\xdb\x76\x2d\x02\xd0\xbf\x37\xc9\xe5\x92";
+  got = fio_sha2_result(&s);
+  if (strcmp(expect, got))
+    goto error;
 
   s = fio_sha2_init(SHA_224);
   str = "The quick brown fox jumps over the lazy dog";
@@ -10399,6 +15809,117 @@ error:
   FIO_ASSERT(0, "SHA-2 failure.");
 }
 
+/* *****************************************************************************
+SHA-1 / SHA-256 - split writes and hardware acceleration tests
+***************************************************************************** */
+
+#if FIO_SHA_SHANI
+/* measures the block processing throughput of the portable / SHA-NI code */
+FIO_FUNC void fio_sha_shani_speed_test(void) {
+  uint8_t buffer[8192];
+  fio_sha1_s sha1 = fio_sha1_init();
+  fio_sha2_s sha2 = fio_sha2_init(SHA_256);
+  memset(buffer, 'T', sizeof(buffer));
+  for (int impl = 0; impl < 4; ++impl) {
+    const char *names[] = {"SHA-1 (portable)", "SHA-1 (SHA-NI)",
+                           "SHA-256 (portable)", "SHA-256 (SHA-NI)"};
+    for (size_t cycles = 1024;;) {
+      clock_t start = clock();
+      for (size_t i = cycles; i > 0; i--) {
+        switch (impl) {
+        case 0:
+          for (size_t b = 0; b < sizeof(buffer); b += 64)
+            fio_sha1_perform_all_rounds(&sha1, buffer + b);
+          break;
+        case 1:
+          fio_sha1_perform_blocks_shani(&sha1, buffer, sizeof(buffer) >> 6);
+          break;
+        case 2:
+          for (size_t b = 0; b < sizeof(buffer); b += 64)
+            fio_sha2_perform_all_rounds(&sha2, buffer + b);
+          break;
+        case 3:
+          fio_sha2_256_perform_blocks_shani(&sha2, buffer, sizeof(buffer) >> 6);
+          break;
+        }
+        __asm__ volatile("" ::: "memory");
+      }
+      clock_t end = clock();
+      if ((end - start) >= (CLOCKS_PER_SEC >> 1)) {
+        fprintf(stderr, "%-20s %8.2f MB/s\n", names[impl],
+                (double)(sizeof(buffer) * cycles) /
+                    (((end - start) * 1000000.0 / CLOCKS_PER_SEC)));
+        break;
+      }
+      cycles <<= 1;
+    }
+  }
+}
+#endif
+
+FIO_FUNC void fio_sha_shani_test(void) {
+  uint8_t data[1031];
+  for (size_t i = 0; i < sizeof(data); ++i)
+    data[i] = (uint8_t)((i * 131) ^ (i >> 3));
+  fprintf(stderr, "* Testing SHA-1 / SHA-256 split writes.\n");
+  for (size_t len = 0; len < sizeof(data); len += 7) {
+    /* digests must not depend on the way the data is split */
+    fio_sha1_s a = fio_sha1_init(), b = fio_sha1_init();
+    fio_sha2_s c = fio_sha2_init(SHA_256), d = fio_sha2_init(SHA_256);
+    fio_sha2_s e = fio_sha2_init(SHA_512), f = fio_sha2_init(SHA_512);
+    fio_sha1_write(&a, data, len);
+    fio_sha2_write(&c, data, len);
+    fio_sha2_write(&e, data, len);
+    for (size_t pos = 0, step = 1; pos < len; pos += step, step += 3) {
+      size_t part = (len - pos < step) ? len - pos : step;
+      fio_sha1_write(&b, data + pos, part);
+      fio_sha2_write(&d, data + pos, part);
+      fio_sha2_write(&f, data + pos, part);
+    }
+    FIO_ASSERT(!memcmp(fio_sha1_result(&a), fio_sha1_result(&b), 20),
+               "SHA-1 split write digest mismatch (%zu bytes)", len);
+    FIO_ASSERT(!memcmp(fio_sha2_result(&c), fio_sha2_result(&d), 32),
+               "SHA-256 split write digest mismatch (%zu bytes)", len);
+    FIO_ASSERT(!memcmp(fio_sha2_result(&e), fio_sha2_result(&f), 64),
+               "SHA-512 split write digest mismatch (%zu bytes)", len);
+  }
+#if FIO_SHA_SHANI
+  if (!fio_sha_shani_available()) {
+    fprintf(stderr, "* SHA-NI unavailable, hardware tests skipped.\n");
+    (void)fio_sha_shani_speed_test;
+    return;
+  }
+  fprintf(stderr, "* Testing SHA-NI against the portable implementation.\n");
+  for (size_t blocks = 1; blocks <= (sizeof(data) >> 6); ++blocks) {
+    fio_sha1_s s1 = fio_sha1_init(), h1 = fio_sha1_init();
+    fio_sha2_s s2 = fio_sha2_init(SHA_256), h2 = fio_sha2_init(SHA_256);
+    fio_sha2_s s3 = fio_sha2_init(SHA_224), h3 = fio_sha2_init(SHA_224);
+    for (size_t i = 0; i < blocks; ++i) {
+      fio_sha1_perform_all_rounds(&s1, data + (i << 6));
+      fio_sha2_perform_all_rounds(&s2, data + (i << 6));
+      fio_sha2_perform_all_rounds(&s3, data + (i << 6));
+    }
+    fio_sha1_perform_blocks_shani(&h1, data, blocks);
+    fio_sha2_256_perform_blocks_shani(&h2, data, blocks);
+    fio_sha2_256_perform_blocks_shani(&h3, data, blocks);
+    FIO_ASSERT(!memcmp(s1.digest.i, h1.digest.i, sizeof(s1.digest.i)),
+               "SHA-1 SHA-NI state mismatch (%zu blocks)", blocks);
+    FIO_ASSERT(!memcmp(s2.digest.i32, h2.digest.i32, 32),
+               "SHA-256 SHA-NI state mismatch (%zu blocks)", blocks);
+    FIO_ASSERT(!memcmp(s3.digest.i32, h3.digest.i32, 32),
+               "SHA-224 SHA-NI state mismatch (%zu blocks)", blocks);
+  }
+#if NODEBUG
+  fio_sha_shani_speed_test();
+#else
+  fprintf(stderr, "SHA-NI speed test skipped (debug mode is slow)\n");
+  (void)fio_sha_shani_speed_test;
+#endif
+#else
+  fprintf(stderr, "* SHA-NI unsupported by compiler / platform, skipped.\n");
+#endif
+}
+
 /* *****************************************************************************
 Base64 tests
 ***************************************************************************** */
@@ -10519,8 +16040,75 @@ FIO_FUNC void fio_base64_test(void) {
   }
   fprintf(stderr, " Base64 decode passed.\n");
 
+  /* 'A' (0) and the Base64URL alphabet */
+  fio_base64_decode(buffer, "AAAAAP__-_-_QUFB", 16);
+  FIO_ASSERT(!memcmp(buffer, "\0\0\0\0\xff\xff\xfb\xff\xbf"
+                             "AAA",
+                     12),
+             "Base64 decode failed for 'A' / Base64URL data");
+  FIO_ASSERT(fio_base64url_encode(buffer, "\0\0\0\0\xff\xff\xfb\xff\xbf",
+                                  9) == 12 &&
+                 !memcmp(buffer, "AAAAAP__-_-_", 12),
+             "Base64URL encode failed");
+#if FIO_BASE64_SIMD
+  {
+    /* the SIMD kernels must produce the same results as the portable code */
+    const int max_level = fio_base64_simd_level();
+    char raw[777], encoded[3][1040], decoded[3][1040];
+    int elen[3], dlen[3];
+    fprintf(stderr, "* Testing Base64 SIMD kernels (level %d).\n", max_level);
+    for (size_t round = 0; round < 1024; ++round) {
+      const int len = (int)(fio_rand64() % sizeof(raw));
+      fio_rand_bytes(raw, len);
+      for (int level = 0; level <= max_level; ++level) {
+        fio_base64_simd = level;
+        elen[level] = (round & 1)
+                          ? fio_base64url_encode(encoded[level], raw, len)
+                          : fio_base64_encode(encoded[level], raw, len);
+        FIO_ASSERT(elen[level] == elen[0] &&
+                       !memcmp(encoded[level], encoded[0], elen[0]),
+                   "Base64 SIMD encoding mismatch (level %d, %d bytes)", level,
+                   len);
+      }
+      /* white space, padding and invalid data leave the fast path */
+      if ((round & 3) == 3 && elen[0])
+        encoded[0][fio_rand64() % elen[0]] = "\n =.!\x80"[fio_rand64() % 6];
+      for (int level = 0; level <= max_level; ++level) {
+        fio_base64_simd = level;
+        memcpy(encoded[1], encoded[0], elen[0]);
+        errno = 0;
+        dlen[level] = fio_base64_decode(decoded[level], encoded[1], elen[0]);
+        if (errno)
+          dlen[level] = -1 - dlen[level];
+        FIO_ASSERT(dlen[level] == dlen[0] &&
+                       !memcmp(decoded[level], decoded[0],
+                               (dlen[0] < 0 ? -1 - dlen[0] : dlen[0])),
+                   "Base64 SIMD decoding mismatch (level %d, %d bytes)", level,
+                   elen[0]);
+      }
+      FIO_ASSERT((round & 3) == 3 ||
+                     (dlen[0] == len && !memcmp(decoded[0], raw, len)),
+                 "Base64 round-trip failed (%d bytes)", len);
+    }
+    fio_base64_simd = max_level;
+  }
+#endif
+
 #if NODEBUG
+#if FIO_BASE64_SIMD
+  {
+    const char *names[] = {"portable", "SSSE3", "AVX2"};
+    const int max_level = fio_base64_simd_level();
+    for (int level = 0; level <= max_level; ++level) {
+      fio_base64_simd = level;
+      fprintf(stderr, "* Base64 %s:\n", names[level]);
+      fio_base64_speed_test();
+    }
+    fio_base64_simd = max_level;
+  }
+#else
   fio_base64_speed_test();
+#endif
 #else
   fprintf(stderr,
           "* Base64 speed test skipped (debug speeds are always slow).\n");
@@ -10610,6 +16198,122 @@ FIO_FUNC void fio_poll_test(void) {
 #define fio_poll_test()
 #endif
 
+/* *****************************************************************************
+Connection Data Layout Testing
+***************************************************************************** */
+
+/* the number of connections reviewed by the speed test */
+#define FIO_FD_DATA_SPEED_TEST_COUNT 100000
+
+FIO_FUNC void fio_fd_data_speed_test(void) {
+  /* reviews the reactor's own connection table, using the unused fds */
+  uintptr_t start = 0;
+  for (uintptr_t fd = 0; fd < fio_data->capa; ++fd) {
+    if (fd_page_exists(fd) && fd_data(fd).open)
+      start = fd + 1;
+  }
+  const uintptr_t count = FIO_FD_DATA_SPEED_TEST_COUNT;
+  const uintptr_t end = start + count;
+  fio_data_s *const real = fio_data;
+  const uintptr_t real_pages = fio_fd_page_count(real->capa);
+  if (real->capa < end) {
+    /*
+     * The capacity is set by `fio_lib_init` (which already raised the
+     * RLIMIT_NOFILE limit as far as possible), so a larger copy of the state
+     * is used, sharing the existing pages and adding pages on demand.
+     */
+    const size_t len =
+        sizeof(*fio_data) + (fio_fd_page_count(end) * sizeof(*fio_data->pages));
+    fio_data_s *tmp = fio_mmap(len);
+    FIO_ASSERT_ALLOC(tmp);
+    memcpy(tmp, real, sizeof(*tmp));
+    memcpy(tmp->pages, real->pages, real_pages * sizeof(*tmp->pages));
+    tmp->capa = (uint32_t)end;
+    fio_data = tmp;
+  }
+  fprintf(stderr, "* reviewing %zu connections (%s table, capacity %zu).\n",
+          (size_t)count, (fio_data == real ? "reactor" : "synthetic"),
+          (size_t)real->capa);
+  const time_t now = fio_data->last_cycle.tv_sec;
+  for (uintptr_t fd = start; fd < end; ++fd) {
+    /* half expired (without a protocol, the review leaves them open) */
+    fd_data(fd).open = 1;
+    fd_data(fd).active = now - ((fd & 1) ? 600 : 0);
+    fd_data(fd).timeout = (uint8_t)((fd & 63) + 1);
+  }
+  size_t expired = 0;
+  clock_t begin = clock();
+  for (size_t round = 0; round < 128; ++round) {
+    const time_t review = now + round;
+    for (uintptr_t fd = start; fd < end; ++fd) {
+      fio_fd_data_s *d = &fd_data(fd);
+      expired += (d->open && d->active + d->timeout < review);
+    }
+    __asm__ volatile("" ::: "memory");
+  }
+  clock_t end_clock = clock();
+  fprintf(stderr,
+          "* fd_data review of %zu connections: %.2f ns per connection "
+          "(%zu bytes per connection, %zu expired).\n",
+          (size_t)count,
+          (double)(end_clock - begin) * 1000000000.0 /
+              ((double)CLOCKS_PER_SEC * count * 128),
+          sizeof(fio_fd_data_s), expired);
+  /* the actual review walks the table using the task queue */
+  const uint32_t max_protocol_fd = real->max_protocol_fd;
+  const uint8_t need_review = real->need_review;
+  fio_data->max_protocol_fd = (uint32_t)(end - 1);
+  begin = clock();
+  for (size_t round = 0; round < 16; ++round) {
+    fio_review_timeout((void *)start, NULL);
+    fio_defer_perform();
+  }
+  end_clock = clock();
+  fprintf(stderr,
+          "* fio_review_timeout of %zu connections: %.2f ns per connection.\n",
+          (size_t)count,
+          (double)(end_clock - begin) * 1000000000.0 /
+              ((double)CLOCKS_PER_SEC * count * 16));
+  for (uintptr_t fd = start; fd < end; ++fd) {
+    FIO_ASSERT(fd_data(fd).open, "the timeout review closed fd %zu",
+               (size_t)fd);
+    fd_data(fd).open = 0;
+    fd_data(fd).active = 0;
+    fd_data(fd).timeout = 0;
+  }
+  if (fio_data != real) {
+    /* free the pages allocated by the copy (including pages below the real
+     * capacity that the reactor's table never allocated) */
+    for (size_t i = 0; i < fio_fd_page_count(end); ++i) {
+      if (fio_data->pages[i] &&
+          (i >= real_pages || fio_data->pages[i] != real->pages[i]))
+        fio_free(fio_data->pages[i]->mem);
+    }
+    fio_free(fio_data);
+    fio_data = real;
+  }
+  fio_data->max_protocol_fd = max_protocol_fd;
+  fio_data->need_review = need_review;
+}
+
+FIO_FUNC void fio_fd_data_test(void) {
+  fprintf(stderr, "=== Testing connection data layout\n");
+  FIO_ASSERT(sizeof(fio_fd_data_s) <= FIO_MEMORY_CACHE_LINE,
+             "connection data should fit in a cache line!");
+  FIO_ASSERT(!((uintptr_t)fd_page(0)->info & (FIO_MEMORY_CACHE_LINE - 1)),
+             "connection data should be aligned to a cache line!");
+  FIO_ASSERT(fio_fd_page_count(fio_data->capa) * FIO_FD_PAGE_SIZE >=
+                 fio_data->capa,
+             "connection data pages should cover the whole capacity!");
+#if NODEBUG
+  fio_fd_data_speed_test();
+#else
+  fprintf(stderr, "* connection data speed test skipped (debug mode)\n");
+  (void)fio_fd_data_speed_test;
+#endif
+  fprintf(stderr, "* passed.\n");
+}
+
 /* *****************************************************************************
 Test UUID Linking
 ***************************************************************************** */
@@ -10682,6 +16386,864 @@ FIO_FUNC void fio_pubsub_test_on_unsubscribe(void *udata1, void *udata2) {
   (void)udata2;
 }
 
+/* a custom matcher: the channel name is as long as the pattern */
+FIO_FUNC int fio_pubsub_test_match_len(fio_str_info_s pattern,
+                                       fio_str_info_s channel) {
+  return pattern.len == channel.len;
+}
+
+FIO_FUNC void fio_pubsub_test_pattern_index(void) {
+  const char *patterns[] = {
+      "*",          "tenant.*.events", "tenant.*",  "tenant.?.events",
+      "tenant.1.*", "*.events",        "*events",   "tenant.[0-9]*.events",
+      "tenant.a\\*", "tenant.a*",       "tenant.a*b", "t*t*t",
+      "[!x]*",      "*]",              "a*a",       "tenant.1.events",
+      "tenant.",    "",                "*.*.*",     "tenant.[ab]",
+  };
+  const char *channels[] = {
+      "tenant.1.events", "tenant.a.events", "tenant.42.events",
+      "tenant.a*",       "tenant.ab",       "tenant.a",
+      "tenant.b",        "tenant.",         "events",
+      "x.events",        "a",               "aa",
+      "tttt",            "",                "tenant.1.eventss",
+      "t.*.[",
+  };
+  const size_t pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+  const size_t channel_count = sizeof(channels) / sizeof(channels[0]);
+  subscription_s *subs[sizeof(patterns) / sizeof(patterns[0]) + 1];
+  uintptr_t counter = 0;
+  for (size_t i = 0; i < pattern_count; ++i) {
+    subs[i] = fio_subscribe(.channel = {0, strlen(patterns[i]),
+                                        (char *)patterns[i]},
+                            .match = FIO_MATCH_GLOB, .udata1 = &counter,
+                            .on_message = fio_pubsub_test_on_message);
+    FIO_ASSERT(subs[i], "fio_subscribe FAILED for pattern %s", patterns[i]);
+  }
+  subs[pattern_count] = fio_subscribe(
+      .channel = {0, 8, "12345678"}, .match = fio_pubsub_test_match_len,
+      .udata1 = &counter, .on_message = fio_pubsub_test_on_message);
+  FIO_ASSERT(subs[pattern_count], "fio_subscribe FAILED for custom matcher");
+  for (size_t i = 0; i < channel_count; ++i) {
+    fio_str_info_s ch = {.data = (char *)channels[i],
+                         .len = strlen(channels[i])};
+    uintptr_t expect = counter + (ch.len == 8);
+    for (size_t j = 0; j < pattern_count; ++j) {
+      expect += fio_glob_match(
+          (fio_str_info_s){.data = (char *)patterns[j],
+                           .len = strlen(patterns[j])},
+          ch);
+    }
+    fio_publish(.channel = ch);
+    fio_defer_perform();
+    FIO_ASSERT(counter == expect,
+               "pattern index missed a match for %s (%zu != %zu)", ch.data,
+               (size_t)counter, (size_t)expect);
+  }
+  for (size_t i = 0; i <= pattern_count; ++i)
+    fio_unsubscribe(subs[i]);
+  fio_defer_perform();
+  FIO_ASSERT(!fio_pattern_prefix_tree_count(&fio_postoffice.pattern_index.glob),
+             "pattern index should be empty after unsubscribing");
+  FIO_ASSERT(!fio_postoffice.pattern_index.custom,
+             "custom patterns should be empty after unsubscribing");
+#if NODEBUG
+  {
+    /* 50K tenant patterns, each publication matches one of them */
+    const size_t limit = 50000;
+    subscription_s **s = malloc(sizeof(*s) * limit);
+    char **names = malloc(sizeof(*names) * limit);
+    FIO_ASSERT_ALLOC(s && names);
+    for (size_t i = 0; i < limit; ++i) {
+      char buf[64];
+      size_t len = (size_t)snprintf(buf, sizeof(buf), "tenant%zu.*.events", i);
+      names[i] = malloc(len + 1);
+      FIO_ASSERT_ALLOC(names[i]);
+      memcpy(names[i], buf, len + 1);
+      s[i] = fio_subscribe(.channel = {0, len, names[i]},
+                           .match = FIO_MATCH_GLOB, .udata1 = &counter,
+                           .on_message = fio_pubsub_test_on_message);
+    }
+    const size_t rounds = 512;
+    char buf[64];
+    size_t found = 0;
+    clock_t start = clock();
+    for (size_t r = 0; r < rounds; ++r) {
+      channel_s *stack_buffer[64];
+      fio_str_info_s ch = {.data = buf};
+      ch.len = (size_t)snprintf(buf, sizeof(buf), "tenant%zu.users.events",
+                                (r * 97) % limit);
+      char reversed[64];
+      fio_pattern_reverse(reversed, ch.data, ch.len, ch.len);
+      fio_pattern_found_s f = {
+          .channel = ch,
+          .reversed = reversed,
+          .found = stack_buffer,
+          .capa = 64,
+          .stack_buffer = stack_buffer,
+      };
+      fio_pattern_index_find_dup(&f);
+      found += f.count;
+      for (size_t i = 0; i < f.count; ++i)
+        fio_channel_free(f.found[i]);
+      if (f.found != stack_buffer)
+        free(f.found);
+    }
+    clock_t end = clock();
+    FIO_ASSERT(found == rounds, "pattern index lookup count error (%zu)",
+               found);
+    fprintf(stderr,
+            "\t- pattern index, %zu patterns: %.2f us per publication\n",
+            limit, (double)(end - start) * 1000000 / CLOCKS_PER_SEC / rounds);
+    found = 0;
+    start = clock();
+    for (size_t r = 0; r < rounds; r += 16) {
+      fio_str_info_s ch = {.data = buf};
+      ch.len = (size_t)snprintf(buf, sizeof(buf), "tenant%zu.users.events",
+                                (r * 97) % limit);
+      for (size_t i = 0; i < limit; ++i)
+        found += fio_glob_match(
+            (fio_str_info_s){.data = names[i], .len = strlen(names[i])}, ch);
+    }
+    end = clock();
+    FIO_ASSERT(found == rounds / 16, "linear glob count error (%zu)", found);
+    fprintf(stderr,
+            "\t- linear glob scan, %zu patterns: %.2f us per publication\n",
+            limit,
+            (double)(end - start) * 1000000 / CLOCKS_PER_SEC / (rounds / 16));
+    for (size_t i = 0; i < limit; ++i) {
+      fio_unsubscribe(s[i]);
+      free(names[i]);
+    }
+    free(s);
+    free(names);
+    fio_defer_perform();
+  }
+#endif
+}
+
+/* defers the first message it receives, once (`udata2` marks the deferral) */
+FIO_FUNC void fio_pubsub_test_on_message_defer(fio_msg_s *msg) {
+  if (!fio_atomic_xchange((uintptr_t *)msg->udata2, 1)) {
+    fio_message_defer(msg);
+    return;
+  }
+  fio_atomic_add((uintptr_t *)msg->udata1, 1);
+}
+
+FIO_FUNC void fio_pubsub_test_fanout(void) {
+  const size_t limit = (FIO_PUBSUB_BATCH_SIZE * 3) + 7;
+  subscription_s *subs[(FIO_PUBSUB_BATCH_SIZE * 3) + 7];
+  uintptr_t deferred[(FIO_PUBSUB_BATCH_SIZE * 3) + 7] = {0};
+  uintptr_t counter = 0;
+  uintptr_t expect = 0;
+  for (size_t i = 0; i < limit; ++i) {
+    subs[i] = fio_subscribe(.channel = {0, 6, "fanout"}, .udata1 = &counter,
+                            .udata2 = deferred + i,
+                            .on_message = (i & 7)
+                                              ? fio_pubsub_test_on_message
+                                              : fio_pubsub_test_on_message_defer);
+    FIO_ASSERT(subs[i], "fio_subscribe FAILED for fan-out subscription.");
+  }
+  fio_publish(.channel = {0, 6, "fanout"});
+  expect += limit;
+  fio_defer_perform();
+  FIO_ASSERT(counter == expect, "fan-out delivery error (%zu != %zu)",
+             (size_t)counter, (size_t)expect);
+  /* remove every third subscription, shuffling the array */
+  size_t removed = 0;
+  for (size_t i = 0; i < limit; i += 3) {
+    fio_unsubscribe(subs[i]);
+    subs[i] = NULL;
+    ++removed;
+  }
+  fio_publish(.channel = {0, 6, "fanout"});
+  expect += limit - removed;
+  fio_defer_perform();
+  FIO_ASSERT(counter == expect,
+             "fan-out delivery error after unsubscribe (%zu != %zu)",
+             (size_t)counter, (size_t)expect);
+  for (size_t i = 0; i < limit; ++i)
+    fio_unsubscribe(subs[i]);
+  fio_publish(.channel = {0, 6, "fanout"});
+  fio_defer_perform();
+  FIO_ASSERT(counter == expect, "fan-out delivered to unsubscribed channel");
+#if NODEBUG
+  {
+    /* 10K subscribers on a single channel */
+    const size_t count = 10000;
+    const size_t rounds = 64;
+    subscription_s **s = malloc(sizeof(*s) * count);
+    FIO_ASSERT_ALLOC(s);
+    for (size_t i = 0; i < count; ++i)
+      s[i] = fio_subscribe(.channel = {0, 6, "fanout"}, .udata1 = &counter,
+                           .on_message = fio_pubsub_test_on_message);
+    counter = 0;
+    clock_t start = clock();
+    for (size_t r = 0; r < rounds; ++r) {
+      fio_publish(.channel = {0, 6, "fanout"});
+      fio_defer_perform();
+    }
+    clock_t end = clock();
+    FIO_ASSERT(counter == count * rounds, "fan-out benchmark count error");
+    fprintf(stderr, "\t- fan-out to %zu subscribers: %.2f us per message\n",
+            count, (double)(end - start) * 1000000 / CLOCKS_PER_SEC / rounds);
+    for (size_t i = 0; i < count; ++i)
+      fio_unsubscribe(s[i]);
+    free(s);
+    fio_defer_perform();
+  }
+#endif
+}
+
+/* counts messages that arrived NUL terminated */
+FIO_FUNC void fio_pubsub_test_on_big_message(fio_msg_s *msg) {
+  if (!msg->msg.data[msg->msg.len] && !msg->channel.data[msg->channel.len])
+    fio_atomic_add((uintptr_t *)msg->udata1, 1);
+}
+
+FIO_FUNC void fio_pubsub_test_big_message(void) {
+  /* messages above FIO_MEMORY_BLOCK_ALLOC_LIMIT reuse cached big allocations */
+  const size_t len = 20000;
+  uintptr_t counter = 0;
+  char *data = malloc(len);
+  FIO_ASSERT_ALLOC(data);
+  memset(data, 'd', len);
+  subscription_s *s =
+      fio_subscribe(.channel = {0, 3, "big"}, .udata1 = &counter,
+                    .on_message = fio_pubsub_test_on_big_message);
+  for (size_t i = 0; i < 4; ++i) {
+    /* leave dirty memory in the big allocation cache (same size bin) */
+    char *dirty = fio_malloc(len + 4096);
+    FIO_ASSERT_ALLOC(dirty);
+    memset(dirty, 'x', len + 4096);
+    fio_free(dirty);
+    fio_publish(.channel = {0, 3, "big"}, .message = {0, len, data});
+    fio_defer_perform();
+  }
+  FIO_ASSERT(counter == 4, "big messages should be NUL terminated (%zu/4)",
+             (size_t)counter);
+  fio_unsubscribe(s);
+  fio_defer_perform();
+  free(data);
+}
+
+#if FIO_CLUSTER_SHM
+static size_t fio_pubsub_test_ring_count;
+
+/* verifies the records are popped in order (the data is the sequence) */
+FIO_FUNC void fio_pubsub_test_ring_handler(uint32_t sender,
+                                           fio_msg_internal_s *m) {
+  FIO_ASSERT(sender == 3, "shared memory ring sender error (%u)",
+             (unsigned int)sender);
+  FIO_ASSERT(m->channel.len == 4 && !memcmp(m->channel.data, "ring", 4),
+             "shared memory ring channel error");
+  FIO_ASSERT(m->data.len >= 8 &&
+                 fio_str2u64(m->data.data) == fio_pubsub_test_ring_count,
+             "shared memory ring order error (%zu)",
+             fio_pubsub_test_ring_count);
+  FIO_ASSERT(m->filter == 0 && !m->is_json,
+             "shared memory ring message properties error");
+  ++fio_pubsub_test_ring_count;
+}
+
+/* locks the ring and exits without unlocking it (a crashing producer) */
+FIO_FUNC void *fio_pubsub_test_ring_crash(void *r) {
+  fio_cluster_ring_lock(r);
+  return NULL;
+}
+
+FIO_FUNC void fio_pubsub_test_ring(void) {
+  fio_cluster_ring_s *r = calloc(1, sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  r->bell = -1;
+  FIO_ASSERT(!fio_cluster_ring_lock_init(r),
+             "shared memory ring lock initialization failed");
+  char buf[1024] = {0};
+  size_t pushed = 0;
+  /* fill the ring, using uneven record lengths */
+  for (;;) {
+    fio_u2str64((uint8_t *)buf, pushed);
+    fio_msg_internal_s *m = fio_msg_internal_create(
+        0, FIO_CLUSTER_MSG_FORWARD, (fio_str_info_s){.data = "ring", .len = 4},
+        (fio_str_info_s){.data = buf, .len = 8 + (pushed % 997)}, 0, 1);
+    size_t offset = 0;
+    int ret = fio_cluster_ring_push(r, 3, m, &offset);
+    fio_msg_internal_free(m);
+    if (ret)
+      break;
+    ++pushed;
+  }
+  FIO_ASSERT(pushed > 100 && r->tail - r->head <= FIO_CLUSTER_SHM_RING_SIZE,
+             "shared memory ring fill error");
+  fio_pubsub_test_ring_count = 0;
+  FIO_ASSERT(fio_cluster_ring_drain(r, fio_pubsub_test_ring_handler) ==
+                     pushed &&
+                 fio_pubsub_test_ring_count == pushed,
+             "shared memory ring drain count error");
+  FIO_ASSERT(r->head == r->tail, "shared memory ring should be empty");
+  /* interleave pushes and pops, wrapping around the end of the ring */
+  for (size_t round = 0; round < 8; ++round) {
+    const size_t start = pushed;
+    while (pushed - start < 500) {
+      fio_u2str64((uint8_t *)buf, pushed);
+      fio_msg_internal_s *m = fio_msg_internal_create(
+          0, FIO_CLUSTER_MSG_FORWARD,
+          (fio_str_info_s){.data = "ring", .len = 4},
+          (fio_str_info_s){.data = buf, .len = 8 + (pushed % 997)}, 0, 1);
+      size_t offset = 0;
+      FIO_ASSERT(!fio_cluster_ring_push(r, 3, m, &offset),
+                 "shared memory ring push failed with room available");
+      fio_msg_internal_free(m);
+      ++pushed;
+    }
+    fio_cluster_ring_drain(r, fio_pubsub_test_ring_handler);
+    FIO_ASSERT(fio_pubsub_test_ring_count == pushed,
+               "shared memory ring wrap-around error");
+  }
+  FIO_ASSERT(r->tail > FIO_CLUSTER_SHM_RING_SIZE * 2,
+             "shared memory ring test didn't wrap around");
+  /* a producer that died while holding the lock shouldn't block the ring */
+  pthread_t thread;
+  FIO_ASSERT(!pthread_create(&thread, NULL, fio_pubsub_test_ring_crash, r),
+             "couldn't create a thread for the shared memory ring test");
+  pthread_join(thread, NULL);
+  {
+    fio_u2str64((uint8_t *)buf, pushed);
+    fio_msg_internal_s *m = fio_msg_internal_create(
+        0, FIO_CLUSTER_MSG_FORWARD, (fio_str_info_s){.data = "ring", .len = 4},
+        (fio_str_info_s){.data = buf, .len = 8}, 0, 1);
+    size_t offset = 0;
+    FIO_ASSERT(!fio_cluster_ring_push(r, 3, m, &offset),
+               "shared memory ring push failed after the owner died");
+    fio_msg_internal_free(m);
+    ++pushed;
+    fio_cluster_ring_drain(r, fio_pubsub_test_ring_handler);
+    FIO_ASSERT(fio_pubsub_test_ring_count == pushed,
+               "shared memory ring recovery error");
+  }
+  pthread_mutex_destroy(&r->lock);
+  free(r);
+}
+
+static size_t fio_pubsub_test_order_count;
+static uint32_t fio_pubsub_test_order_sender;
+
+/* the data length of the ordering test's publications (`i` is the index) */
+static size_t fio_pubsub_test_order_len(size_t i) {
+  return (i % 3 == 1 ? (FIO_CLUSTER_SHM_RING_SIZE * 2) + i : 17 + i);
+}
+
+/* pushes a publication for the ordering test (big ones don't fit the ring) */
+static fio_msg_internal_s *fio_pubsub_test_order_msg(size_t i) {
+  const size_t len = fio_pubsub_test_order_len(i);
+  char *buf = malloc(len);
+  FIO_ASSERT_ALLOC(buf);
+  memset(buf, (int)(i & 0xFF), len);
+  fio_u2str64((uint8_t *)buf, i);
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_FORWARD, (fio_str_info_s){.data = "order", .len = 5},
+      (fio_str_info_s){.data = buf, .len = len}, 0, 1);
+  free(buf);
+  return m;
+}
+
+/* verifies publications arrive whole and in the order they were sent */
+FIO_FUNC void fio_pubsub_test_order_handler(uint32_t sender,
+                                            fio_msg_internal_s *m) {
+  const size_t i = fio_pubsub_test_order_count++;
+  FIO_ASSERT(sender == fio_pubsub_test_order_sender,
+             "shared memory ring sender error (%u)", (unsigned int)sender);
+  FIO_ASSERT(m->channel.len == 5 && !memcmp(m->channel.data, "order", 5),
+             "mixed size publication channel error (%zu)", i);
+  FIO_ASSERT(m->data.len == fio_pubsub_test_order_len(i) &&
+                 fio_str2u64(m->data.data) == i,
+             "mixed size publications out of order (%zu)", i);
+  FIO_ASSERT(m->data.data[m->data.len - 1] == (char)(i & 0xFF) &&
+                 m->data.data[m->data.len >> 1] == (char)(i & 0xFF),
+             "mixed size publication corrupted (%zu)", i);
+}
+
+/* pops the ring until `expected` publications arrived, retrying the pushes */
+FIO_FUNC void fio_pubsub_test_order_collect(size_t slot, size_t expected) {
+  for (size_t loops = 0; fio_pubsub_test_order_count < expected; ++loops) {
+      FIO_ASSERT(loops < expected * 64,
+               "mixed size publications weren't delivered (%zu / %zu)",
+               fio_pubsub_test_order_count, expected);
+    fio_cluster_ring_drain(cluster_shm.rings + slot,
+                           fio_pubsub_test_order_handler);
+    fio_cluster_shm_flush((void *)slot, NULL);
+  }
+  fio_defer_perform(); /* the retry tasks find nothing left to push */
+  FIO_ASSERT(fio_ls_is_empty(&cluster_shm.peers[slot].overflow) &&
+                 cluster_shm.rings[slot].head == cluster_shm.rings[slot].tail,
+             "mixed size publications left behind");
+}
+
+FIO_FUNC void fio_pubsub_test_ring_order(void) {
+  const size_t total = 30;
+  fio_cluster_ring_s *rings = calloc(2, sizeof(*rings));
+  fio_cluster_shm_peer_s peers[2];
+  fio_cluster_shm_pieces_s pieces[2];
+  FIO_ASSERT_ALLOC(rings);
+  for (size_t i = 0; i < 2; ++i) {
+    rings[i].bell = -1;
+    rings[i].pid = getpid();
+    FIO_ASSERT(!fio_cluster_ring_lock_init(rings + i),
+               "shared memory ring lock initialization failed");
+    peers[i] = (fio_cluster_shm_peer_s){
+        .overflow = FIO_LS_INIT(peers[i].overflow),
+        .uuid = -1,
+        .lock = FIO_LOCK_INIT,
+    };
+    pieces[i] = (fio_cluster_shm_pieces_s){.frame = NULL};
+  }
+  const size_t count = cluster_shm.count, self = cluster_shm.self;
+  const uint8_t ready = cluster_shm.ready;
+  fio_cluster_ring_s *old_rings = cluster_shm.rings;
+  fio_cluster_shm_peer_s *old_peers = cluster_shm.peers;
+  fio_cluster_shm_pieces_s *old_pieces = cluster_shm.pieces;
+  fio_cluster_interest_s *interest = cluster_shm.interest;
+  cluster_shm.rings = rings;
+  cluster_shm.peers = peers;
+  cluster_shm.pieces = pieces;
+  cluster_shm.interest = NULL;
+  cluster_shm.count = 2;
+
+  /* the root process publishing to a worker (big frames are split) */
+  cluster_shm.self = 0;
+  for (size_t i = 0; i < total; ++i) {
+    fio_msg_internal_s *m = fio_pubsub_test_order_msg(i);
+    fio_cluster_shm_push(1, m);
+    fio_msg_internal_free(m);
+  }
+  FIO_ASSERT(fio_ls_any(&peers[1].overflow),
+             "the ordering test should overflow the ring");
+  fio_pubsub_test_order_count = 0;
+  fio_pubsub_test_order_sender = 0;
+  fio_pubsub_test_order_collect(1, total);
+
+  /* a worker publishing before the root process acknowledged its ring */
+  cluster_shm.self = 1;
+  cluster_shm.ready = 0;
+  for (size_t i = 0; i < total; ++i) {
+    fio_msg_internal_s *m = fio_pubsub_test_order_msg(i);
+    FIO_ASSERT(!fio_cluster_shm_send2root(m),
+               "publications should wait for the ring, not use the socket");
+    fio_msg_internal_free(m);
+  }
+  FIO_ASSERT(rings[0].head == rings[0].tail &&
+                 fio_ls_any(&cluster_shm.waiting),
+             "publications should wait for the root's acknowledgement");
+  fio_cluster_shm_on_ack();
+  FIO_ASSERT(cluster_shm.ready && fio_ls_is_empty(&cluster_shm.waiting),
+             "waiting publications weren't sent after the acknowledgement");
+  fio_pubsub_test_order_count = 0;
+  fio_pubsub_test_order_sender = 1;
+  fio_pubsub_test_order_collect(0, total);
+
+  cluster_shm.rings = old_rings;
+  cluster_shm.peers = old_peers;
+  cluster_shm.pieces = old_pieces;
+  cluster_shm.interest = interest;
+  cluster_shm.count = count;
+  cluster_shm.self = self;
+  cluster_shm.ready = ready;
+  for (size_t i = 0; i < 2; ++i)
+    pthread_mutex_destroy(&rings[i].lock);
+  free(rings);
+}
+
+FIO_FUNC void fio_pubsub_test_interest(void) {
+  /* pretend we consume ring 5 of 8, routing directly */
+  const size_t count = cluster_shm.count, self = cluster_shm.self;
+  cluster_shm.count = 8;
+  cluster_shm.self = 5;
+  cluster_shm.interest = calloc(1, sizeof(*cluster_shm.interest));
+  cluster_shm.interest_count =
+      calloc(FIO_CLUSTER_SHM_INTEREST, sizeof(*cluster_shm.interest_count));
+  FIO_ASSERT_ALLOC(cluster_shm.interest && cluster_shm.interest_count);
+  uintptr_t counter = 0;
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_FORWARD,
+      (fio_str_info_s){.data = "interest", .len = 8},
+      (fio_str_info_s){.data = NULL, .len = 0}, 0, 1);
+  FIO_ASSERT(!fio_cluster_shm_interested(m),
+             "interest marked without subscriptions");
+  subscription_s *s1 =
+      fio_subscribe(.channel = {0, 8, "interest"}, .udata1 = &counter,
+                    .on_message = fio_pubsub_test_on_message);
+  subscription_s *s2 =
+      fio_subscribe(.channel = {0, 8, "interest"}, .udata1 = &counter,
+                    .on_message = fio_pubsub_test_on_message);
+  FIO_ASSERT(fio_cluster_shm_interested(m) == ((uint64_t)1 << 5),
+             "channel interest not marked for our ring");
+  fio_unsubscribe(s1);
+  FIO_ASSERT(fio_cluster_shm_interested(m) == ((uint64_t)1 << 5),
+             "channel interest cleared while still subscribed");
+  fio_unsubscribe(s2);
+  FIO_ASSERT(!fio_cluster_shm_interested(m),
+             "channel interest not cleared after unsubscribing");
+  s1 = fio_subscribe(.channel = {0, 3, "in*"}, .match = fio_glob_match,
+                     .udata1 = &counter,
+                     .on_message = fio_pubsub_test_on_message);
+  FIO_ASSERT(cluster_shm.interest->patterns == ((uint64_t)1 << 5) &&
+                 fio_cluster_shm_interested(m) == ((uint64_t)1 << 5),
+             "pattern interest not marked for our ring");
+  /* another ring's interest and a (reset) restart */
+  cluster_shm.interest->channels[3] |= 1;
+  fio_cluster_shm_interest_reset();
+  FIO_ASSERT(cluster_shm.interest->patterns == ((uint64_t)1 << 5) &&
+                 cluster_shm.interest->channels[3] == 1,
+             "interest reset error");
+  fio_cluster_shm_interest_clear(5);
+  FIO_ASSERT(!cluster_shm.interest->patterns &&
+                 cluster_shm.interest->channels[3] == 1,
+             "interest clearing error");
+  fio_unsubscribe(s1);
+  fio_defer_perform();
+  /* workers without a linked ring are reached by the root (using sockets) */
+  const uint8_t ready = cluster_shm.ready;
+  cluster_shm.ready = 1;
+  fio_cluster_shm_on_accept();
+  FIO_ASSERT(cluster_shm.interest->unlinked == 1 &&
+                 fio_cluster_shm_send2root(m) == -1,
+             "publications should use the socket while workers are unlinked");
+  cluster_shm.ready = ready;
+  fio_msg_internal_free(m);
+  free(cluster_shm.interest);
+  free(cluster_shm.interest_count);
+  cluster_shm.interest = NULL;
+  cluster_shm.interest_count = NULL;
+  cluster_shm.count = count;
+  cluster_shm.self = self;
+}
+#endif
+
+/* the messages sent by the cluster frame test (`i` is the message's index) */
+static fio_msg_internal_s *fio_pubsub_test_frames_msg(size_t i) {
+  static const char *names[] = {"",          "abc",       "channel-1",
+                                "channel-2", "channel-1", NULL};
+  char long_name[300];
+  char data[10000];
+  fio_str_info_s ch = {.data = (char *)names[i % 6]};
+  if (ch.data) {
+    ch.len = strlen(ch.data);
+  } else {
+    memset(long_name, 'a' + (i & 7), sizeof(long_name));
+    ch = (fio_str_info_s){.data = long_name, .len = sizeof(long_name)};
+  }
+  fio_str_info_s msg = {.data = data,
+                        .len = (size_t)snprintf(data, 32, "data-%zu", i)};
+  if (i % 20 == 19) {
+    for (size_t j = 0; j < sizeof(data); ++j)
+      data[j] = (char)(i + j);
+    msg.len = sizeof(data);
+  }
+  return fio_msg_internal_create(
+      (i % 5 == 4 ? -(int32_t)i : 0),
+      (i % 7 == 3 ? FIO_CLUSTER_MSG_JSON
+                  : (i % 11 == 5 ? FIO_CLUSTER_MSG_ROOT
+                                 : FIO_CLUSTER_MSG_FORWARD)),
+      ch, msg, (i % 7 == 3), 1);
+}
+
+static size_t fio_pubsub_test_frames_count;
+
+FIO_FUNC void fio_pubsub_test_frames_handler(cluster_pr_s *pr) {
+  fio_msg_internal_s *m =
+      fio_pubsub_test_frames_msg(fio_pubsub_test_frames_count);
+  FIO_ASSERT(pr->type == fio_cluster_msg_type(m) &&
+                 pr->msg->filter == m->filter &&
+                 pr->msg->is_json == m->is_json,
+             "cluster frame %zu header error", fio_pubsub_test_frames_count);
+  FIO_ASSERT(pr->msg->channel.len == m->channel.len &&
+                 !memcmp(pr->msg->channel.data, m->channel.data,
+                         m->channel.len) &&
+                 !pr->msg->channel.data[m->channel.len],
+             "cluster frame %zu channel error", fio_pubsub_test_frames_count);
+  FIO_ASSERT(pr->msg->data.len == m->data.len &&
+                 !memcmp(pr->msg->data.data, m->data.data, m->data.len),
+             "cluster frame %zu data error", fio_pubsub_test_frames_count);
+  fio_msg_internal_free(m);
+  ++fio_pubsub_test_frames_count;
+}
+
+FIO_FUNC void fio_pubsub_test_frames(void) {
+  const size_t count = 100;
+  int fds[2];
+  FIO_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair failed");
+  fio_set_non_block(fds[0]);
+  fio_set_non_block(fds[1]);
+  intptr_t uuid = fio_fd2uuid(fds[0]);
+  intptr_t peer = fio_fd2uuid(fds[1]);
+  FIO_ASSERT(uuid != -1 && peer != -1, "fio_fd2uuid failed");
+  cluster_pr_s *sender = (cluster_pr_s *)fio_cluster_protocol_alloc(
+      uuid, fio_pubsub_test_frames_handler, fio_cluster_client_sender);
+  cluster_pr_s *receiver = (cluster_pr_s *)fio_cluster_protocol_alloc(
+      peer, fio_pubsub_test_frames_handler, fio_cluster_client_sender);
+  fio_attach(uuid, &sender->protocol);
+  fio_attach(peer, &receiver->protocol);
+  fio_pubsub_test_frames_count = 0;
+  size_t small = 0, standard = 0;
+  for (size_t i = 0; i < count; ++i) {
+    fio_msg_internal_s *m = fio_pubsub_test_frames_msg(i);
+    fio_cluster_send(uuid, m);
+    if (i <= 10) {
+      standard += 16 + m->channel.len + m->data.len + 2;
+      small = sender->out_len;
+    }
+    fio_msg_internal_free(m);
+  }
+  FIO_ASSERT(small && sender->out_scheduled,
+             "small cluster messages should be coalesced");
+#if FIO_CLUSTER_COMPACT
+  FIO_ASSERT(small + (11 * 8) < standard,
+             "cluster frames should be compact (%zu / %zu bytes)", small,
+             standard);
+#endif
+  fio_defer_perform();
+  FIO_ASSERT(!sender->out_len && !sender->out_scheduled,
+             "coalesced cluster messages weren't written");
+  for (size_t i = 0; i < 1024 && fio_pubsub_test_frames_count < count; ++i) {
+    fio_cluster_on_data(peer, &receiver->protocol);
+  }
+  FIO_ASSERT(fio_pubsub_test_frames_count == count,
+             "cluster frames lost (%zu / %zu)", fio_pubsub_test_frames_count,
+             count);
+  /* headers split between reads: feed the raw stream back one byte at a time */
+  for (size_t i = count; i < count + 30; ++i) {
+    fio_msg_internal_s *m = fio_pubsub_test_frames_msg(i);
+    fio_cluster_send(uuid, m);
+    fio_msg_internal_free(m);
+  }
+  fio_defer_perform();
+  char *raw = fio_malloc(32768);
+  FIO_ASSERT_ALLOC(raw);
+  ssize_t raw_len = 0, tmp;
+  while ((tmp = fio_read(peer, raw + raw_len, 32768 - raw_len)) > 0)
+    raw_len += tmp;
+  FIO_ASSERT(raw_len > 0, "cluster frames weren't written");
+  for (ssize_t i = 0; i < raw_len; ++i) {
+    FIO_ASSERT(write(fds[0], raw + i, 1) == 1, "socketpair write failed");
+    fio_cluster_on_data(peer, &receiver->protocol);
+  }
+  fio_free(raw);
+  FIO_ASSERT(fio_pubsub_test_frames_count == count + 30,
+             "split cluster frames lost (%zu / %zu)",
+             fio_pubsub_test_frames_count, count + 30);
+  fio_force_close(uuid);
+  fio_force_close(peer);
+  fio_defer_perform();
+}
+
+/* counts the calls made to the channel churn test engines */
+static struct {
+  size_t subscribe;
+  size_t unsubscribe;
+  size_t batches;
+  size_t changes;
+  fio_pubsub_change_s last;
+  char last_name[16]; /* a copy of the last channel's name */
+} fio_pubsub_test_churn_counters;
+
+FIO_FUNC void fio_pubsub_test_churn_sub(const fio_pubsub_engine_s *eng,
+                                        fio_str_info_s channel,
+                                        fio_match_fn match) {
+  ++fio_pubsub_test_churn_counters.subscribe;
+  (void)eng;
+  (void)channel;
+  (void)match;
+}
+
+FIO_FUNC void fio_pubsub_test_churn_unsub(const fio_pubsub_engine_s *eng,
+                                          fio_str_info_s channel,
+                                          fio_match_fn match) {
+  ++fio_pubsub_test_churn_counters.unsubscribe;
+  (void)eng;
+  (void)channel;
+  (void)match;
+}
+
+FIO_FUNC void fio_pubsub_test_churn_batch(const fio_pubsub_engine_s *eng,
+                                          const fio_pubsub_change_s *changes,
+                                          size_t count) {
+  ++fio_pubsub_test_churn_counters.batches;
+  fio_pubsub_test_churn_counters.changes += count;
+  fio_pubsub_change_s *last = &fio_pubsub_test_churn_counters.last;
+  *last = changes[count - 1];
+  /* the channel might be freed once the callback returns */
+  if (last->channel.len >= sizeof(fio_pubsub_test_churn_counters.last_name))
+    last->channel.len = sizeof(fio_pubsub_test_churn_counters.last_name) - 1;
+  memcpy(fio_pubsub_test_churn_counters.last_name, last->channel.data,
+         last->channel.len);
+  fio_pubsub_test_churn_counters.last_name[last->channel.len] = 0;
+  last->channel.data = fio_pubsub_test_churn_counters.last_name;
+  (void)eng;
+}
+
+FIO_FUNC void fio_pubsub_test_churn_publish(const fio_pubsub_engine_s *eng,
+                                            fio_str_info_s channel,
+                                            fio_str_info_s msg,
+                                            uint8_t is_json) {
+  (void)eng;
+  (void)channel;
+  (void)msg;
+  (void)is_json;
+}
+
+FIO_FUNC void fio_pubsub_test_churn(void) {
+  fio_pubsub_engine_s plain = {
+      .subscribe = fio_pubsub_test_churn_sub,
+      .unsubscribe = fio_pubsub_test_churn_unsub,
+      .publish = fio_pubsub_test_churn_publish,
+  };
+  fio_pubsub_engine_s batched = plain;
+  batched.subscribe_batch = fio_pubsub_test_churn_batch;
+  uintptr_t counter = 0;
+  /* earlier changes wait for a timer, since the reactor isn't running */
+  fio_timer_clear_all();
+  fio_defer_perform();
+  fio_pubsub_attach(&plain);
+  fio_pubsub_attach(&batched);
+  fio_defer_perform();
+  fio_pubsub_test_churn_counters.subscribe = 0;
+
+  subscription_s *s1 = fio_subscribe(
+      .channel = {0, 7, "churn-1"}, .udata1 = &counter,
+      .on_message = fio_pubsub_test_on_message);
+  subscription_s *s2 = fio_subscribe(
+      .channel = {0, 7, "churn-2"}, .udata1 = &counter,
+      .on_message = fio_pubsub_test_on_message);
+  subscription_s *s3 = fio_subscribe(
+      .channel = {0, 7, "churn-*"}, .match = FIO_MATCH_GLOB,
+      .udata1 = &counter, .on_message = fio_pubsub_test_on_message);
+  fio_unsubscribe(fio_subscribe(.channel = {0, 7, "churn-3"},
+                                .udata1 = &counter,
+                                .on_message = fio_pubsub_test_on_message));
+  FIO_ASSERT(!fio_pubsub_test_churn_counters.subscribe &&
+                 !fio_pubsub_test_churn_counters.batches,
+             "channel changes should be reported later, in a batch");
+  fio_defer_perform();
+  FIO_ASSERT(fio_pubsub_test_churn_counters.batches == 1 &&
+                 fio_pubsub_test_churn_counters.changes == 3,
+             "channel changes batch error (%zu batches, %zu changes)",
+             fio_pubsub_test_churn_counters.batches,
+             fio_pubsub_test_churn_counters.changes);
+  FIO_ASSERT(fio_pubsub_test_churn_counters.subscribe == 3 &&
+                 !fio_pubsub_test_churn_counters.unsubscribe,
+             "channel changes should be reported per channel without a batch "
+             "callback (%zu)",
+             fio_pubsub_test_churn_counters.subscribe);
+  FIO_ASSERT(fio_pubsub_test_churn_counters.last.subscribe &&
+                 fio_pubsub_test_churn_counters.last.match == FIO_MATCH_GLOB &&
+                 !memcmp(fio_pubsub_test_churn_counters.last.channel.data,
+                         "churn-*", 7),
+             "channel changes should be reported in order");
+
+  /* a channel destroyed and recreated within the window isn't reported */
+  fio_unsubscribe(s1);
+  fio_unsubscribe(s2);
+  s2 = fio_subscribe(.channel = {0, 7, "churn-2"}, .udata1 = &counter,
+                     .on_message = fio_pubsub_test_on_message);
+  fio_defer_perform();
+  FIO_ASSERT(fio_pubsub_test_churn_counters.batches == 2 &&
+                 fio_pubsub_test_churn_counters.changes == 4 &&
+                 fio_pubsub_test_churn_counters.unsubscribe == 1 &&
+                 fio_pubsub_test_churn_counters.subscribe == 3,
+             "channel churn should cancel out");
+  FIO_ASSERT(!fio_pubsub_test_churn_counters.last.subscribe &&
+                 !memcmp(fio_pubsub_test_churn_counters.last.channel.data,
+                         "churn-1", 7),
+             "channel removal wasn't reported");
+  fio_pubsub_detach(&plain);
+  fio_pubsub_detach(&batched);
+
+  /* root: a worker's batch of changes */
+  fio_pubsub_change_s changes[] = {
+      {.channel = {0, 7, "churn-2"}, .subscribe = 1},
+      {.channel = {0, 7, "churn-4"}, .subscribe = 1},
+      {.channel = {0, 7, "churn-*"}, .match = FIO_MATCH_GLOB, .subscribe = 1},
+      {.channel = {0, 7, "churn-4"}, .subscribe = 0},
+  };
+  size_t count = 4;
+  cluster_pr_s *pr = (cluster_pr_s *)fio_cluster_protocol_alloc(
+      -1, fio_cluster_server_handler, fio_cluster_server_sender);
+  pr->msg = fio_cluster_churn_msg(changes, &count);
+  pr->type = fio_cluster_msg_type(pr->msg);
+  FIO_ASSERT(count == 4 && pr->type == FIO_CLUSTER_MSG_PUBSUB_BATCH,
+             "channel changes batch message error");
+  fio_cluster_server_handler(pr);
+  FIO_ASSERT(fio_sub_hash_count(&pr->pubsub) == 1 &&
+                 fio_sub_hash_count(&pr->patterns) == 1,
+             "root didn't apply the channel changes batch");
+  FIO_ASSERT(fio_collection_count(&fio_postoffice.pubsub) == 1 &&
+                 fio_collection_count(&fio_postoffice.patterns) == 1,
+             "root's channels don't match the channel changes batch");
+  fio_msg_internal_free(pr->msg);
+  fio_sub_hash_free(&pr->pubsub);
+  fio_sub_hash_free(&pr->patterns);
+  fio_cluster_protocol_free(pr);
+  fio_unsubscribe(s2);
+  fio_unsubscribe(s3);
+  fio_defer_perform();
+  FIO_ASSERT(!fio_collection_count(&fio_postoffice.pubsub) &&
+                 !fio_collection_count(&fio_postoffice.patterns),
+             "channels leaked by the channel changes test");
+}
+
+/* tests that channels are spread between (and removed from) the shards */
+FIO_FUNC void fio_pubsub_test_shards(void) {
+  subscription_s *subs[128];
+  subscription_s *filters[64];
+  char name[16];
+  uintptr_t counter = 0;
+  for (size_t i = 0; i < 128; ++i) {
+    size_t len = (size_t)snprintf(name, sizeof(name), "shard%zu", i);
+    subs[i] = fio_subscribe(.channel = {0, len, name}, .udata1 = &counter,
+                            .on_message = fio_pubsub_test_on_message);
+    FIO_ASSERT(subs[i], "fio_subscribe FAILED for sharded channel.");
+  }
+  for (size_t i = 0; i < 64; ++i) {
+    filters[i] = fio_subscribe(.filter = (int32_t)(i + 1), .udata1 = &counter,
+                               .on_message = fio_pubsub_test_on_message);
+    fio_unsubscribe(subs[i]);
+    subs[i] = NULL;
+  }
+  fio_defer_perform();
+  FIO_ASSERT(fio_collection_count(&fio_postoffice.pubsub) == 64 &&
+                 fio_collection_count(&fio_postoffice.filters) == 64,
+             "sharded collections count error (%zu, %zu)",
+             fio_collection_count(&fio_postoffice.pubsub),
+             fio_collection_count(&fio_postoffice.filters));
+  size_t used = 0;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.pubsub, shard) {
+    used += (fio_ch_set_count(&shard->channels) != 0);
+  }
+  FIO_ASSERT(FIO_PUBSUB_SHARDS == 1 || used > 1,
+             "channels should be spread between shards (%zu used)", used);
+  used = 0;
+  FIO_COLLECTION_FOR_SHARD(&fio_postoffice.filters, shard) {
+    used += (fio_ch_set_count(&shard->channels) != 0);
+  }
+  FIO_ASSERT(FIO_PUBSUB_SHARDS == 1 || used > 1,
+             "filters should be spread between shards (%zu used)", used);
+  fio_publish(.channel = {0, 8, "shard100"});
+  fio_publish(.filter = 7);
+  fio_defer_perform();
+  FIO_ASSERT(counter == 2, "sharded channels publishing error (%zu)",
+             (size_t)counter);
+  for (size_t i = 0; i < 64; ++i) {
+    fio_unsubscribe(subs[i + 64]);
+    fio_unsubscribe(filters[i]);
+  }
+  fio_defer_perform();
+  FIO_ASSERT(!fio_collection_count(&fio_postoffice.pubsub) &&
+                 !fio_collection_count(&fio_postoffice.filters),
+             "sharded collections should be empty (%zu, %zu)",
+             fio_collection_count(&fio_postoffice.pubsub),
+             fio_collection_count(&fio_postoffice.filters));
+}
+
 FIO_FUNC void fio_pubsub_test(void) {
   fprintf(stderr, "=== Testing pub/sub (partial)\n");
   fio_data->active = 1;
@@ -10715,6 +17277,8 @@ FIO_FUNC void fio_pubsub_test(void) {
   ++expect;
   fio_defer_perform();
   FIO_ASSERT(counter == expect, "unsubscribe wasn't called for filter 1!");
+  FIO_ASSERT(!fio_collection_count(&fio_postoffice.filters),
+             "empty filter channels should be removed!");
   s = fio_subscribe(.channel = {0, 4, "name"}, .udata1 = &counter,
                     .on_message = fio_pubsub_test_on_message,
                     .on_unsubscribe = fio_pubsub_test_on_unsubscribe);
@@ -10731,10 +17295,21 @@ FIO_FUNC void fio_pubsub_test(void) {
   ++expect;
   fio_defer_perform();
   FIO_ASSERT(counter == expect, "unsubscribe wasn't called for named channel!");
+  fio_pubsub_test_shards();
+  fio_pubsub_test_pattern_index();
+  fio_pubsub_test_fanout();
+  fio_pubsub_test_big_message();
+#if FIO_CLUSTER_SHM
+  fio_pubsub_test_ring();
+  fio_pubsub_test_ring_order();
+  fio_pubsub_test_interest();
+#endif
   fio_data->is_worker = 0;
   fio_data->active = 0;
   fio_data->workers = 0;
   fio_defer_perform();
+  fio_pubsub_test_frames();
+  fio_pubsub_test_churn();
   (void)fio_pubsub_test_on_message;
   (void)fio_pubsub_test_on_unsubscribe;
   fprintf(stderr, "* passed.\n");
@@ -10814,6 +17389,36 @@ FIO_FUNC void fio_atol_test(void) {
             9223372036854775807LL); /* INT64_MAX overflow protection */
   TEST_ATOL("9223372036854775999",
             9223372036854775807LL); /* INT64_MAX overflow protection */
+  TEST_ATOL("18446744073709551615",
+            9223372036854775807LL); /* INT64_MAX overflow protection */
+  TEST_ATOL("12345678", 12345678);
+  TEST_ATOL("-87654321", -87654321);
+  TEST_ATOL("1234567890123456", 1234567890123456LL);
+  TEST_ATOL("-12345678901234567", -12345678901234567LL);
+  {
+    /* too large for 64 bits: 0 is returned and nothing is consumed */
+    char *too_large[] = {"18446744073709551616", "99999999999999999999",
+                         "123456789012345678901", NULL};
+    for (size_t i = 0; too_large[i]; ++i) {
+      char *p = too_large[i];
+      FIO_ASSERT(!fio_atol(&p) && p == too_large[i],
+                 "fio_atol overflow should return 0 (%s)", too_large[i]);
+    }
+  }
+  {
+    /* random base 10 round-trips, compared with the C library */
+    char buf[72], expected[72];
+    for (size_t i = 0; i < 4096; ++i) {
+      int64_t n = (int64_t)fio_rand64() >> (fio_rand64() & 63);
+      size_t len = fio_ltoa(buf, n, 10);
+      snprintf(expected, sizeof(expected), "%lld", (long long)n);
+      FIO_ASSERT(len == strlen(expected) && !memcmp(buf, expected, len + 1),
+                 "fio_ltoa base 10 error: %s != %s", buf, expected);
+      char *p = buf;
+      FIO_ASSERT(fio_atol(&p) == n && p == buf + len,
+                 "fio_atol base 10 round-trip error for %s", buf);
+    }
+  }
 
   char number_hex[128] = "0xe5d4c3b2a1908770"; /* hex with embedded sign */
   // char number_hex[128] = "-0x1a2b3c4d5e6f7890";
@@ -10895,6 +17500,47 @@ FIO_FUNC void fio_atol_test(void) {
   end = clock();
   fprintf(stderr, "native sprintf base 10 (%s): %zd CPU cycles\n", number,
           end - start);
+#if NODEBUG
+  {
+    /* mixed lengths, closer to JSON / HTTP data than a single long number */
+    char numbers[256][24];
+    int64_t values[256];
+    for (size_t i = 0; i < 256; ++i) {
+      values[i] = (int64_t)fio_rand64() >> (fio_rand64() & 63);
+      fio_ltoa(numbers[i], values[i], 10);
+    }
+    for (int test = 0; test < 4; ++test) {
+      const char *names[] = {"fio_atol", "strtoll", "fio_ltoa", "sprintf"};
+      start = clock();
+      for (size_t i = 0; i < (FIO_ATOL_TEST_MAX_CYCLES >> 8); ++i) {
+        for (size_t k = 0; k < 256; ++k) {
+          char *pos = numbers[k];
+          char tmp[24];
+          switch (test) {
+          case 0:
+            result = fio_atol(&pos);
+            break;
+          case 1:
+            result = strtoll(pos, NULL, 10);
+            break;
+          case 2:
+            fio_ltoa(tmp, values[k], 10);
+            break;
+          case 3:
+            sprintf(tmp, "%lld", (long long)values[k]);
+            break;
+          }
+          __asm__ volatile("" ::: "memory");
+        }
+      }
+      end = clock();
+      fprintf(stderr, "%-8s base 10 (mixed lengths): %.2f ns per number\n",
+              names[test],
+              ((end - start) * 1000000000.0 / CLOCKS_PER_SEC) /
+                  (FIO_ATOL_TEST_MAX_CYCLES & (~(size_t)255)));
+    }
+  }
+#endif
   FIO_ASSERT(fio_ltoa(number, 0, 0) == 1,
              "base 10 zero should be single char.");
   FIO_ASSERT(memcmp(number, "0", 2) == 0, "base 10 zero should be \"0\" (%s).",
@@ -11001,6 +17647,88 @@ FIO_FUNC void fio_atof_test(void) {
               5708990770823839524233143877797980545530986496.0, 0);
   TEST_DOUBLE("5708990770823839207320493820740630171355185152001e-3",
               5708990770823839524233143877797980545530986496.0, 0);
+#undef TEST_DOUBLE
+
+#define TEST_FTOA(d, s)                                                        \
+  do {                                                                         \
+    char buf_[130];                                                            \
+    size_t len_ = fio_ftoa(buf_, (d), 10);                                     \
+    FIO_ASSERT(len_ == strlen(s) && !memcmp(buf_, (s), len_),                  \
+               "fio_ftoa error for %.17g: %s != %s", (double)(d), buf_, (s));  \
+  } while (0)
+  TEST_FTOA(0.0, "0.0");
+  TEST_FTOA(-0.0, "-0.0");
+  TEST_FTOA(1.0, "1.0");
+  TEST_FTOA(-1.5, "-1.5");
+  TEST_FTOA(0.1, "0.1");
+  TEST_FTOA(0.3, "0.3");
+  TEST_FTOA(1.0 / 3, "0.3333333333333333");
+  TEST_FTOA(1e10, "10000000000.0");
+  TEST_FTOA(1e-5, "1e-05");
+  TEST_FTOA(0.0001, "0.0001");
+  TEST_FTOA(1234.5678, "1234.5678");
+  TEST_FTOA(1e17, "1e+17");
+  TEST_FTOA(1e23, "1e+23");
+  TEST_FTOA(9007199254740992.0, "9007199254740992.0");
+  TEST_FTOA(4.9406564584124654e-324, "4.9e-324");
+  TEST_FTOA(2.2250738585072014e-308, "2.2250738585072014e-308");
+  TEST_FTOA(1.7976931348623157e+308, "1.7976931348623157e+308");
+  TEST_FTOA(1e300, "1e+300");
+#undef TEST_FTOA
+  {
+    /* random bit patterns must survive a round-trip */
+    char buf[130];
+    for (size_t i = 0; i < (1 << 18); ++i) {
+      uint64_t bits = fio_rand64();
+      double d;
+      memcpy(&d, &bits, sizeof(d));
+      if (d != d || d - d != 0.0)
+        continue; /* NaN / Infinity */
+      fio_ftoa(buf, d, 10);
+      char *p = buf;
+      double r = fio_atof(&p);
+      FIO_ASSERT(!memcmp(&r, &d, sizeof(d)) && *p == 0,
+                 "fio_ftoa round-trip failed for %.17g (%s => %.17g)", d, buf,
+                 r);
+    }
+  }
+#if NODEBUG
+  {
+    double values[1024];
+    char buf[130];
+    for (size_t i = 0; i < 1024; ++i) {
+      uint64_t bits = fio_rand64();
+      memcpy(values + i, &bits, sizeof(double));
+      if (values[i] != values[i] || values[i] - values[i] != 0.0)
+        values[i] = (double)bits / 3.0;
+      if (i & 1)
+        values[i] = (double)(fio_rand64() % 100000) / 100.0;
+    }
+    for (int test_sprintf = 0; test_sprintf < 2; ++test_sprintf) {
+      for (size_t cycles = 64;;) {
+        clock_t start = clock();
+        for (size_t i = cycles; i > 0; i--) {
+          for (size_t k = 0; k < 1024; ++k) {
+            if (test_sprintf)
+              sprintf(buf, "%.17g", values[k]);
+            else
+              fio_ftoa(buf, values[k], 10);
+            __asm__ volatile("" ::: "memory");
+          }
+        }
+        clock_t end = clock();
+        if ((end - start) >= (CLOCKS_PER_SEC >> 1)) {
+          fprintf(stderr, "%-20s %8.2f ns per double\n",
+                  (test_sprintf ? "sprintf(\"%.17g\")" : "fio_ftoa"),
+                  ((end - start) * 1000000000.0 / CLOCKS_PER_SEC) /
+                      (cycles * 1024.0));
+          break;
+        }
+        cycles <<= 1;
+      }
+    }
+  }
+#endif
   fprintf(stderr, "\n* passed.\n");
 }
 /* *****************************************************************************
@@ -11012,22 +17740,32 @@ void fio_test(void) {
   fio_malloc_test();
   fio_state_callback_test();
   fio_str_test();
+  fio_str_utf8_test();
   fio_atol_test();
   fio_atof_test();
   fio_str2u_test();
   fio_llist_test();
   fio_ary_test();
   fio_set_test();
+  fio_set_swiss_test();
+  fio_set_concurrent_test();
+  fio_ring_test();
+  fio_radix_test();
+  fio_radix_concurrent_test();
+  fio_cache_test();
   fio_defer_test();
   fio_timer_test();
   fio_poll_test();
   fio_socket_test();
+  fio_rope_test();
   fio_uuid_link_test();
+  fio_fd_data_test();
   fio_cycle_test();
   fio_riskyhash_test();
   fio_siphash_test();
   fio_sha1_test();
   fio_sha2_test();
+  fio_sha_shani_test();
   fio_base64_test();
   fio_test_random();
   fio_pubsub_test();
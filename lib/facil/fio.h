@@ -30,6 +30,7 @@ Feel free to copy, use and enjoy according to the license provided.
  * Event / Task scheduling
  * Startup / State Callbacks (fork, start up, idle, etc')
  * Lower Level API - for special circumstances, use with care under
+ * Lock-free Read Sections (epoch based memory reclamation)
  *
  * Pub/Sub / Cluster Messages API
  * Cluster Messages and Pub/Sub
@@ -38,6 +39,7 @@ Feel free to copy, use and enjoy according to the license provided.
  * Atomic Operations and Spin Locking Helper Functions
  * Simple Constant Time Operations
  * Byte Swapping and Network Order
+ * Byte Group Matching (used by Set / Hash Map control bytes)
  *
  * Converting Numbers to Strings (and back)
  * Strings to Numbers
@@ -100,6 +102,34 @@ Feel free to copy, use and enjoy according to the license provided.
  * Set / Hash Map Internal Helpers
  * Set / Hash Map Implementation
  *
+ *
+ *
+ *            #ifdef FIO_RING_NAME - can be included more than once
+ *
+ * Ring Buffer (bounded SPSC / MPSC queue)
+ * Ring Buffer API
+ * Ring Buffer Implementation
+ *
+ *
+ *
+ *            #ifdef FIO_RADIX_NAME - can be included more than once
+ *
+ * Radix Tree (prefix lookups)
+ * Radix Tree API
+ * Radix Tree Internal Data Structures
+ * Radix Tree Internal Helpers
+ * Radix Tree Implementation
+ *
+ *
+ *
+ *            #ifdef FIO_CACHE_NAME - can be included more than once
+ *
+ * Bounded Cache (LRU / TinyLFU)
+ * Cache Internal Data Structures (and the underlying Set)
+ * Cache API
+ * Cache Internal Helpers
+ * Cache Implementation
+ *
  *****************************************************************************
  */
 
@@ -131,8 +161,11 @@ Version and helper macros
 #ifndef FIO_MAX_SOCK_CAPACITY
 /**
  * The maximum number of connections per worker process.
+ *
+ * Connection data is allocated on demand (in small pages), so a higher limit
+ * costs only a pointer per page of connections.
  */
-#define FIO_MAX_SOCK_CAPACITY 131072
+#define FIO_MAX_SOCK_CAPACITY 1048576
 #endif
 
 #ifndef FIO_CPU_CORES_LIMIT
@@ -181,6 +214,80 @@ Version and helper macros
 #define FIO_PUBSUB_SUPPORT 1
 #endif
 
+#ifndef FIO_PUBSUB_BATCH_SIZE
+/**
+ * The number of subscriptions handled by each task when a message is delivered
+ * to a channel's subscribers (a 10K subscriber channel produces 157 tasks).
+ */
+#define FIO_PUBSUB_BATCH_SIZE 64
+#endif
+
+#ifndef FIO_PUBSUB_SHARDS
+/**
+ * The number of independently locked shards used by each of the pub/sub channel
+ * collections (a power of 2, up to 256). Channels are assigned to a shard by
+ * their hash, so subscriptions to different channels rarely share a lock.
+ */
+#define FIO_PUBSUB_SHARDS 16
+#endif
+
+#ifndef FIO_PUBSUB_CHURN_WINDOW
+/**
+ * Channels created or destroyed within this many milliseconds are reported to
+ * the pub/sub engines (and, by workers, to the root process) as a single batch.
+ * A channel that is destroyed and recreated within the window isn't reported.
+ *
+ * If 0 (or when the reactor isn't running), changes are reported by a deferred
+ * task.
+ */
+#define FIO_PUBSUB_CHURN_WINDOW 10
+#endif
+
+#ifndef FIO_CLUSTER_SHM
+/**
+ * If true (1), pub/sub messages are passed between the root process and the
+ * worker processes using shared memory rings (with an `eventfd` doorbell)
+ * rather than the cluster's Unix socket. Requires Linux.
+ */
+#if defined(__linux__)
+#define FIO_CLUSTER_SHM 1
+#else
+#define FIO_CLUSTER_SHM 0
+#endif
+#endif
+
+#ifndef FIO_CLUSTER_SHM_RING_SIZE
+/**
+ * The size of each process's shared memory ring (a power of 2). Messages
+ * larger than a quarter of the ring are passed in pieces.
+ */
+#define FIO_CLUSTER_SHM_RING_SIZE (1UL << 20)
+#endif
+
+#ifndef FIO_CLUSTER_DIRECT
+/**
+ * If true (1), workers publish directly to the shared memory rings of the
+ * processes subscribed to a channel instead of having the root process relay
+ * every publication. The root process only tracks membership.
+ *
+ * Direct routing is faster when few workers subscribe to a channel, but slower
+ * when most of them do (producers contend for every ring), see
+ * `tests/cluster_speed.c`.
+ *
+ * Requires `FIO_CLUSTER_SHM` and no more than 63 workers.
+ */
+#define FIO_CLUSTER_DIRECT 0
+#endif
+
+#ifndef FIO_CLUSTER_COMPACT
+/**
+ * If true (1), messages sent over the cluster's Unix socket use a compact
+ * frame (a varint header) and per connection dictionary IDs for repeated
+ * channel names, instead of a 16 byte header followed by the channel name.
+ */
+#define FIO_CLUSTER_COMPACT 1
+#endif
+
 #ifndef FIO_LOG_LENGTH_LIMIT
 /**
  * Since logging uses stack memory rather than dynamic allocation, it's memory
@@ -190,6 +297,14 @@ Version and helper macros
 #define FIO_LOG_LENGTH_LIMIT 2048
 #endif
 
+#ifndef FIO_ROPE_SEGMENT_SIZE
+/**
+ * The allocation size for each of the segments in a `fio_rope_s` (the
+ * segmented String builder). Larger writes allocate larger segments.
+ */
+#define FIO_ROPE_SEGMENT_SIZE 8192
+#endif
+
 #ifndef FIO_IGNORE_MACRO
 /**
  * This is used internally to ignore macros that shadow functions (avoiding
@@ -373,6 +488,61 @@ void *FIO_ALIGN fio_realloc2(void *ptr, size_t new_size, size_t copy_length);
  */
 void *FIO_ALIGN_NEW fio_mmap(size_t size);
 
+/**
+ * A memory region, used for short lived allocations that share a lifetime (i.e.,
+ * the objects created while handling a single HTTP request).
+ *
+ * While a region is active, the calling thread's allocations (below
+ * FIO_MEMORY_BLOCK_ALLOC_LIMIT) are sliced from a memory block owned by the
+ * region, avoiding the per-CPU arena locks and keeping the objects close
+ * together in memory.
+ *
+ * Region memory is freed using `fio_free` (as usual). Memory blocks are
+ * reference counted, so objects that outlive the region remain valid.
+ *
+ * Once a region's objects were freed, `fio_region_reset` discards all of it's
+ * allocations at once, so a long lived region (i.e., one per connection) can
+ * reuse it's memory block without locking.
+ *
+ * A region MUST NOT be active in more than a single thread at a time.
+ *
+ * Initialize regions using `FIO_REGION_INIT` (all zero).
+ */
+typedef struct {
+  void *block;
+} fio_region_s;
+
+/** Initializes a memory region object. */
+#define FIO_REGION_INIT                                                        \
+  { .block = NULL }
+
+/**
+ * Sets the calling thread's active memory region, returning the previously
+ * active region (or NULL).
+ *
+ * Use `fio_region_enter(NULL)` (or the returned value) to stop using a region.
+ */
+fio_region_s *fio_region_enter(fio_region_s *region);
+
+/**
+ * Releases the region's hold on it's current memory block, so the block is
+ * returned to the memory pool once all of it's allocations were freed.
+ *
+ * This is an O(1) operation and the region can be reused afterwards.
+ */
+void fio_region_release(fio_region_s *region);
+
+/**
+ * Resets the region, reusing it's memory block for future allocations.
+ *
+ * If all of the region's allocations were freed, the block is reused from the
+ * start (only the used memory is cleared). Otherwise, allocations continue
+ * after the remaining objects, until the block is full.
+ *
+ * The region MUST NOT be active in another thread.
+ */
+void fio_region_reset(fio_region_s *region);
+
 /**
  * When forking is called manually, call this function to reset the facil.io
  * memory allocator's locks.
@@ -1177,6 +1347,14 @@ typedef struct {
    *  `.data.fd = fd` or `.data.buffer = (void*)fd;`
    */
   unsigned is_fd : 1;
+  /**
+   * The data union points to a `fio_rope_s` (`.data.buffer = &rope`). The
+   * Rope's segments are moved to the socket (the Rope is left empty) and sent
+   * using vectored IO, without flattening the data.
+   *
+   * The `length`, `offset` and `after` fields are ignored.
+   */
+  unsigned is_rope : 1;
   /** for internal use */
   unsigned rsv : 1;
   /** for internal use */
@@ -1253,6 +1431,102 @@ inline FIO_FUNC ssize_t fio_sendfile(intptr_t uuid, intptr_t source_fd,
                     .offset = (uintptr_t)offset);
 }
 
+/* *****************************************************************************
+Rope - a segmented String builder for vectored writes
+***************************************************************************** */
+
+/**
+ * A Rope is a segmented String builder, meant for assembling responses.
+ *
+ * Data is appended into fixed size segments (FIO_ROPE_SEGMENT_SIZE), so a
+ * growing Rope never reallocates or copies the data it already holds. Large
+ * buffers can also be referenced (rather than copied) using
+ * `fio_rope_write_ref`.
+ *
+ * A Rope can be sent using `fio_write_rope` (or `fio_write2` with `.is_rope =
+ * 1`), moving the segments to the socket, where they are written using `writev`
+ * without being flattened. i.e.:
+ *
+ *      fio_rope_s rope = FIO_ROPE_INIT;
+ *      fio_rope_write(&rope, "HTTP/1.1 200 OK\r\n", 17);
+ *      fio_rope_printf(&rope, "Content-Length: %zu\r\n\r\n", body_len);
+ *      fio_rope_write_ref(&rope, body, body_len, free); // no copy
+ *      fio_write_rope(uuid, &rope); // the rope is now empty
+ *
+ * Note: Ropes aren't thread safe.
+ */
+typedef struct fio_rope_s fio_rope_s;
+
+/** A Rope segment (opaque). */
+typedef struct fio_rope_segment_s fio_rope_segment_s;
+
+struct fio_rope_s {
+  /** The first segment. */
+  fio_rope_segment_s *head;
+  /** The last segment (the one written to). */
+  fio_rope_segment_s *tail;
+  /** The total length of the data in the Rope. */
+  size_t len;
+  /** The number of segments in the Rope. */
+  size_t count;
+};
+
+/** Initializes an empty Rope. */
+#define FIO_ROPE_INIT                                                          \
+  { .head = NULL }
+
+/**
+ * Copies `len` bytes from `data` to the end of the Rope.
+ *
+ * Returns the Rope's new length.
+ */
+size_t fio_rope_write(fio_rope_s *rope, const void *data, size_t len);
+
+/**
+ * Appends `len` bytes from `data` to the end of the Rope *without* copying the
+ * data.
+ *
+ * The data must remain valid (and unchanged) until `dealloc` is called (once
+ * the data was sent or the Rope was freed). `dealloc` may be NULL (i.e., static
+ * data).
+ *
+ * Short buffers might be copied (in which case `dealloc` is called
+ * immediately).
+ *
+ * Returns the Rope's new length.
+ */
+size_t fio_rope_write_ref(fio_rope_s *rope, const void *data, size_t len,
+                          void (*dealloc)(void *data));
+
+/**
+ * Writes formatted data to the end of the Rope (see `printf`).
+ *
+ * Returns the Rope's new length.
+ */
+size_t __attribute__((format(printf, 2, 3)))
+fio_rope_printf(fio_rope_s *rope, const char *format, ...);
+
+/**
+ * Copies the Rope's data to `dest`, which must have room for at least
+ * `rope->len` bytes (no NUL byte is written).
+ *
+ * Returns the number of bytes copied.
+ */
+size_t fio_rope_copy(const fio_rope_s *rope, void *dest);
+
+/** Frees the Rope's segments, leaving an empty (reusable) Rope. */
+void fio_rope_free(fio_rope_s *rope);
+
+/**
+ * Moves the Rope's data to the socket's outgoing queue, as a single packet that
+ * will be written using vectored IO (no flattening). The Rope is left empty.
+ *
+ * Returns the same values as `fio_write2`.
+ */
+inline FIO_FUNC ssize_t fio_write_rope(intptr_t uuid, fio_rope_s *rope) {
+  return fio_write2(uuid, .data.buffer = rope, .is_rope = 1);
+}
+
 /**
  * Returns the number of `fio_write` calls that are waiting in the socket's
  * queue and haven't been processed.
@@ -1663,6 +1937,37 @@ fio_protocol_s *fio_protocol_try_lock(intptr_t uuid, enum fio_protocol_lock_e);
  * details. */
 void fio_protocol_unlock(fio_protocol_s *pr, enum fio_protocol_lock_e);
 
+/* *****************************************************************************
+Lock-free Read Sections (epoch based memory reclamation)
+***************************************************************************** */
+
+/**
+ * Marks the beginning of a lock-free read section, returning a token that
+ * must be passed to `fio_rcu_read_unlock`.
+ *
+ * Memory retired using `fio_rcu_defer` isn't released while a read section
+ * that might access it is active. Read sections should be short and MUST NOT
+ * block.
+ */
+uintptr_t fio_rcu_read_lock(void);
+
+/** Marks the end of a lock-free read section. */
+void fio_rcu_read_unlock(uintptr_t token);
+
+/**
+ * Schedules `task(arg)` to run once all the read sections that were active when
+ * `fio_rcu_defer` was called are done (i.e., to free retired memory).
+ *
+ * Retired data is reviewed once per reactor cycle, so it might take a couple of
+ * cycles before `task` is called. When no read section is active, data retired
+ * earlier is released by the next `fio_rcu_defer` call. When the reactor isn't
+ * running, retired data is released during cleanup.
+ *
+ * NOTE: the data MUST be unreachable for new readers before `fio_rcu_defer` is
+ * called and `task` might be called by any thread.
+ */
+void fio_rcu_defer(void (*task)(void *), void *arg);
+
 /* *****************************************************************************
  * Pub/Sub / Cluster Messages API
  *
@@ -1919,6 +2224,16 @@ typedef fio_msg_metadata_s (*fio_msg_metadata_fn)(fio_str_info_s ch,
 void fio_message_metadata_callback_set(fio_msg_metadata_fn callback,
                                        int enable);
 
+/** A channel change, as reported to an engine's `subscribe_batch` callback. */
+typedef struct {
+  /** The channel's name. */
+  fio_str_info_s channel;
+  /** The channel's pattern matching function (NULL unless it's a pattern). */
+  fio_match_fn match;
+  /** 1 if the channel should be subscribed, 0 if it should be unsubscribed. */
+  uint8_t subscribe;
+} fio_pubsub_change_s;
+
 /**
  * facil.io can be linked with external Pub/Sub services using "engines".
  *
@@ -1940,6 +2255,9 @@ void fio_message_metadata_callback_set(fio_msg_metadata_fn callback,
  *           .channel = channel_name,
  *           .message = msg_body );
  *
+ * Channel changes are collected for `FIO_PUBSUB_CHURN_WINDOW` milliseconds and
+ * reported together, using `subscribe_batch` (when provided).
+ *
  * IMPORTANT: The `subscribe` and `unsubscribe` callbacks are called from within
  *            an internal lock. They MUST NEVER call pub/sub functions except by
  *            exiting the lock using `fio_defer`.
@@ -1954,6 +2272,14 @@ struct fio_pubsub_engine_s {
   /** Should publish a message through the engine. Failures are ignored. */
   void (*publish)(const fio_pubsub_engine_s *eng, fio_str_info_s channel,
                   fio_str_info_s msg, uint8_t is_json);
+  /**
+   * Optional: should subscribe / unsubscribe a batch of channels (in order).
+   * Failures are ignored.
+   *
+   * If missing (NULL), `subscribe` and `unsubscribe` are called per channel.
+   */
+  void (*subscribe_batch)(const fio_pubsub_engine_s *eng,
+                          const fio_pubsub_change_s *changes, size_t count);
 };
 
 /**
@@ -2030,6 +2356,13 @@ int fio_pubsub_is_attached(fio_pubsub_engine_s *engine);
 /** An atomic subtraction operation */
 #define fio_atomic_sub(p_obj, value)                                           \
   __atomic_sub_fetch((p_obj), (value), __ATOMIC_SEQ_CST)
+/** An atomic compare and swap, returns true if `value` was set */
+#define fio_atomic_cas(p_obj, expected, value)                                 \
+  __sync_bool_compare_and_swap((p_obj), (expected), (value))
+/** A memory fence, prevents loads from moving before previous loads */
+#define fio_atomic_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+/** A memory fence, prevents stores from moving before previous stores */
+#define fio_atomic_release() __atomic_thread_fence(__ATOMIC_RELEASE)
 /* Note: __ATOMIC_SEQ_CST is probably safer and __ATOMIC_ACQ_REL may be faster
  */
 
@@ -2042,6 +2375,13 @@ int fio_pubsub_is_attached(fio_pubsub_engine_s *engine);
 #define fio_atomic_add(p_obj, value) __sync_add_and_fetch((p_obj), (value))
 /** An atomic subtraction operation */
 #define fio_atomic_sub(p_obj, value) __sync_sub_and_fetch((p_obj), (value))
+/** An atomic compare and swap, returns true if `value` was set */
+#define fio_atomic_cas(p_obj, expected, value)                                 \
+  __sync_bool_compare_and_swap((p_obj), (expected), (value))
+/** A memory fence (full barrier) */
+#define fio_atomic_acquire() __sync_synchronize()
+/** A memory fence (full barrier) */
+#define fio_atomic_release() __sync_synchronize()
 
 #elif __GNUC__ > 3
 /** An atomic exchange operation, ruturns previous value */
@@ -2051,6 +2391,13 @@ int fio_pubsub_is_attached(fio_pubsub_engine_s *engine);
 #define fio_atomic_add(p_obj, value) __sync_add_and_fetch((p_obj), (value))
 /** An atomic subtraction operation */
 #define fio_atomic_sub(p_obj, value) __sync_sub_and_fetch((p_obj), (value))
+/** An atomic compare and swap, returns true if `value` was set */
+#define fio_atomic_cas(p_obj, expected, value)                                 \
+  __sync_bool_compare_and_swap((p_obj), (expected), (value))
+/** A memory fence (full barrier) */
+#define fio_atomic_acquire() __sync_synchronize()
+/** A memory fence (full barrier) */
+#define fio_atomic_release() __sync_synchronize()
 
 #else
 #error Required builtin "__sync_add_and_fetch" not found.
@@ -2307,6 +2654,56 @@ FIO_FUNC inline uintptr_t fio_ct_if2(uintptr_t cond, uintptr_t a, uintptr_t b) {
   } while (0);
 
 /* *****************************************************************************
+Byte Group Matching (used by Set / Hash Map control bytes)
+***************************************************************************** */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Returns a 16 bit mask where each set bit marks a byte in the 16 byte `group`
+ * that equals `byte` (bit 0 for `group[0]`, etc').
+ *
+ * Uses SSE2 / NEON when available, falling back to SWAR on 64 bit words.
+ */
+FIO_FUNC inline uint16_t fio_byte_group_match(const uint8_t *group,
+                                              uint8_t byte) {
+#if defined(__SSE2__)
+  const __m128i g = _mm_loadu_si128((const __m128i *)group);
+  return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(byte)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                   1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(byte));
+  const uint8x16_t m = vandq_u8(eq, vld1q_u8(bits));
+  return (uint16_t)(vaddv_u8(vget_low_u8(m)) |
+                    ((uint16_t)vaddv_u8(vget_high_u8(m)) << 8));
+#elif !__BIG_ENDIAN__
+  const uint64_t lo7 = 0x7F7F7F7F7F7F7F7FULL;
+  const uint64_t pattern = 0x0101010101010101ULL * byte;
+  uint16_t r = 0;
+  for (int i = 0; i < 2; ++i) {
+    uint64_t w;
+    memcpy(&w, group + (i << 3), 8);
+    w ^= pattern;
+    /* exact zero byte detection: high bit set only for zero bytes */
+    w = ~(((w & lo7) + lo7) | w | lo7);
+    /* gather the high bits of all 8 bytes into a single byte */
+    r |= (uint16_t)(((w >> 7) * 0x0102040810204080ULL) >> 56) << (i << 3);
+  }
+  return r;
+#else
+  uint16_t r = 0;
+  for (int i = 0; i < 16; ++i)
+    r |= (uint16_t)(group[i] == byte) << i;
+  return r;
+#endif
+}
+
+/* *****************************************************************************
 
 
 
@@ -2379,6 +2776,10 @@ size_t fio_ltoa(char *dest, int64_t num, uint8_t base);
  * default to base 10. Prefixes aren't added (i.e., no "0x" or "0b" at the
  * beginning of the string).
  *
+ * Base 10 output is the shortest string that reads back as the same double.
+ * The layout follows `printf`'s "%g" (with up to 17 significant digits),
+ * except that a ".0" suffix is added to whole numbers.
+ *
  * Returns the number of bytes actually written (excluding the NUL
  * terminator).
  */
@@ -2460,28 +2861,23 @@ Risky Hash (always available, even if using only the fio.h header)
   (v) += (w);                                                                  \
   (v) *= RISKY_PRIME_0;
 
-/*  Computes a facil.io Risky Hash. */
-FIO_FUNC inline uint64_t fio_risky_hash(const void *data_, size_t len,
-                                        uint64_t seed) {
-  /* reading position */
-  const uint8_t *data = (uint8_t *)data_;
-
-  /* The consumption vectors initialized state */
-  register uint64_t v0 = seed ^ RISKY_PRIME_1;
-  register uint64_t v1 = ~seed + RISKY_PRIME_1;
-  register uint64_t v2 =
-      fio_lrot64(seed, 17) ^ ((~RISKY_PRIME_1) + RISKY_PRIME_0);
-  register uint64_t v3 = fio_lrot64(seed, 33) + (~RISKY_PRIME_1);
-
-  /* consume 256 bit blocks */
-  for (size_t i = len >> 5; i; --i) {
-    fio_risky_consume(v0, fio_str2u64(data));
-    fio_risky_consume(v1, fio_str2u64(data + 8));
-    fio_risky_consume(v2, fio_str2u64(data + 16));
-    fio_risky_consume(v3, fio_str2u64(data + 24));
-    data += 32;
-  }
+/* Risky Hash consumption vectors, initialized using the seed */
+#define fio_risky_init_vectors(v0, v1, v2, v3, seed)                           \
+  (v0) = (seed) ^ RISKY_PRIME_1;                                               \
+  (v1) = ~(seed) + RISKY_PRIME_1;                                              \
+  (v2) = fio_lrot64((seed), 17) ^ ((~RISKY_PRIME_1) + RISKY_PRIME_0);          \
+  (v3) = fio_lrot64((seed), 33) + (~RISKY_PRIME_1);
 
+/**
+ * Consumes the trailing `len & 31` bytes (at `data`) and returns the Risky
+ * Hash, where `len` is the total length of the hashed data.
+ *
+ * Used internally by the one-shot and streaming implementations.
+ */
+FIO_FUNC inline uint64_t fio_risky_hash_finish(uint64_t v0, uint64_t v1,
+                                               uint64_t v2, uint64_t v3,
+                                               const uint8_t *data,
+                                               size_t len) {
   /* Consume any remaining 64 bit words. */
   switch (len & 24) {
   case 24:
@@ -2556,6 +2952,134 @@ FIO_FUNC inline uint64_t fio_risky_hash(const void *data_, size_t len,
   return result;
 }
 
+/*  Computes a facil.io Risky Hash. */
+FIO_FUNC inline uint64_t fio_risky_hash(const void *data_, size_t len,
+                                        uint64_t seed) {
+  /* reading position */
+  const uint8_t *data = (uint8_t *)data_;
+
+  /* The consumption vectors initialized state */
+  register uint64_t v0, v1, v2, v3;
+  fio_risky_init_vectors(v0, v1, v2, v3, seed);
+
+  /* consume 256 bit blocks */
+  for (size_t i = len >> 5; i; --i) {
+    fio_risky_consume(v0, fio_str2u64(data));
+    fio_risky_consume(v1, fio_str2u64(data + 8));
+    fio_risky_consume(v2, fio_str2u64(data + 16));
+    fio_risky_consume(v3, fio_str2u64(data + 24));
+    data += 32;
+  }
+  return fio_risky_hash_finish(v0, v1, v2, v3, data, len);
+}
+
+/* *****************************************************************************
+Risky Hash - streaming API
+***************************************************************************** */
+
+/**
+ * A Risky Hash streaming state, for hashing data that arrives in parts.
+ *
+ * The result is identical to calling `fio_risky_hash` on the concatenated
+ * data:
+ *
+ *      fio_risky_s r = fio_risky_init(seed);
+ *      fio_risky_write(&r, "Hello ", 6);
+ *      fio_risky_write(&r, "World", 5);
+ *      fio_risky_result(&r) == fio_risky_hash("Hello World", 11, seed);
+ */
+typedef struct {
+  uint64_t v[4];
+  uint64_t len;
+  uint8_t buffer[32];
+} fio_risky_s;
+
+/** Initializes a Risky Hash streaming state using the `seed` value. */
+FIO_FUNC inline fio_risky_s fio_risky_init(uint64_t seed) {
+  fio_risky_s r = {.len = 0};
+  fio_risky_init_vectors(r.v[0], r.v[1], r.v[2], r.v[3], seed);
+  return r;
+}
+
+/** Adds `len` bytes of `data` to the hash. */
+FIO_FUNC inline void fio_risky_write(fio_risky_s *r, const void *data_,
+                                     size_t len) {
+  const uint8_t *data = (uint8_t *)data_;
+  size_t in_buffer = (size_t)(r->len & 31);
+  r->len += len;
+  if (in_buffer) {
+    size_t partial = 32 - in_buffer;
+    if (partial > len) {
+      memcpy(r->buffer + in_buffer, data, len);
+      return;
+    }
+    memcpy(r->buffer + in_buffer, data, partial);
+    data += partial;
+    len -= partial;
+    fio_risky_consume(r->v[0], fio_str2u64(r->buffer));
+    fio_risky_consume(r->v[1], fio_str2u64(r->buffer + 8));
+    fio_risky_consume(r->v[2], fio_str2u64(r->buffer + 16));
+    fio_risky_consume(r->v[3], fio_str2u64(r->buffer + 24));
+  }
+  register uint64_t v0 = r->v[0], v1 = r->v[1], v2 = r->v[2], v3 = r->v[3];
+  for (size_t i = len >> 5; i; --i) {
+    fio_risky_consume(v0, fio_str2u64(data));
+    fio_risky_consume(v1, fio_str2u64(data + 8));
+    fio_risky_consume(v2, fio_str2u64(data + 16));
+    fio_risky_consume(v3, fio_str2u64(data + 24));
+    data += 32;
+  }
+  r->v[0] = v0;
+  r->v[1] = v1;
+  r->v[2] = v2;
+  r->v[3] = v3;
+  if (len & 31)
+    memcpy(r->buffer, data, len & 31);
+}
+
+/**
+ * Returns the hash of the data written so far.
+ *
+ * The state isn't altered, so more data may be written afterwards.
+ */
+FIO_FUNC inline uint64_t fio_risky_result(const fio_risky_s *r) {
+  return fio_risky_hash_finish(r->v[0], r->v[1], r->v[2], r->v[3], r->buffer,
+                               (size_t)r->len);
+}
+
+/* *****************************************************************************
+Risky Hash - batch API
+***************************************************************************** */
+
+/**
+ * Computes the Risky Hash of `count` buffers (`data[i]` of `len[i]` bytes),
+ * placing the results in `results`.
+ *
+ * Useful for bulk operations, such as Set inserts or hashing channel names.
+ * Keys are hashed in groups of four independent lanes, allowing the CPU to
+ * overlap their (otherwise serial) multiplication chains.
+ *
+ * Results are identical to calling `fio_risky_hash` for each buffer.
+ */
+FIO_FUNC void fio_risky_hash_batch(uint64_t *results, const void *const *data,
+                                   const size_t *len, size_t count,
+                                   uint64_t seed) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint64_t h0 = fio_risky_hash(data[i], len[i], seed);
+    const uint64_t h1 = fio_risky_hash(data[i + 1], len[i + 1], seed);
+    const uint64_t h2 = fio_risky_hash(data[i + 2], len[i + 2], seed);
+    const uint64_t h3 = fio_risky_hash(data[i + 3], len[i + 3], seed);
+    results[i] = h0;
+    results[i + 1] = h1;
+    results[i + 2] = h2;
+    results[i + 3] = h3;
+  }
+  for (; i < count; ++i)
+    results[i] = fio_risky_hash(data[i], len[i], seed);
+}
+
+#undef fio_risky_init_vectors
 #undef fio_risky_consume
 #undef FIO_RISKY_PRIME_0
 #undef FIO_RISKY_PRIME_1
@@ -2870,8 +3394,10 @@ C++ extern end
  * freed before it's memory is recycled (no per-allocation "free list").
  *
  * An "arena" is allocated per-CPU core during initialization - there's no
- * dynamic allocation of arenas. This allows threads to minimize lock contention
- * by cycling through the arenas until a free arena is detected.
+ * dynamic allocation of arenas. Each arena is padded to a cache line and, where
+ * `sched_getcpu` is available (Linux), threads use the arena that matches the
+ * CPU core they are running on. Otherwise (or on contention), threads minimize
+ * lock contention by cycling through the arenas until a free arena is detected.
  *
  * There should be a free arena at any given time (statistically speaking) and
  * the thread will only be deferred in the unlikely event in which there's no
@@ -2912,6 +3438,10 @@ C++ extern end
  * The allocator uses `mmap` when requesting memory from the system and for
  * allocations bigger than MEMORY_BLOCK_ALLOC_LIMIT (37.5% of the block).
  *
+ * Freed big allocations are kept in a cache (binned by size) and recycled by
+ * later big allocations. The cache is limited to FIO_MEMORY_BIG_CACHE_LIMIT
+ * bytes (8Mb), set it to 0 to always return the memory to the system.
+ *
  * Small allocations are differentiated from big allocations by their memory
  * alignment.
  *
@@ -4175,19 +4705,198 @@ static uint8_t fio_str_utf8_map[] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
     }                                                                          \
   } while (0);
 
+/**
+ * Scalar UTF-8 validation, skipping ASCII text 8 bytes at a time.
+ *
+ * Note: validation stops at a NUL code point, so a NUL is only valid as the
+ * last character.
+ */
+FIO_FUNC size_t fio_str_utf8_valid_scalar(const char *data, size_t len) {
+  if (!len)
+    return 1;
+  const char *const end = data + len;
+  int32_t c = 0;
+  do {
+    /* ASCII (without NUL bytes) needs no decoding */
+    while (data + 8 <= end) {
+      uint64_t w;
+      memcpy(&w, data, 8);
+      if ((w & 0x8080808080808080ULL) ||
+          ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL))
+        break;
+      data += 8;
+    }
+    if (data == end)
+      return 1;
+    FIO_STR_UTF8_CODE_POINT(data, end, c);
+  } while (c > 0 && data < end);
+  return data == end && c >= 0;
+}
+
+/*
+ * Vectorized validation tests, for every byte, that it's a continuation byte
+ * if (and only if) one of the 3 preceding bytes is a lead byte that requires
+ * it. Each block is tested using unaligned loads at offsets 0, -1, -2 and -3.
+ *
+ * The first and last blocks are copied to a padded buffer (ASCII padding), so
+ * a truncated character fails the test.
+ *
+ * Blocks that might decode to a NUL code point (0x00, 0xC0 0x80, etc')
+ * fallback to the scalar validation, where NUL stops the validation.
+ */
+#define FIO_STR_UTF8_PAD ' '
+
+#if defined(__SSE2__)
+/** Tests the 16 bytes at `p` (the 3 bytes before `p` must be readable). */
+FIO_FUNC inline void fio_str_utf8_sse2_block(const uint8_t *p, __m128i *err,
+                                             __m128i *rare) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i v = _mm_loadu_si128((const __m128i *)p);
+  const __m128i v1 = _mm_loadu_si128((const __m128i *)(p - 1));
+  const __m128i v2 = _mm_loadu_si128((const __m128i *)(p - 2));
+  const __m128i v3 = _mm_loadu_si128((const __m128i *)(p - 3));
+  /* as signed values: 0x80-0xBF < -64 <= 0xC0-0xFF < 0 */
+  const __m128i cont = _mm_cmplt_epi8(v, _mm_set1_epi8(-64));
+  const __m128i expected = _mm_or_si128(
+      _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(v1, _mm_set1_epi8(-65)),
+                                 _mm_cmplt_epi8(v1, zero)),
+                   _mm_and_si128(_mm_cmpgt_epi8(v2, _mm_set1_epi8(-33)),
+                                 _mm_cmplt_epi8(v2, zero))),
+      _mm_and_si128(_mm_cmpgt_epi8(v3, _mm_set1_epi8(-17)),
+                    _mm_cmplt_epi8(v3, zero)));
+  /* 0xF8-0xFF are never valid */
+  const __m128i bad = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(-9)),
+                                    _mm_cmplt_epi8(v, zero));
+  *err = _mm_or_si128(*err, _mm_or_si128(_mm_xor_si128(cont, expected), bad));
+  const __m128i lead0 = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v1, _mm_set1_epi8((char)0xC0)),
+                   _mm_cmpeq_epi8(v1, _mm_set1_epi8((char)0xE0))),
+      _mm_cmpeq_epi8(v1, _mm_set1_epi8((char)0xF0)));
+  *rare = _mm_or_si128(
+      *rare, _mm_or_si128(_mm_cmpeq_epi8(v, zero),
+                          _mm_and_si128(lead0, _mm_cmpeq_epi8(
+                                                   v, _mm_set1_epi8(
+                                                          (char)0x80)))));
+}
+
+/** SSE2 UTF-8 validation (see `fio_str_utf8_valid_scalar`). */
+FIO_FUNC size_t fio_str_utf8_valid_sse2(const char *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint8_t tmp[3 + 16];
+  __m128i err = _mm_setzero_si128();
+  __m128i rare = _mm_setzero_si128();
+  size_t pos = 0;
+  if (len >= 16) {
+    memset(tmp, FIO_STR_UTF8_PAD, 3);
+    memcpy(tmp + 3, p, 16);
+    fio_str_utf8_sse2_block(tmp + 3, &err, &rare);
+    for (pos = 16; pos + 16 <= len; pos += 16)
+      fio_str_utf8_sse2_block(p + pos, &err, &rare);
+    memcpy(tmp, p + pos - 3, 3);
+  } else {
+    memset(tmp, FIO_STR_UTF8_PAD, 3);
+  }
+  memset(tmp + 3, FIO_STR_UTF8_PAD, 16);
+  memcpy(tmp + 3, p + pos, len - pos);
+  fio_str_utf8_sse2_block(tmp + 3, &err, &rare);
+  if (_mm_movemask_epi8(rare))
+    return fio_str_utf8_valid_scalar(data, len);
+  return !_mm_movemask_epi8(err);
+}
+#endif /* __SSE2__ */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(FIO_STR_NO_AVX2)
+#include <immintrin.h>
+#define FIO_STR_UTF8_AVX2 1
+
+/** Tests the 32 bytes at `p` (the 3 bytes before `p` must be readable). */
+FIO_FUNC inline __attribute__((target("avx2"))) void
+fio_str_utf8_avx2_block(const uint8_t *p, __m256i *err, __m256i *rare) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+  const __m256i v1 = _mm256_loadu_si256((const __m256i *)(p - 1));
+  const __m256i v2 = _mm256_loadu_si256((const __m256i *)(p - 2));
+  const __m256i v3 = _mm256_loadu_si256((const __m256i *)(p - 3));
+  /* as signed values: 0x80-0xBF < -64 <= 0xC0-0xFF < 0 */
+  const __m256i cont = _mm256_cmpgt_epi8(_mm256_set1_epi8(-64), v);
+  const __m256i expected = _mm256_or_si256(
+      _mm256_or_si256(
+          _mm256_and_si256(_mm256_cmpgt_epi8(v1, _mm256_set1_epi8(-65)),
+                           _mm256_cmpgt_epi8(zero, v1)),
+          _mm256_and_si256(_mm256_cmpgt_epi8(v2, _mm256_set1_epi8(-33)),
+                           _mm256_cmpgt_epi8(zero, v2))),
+      _mm256_and_si256(_mm256_cmpgt_epi8(v3, _mm256_set1_epi8(-17)),
+                       _mm256_cmpgt_epi8(zero, v3)));
+  /* 0xF8-0xFF are never valid */
+  const __m256i bad =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-9)),
+                       _mm256_cmpgt_epi8(zero, v));
+  *err = _mm256_or_si256(*err,
+                         _mm256_or_si256(_mm256_xor_si256(cont, expected), bad));
+  const __m256i lead0 = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v1, _mm256_set1_epi8((char)0xC0)),
+                      _mm256_cmpeq_epi8(v1, _mm256_set1_epi8((char)0xE0))),
+      _mm256_cmpeq_epi8(v1, _mm256_set1_epi8((char)0xF0)));
+  *rare = _mm256_or_si256(
+      *rare,
+      _mm256_or_si256(
+          _mm256_cmpeq_epi8(v, zero),
+          _mm256_and_si256(lead0,
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0x80)))));
+}
+
+/** AVX2 UTF-8 validation (see `fio_str_utf8_valid_scalar`). */
+FIO_FUNC __attribute__((target("avx2"))) size_t
+fio_str_utf8_valid_avx2(const char *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint8_t tmp[3 + 32];
+  __m256i err = _mm256_setzero_si256();
+  __m256i rare = _mm256_setzero_si256();
+  size_t pos = 0;
+  if (len >= 32) {
+    memset(tmp, FIO_STR_UTF8_PAD, 3);
+    memcpy(tmp + 3, p, 32);
+    fio_str_utf8_avx2_block(tmp + 3, &err, &rare);
+    for (pos = 32; pos + 32 <= len; pos += 32)
+      fio_str_utf8_avx2_block(p + pos, &err, &rare);
+    memcpy(tmp, p + pos - 3, 3);
+  } else {
+    memset(tmp, FIO_STR_UTF8_PAD, 3);
+  }
+  memset(tmp + 3, FIO_STR_UTF8_PAD, 32);
+  memcpy(tmp + 3, p + pos, len - pos);
+  fio_str_utf8_avx2_block(tmp + 3, &err, &rare);
+  if (!_mm256_testz_si256(rare, rare))
+    return fio_str_utf8_valid_scalar(data, len);
+  return _mm256_testz_si256(err, err);
+}
+
+/** Returns 1 if the CPU supports AVX2 (tested once). */
+FIO_FUNC inline int fio_str_utf8_has_avx2(void) {
+  static int has_avx2 = -1;
+  if (has_avx2 == -1)
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return has_avx2;
+}
+#endif /* FIO_STR_UTF8_AVX2 */
+
 /** Returns 1 if the String is UTF-8 valid and 0 if not. */
 FIO_FUNC size_t fio_str_utf8_valid(fio_str_s *s) {
   if (!s)
     return 0;
   fio_str_info_s state = fio_str_info(s);
-  if (!state.len)
-    return 1;
-  char *const end = state.data + state.len;
-  int32_t c = 0;
-  do {
-    FIO_STR_UTF8_CODE_POINT(state.data, end, c);
-  } while (c > 0 && state.data < end);
-  return state.data == end && c >= 0;
+  if (state.len < 16)
+    return fio_str_utf8_valid_scalar(state.data, state.len);
+#if FIO_STR_UTF8_AVX2
+  if (state.len >= 64 && fio_str_utf8_has_avx2())
+    return fio_str_utf8_valid_avx2(state.data, state.len);
+#endif
+#if defined(__SSE2__)
+  return fio_str_utf8_valid_sse2(state.data, state.len);
+#else
+  return fio_str_utf8_valid_scalar(state.data, state.len);
+#endif
 }
 
 /** Returns the String's length in UTF-8 characters. */
@@ -4582,6 +5291,7 @@ inline FIO_FUNC ssize_t fio_str_send_free2(const intptr_t uuid,
 }
 
 #undef ROUND_UP_CAPA2WORDS
+#undef FIO_STR_UTF8_PAD
 #undef FIO_STR_SMALL_DATA
 #undef FIO_STR_NO_REF
 
@@ -5501,7 +6211,36 @@ Done
  *
  * Note: Before freeing the Set, FIO_SET_OBJ_DESTROY will be automatically
  *       called for every existing object.
- */
+ *
+ * Defining FIO_SET_SWISS selects a different probing strategy for that Set
+ * only. Each map slot gets a control byte holding 7 bits of the hash and slots
+ * are probed in groups of 16 control bytes at a time (SSE2 / NEON / SWAR),
+ * instead of cuckoo steps. This costs an extra byte per slot (and a minimal
+ * capacity of 16) but reduces probing costs, especially for lookup misses.
+ * The API and iteration order remain the same.
+ *
+ * Defining FIO_SET_CONCURRENT creates a read-mostly Set, where `find` is
+ * lock-free and can run concurrently with a (single) writer:
+ *
+ * * Writers (all functions except `find`) MUST be serialized by the caller,
+ *   i.e., using a lock.
+ *
+ * * `find` MUST be called within a `fio_rcu_read_lock` read section and any
+ *   object it returns is only valid within that read section (unless the
+ *   object is reference counted and a reference was added).
+ *
+ * * Removed or overwritten objects, as well as replaced internal memory, are
+ *   destroyed using `fio_rcu_defer` (after concurrent readers are done).
+ *
+ * * Rehashing builds a new table and publishes it by pointer. Readers never
+ *   wait for a rehash, they keep using the previous table until they're done.
+ *
+ * * Readers can iterate using `read_begin` and `read_retry`.
+ *
+ * * The `free` function assumes no concurrent readers exist.
+ *
+ * This requires the facil.io core library (fio.c).
+ */
 
 /* Used for naming functions and types, prefixing FIO_SET_NAME to the name */
 #define FIO_NAME_FROM_MACRO_STEP2(name, postfix) name##_##postfix
@@ -5635,6 +6374,28 @@ typedef struct {
 #define FIO_SET_TYPE FIO_SET_OBJ_TYPE
 #endif
 
+#ifdef FIO_SET_CONCURRENT
+/** Internal macros for writers in concurrent mode (readers may be active) */
+#define FIO_SET_PUBLISH() fio_atomic_release()
+#define FIO_SET_COPY_PUBLISH(dest, src)                                        \
+  do {                                                                         \
+    FIO_SET_TYPE tmp__;                                                        \
+    FIO_SET_COPY(tmp__, (src));                                                \
+    FIO_SET_PUBLISH();                                                         \
+    (dest) = tmp__;                                                            \
+  } while (0)
+#define FIO_SET_RETIRE(obj) FIO_NAME(_retire_)((obj))
+#define FIO_SET_WRITE_BEGIN(set)                                               \
+  const uintptr_t fio_set_write__ = FIO_NAME(_write_begin_)((set))
+#define FIO_SET_WRITE_END(set) FIO_NAME(_write_end_)((set), fio_set_write__)
+#else
+#define FIO_SET_PUBLISH()
+#define FIO_SET_COPY_PUBLISH(dest, src) FIO_SET_COPY((dest), (src))
+#define FIO_SET_RETIRE(obj) FIO_SET_DESTROY((obj))
+#define FIO_SET_WRITE_BEGIN(set)
+#define FIO_SET_WRITE_END(set)
+#endif
+
 /* *****************************************************************************
 Set / Hash Map API
 ***************************************************************************** */
@@ -5791,6 +6552,29 @@ FIO_FUNC inline size_t FIO_NAME(compact)(FIO_NAME(s) * set);
 /** Forces a rehashing of the Set. */
 FIO_FUNC void FIO_NAME(rehash)(FIO_NAME(s) * set);
 
+#ifdef FIO_SET_CONCURRENT
+/**
+ * Copies a consistent state of the Set to `snapshot`, returning a token for
+ * `read_retry` (FIO_SET_CONCURRENT only).
+ *
+ * Must be called within a `fio_rcu_read_lock` read section. The snapshot can be
+ * iterated using FIO_SET_FOR_LOOP (skipping holes). Objects could be removed
+ * concurrently, but their memory remains valid for the read section.
+ *
+ * Rehashing publishes a new table (the snapshot's table remains valid and
+ * unchanged), so readers only wait for writers altering a few slots in place.
+ */
+FIO_FUNC inline uintptr_t FIO_NAME(read_begin)(FIO_NAME(s) * set,
+                                               FIO_NAME(s) * snapshot);
+
+/**
+ * Returns non-zero if the Set was altered since `read_begin` returned `token`,
+ * meaning that any data collected from the snapshot might be invalid and the
+ * read should be repeated.
+ */
+FIO_FUNC inline int FIO_NAME(read_retry)(FIO_NAME(s) * set, uintptr_t token);
+#endif
+
 #ifndef FIO_SET_FOR_LOOP
 /**
  * A macro for a `for` loop that iterates over all the Set's objects (in
@@ -5829,6 +6613,13 @@ struct FIO_NAME(s) {
   uintptr_t pos;
   FIO_NAME(_ordered_s_) * ordered;
   FIO_NAME(_map_s_) * map;
+#ifdef FIO_SET_SWISS
+  uint8_t *ctrl;
+#endif
+#ifdef FIO_SET_CONCURRENT
+  volatile uintptr_t seq; /* odd while a writer alters the table in place */
+  FIO_NAME(s) * volatile table; /* the table readers use (see `_publish_`) */
+#endif
   uint8_t has_collisions;
   uint8_t used_bits;
   uint8_t under_attack;
@@ -5843,6 +6634,77 @@ struct FIO_NAME(s) {
 Set / Hash Map Internal Helpers
 ***************************************************************************** */
 
+#ifdef FIO_SET_SWISS
+/* the control byte for a hash value (the high bit marks a used slot) */
+#define FIO_SET_CTRL_TAG(hash_i)                                               \
+  ((uint8_t)(0x80 | (((uint64_t)(hash_i)*0x9E3779B97F4A7C15ULL) >> 57)))
+
+/** Locates an object's map position in the Set, if it exists. */
+FIO_FUNC inline FIO_NAME(_map_s_) *
+    FIO_NAME(_find_map_pos_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
+                             FIO_SET_TYPE obj) {
+  if (FIO_SET_HASH_COMPARE(hash_value, FIO_SET_HASH_INVALID))
+    hash_value = FIO_SET_HASH_FORCE;
+  if (set->map) {
+    /* make sure collisions don't effect seeking */
+    if (set->has_collisions && set->pos != set->count) {
+      FIO_NAME(rehash)(set);
+    }
+    size_t full_collisions_counter = 0;
+    const uintptr_t mask = (1ULL << set->used_bits) - 1;
+    const uintptr_t hash_value_i = FIO_SET_HASH2UINTPTR(hash_value, 0);
+    const uint8_t tag = FIO_SET_CTRL_TAG(hash_value_i);
+    /* groups are 16 slot aligned, the capacity is always a multiple of 16 */
+    uintptr_t group =
+        FIO_SET_HASH2UINTPTR(hash_value, set->used_bits) & (mask ^ 15);
+    /* triangular probing visits every group (the group count is 2^n) */
+    uintptr_t step = 0;
+    uintptr_t limit = (set->capa >> 4);
+    if (limit > FIO_SET_MAX_MAP_SEEK)
+      limit = FIO_SET_MAX_MAP_SEEK;
+    while (step < limit) {
+      uint16_t match = fio_byte_group_match(set->ctrl + group, tag);
+      while (match) {
+        FIO_NAME(_map_s_) *pos = set->map + group + __builtin_ctz(match);
+        match &= (match - 1);
+        if (!FIO_SET_HASH_COMPARE(pos->hash, hash_value_i))
+          continue;
+        if (!pos->pos || (FIO_SET_COMPARE(pos->pos->obj, obj)))
+          return pos;
+        /* full hash value collision detected */
+        set->has_collisions = 1;
+        if (++full_collisions_counter >= FIO_SET_MAX_MAP_FULL_COLLISIONS) {
+          /* is the hash under attack? */
+          FIO_LOG_WARNING(
+              "(fio hash map) too many full collisions - under attack?");
+          set->under_attack = 1;
+        }
+        if (set->under_attack) {
+          return pos;
+        }
+      }
+      /* slots are never emptied (only rehashing resets control bytes) */
+      match = fio_byte_group_match(set->ctrl + group, 0);
+      if (match)
+        return set->map + group + __builtin_ctz(match);
+      ++step;
+      group = (group + (step << 4)) & mask;
+    }
+  }
+  return NULL;
+  (void)obj; /* in cases where FIO_SET_OBJ_COMPARE does nothing */
+}
+
+/** Marks a map position as used (after setting the position's hash). */
+FIO_FUNC inline void FIO_NAME(_map_mark_)(FIO_NAME(s) * set,
+                                          FIO_NAME(_map_s_) * pos) {
+  const uintptr_t hash_value_i = FIO_SET_HASH2UINTPTR(pos->hash, 0);
+  set->ctrl[pos - set->map] = FIO_SET_CTRL_TAG(hash_value_i);
+}
+#undef FIO_SET_CTRL_TAG
+
+#else /* FIO_SET_SWISS */
+
 /** Locates an object's map position in the Set, if it exists. */
 FIO_FUNC inline FIO_NAME(_map_s_) *
     FIO_NAME(_find_map_pos_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
@@ -5909,11 +6771,165 @@ FIO_FUNC inline FIO_NAME(_map_s_) *
   return NULL;
   (void)obj; /* in cases where FIO_SET_OBJ_COMPARE does nothing */
 }
+
+/** Marks a map position as used (nothing to do without control bytes). */
+FIO_FUNC inline void FIO_NAME(_map_mark_)(FIO_NAME(s) * set,
+                                          FIO_NAME(_map_s_) * pos) {
+  (void)set;
+  (void)pos;
+}
+
+#endif /* FIO_SET_SWISS */
 #undef FIO_SET_CUCKOO_STEPS
 
+#ifdef FIO_SET_CONCURRENT
+/** Marks the beginning of a write, returns 0 if already writing (nested). */
+FIO_FUNC inline uintptr_t FIO_NAME(_write_begin_)(FIO_NAME(s) * set) {
+  if ((set->seq & 1))
+    return 0;
+  fio_atomic_add(&set->seq, 1);
+  FIO_SET_PUBLISH();
+  return 1;
+}
+
+/** Marks the end of a write (unless nested), updating the readers' table. */
+FIO_FUNC inline void FIO_NAME(_write_end_)(FIO_NAME(s) * set, uintptr_t began) {
+  if (!began)
+    return;
+  if (set->table) {
+    set->table->pos = set->pos;
+    set->table->count = set->count;
+  }
+  fio_atomic_add(&set->seq, 1);
+}
+
+/** Frees retired memory (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_free_)(void *ptr) { FIO_SET_FREE(ptr, 0); }
+
+/** Frees a retired table (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_free_table_)(void *ptr) {
+  FIO_NAME(s) *table = (FIO_NAME(s) *)ptr;
+#ifdef FIO_SET_SWISS
+  FIO_SET_FREE(table->ctrl, table->capa);
+#endif
+  FIO_SET_FREE(table->map, table->capa * sizeof(*table->map));
+  FIO_SET_FREE(table->ordered, table->capa * sizeof(*table->ordered));
+  FIO_SET_FREE(table, sizeof(*table));
+}
+
+/**
+ * Publishes the Set's (rehashed) memory to concurrent readers, retiring the
+ * previous table. The previous table is never altered by the writer, so readers
+ * can keep using it until their read section ends.
+ */
+FIO_FUNC void FIO_NAME(_publish_)(FIO_NAME(s) * set) {
+  FIO_NAME(s) *old = set->table;
+  FIO_NAME(s) *table = (FIO_NAME(s) *)FIO_SET_CALLOC(sizeof(*table), 1);
+  if (!table) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  *table = *set;
+  table->seq = 0;
+  table->table = NULL;
+  table->has_collisions = 0; /* readers never rehash */
+  FIO_SET_PUBLISH();
+  set->table = table;
+  if (old)
+    fio_rcu_defer(FIO_NAME(_rcu_free_table_), old);
+}
+
+/** Destroys a retired object (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_destroy_)(void *ptr) {
+  FIO_SET_TYPE *obj = (FIO_SET_TYPE *)ptr;
+  FIO_SET_DESTROY((*obj));
+  FIO_SET_FREE(obj, sizeof(*obj));
+}
+
+/** Retires an object that concurrent readers might be accessing. */
+FIO_FUNC void FIO_NAME(_retire_)(FIO_SET_TYPE obj) {
+  FIO_SET_TYPE *tmp = (FIO_SET_TYPE *)FIO_SET_CALLOC(sizeof(*tmp), 1);
+  if (!tmp) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  *tmp = obj;
+  fio_rcu_defer(FIO_NAME(_rcu_destroy_), tmp);
+}
+
+#ifdef FIO_SET_KEY_TYPE
+/** Destroys a retired value (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_destroy_obj_)(void *ptr) {
+  FIO_SET_OBJ_TYPE *obj = (FIO_SET_OBJ_TYPE *)ptr;
+  FIO_SET_OBJ_DESTROY((*obj));
+  FIO_SET_FREE(obj, sizeof(*obj));
+}
+
+/** Retires a value (not the key) that concurrent readers might be accessing. */
+FIO_FUNC void FIO_NAME(_retire_obj_)(FIO_SET_OBJ_TYPE obj) {
+  FIO_SET_OBJ_TYPE *tmp = (FIO_SET_OBJ_TYPE *)FIO_SET_CALLOC(sizeof(*tmp), 1);
+  if (!tmp) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  *tmp = obj;
+  fio_rcu_defer(FIO_NAME(_rcu_destroy_obj_), tmp);
+}
+#endif
+
+FIO_FUNC inline uintptr_t FIO_NAME(read_begin)(FIO_NAME(s) * set,
+                                               FIO_NAME(s) * snapshot) {
+  for (;;) {
+    const uintptr_t token = set->seq;
+    if (!(token & 1)) {
+      fio_atomic_acquire();
+      FIO_NAME(s) *table = set->table;
+      if (table)
+        *snapshot = *table;
+      else
+        *snapshot = (FIO_NAME(s)){.map = NULL};
+      fio_atomic_acquire();
+      if (token == set->seq)
+        return token;
+      continue;
+    }
+    /* a writer is altering a few slots in place (rehashing doesn't wait) */
+    fio_reschedule_thread();
+  }
+}
+
+FIO_FUNC inline int FIO_NAME(read_retry)(FIO_NAME(s) * set, uintptr_t token) {
+  fio_atomic_acquire();
+  return token != set->seq;
+}
+
+/** Lock-free lookup, returns an empty object if none was found. */
+FIO_FUNC inline FIO_SET_TYPE FIO_NAME(_find_concurrent_)(
+    FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value, FIO_SET_TYPE obj) {
+  FIO_NAME(s) snapshot;
+  FIO_SET_TYPE result;
+  uintptr_t token;
+  do {
+    token = FIO_NAME(read_begin)(set, &snapshot);
+    memset(&result, 0, sizeof(result));
+    FIO_NAME(_map_s_) *pos =
+        FIO_NAME(_find_map_pos_)(&snapshot, hash_value, obj);
+    FIO_NAME(_ordered_s_) *found = pos ? pos->pos : NULL;
+    if (found)
+      result = found->obj;
+  } while (FIO_NAME(read_retry)(set, token));
+  return result;
+}
+#endif /* FIO_SET_CONCURRENT */
+
 /** Removes "holes" from the Set's internal Array - MUST re-hash afterwards.
  */
 FIO_FUNC inline void FIO_NAME(_compact_ordered_array_)(FIO_NAME(s) * set) {
+#ifdef FIO_SET_CONCURRENT
+  /* readers might be using the array, `_reallocate_set_mem_` compacts a copy */
+  if (set->table)
+    return;
+#endif
   if (set->count == set->pos)
     return;
   FIO_NAME(_ordered_s_) *reader = set->ordered;
@@ -5932,12 +6948,54 @@ FIO_FUNC inline void FIO_NAME(_compact_ordered_array_)(FIO_NAME(s) * set) {
 
 /** (Re)allocates the set's internal, invalidatint the mapping (must rehash) */
 FIO_FUNC inline void FIO_NAME(_reallocate_set_mem_)(FIO_NAME(s) * set) {
+#ifdef FIO_SET_SWISS
+  /* control bytes are probed in groups of 16 */
+  if (set->used_bits < 4)
+    set->used_bits = 4;
+#endif
   const uintptr_t new_capa = 1ULL << set->used_bits;
+#ifdef FIO_SET_CONCURRENT
+  /*
+   * concurrent readers might be using the published memory, which is retired
+   * once the new table is published. Unpublished memory is freed.
+   */
+  FIO_NAME(_ordered_s_) *ordered = (FIO_NAME(_ordered_s_) *)FIO_SET_CALLOC(
+      sizeof(*set->ordered), new_capa);
+  if (ordered) {
+    /* compact the copy, the published array is never altered */
+    uintptr_t count = 0;
+    for (uintptr_t i = 0; i < set->pos; ++i) {
+      if (FIO_SET_HASH_COMPARE(set->ordered[i].hash, FIO_SET_HASH_INVALID))
+        continue;
+      ordered[count++] = set->ordered[i];
+    }
+    set->pos = set->count = count;
+  }
+  if (!set->table || set->table->ordered != set->ordered) {
+#ifdef FIO_SET_SWISS
+    FIO_SET_FREE(set->ctrl, set->capa);
+#endif
+    FIO_SET_FREE(set->map, set->capa * sizeof(*set->map));
+    FIO_SET_FREE(set->ordered, set->capa * sizeof(*set->ordered));
+  }
+  set->ordered = ordered;
+#else
+#ifdef FIO_SET_SWISS
+  FIO_SET_FREE(set->ctrl, set->capa);
+#endif
   FIO_SET_FREE(set->map, set->capa * sizeof(*set->map));
-  set->map = (FIO_NAME(_map_s_) *)FIO_SET_CALLOC(sizeof(*set->map), new_capa);
   set->ordered = (FIO_NAME(_ordered_s_) *)FIO_SET_REALLOC(
       set->ordered, (set->capa * sizeof(*set->ordered)),
       (new_capa * sizeof(*set->ordered)), (set->pos * sizeof(*set->ordered)));
+#endif
+#ifdef FIO_SET_SWISS
+  set->ctrl = (uint8_t *)FIO_SET_CALLOC(1, new_capa);
+  if (!set->ctrl) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+#endif
+  set->map = (FIO_NAME(_map_s_) *)FIO_SET_CALLOC(sizeof(*set->map), new_capa);
   if (!set->map || !set->ordered) {
     perror("FATAL ERROR: couldn't allocate memory for Set data");
     exit(errno);
@@ -5973,6 +7031,7 @@ FIO_NAME(_insert_or_overwrite_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
 
   if (!pos) {
     /* inserting a new object, with too many holes in the map */
+    /* (readers can't reach the slot before the rehashed table is published) */
     FIO_SET_COPY(set->ordered[set->pos].obj, obj);
     set->ordered[set->pos].hash = hash_value;
     ++set->pos;
@@ -5981,11 +7040,14 @@ FIO_NAME(_insert_or_overwrite_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
     return set->ordered[set->pos - 1].obj;
   }
 
+  FIO_SET_WRITE_BEGIN(set);
+
   /* overwriting / new */
   if (pos->pos) {
     /* overwrite existing object */
     if (!overwrite) {
       FIO_SET_DESTROY(obj);
+      FIO_SET_WRITE_END(set);
       return pos->pos->obj;
     }
 #ifdef FIO_SET_KEY_TYPE
@@ -5993,26 +7055,50 @@ FIO_NAME(_insert_or_overwrite_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
       FIO_SET_OBJ_COPY((*old), pos->pos->obj.obj);
     }
     /* no need to recreate the key object, just the value object */
+#ifdef FIO_SET_CONCURRENT
+    {
+      /* retired only once unreachable (`fio_rcu_defer` might release it) */
+      FIO_SET_OBJ_TYPE tmp, retired = pos->pos->obj.obj;
+      FIO_SET_OBJ_COPY(tmp, obj.obj);
+      FIO_SET_PUBLISH();
+      pos->pos->obj.obj = tmp;
+      FIO_NAME(_retire_obj_)(retired);
+    }
+#else
     FIO_SET_OBJ_DESTROY(pos->pos->obj.obj);
     FIO_SET_OBJ_COPY(pos->pos->obj.obj, obj.obj);
+#endif
+    FIO_SET_WRITE_END(set);
     return pos->pos->obj;
 #else
     if (old) {
       FIO_SET_COPY((*old), pos->pos->obj);
     }
-    FIO_SET_DESTROY(pos->pos->obj);
 #endif
   } else {
-    /* insert into new slot */
-    pos->pos = set->ordered + set->pos;
+    /* insert into new slot, the object is set before it's mapped */
+    FIO_NAME(_ordered_s_) *slot = set->ordered + set->pos;
     ++set->pos;
     ++set->count;
+    FIO_SET_COPY_PUBLISH(slot->obj, obj);
+    FIO_SET_PUBLISH();
+    slot->hash = hash_value;
+    FIO_SET_PUBLISH();
+    pos->pos = slot;
+    pos->hash = hash_value;
+    FIO_NAME(_map_mark_)(set, pos);
+    FIO_SET_WRITE_END(set);
+    return slot->obj;
   }
-  /* store object at position */
+  /* store object at position (retiring the old one once it's unreachable) */
+  FIO_SET_TYPE retired = pos->pos->obj;
   pos->hash = hash_value;
+  FIO_NAME(_map_mark_)(set, pos);
   pos->pos->hash = hash_value;
-  FIO_SET_COPY(pos->pos->obj, obj);
-
+  FIO_SET_COPY_PUBLISH(pos->pos->obj, obj);
+  FIO_SET_RETIRE(retired);
+  (void)retired; /* in cases where FIO_SET_DESTROY does nothing */
+  FIO_SET_WRITE_END(set);
   return pos->pos->obj;
 }
 
@@ -6032,8 +7118,14 @@ FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * s) {
     }
   }
   /* free ordered array and hash mapping */
+#ifdef FIO_SET_SWISS
+  FIO_SET_FREE(s->ctrl, s->capa);
+#endif
   FIO_SET_FREE(s->map, s->capa * sizeof(*s->map));
   FIO_SET_FREE(s->ordered, s->capa * sizeof(*s->ordered));
+#ifdef FIO_SET_CONCURRENT
+  FIO_SET_FREE(s->table, sizeof(*s->table));
+#endif
   *s = (FIO_NAME(s)){.map = NULL};
 }
 
@@ -6049,6 +7141,11 @@ FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * s) {
 FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
                                          const FIO_SET_HASH_TYPE hash_value,
                                          FIO_SET_KEY_TYPE key) {
+#ifdef FIO_SET_CONCURRENT
+  return FIO_NAME(_find_concurrent_)(set, hash_value,
+                                     (FIO_SET_TYPE){.key = key})
+      .obj;
+#else
   FIO_NAME(_map_s_) *pos =
       FIO_NAME(_find_map_pos_)(set, hash_value, (FIO_SET_TYPE){.key = key});
   if (!pos || !pos->pos) {
@@ -6057,6 +7154,7 @@ FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
     return empty;
   }
   return pos->pos->obj.obj;
+#endif
 }
 
 /**
@@ -6092,16 +7190,19 @@ FIO_FUNC inline int FIO_NAME(remove)(FIO_NAME(s) * set,
                                      const FIO_SET_HASH_TYPE hash_value,
                                      FIO_SET_KEY_TYPE key,
                                      FIO_SET_OBJ_TYPE *old) {
+  FIO_SET_WRITE_BEGIN(set);
   FIO_NAME(_map_s_) *pos =
       FIO_NAME(_find_map_pos_)(set, hash_value, (FIO_SET_TYPE){.key = key});
-  if (!pos || !pos->pos)
+  if (!pos || !pos->pos) {
+    FIO_SET_WRITE_END(set);
     return -1;
+  }
   if (old)
     FIO_SET_OBJ_COPY((*old), pos->pos->obj.obj);
-  FIO_SET_DESTROY(pos->pos->obj);
+  FIO_NAME(_ordered_s_) *slot = pos->pos;
   --set->count;
-  pos->pos->hash = FIO_SET_HASH_INVALID;
-  if (pos->pos == set->pos + set->ordered - 1) {
+  slot->hash = FIO_SET_HASH_INVALID;
+  if (slot == set->pos + set->ordered - 1) {
     /* removing last item inserted */
     pos->hash = FIO_SET_HASH_INVALID; /* no need for a "hole" */
     do {
@@ -6110,6 +7211,9 @@ FIO_FUNC inline int FIO_NAME(remove)(FIO_NAME(s) * set,
                                               FIO_SET_HASH_INVALID));
   }
   pos->pos = NULL; /* leave pos->hash set to mark "hole" */
+  /* retired once unmapped (`fio_rcu_defer` might release it) */
+  FIO_SET_RETIRE(slot->obj);
+  FIO_SET_WRITE_END(set);
   return 0;
 }
 
@@ -6121,6 +7225,9 @@ FIO_FUNC inline int FIO_NAME(remove)(FIO_NAME(s) * set,
 FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
                                          const FIO_SET_HASH_TYPE hash_value,
                                          FIO_SET_OBJ_TYPE obj) {
+#ifdef FIO_SET_CONCURRENT
+  return FIO_NAME(_find_concurrent_)(set, hash_value, obj);
+#else
   FIO_NAME(_map_s_) *pos = FIO_NAME(_find_map_pos_)(set, hash_value, obj);
   if (!pos || !pos->pos) {
     FIO_SET_OBJ_TYPE empty;
@@ -6128,6 +7235,7 @@ FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
     return empty;
   }
   return pos->pos->obj;
+#endif
 }
 
 /**
@@ -6166,15 +7274,18 @@ FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * set,
                               FIO_SET_OBJ_TYPE obj, FIO_SET_OBJ_TYPE *old) {
   if (FIO_SET_HASH_COMPARE(hash_value, FIO_SET_HASH_INVALID))
     return -1;
+  FIO_SET_WRITE_BEGIN(set);
   FIO_NAME(_map_s_) *pos = FIO_NAME(_find_map_pos_)(set, hash_value, obj);
-  if (!pos || !pos->pos)
+  if (!pos || !pos->pos) {
+    FIO_SET_WRITE_END(set);
     return -1;
+  }
   if (old)
     FIO_SET_COPY((*old), pos->pos->obj);
-  FIO_SET_DESTROY(pos->pos->obj);
+  FIO_NAME(_ordered_s_) *slot = pos->pos;
   --set->count;
-  pos->pos->hash = FIO_SET_HASH_INVALID;
-  if (pos->pos == set->pos + set->ordered - 1) {
+  slot->hash = FIO_SET_HASH_INVALID;
+  if (slot == set->pos + set->ordered - 1) {
     /* removing last item inserted */
     pos->hash = FIO_SET_HASH_INVALID; /* no need for a "hole" */
     do {
@@ -6183,6 +7294,9 @@ FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * set,
                                               FIO_SET_HASH_INVALID));
   }
   pos->pos = NULL; /* leave pos->hash set to mark "hole" */
+  /* retired once unmapped (`fio_rcu_defer` might release it) */
+  FIO_SET_RETIRE(slot->obj);
+  FIO_SET_WRITE_END(set);
   return 0;
 }
 
@@ -6210,13 +7324,25 @@ FIO_FUNC inline FIO_SET_TYPE FIO_NAME(last)(FIO_NAME(s) * set) {
 FIO_FUNC void FIO_NAME(pop)(FIO_NAME(s) * set) {
   if (!set->ordered || !set->pos)
     return;
-  FIO_SET_DESTROY(set->ordered[set->pos - 1].obj);
+  FIO_SET_WRITE_BEGIN(set);
+#ifdef FIO_SET_CONCURRENT
+  {
+    /* unmap the object, so readers will never reach a destroyed object */
+    FIO_NAME(_ordered_s_) *last = set->ordered + set->pos - 1;
+    FIO_NAME(_map_s_) *pos =
+        FIO_NAME(_find_map_pos_)(set, last->hash, last->obj);
+    if (pos && pos->pos == last)
+      pos->pos = NULL;
+  }
+#endif
   set->ordered[set->pos - 1].hash = FIO_SET_HASH_INVALID;
+  FIO_SET_RETIRE(set->ordered[set->pos - 1].obj);
   --(set->count);
   do {
     --(set->pos);
   } while (set->pos && FIO_SET_HASH_COMPARE(set->ordered[set->pos - 1].hash,
                                             FIO_SET_HASH_INVALID));
+  FIO_SET_WRITE_END(set);
 }
 
 /** Returns the number of objects currently in the Set. */
@@ -6300,8 +7426,12 @@ restart:
       }
       mp->pos = pos;
       mp->hash = pos->hash;
+      FIO_NAME(_map_mark_)(set, mp);
     }
   }
+#ifdef FIO_SET_CONCURRENT
+  FIO_NAME(_publish_)(set);
+#endif
 }
 
 #undef FIO_SET_OBJ_TYPE
@@ -6322,6 +7452,13 @@ restart:
 #undef FIO_SET_DESTROY
 #undef FIO_SET_MAX_MAP_SEEK
 #undef FIO_SET_MAX_MAP_FULL_COLLISIONS
+#undef FIO_SET_SWISS
+#undef FIO_SET_CONCURRENT
+#undef FIO_SET_PUBLISH
+#undef FIO_SET_COPY_PUBLISH
+#undef FIO_SET_RETIRE
+#undef FIO_SET_WRITE_BEGIN
+#undef FIO_SET_WRITE_END
 #undef FIO_SET_REALLOC
 #undef FIO_SET_CALLOC
 #undef FIO_SET_FREE
@@ -6335,3 +7472,1976 @@ restart:
 #undef FIO_FORCE_MALLOC_TMP
 
 #endif
+
+/* *****************************************************************************
+
+
+
+
+
+
+
+
+
+
+
+                    Ring Buffer (bounded SPSC / MPSC queue)
+
+
+
+
+
+
+
+
+
+
+
+***************************************************************************** */
+
+#ifdef FIO_RING_NAME
+
+/**
+ * A bounded, lock-free, FIFO queue for handing objects between threads.
+ *
+ * By default, the Ring Buffer is a Single Producer Single Consumer (SPSC)
+ * queue. Defining FIO_RING_MPSC selects a Multiple Producer Single Consumer
+ * variant, where any number of threads may push concurrently (the consumer
+ * side must still be serialized).
+ *
+ * To create a Ring Buffer type, define the macro FIO_RING_NAME. i.e.:
+ *
+ *         #define FIO_RING_NAME fio_task_ring
+ *         #define FIO_RING_TYPE fio_defer_task_s
+ *         #define FIO_RING_MPSC 1
+ *         #include <fio.h>
+ *
+ *         fio_task_ring_s ring = FIO_RING_INIT;
+ *         fio_task_ring_init(&ring, 1024);
+ *         fio_task_ring_push(&ring, task); // -1 when full
+ *         fio_task_ring_pop(&ring, &task); // -1 when empty
+ *         fio_task_ring_free(&ring);
+ *
+ * The producer and consumer indexes are placed on separate cache lines
+ * (FIO_RING_CACHE_LINE, defaults to 64 bytes) to prevent false sharing. The
+ * SPSC variant also caches the opposite index, so the shared cache line is
+ * only read when the ring seems full (or empty).
+ *
+ * The batch functions (`push_batch` / `pop_batch`) move a number of objects
+ * while touching the shared indexes only once.
+ *
+ * Objects are copied by assignment. Note: Before freeing the Ring Buffer,
+ * FIO_RING_DESTROY will be automatically called for every object still in the
+ * queue.
+ *
+ * The capacity is fixed (rounded up to a power of 2) when the Ring Buffer is
+ * initialized. `init` and `free` MUST NOT be called concurrently with any other
+ * function.
+ */
+
+/* Used for naming functions and types, prefixing FIO_RING_NAME to the name */
+#define FIO_NAME_FROM_MACRO_STEP2(name, postfix) name##_##postfix
+#define FIO_NAME_FROM_MACRO_STEP1(name, postfix)                               \
+  FIO_NAME_FROM_MACRO_STEP2(name, postfix)
+#define FIO_NAME(postfix) FIO_NAME_FROM_MACRO_STEP1(FIO_RING_NAME, postfix)
+
+/* Used for naming the `free` function */
+#define FIO_NAME_FROM_MACRO_STEP4(name) name##_free
+#define FIO_NAME_FROM_MACRO_STEP3(name) FIO_NAME_FROM_MACRO_STEP4(name)
+#define FIO_NAME_FREE() FIO_NAME_FROM_MACRO_STEP3(FIO_RING_NAME)
+
+/* The default Ring Buffer object type is `void *` */
+#if !defined(FIO_RING_TYPE)
+#define FIO_RING_TYPE void *
+#endif
+
+/** object destruction required? */
+#ifndef FIO_RING_DESTROY
+#define FIO_RING_DESTROY(obj) ((void)0)
+#endif
+
+/* Customizable memory management */
+#ifndef FIO_RING_MALLOC
+#define FIO_RING_MALLOC(size) FIO_MALLOC((size))
+#endif
+
+#ifndef FIO_RING_FREE
+#define FIO_RING_FREE(ptr, size) FIO_FREE((ptr))
+#endif
+
+/* The distance used to keep the indexes from sharing a cache line */
+#ifndef FIO_RING_CACHE_LINE
+#define FIO_RING_CACHE_LINE 64
+#endif
+
+/* *****************************************************************************
+Ring Buffer API
+***************************************************************************** */
+
+/** The Ring Buffer container type. */
+typedef struct FIO_NAME(s) FIO_NAME(s);
+
+#ifndef FIO_RING_INIT
+/** Initializes the Ring Buffer container (`init` must still be called) */
+#define FIO_RING_INIT                                                          \
+  { .buf = NULL }
+#endif
+
+/**
+ * Allocates the Ring Buffer's storage for (at least) `capa` objects.
+ *
+ * The capacity is rounded up to a power of 2. Returns -1 on error.
+ */
+FIO_FUNC int FIO_NAME(init)(FIO_NAME(s) * ring, size_t capa);
+
+/** Destroys any remaining objects and frees the Ring Buffer's storage. */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * ring);
+
+/** Returns the Ring Buffer's capacity. */
+FIO_FUNC inline size_t FIO_NAME(capa)(FIO_NAME(s) * ring);
+
+/**
+ * Returns the number of objects in the Ring Buffer.
+ *
+ * When called concurrently, this is only an approximation.
+ */
+FIO_FUNC inline size_t FIO_NAME(count)(FIO_NAME(s) * ring);
+
+/**
+ * Pushes an object to the Ring Buffer. Returns -1 if the Ring Buffer is full.
+ *
+ * Producer side. For SPSC Ring Buffers, calls must be serialized.
+ */
+FIO_FUNC inline int FIO_NAME(push)(FIO_NAME(s) * ring, FIO_RING_TYPE obj);
+
+/**
+ * Pushes up to `count` objects to the Ring Buffer, in order.
+ *
+ * Returns the number of objects pushed (0 if the Ring Buffer is full).
+ *
+ * Producer side. For SPSC Ring Buffers, calls must be serialized.
+ */
+FIO_FUNC size_t FIO_NAME(push_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *objs,
+                                     size_t count);
+
+/**
+ * Pops the oldest object from the Ring Buffer, copying it to `dest`.
+ *
+ * Returns -1 if the Ring Buffer is empty.
+ *
+ * Consumer side, calls must be serialized.
+ */
+FIO_FUNC inline int FIO_NAME(pop)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest);
+
+/**
+ * Pops up to `max` objects from the Ring Buffer, copying them to `dest`.
+ *
+ * Returns the number of objects popped (0 if the Ring Buffer is empty).
+ *
+ * Consumer side, calls must be serialized.
+ */
+FIO_FUNC size_t FIO_NAME(pop_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest,
+                                    size_t max);
+
+/* *****************************************************************************
+Ring Buffer Implementation - type
+***************************************************************************** */
+
+typedef struct {
+#ifdef FIO_RING_MPSC
+  /* slot position + 1 when the object is ready, position + capa when free */
+  volatile size_t seq;
+#endif
+  FIO_RING_TYPE obj;
+} FIO_NAME(_slot_s);
+
+struct FIO_NAME(s) {
+  FIO_NAME(_slot_s) * buf;
+  size_t mask;
+  uint8_t pad0__[FIO_RING_CACHE_LINE - (sizeof(size_t) << 1)];
+  /* consumer owned */
+  volatile size_t head;
+  size_t tail_cache;
+  uint8_t pad1__[FIO_RING_CACHE_LINE - (sizeof(size_t) << 1)];
+  /* producer owned (shared by all producers in MPSC Ring Buffers) */
+  volatile size_t tail;
+  size_t head_cache;
+  uint8_t pad2__[FIO_RING_CACHE_LINE - (sizeof(size_t) << 1)];
+};
+
+/* *****************************************************************************
+Ring Buffer Implementation - API
+***************************************************************************** */
+
+/**
+ * Allocates the Ring Buffer's storage for (at least) `capa` objects.
+ *
+ * The capacity is rounded up to a power of 2. Returns -1 on error.
+ */
+FIO_FUNC int FIO_NAME(init)(FIO_NAME(s) * ring, size_t capa) {
+  size_t bits = 1;
+  while (((size_t)1 << bits) < capa && bits < ((sizeof(size_t) << 3) - 2))
+    ++bits;
+  capa = (size_t)1 << bits;
+  *ring = (FIO_NAME(s))FIO_RING_INIT;
+  ring->buf = (FIO_NAME(_slot_s) *)FIO_RING_MALLOC(sizeof(*ring->buf) * capa);
+  if (!ring->buf)
+    return -1;
+  ring->mask = capa - 1;
+#ifdef FIO_RING_MPSC
+  for (size_t i = 0; i < capa; ++i) {
+    ring->buf[i].seq = i;
+  }
+#endif
+  return 0;
+}
+
+/** Destroys any remaining objects and frees the Ring Buffer's storage. */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * ring) {
+  if (!ring || !ring->buf)
+    return;
+  FIO_RING_TYPE obj;
+  while (!FIO_NAME(pop)(ring, &obj)) {
+    FIO_RING_DESTROY(obj);
+  }
+  FIO_RING_FREE(ring->buf, sizeof(*ring->buf) * (ring->mask + 1));
+  *ring = (FIO_NAME(s))FIO_RING_INIT;
+}
+
+/** Returns the Ring Buffer's capacity. */
+FIO_FUNC inline size_t FIO_NAME(capa)(FIO_NAME(s) * ring) {
+  return ring->buf ? ring->mask + 1 : 0;
+}
+
+/** Returns the number of objects in the Ring Buffer. */
+FIO_FUNC inline size_t FIO_NAME(count)(FIO_NAME(s) * ring) {
+  size_t h = ring->head;
+  size_t t = ring->tail;
+  if ((intptr_t)(t - h) <= 0)
+    return 0;
+  return t - h;
+}
+
+#ifdef FIO_RING_MPSC
+
+/* *****************************************************************************
+MPSC - every slot carries a sequence number, so producers can claim a slot
+(using CAS on the tail) and publish it independently of each other.
+***************************************************************************** */
+
+/** Pushes an object to the Ring Buffer. Returns -1 if the Ring Buffer is full.
+ */
+FIO_FUNC inline int FIO_NAME(push)(FIO_NAME(s) * ring, FIO_RING_TYPE obj) {
+  FIO_NAME(_slot_s) * slot;
+  size_t t = ring->tail;
+  for (;;) {
+    slot = ring->buf + (t & ring->mask);
+    size_t seq = slot->seq;
+    fio_atomic_acquire();
+    intptr_t diff = (intptr_t)(seq - t);
+    if (!diff) {
+      if (fio_atomic_cas(&ring->tail, t, t + 1))
+        break;
+    } else if (diff < 0) {
+      return -1; /* full */
+    }
+    t = ring->tail;
+  }
+  slot->obj = obj;
+  fio_atomic_release();
+  slot->seq = t + 1;
+  return 0;
+}
+
+/** Pushes up to `count` objects to the Ring Buffer, in order. */
+FIO_FUNC size_t FIO_NAME(push_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *objs,
+                                     size_t count) {
+  size_t t, n;
+  if (!count)
+    return 0;
+  t = ring->tail;
+  for (;;) {
+    /* the consumer frees slots (in order) before advancing the head */
+    size_t h = ring->head;
+    fio_atomic_acquire();
+    if ((intptr_t)(t - h) < 0) {
+      t = ring->tail; /* stale tail */
+      continue;
+    }
+    /* `push` may claim a slot freed before the head was updated */
+    if (t - h > ring->mask)
+      return 0;
+    n = (ring->mask + 1) - (t - h);
+    if (n > count)
+      n = count;
+    if (fio_atomic_cas(&ring->tail, t, t + n))
+      break;
+    t = ring->tail;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    ring->buf[(t + i) & ring->mask].obj = objs[i];
+  }
+  fio_atomic_release();
+  for (size_t i = 0; i < n; ++i) {
+    ring->buf[(t + i) & ring->mask].seq = t + i + 1;
+  }
+  return n;
+}
+
+/** Pops the oldest object from the Ring Buffer, copying it to `dest`. */
+FIO_FUNC inline int FIO_NAME(pop)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest) {
+  size_t h = ring->head;
+  FIO_NAME(_slot_s) *slot = ring->buf + (h & ring->mask);
+  if (slot->seq != h + 1)
+    return -1; /* empty (or the next object wasn't published yet) */
+  fio_atomic_acquire();
+  *dest = slot->obj;
+  fio_atomic_release();
+  slot->seq = h + ring->mask + 1;
+  /* `push_batch` claims slots by the head, so the slot is freed first */
+  fio_atomic_release();
+  ring->head = h + 1;
+  return 0;
+}
+
+/** Pops up to `max` objects from the Ring Buffer, copying them to `dest`. */
+FIO_FUNC size_t FIO_NAME(pop_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest,
+                                    size_t max) {
+  size_t h = ring->head;
+  size_t n = 0;
+  if (max > ring->mask + 1)
+    max = ring->mask + 1;
+  while (n < max && ring->buf[(h + n) & ring->mask].seq == h + n + 1)
+    ++n;
+  if (!n)
+    return 0;
+  fio_atomic_acquire();
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = ring->buf[(h + i) & ring->mask].obj;
+  }
+  fio_atomic_release();
+  for (size_t i = 0; i < n; ++i) {
+    ring->buf[(h + i) & ring->mask].seq = h + i + ring->mask + 1;
+  }
+  /* `push_batch` claims slots by the head, so the slots are freed first */
+  fio_atomic_release();
+  ring->head = h + n;
+  return n;
+}
+
+#else /* FIO_RING_MPSC */
+
+/* *****************************************************************************
+SPSC - the producer owns the tail, the consumer owns the head, each side
+caches the other side's index.
+***************************************************************************** */
+
+/** Pushes an object to the Ring Buffer. Returns -1 if the Ring Buffer is full.
+ */
+FIO_FUNC inline int FIO_NAME(push)(FIO_NAME(s) * ring, FIO_RING_TYPE obj) {
+  size_t t = ring->tail;
+  if (t - ring->head_cache > ring->mask) {
+    ring->head_cache = ring->head;
+    fio_atomic_acquire();
+    if (t - ring->head_cache > ring->mask)
+      return -1; /* full */
+  }
+  ring->buf[t & ring->mask].obj = obj;
+  fio_atomic_release();
+  ring->tail = t + 1;
+  return 0;
+}
+
+/** Pushes up to `count` objects to the Ring Buffer, in order. */
+FIO_FUNC size_t FIO_NAME(push_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *objs,
+                                     size_t count) {
+  size_t t = ring->tail;
+  size_t n = (ring->mask + 1) - (t - ring->head_cache);
+  if (n < count) {
+    ring->head_cache = ring->head;
+    fio_atomic_acquire();
+    n = (ring->mask + 1) - (t - ring->head_cache);
+  }
+  if (n > count)
+    n = count;
+  if (!n)
+    return 0;
+  for (size_t i = 0; i < n; ++i) {
+    ring->buf[(t + i) & ring->mask].obj = objs[i];
+  }
+  fio_atomic_release();
+  ring->tail = t + n;
+  return n;
+}
+
+/** Pops the oldest object from the Ring Buffer, copying it to `dest`. */
+FIO_FUNC inline int FIO_NAME(pop)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest) {
+  size_t h = ring->head;
+  if (h == ring->tail_cache) {
+    ring->tail_cache = ring->tail;
+    fio_atomic_acquire();
+    if (h == ring->tail_cache)
+      return -1; /* empty */
+  }
+  *dest = ring->buf[h & ring->mask].obj;
+  fio_atomic_release();
+  ring->head = h + 1;
+  return 0;
+}
+
+/** Pops up to `max` objects from the Ring Buffer, copying them to `dest`. */
+FIO_FUNC size_t FIO_NAME(pop_batch)(FIO_NAME(s) * ring, FIO_RING_TYPE *dest,
+                                    size_t max) {
+  size_t h = ring->head;
+  size_t n = ring->tail_cache - h;
+  if (n < max) {
+    ring->tail_cache = ring->tail;
+    fio_atomic_acquire();
+    n = ring->tail_cache - h;
+  }
+  if (n > max)
+    n = max;
+  if (!n)
+    return 0;
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = ring->buf[(h + i) & ring->mask].obj;
+  }
+  fio_atomic_release();
+  ring->head = h + n;
+  return n;
+}
+
+#endif /* FIO_RING_MPSC */
+
+/* *****************************************************************************
+Done
+***************************************************************************** */
+
+#undef FIO_NAME_FROM_MACRO_STEP2
+#undef FIO_NAME_FROM_MACRO_STEP1
+#undef FIO_NAME
+#undef FIO_NAME_FROM_MACRO_STEP4
+#undef FIO_NAME_FROM_MACRO_STEP3
+#undef FIO_NAME_FREE
+#undef FIO_RING_NAME
+#undef FIO_RING_TYPE
+#undef FIO_RING_DESTROY
+#undef FIO_RING_MALLOC
+#undef FIO_RING_FREE
+#undef FIO_RING_MPSC
+
+#endif
+
+/* *****************************************************************************
+
+
+
+
+
+
+
+
+
+
+
+                        Radix Tree (prefix lookups)
+
+
+
+
+
+
+
+
+
+
+
+***************************************************************************** */
+
+#ifdef FIO_RADIX_NAME
+
+/**
+ * A compressed radix tree (a.k.a. Patricia trie), mapping byte strings to
+ * objects, with a minimal API.
+ *
+ * Unlike a Set / Hash Map, the Radix Tree can answer prefix related questions:
+ *
+ * * `find` locates an exact key.
+ *
+ * * `find_prefix` locates the longest key that is a prefix of the requested
+ *   key (i.e., routing `/static/css/main.css` to a `/static/` handler).
+ *
+ * * `each_prefix` visits every key that is a prefix of the requested key.
+ *
+ * * `match` locates a key where wildcard segments are allowed. A stored key
+ *   segment made of the FIO_RADIX_WILDCARD character alone (defaults to `*`)
+ *   matches any single (non-empty) segment in the requested key. Segments are
+ *   separated by FIO_RADIX_SEPARATOR (defaults to `/`). Literal segments are
+ *   preferred over wildcard segments.
+ *
+ * * `each` iterates over the keys in (byte-wise) lexicographic order,
+ *   optionally limited to keys starting with a specific prefix.
+ *
+ * To create a Radix Tree type, define the macro FIO_RADIX_NAME. i.e.:
+ *
+ *         #define FIO_RADIX_NAME fio_route_tree
+ *         #define FIO_RADIX_OBJ_TYPE route_s *
+ *         #define FIO_RADIX_WILDCARD ':'
+ *         #include <fio.h>
+ *
+ *         fio_route_tree_s routes = FIO_RADIX_INIT;
+ *         fio_route_tree_insert(&routes, "/users/:", 8, user_route, NULL);
+ *         route_s *r = fio_route_tree_match(&routes, "/users/42", 9);
+ *         fio_route_tree_free(&routes);
+ *
+ * Each node is a single allocation, holding the edge label, the child pointers
+ * and a compact (sorted) array with the first byte of each child's label, so a
+ * lookup step usually touches a single cache line per node.
+ *
+ * The object's behavior is controlled by the FIO_RADIX_OBJ_* macros, same as
+ * a Set's FIO_SET_OBJ_* macros. Missing objects are reported using
+ * FIO_RADIX_OBJ_INVALID (all bytes are 0 by default).
+ *
+ * Note: Before freeing the Radix Tree, FIO_RADIX_OBJ_DESTROY will be
+ *       automatically called for every existing object.
+ *
+ * Note: Keys are limited to 4GiB.
+ *
+ * Defining FIO_RADIX_CONCURRENT creates a read-mostly Radix Tree, where the
+ * lookup functions (`find`, `find_prefix`, `each_prefix`, `match` and `each`)
+ * are lock-free and can run concurrently with a (single) writer:
+ *
+ * * Writers (`insert` and `remove`) MUST be serialized by the caller, i.e.,
+ *   using a lock.
+ *
+ * * Lookups MUST be performed within a `fio_rcu_read_lock` read section and
+ *   any object they return is only valid within that read section (unless the
+ *   object is reference counted and a reference was added).
+ *
+ * * Published nodes are never altered in place (except for child pointers and
+ *   the removal of an object). Writers replace nodes with updated copies.
+ *
+ * * Replaced nodes and removed or overwritten objects are destroyed using
+ *   `fio_rcu_defer` (after concurrent readers are done).
+ *
+ * * The `free` function assumes no concurrent readers exist.
+ *
+ * This requires the facil.io core library (fio.c).
+ */
+
+/* Used for naming functions and types, prefixing FIO_RADIX_NAME to the name */
+#define FIO_NAME_FROM_MACRO_STEP2(name, postfix) name##_##postfix
+#define FIO_NAME_FROM_MACRO_STEP1(name, postfix)                               \
+  FIO_NAME_FROM_MACRO_STEP2(name, postfix)
+#define FIO_NAME(postfix) FIO_NAME_FROM_MACRO_STEP1(FIO_RADIX_NAME, postfix)
+
+/* Used for naming the `free` function */
+#define FIO_NAME_FROM_MACRO_STEP4(name) name##_free
+#define FIO_NAME_FROM_MACRO_STEP3(name) FIO_NAME_FROM_MACRO_STEP4(name)
+#define FIO_NAME_FREE() FIO_NAME_FROM_MACRO_STEP3(FIO_RADIX_NAME)
+
+/* The default Radix Tree object type is `void *` */
+#if !defined(FIO_RADIX_OBJ_TYPE)
+#define FIO_RADIX_OBJ_TYPE void *
+#endif
+
+/* An invalid object has all bytes set to 0 - a static constant will do. */
+#if !defined(FIO_RADIX_OBJ_INVALID)
+static FIO_RADIX_OBJ_TYPE const FIO_NAME(s___const_invalid_object);
+#define FIO_RADIX_OBJ_INVALID FIO_NAME(s___const_invalid_object)
+#endif
+
+/** object copy required? */
+#ifndef FIO_RADIX_OBJ_COPY
+#define FIO_RADIX_OBJ_COPY(dest, obj) ((dest) = (obj))
+#endif
+
+/** object destruction required? */
+#ifndef FIO_RADIX_OBJ_DESTROY
+#define FIO_RADIX_OBJ_DESTROY(obj) ((void)0)
+#endif
+
+/* The wildcard segment character, used by `match` */
+#ifndef FIO_RADIX_WILDCARD
+#define FIO_RADIX_WILDCARD '*'
+#endif
+
+/* The segment separator character, used by `match` */
+#ifndef FIO_RADIX_SEPARATOR
+#define FIO_RADIX_SEPARATOR '/'
+#endif
+
+/* Customizable memory management */
+#ifndef FIO_RADIX_MALLOC
+#define FIO_RADIX_MALLOC(size) FIO_MALLOC((size))
+#endif
+
+#ifndef FIO_RADIX_FREE
+#define FIO_RADIX_FREE(ptr, size) FIO_FREE((ptr))
+#endif
+
+/* *****************************************************************************
+Radix Tree API
+***************************************************************************** */
+
+/** The Radix Tree container type. */
+typedef struct FIO_NAME(s) FIO_NAME(s);
+
+#ifndef FIO_RADIX_INIT
+/** Initializes the Radix Tree */
+#define FIO_RADIX_INIT                                                         \
+  { .root = NULL }
+#endif
+
+/** Frees all the objects in the tree and deallocates any internal resources. */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * tree);
+
+/** Returns the number of objects currently in the Radix Tree. */
+FIO_FUNC inline size_t FIO_NAME(count)(const FIO_NAME(s) * tree);
+
+/**
+ * Locates the object stored using the exact `key`.
+ *
+ * Returns FIO_RADIX_OBJ_INVALID if the key wasn't found.
+ */
+FIO_FUNC inline FIO_RADIX_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * tree,
+                                                  const char *key, size_t len);
+
+/**
+ * Locates the object stored using the longest key that is a prefix of `key`
+ * (including `key` itself).
+ *
+ * If `match_len` isn't NULL, the length of the matching key is written to the
+ * location pointed to by `match_len` (0 if nothing was found).
+ *
+ * Returns FIO_RADIX_OBJ_INVALID if no prefix was found.
+ */
+FIO_FUNC inline FIO_RADIX_OBJ_TYPE FIO_NAME(find_prefix)(FIO_NAME(s) * tree,
+                                                         const char *key,
+                                                         size_t len,
+                                                         size_t *match_len);
+
+/**
+ * Locates the object stored using a key that matches `key`, where stored
+ * wildcard segments (see FIO_RADIX_WILDCARD) match any single segment.
+ *
+ * Literal segments are tested before wildcard segments.
+ *
+ * Returns FIO_RADIX_OBJ_INVALID if no match was found.
+ */
+FIO_FUNC FIO_RADIX_OBJ_TYPE FIO_NAME(match)(FIO_NAME(s) * tree, const char *key,
+                                            size_t len);
+
+/**
+ * Inserts an object to the Radix Tree.
+ *
+ * If an object already exists for the same key, it will be destroyed.
+ *
+ * If `old` is set, the existing object (if any) will be copied to the location
+ * pointed to by `old` before it is destroyed.
+ *
+ * Returns 0 on success and -1 on error (memory allocation failure or key too
+ * long).
+ */
+FIO_FUNC int FIO_NAME(insert)(FIO_NAME(s) * tree, const char *key, size_t len,
+                              FIO_RADIX_OBJ_TYPE obj, FIO_RADIX_OBJ_TYPE *old);
+
+/**
+ * Removes an object from the Radix Tree.
+ *
+ * If `old` is set, the existing object will be copied to the location pointed
+ * to by `old` before it is destroyed.
+ *
+ * Returns 0 on success and -1 if the key wasn't found.
+ */
+FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * tree, const char *key, size_t len,
+                              FIO_RADIX_OBJ_TYPE *old);
+
+/**
+ * Iteration using a callback for each stored key that is a prefix of `key`
+ * (including `key` itself), from the shortest to the longest.
+ *
+ * The callback task function must accept the length of the stored key (the
+ * prefix of `key` it represents), the object and an opaque user pointer.
+ *
+ * If the callback returns -1, the loop is broken. Any other value is ignored.
+ *
+ * The Radix Tree MUST NOT be altered during the iteration.
+ *
+ * Returns the number of objects processed.
+ */
+FIO_FUNC size_t FIO_NAME(each_prefix)(FIO_NAME(s) * tree, const char *key,
+                                      size_t len,
+                                      int (*task)(size_t len,
+                                                  FIO_RADIX_OBJ_TYPE obj,
+                                                  void *arg),
+                                      void *arg);
+
+/**
+ * Iteration using a callback for each key starting with `prefix` (or all keys,
+ * if `prefix_len` is 0), in lexicographic order.
+ *
+ * The callback task function must accept the key (NUL terminated, valid only
+ * during the callback), its length, the object and an opaque user pointer.
+ *
+ * If the callback returns -1, the loop is broken. Any other value is ignored.
+ *
+ * The Radix Tree MUST NOT be altered during the iteration.
+ *
+ * Returns the number of objects processed.
+ */
+FIO_FUNC size_t FIO_NAME(each)(FIO_NAME(s) * tree, const char *prefix,
+                               size_t prefix_len,
+                               int (*task)(const char *key, size_t len,
+                                           FIO_RADIX_OBJ_TYPE obj, void *arg),
+                               void *arg);
+
+/* *****************************************************************************
+Radix Tree Internal Data Structures
+***************************************************************************** */
+
+typedef struct FIO_NAME(_node_s) FIO_NAME(_node_s);
+
+/*
+ * Each node is a single allocation, holding the edge label, followed by the
+ * child pointers and the (sorted) first bytes of the children's labels.
+ */
+struct FIO_NAME(_node_s) {
+  FIO_RADIX_OBJ_TYPE obj;
+  uint32_t len;    /* edge label length */
+  uint16_t count;  /* child count */
+  uint16_t capa;   /* child capacity */
+  uint8_t has_obj; /* is there an object stored in the node? */
+  uint8_t label[];
+};
+
+struct FIO_NAME(s) {
+  FIO_NAME(_node_s) * root;
+  size_t count;
+};
+
+/* the child pointers, aligned and placed after the label */
+#define FIO_RADIX_CHILDREN(n)                                                  \
+  ((FIO_NAME(_node_s) **)(((uintptr_t)((n)->label + (n)->len) +              \
+                            (sizeof(void *) - 1)) &                            \
+                           (~(uintptr_t)(sizeof(void *) - 1))))
+/* the sorted first bytes of the child labels */
+#define FIO_RADIX_CHILD_KEYS(n) ((uint8_t *)(FIO_RADIX_CHILDREN(n) + (n)->capa))
+/* the (maximal) allocation size for a node */
+#define FIO_RADIX_NODE_SIZE(len, capa)                                         \
+  (sizeof(FIO_NAME(_node_s)) + (len) + (sizeof(void *) - 1) +                  \
+   ((capa) * (sizeof(void *) + 1)))
+
+/* *****************************************************************************
+Radix Tree Internal Helpers
+***************************************************************************** */
+
+/** Allocates a new node with the requested label (copied unless NULL). */
+FIO_FUNC inline FIO_NAME(_node_s) *
+    FIO_NAME(_node_new_)(const uint8_t *label, size_t len, size_t capa) {
+  FIO_NAME(_node_s) *n =
+      (FIO_NAME(_node_s) *)FIO_RADIX_MALLOC(FIO_RADIX_NODE_SIZE(len, capa));
+  if (!n)
+    return NULL;
+  n->obj = FIO_RADIX_OBJ_INVALID;
+  n->len = (uint32_t)len;
+  n->count = 0;
+  n->capa = (uint16_t)capa;
+  n->has_obj = 0;
+  if (label)
+    memcpy(n->label, label, len);
+  return n;
+}
+
+#ifdef FIO_RADIX_CONCURRENT
+/** Frees a retired node (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_free_)(void *n) { FIO_RADIX_FREE(n, 0); }
+
+/** Destroys a retired object (called once concurrent readers are done). */
+FIO_FUNC void FIO_NAME(_rcu_destroy_)(void *ptr) {
+  FIO_RADIX_OBJ_TYPE *obj = (FIO_RADIX_OBJ_TYPE *)ptr;
+  FIO_RADIX_OBJ_DESTROY((*obj));
+  FIO_RADIX_FREE(obj, sizeof(*obj));
+}
+
+/** Destroys an object that concurrent readers might be accessing. */
+FIO_FUNC void FIO_NAME(_destroy_obj_)(FIO_RADIX_OBJ_TYPE obj) {
+  FIO_RADIX_OBJ_TYPE *tmp =
+      (FIO_RADIX_OBJ_TYPE *)FIO_RADIX_MALLOC(sizeof(*tmp));
+  if (!tmp) {
+    perror("FATAL ERROR: couldn't allocate memory for Radix Tree data");
+    exit(errno);
+  }
+  memcpy(tmp, &obj, sizeof(obj));
+  fio_rcu_defer(FIO_NAME(_rcu_destroy_), tmp);
+}
+
+/** Frees a node that concurrent readers might be accessing. */
+FIO_FUNC inline void FIO_NAME(_retire_)(FIO_NAME(_node_s) * n) {
+  fio_rcu_defer(FIO_NAME(_rcu_free_), n);
+}
+
+/** Replaces the node pointed to by `pn`, once the new node is complete. */
+FIO_FUNC inline void FIO_NAME(_publish_)(FIO_NAME(_node_s) * *pn,
+                                         FIO_NAME(_node_s) * n) {
+  fio_atomic_release();
+  *pn = n;
+}
+#else
+/** Destroys a removed or overwritten object. */
+FIO_FUNC inline void FIO_NAME(_destroy_obj_)(FIO_RADIX_OBJ_TYPE obj) {
+  FIO_RADIX_OBJ_DESTROY(obj);
+  (void)obj;
+}
+
+/** Frees a node that was removed from the tree. */
+FIO_FUNC inline void FIO_NAME(_retire_)(FIO_NAME(_node_s) * n) {
+  FIO_RADIX_FREE(n, FIO_RADIX_NODE_SIZE(n->len, n->capa));
+}
+
+/** Replaces the node pointed to by `pn`. */
+FIO_FUNC inline void FIO_NAME(_publish_)(FIO_NAME(_node_s) * *pn,
+                                         FIO_NAME(_node_s) * n) {
+  *pn = n;
+}
+#endif
+
+/** Copies a node (label, object and children) using a new capacity. */
+FIO_FUNC FIO_NAME(_node_s) *
+    FIO_NAME(_node_copy_)(FIO_NAME(_node_s) * n, size_t capa) {
+  FIO_NAME(_node_s) *tmp = FIO_NAME(_node_new_)(n->label, n->len, capa);
+  if (!tmp)
+    return NULL;
+  tmp->obj = n->obj;
+  tmp->has_obj = n->has_obj;
+  tmp->count = n->count;
+  memcpy(FIO_RADIX_CHILDREN(tmp), FIO_RADIX_CHILDREN(n),
+         n->count * sizeof(void *));
+  memcpy(FIO_RADIX_CHILD_KEYS(tmp), FIO_RADIX_CHILD_KEYS(n), n->count);
+  return tmp;
+}
+
+/** Frees a node and all of its children. */
+FIO_FUNC void FIO_NAME(_node_free_)(FIO_NAME(_node_s) * n) {
+  for (size_t i = 0; i < n->count; ++i) {
+    FIO_NAME(_node_free_)(FIO_RADIX_CHILDREN(n)[i]);
+  }
+  if (n->has_obj) {
+    FIO_RADIX_OBJ_DESTROY(n->obj);
+  }
+  FIO_RADIX_FREE(n, FIO_RADIX_NODE_SIZE(n->len, n->capa));
+}
+
+/** Returns a pointer to the child slot starting with `c` (or NULL). */
+FIO_FUNC inline FIO_NAME(_node_s) **
+    FIO_NAME(_child_)(FIO_NAME(_node_s) * n, uint8_t c) {
+  uint8_t *keys = FIO_RADIX_CHILD_KEYS(n);
+  if (n->count <= 8) {
+    /* a short loop beats a function call for the common (small) case */
+    for (size_t i = 0; i < n->count; ++i) {
+      if (keys[i] == c)
+        return FIO_RADIX_CHILDREN(n) + i;
+    }
+    return NULL;
+  }
+  uint8_t *pos = (uint8_t *)memchr(keys, c, n->count);
+  if (!pos)
+    return NULL;
+  return FIO_RADIX_CHILDREN(n) + (pos - keys);
+}
+
+/**
+ * Adds a child to the node pointed to by `pn`, keeping the children sorted.
+ *
+ * The node might be reallocated (updating `*pn`). Concurrent trees always
+ * update a copy of the node.
+ */
+FIO_FUNC int FIO_NAME(_child_add_)(FIO_NAME(_node_s) * *pn,
+                                   FIO_NAME(_node_s) * child) {
+  FIO_NAME(_node_s) *n = *pn;
+  const uint8_t c = child->label[0];
+#ifdef FIO_RADIX_CONCURRENT
+  const int copy = 1; /* readers might be walking the node */
+#else
+  const int copy = (n->count == n->capa);
+#endif
+  if (copy) {
+    const size_t capa = n->count < n->capa
+                            ? (size_t)n->capa
+                            : (n->capa ? (size_t)n->capa << 1 : 2);
+    n = FIO_NAME(_node_copy_)(n, capa);
+    if (!n)
+      return -1;
+  }
+  FIO_NAME(_node_s) **children = FIO_RADIX_CHILDREN(n);
+  uint8_t *keys = FIO_RADIX_CHILD_KEYS(n);
+  size_t pos = 0;
+  while (pos < n->count && keys[pos] < c)
+    ++pos;
+  memmove(children + pos + 1, children + pos,
+          (n->count - pos) * sizeof(*children));
+  memmove(keys + pos + 1, keys + pos, n->count - pos);
+  children[pos] = child;
+  keys[pos] = c;
+  ++n->count;
+  if (n != *pn) {
+    FIO_NAME(_node_s) *old = *pn;
+    FIO_NAME(_publish_)(pn, n);
+    FIO_NAME(_retire_)(old);
+  }
+  return 0;
+}
+
+/**
+ * Removes (and frees) the child at position `pos` from the node pointed to by
+ * `pn` (capacity is kept).
+ *
+ * Concurrent trees update a copy of the node. On allocation failure, the child
+ * is kept (it holds no object, so the tree is still valid).
+ */
+FIO_FUNC void FIO_NAME(_child_remove_)(FIO_NAME(_node_s) * *pn, size_t pos) {
+  FIO_NAME(_node_s) *n = *pn;
+  FIO_NAME(_node_s) *child = FIO_RADIX_CHILDREN(n)[pos];
+#ifdef FIO_RADIX_CONCURRENT
+  n = FIO_NAME(_node_copy_)(n, n->capa);
+  if (!n)
+    return;
+#endif
+  FIO_NAME(_node_s) **children = FIO_RADIX_CHILDREN(n);
+  uint8_t *keys = FIO_RADIX_CHILD_KEYS(n);
+  --n->count;
+  memmove(children + pos, children + pos + 1,
+          (n->count - pos) * sizeof(*children));
+  memmove(keys + pos, keys + pos + 1, n->count - pos);
+  if (n != *pn) {
+    FIO_NAME(_node_s) *old = *pn;
+    FIO_NAME(_publish_)(pn, n);
+    FIO_NAME(_retire_)(old);
+  }
+  FIO_NAME(_retire_)(child);
+}
+
+/**
+ * Splits the edge leading to `*pn` after `at` bytes, inserting a new (object
+ * less) node holding the shared part of the label.
+ */
+FIO_FUNC int FIO_NAME(_split_)(FIO_NAME(_node_s) * *pn, size_t at) {
+  FIO_NAME(_node_s) *c = *pn;
+  FIO_NAME(_node_s) *p = FIO_NAME(_node_new_)(c->label, at, 2);
+  if (!p)
+    return -1;
+#ifdef FIO_RADIX_CONCURRENT
+  /* readers might be walking the node, so the shorter label is a copy */
+  FIO_NAME(_node_s) *tmp =
+      FIO_NAME(_node_new_)(c->label + at, c->len - at, c->capa);
+  if (!tmp) {
+    FIO_RADIX_FREE(p, FIO_RADIX_NODE_SIZE(at, 2));
+    return -1;
+  }
+  tmp->obj = c->obj;
+  tmp->has_obj = c->has_obj;
+  tmp->count = c->count;
+  memcpy(FIO_RADIX_CHILDREN(tmp), FIO_RADIX_CHILDREN(c),
+         c->count * sizeof(void *));
+  memcpy(FIO_RADIX_CHILD_KEYS(tmp), FIO_RADIX_CHILD_KEYS(c), c->count);
+  FIO_RADIX_CHILDREN(p)[0] = tmp;
+  FIO_RADIX_CHILD_KEYS(p)[0] = tmp->label[0];
+  p->count = 1;
+  FIO_NAME(_publish_)(pn, p);
+  FIO_NAME(_retire_)(c);
+#else
+  /* move the label and then the children (the children move backwards) */
+  FIO_NAME(_node_s) **old_children = FIO_RADIX_CHILDREN(c);
+  memmove(c->label, c->label + at, c->len - at);
+  c->len -= (uint32_t)at;
+  memmove(FIO_RADIX_CHILDREN(c), old_children,
+          c->capa * (sizeof(void *) + 1));
+  FIO_RADIX_CHILDREN(p)[0] = c;
+  FIO_RADIX_CHILD_KEYS(p)[0] = c->label[0];
+  p->count = 1;
+  *pn = p;
+#endif
+  return 0;
+}
+
+/**
+ * Merges a node (with no object) into its only child, so a lookup walks a
+ * single label. On allocation failure the tree is left as is (still valid).
+ */
+FIO_FUNC void FIO_NAME(_merge_)(FIO_NAME(_node_s) * *pn) {
+  FIO_NAME(_node_s) *n = *pn;
+  FIO_NAME(_node_s) *child = FIO_RADIX_CHILDREN(n)[0];
+  FIO_NAME(_node_s) *m =
+      FIO_NAME(_node_new_)(NULL, n->len + child->len, child->count);
+  if (!m)
+    return;
+  memcpy(m->label, n->label, n->len);
+  memcpy(m->label + n->len, child->label, child->len);
+  m->count = child->count;
+  m->has_obj = child->has_obj;
+  m->obj = child->obj;
+  memcpy(FIO_RADIX_CHILDREN(m), FIO_RADIX_CHILDREN(child),
+         child->count * sizeof(void *));
+  memcpy(FIO_RADIX_CHILD_KEYS(m), FIO_RADIX_CHILD_KEYS(child), child->count);
+  FIO_NAME(_publish_)(pn, m);
+  FIO_NAME(_retire_)(n);
+  FIO_NAME(_retire_)(child);
+}
+
+/**
+ * Recursive removal, merging nodes on the way back up.
+ *
+ * Returns -1 if the key wasn't found, 0 on success and 1 if the (now empty)
+ * node should be removed from its parent.
+ */
+FIO_FUNC int FIO_NAME(_remove_)(FIO_NAME(s) * tree, FIO_NAME(_node_s) * *pn,
+                                const uint8_t *key, size_t len,
+                                FIO_RADIX_OBJ_TYPE *old) {
+  FIO_NAME(_node_s) *n = *pn;
+  if (n->len > len || (n->len && memcmp(n->label, key, n->len)))
+    return -1;
+  key += n->len;
+  len -= n->len;
+  if (!len) {
+    if (!n->has_obj)
+      return -1;
+    if (old)
+      FIO_RADIX_OBJ_COPY((*old), n->obj);
+    n->has_obj = 0;
+    FIO_NAME(_destroy_obj_)(n->obj);
+#ifndef FIO_RADIX_CONCURRENT
+    /* (concurrent readers might still be reading the object) */
+    n->obj = FIO_RADIX_OBJ_INVALID;
+#endif
+    --tree->count;
+  } else {
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[0]);
+    int ret;
+    if (!pc || (ret = FIO_NAME(_remove_)(tree, pc, key, len, old)) == -1)
+      return -1;
+    if (ret == 1)
+      FIO_NAME(_child_remove_)(pn, pc - FIO_RADIX_CHILDREN(n));
+    n = *pn;
+  }
+  if (pn == &tree->root || n->has_obj || n->count > 1)
+    return 0;
+  if (n->count == 1) {
+    FIO_NAME(_merge_)(pn);
+    return 0;
+  }
+  return 1;
+}
+
+/** Recursive wildcard matching. */
+FIO_FUNC FIO_NAME(_node_s) *
+    FIO_NAME(_match_)(FIO_NAME(_node_s) * n, const uint8_t *key, size_t len,
+                      uint8_t segment_start) {
+  for (size_t i = 0; i < n->len; ++i) {
+    const uint8_t c = n->label[i];
+    if (c == (uint8_t)FIO_RADIX_WILDCARD && segment_start) {
+      /* consume a whole (non-empty) segment */
+      size_t seg = 0;
+      while (seg < len && key[seg] != (uint8_t)FIO_RADIX_SEPARATOR)
+        ++seg;
+      if (!seg)
+        return NULL;
+      key += seg;
+      len -= seg;
+      segment_start = 0;
+      continue;
+    }
+    if (!len || key[0] != c)
+      return NULL;
+    segment_start = (c == (uint8_t)FIO_RADIX_SEPARATOR);
+    ++key;
+    --len;
+  }
+  if (!len)
+    return n->has_obj ? n : NULL;
+  FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[0]);
+  FIO_NAME(_node_s) *found;
+  if (pc && (found = FIO_NAME(_match_)(*pc, key, len, segment_start)))
+    return found;
+  if (!segment_start || key[0] == (uint8_t)FIO_RADIX_WILDCARD)
+    return NULL;
+  pc = FIO_NAME(_child_)(n, (uint8_t)FIO_RADIX_WILDCARD);
+  if (pc && (found = FIO_NAME(_match_)(*pc, key, len, segment_start)))
+    return found;
+  return NULL;
+}
+
+/* iteration state */
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t capa;
+  size_t count;
+  int (*task)(const char *key, size_t len, FIO_RADIX_OBJ_TYPE obj, void *arg);
+  void *arg;
+  uint8_t stop;
+  uint8_t allocated;
+} FIO_NAME(_each_s);
+
+/** Makes sure the iteration key buffer can hold `len` bytes + NUL. */
+FIO_FUNC int FIO_NAME(_each_require_)(FIO_NAME(_each_s) * e, size_t len) {
+  if (len < e->capa)
+    return 0;
+  size_t capa = e->capa << 1;
+  while (capa <= len)
+    capa <<= 1;
+  uint8_t *tmp = (uint8_t *)FIO_RADIX_MALLOC(capa);
+  if (!tmp)
+    return -1;
+  memcpy(tmp, e->buf, e->len);
+  if (e->allocated)
+    FIO_RADIX_FREE(e->buf, e->capa);
+  e->buf = tmp;
+  e->capa = capa;
+  e->allocated = 1;
+  return 0;
+}
+
+/** Recursive (depth first, ordered) iteration. */
+FIO_FUNC void FIO_NAME(_each_)(FIO_NAME(_each_s) * e, FIO_NAME(_node_s) * n) {
+  if (FIO_NAME(_each_require_)(e, e->len + n->len)) {
+    e->stop = 1;
+    return;
+  }
+  memcpy(e->buf + e->len, n->label, n->len);
+  e->len += n->len;
+  if (n->has_obj) {
+    ++e->count;
+    e->buf[e->len] = 0;
+    if (e->task((const char *)e->buf, e->len, n->obj, e->arg) == -1)
+      e->stop = 1;
+  }
+  for (size_t i = 0; i < n->count && !e->stop; ++i) {
+    FIO_NAME(_each_)(e, FIO_RADIX_CHILDREN(n)[i]);
+  }
+  e->len -= n->len;
+}
+
+/* *****************************************************************************
+Radix Tree Implementation
+***************************************************************************** */
+
+/** Frees all the objects in the tree and deallocates any internal resources. */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * tree) {
+  if (tree->root)
+    FIO_NAME(_node_free_)(tree->root);
+  *tree = (FIO_NAME(s))FIO_RADIX_INIT;
+}
+
+/** Returns the number of objects currently in the Radix Tree. */
+FIO_FUNC inline size_t FIO_NAME(count)(const FIO_NAME(s) * tree) {
+  return tree->count;
+}
+
+/** Locates the object stored using the exact `key`. */
+FIO_FUNC inline FIO_RADIX_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * tree,
+                                                  const char *key_,
+                                                  size_t len) {
+  const uint8_t *key = (const uint8_t *)key_;
+  FIO_NAME(_node_s) *n = tree->root;
+  if (!n)
+    return FIO_RADIX_OBJ_INVALID;
+  while (len) {
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[0]);
+    if (!pc)
+      return FIO_RADIX_OBJ_INVALID;
+    n = *pc;
+    if (n->len > len || memcmp(n->label, key, n->len))
+      return FIO_RADIX_OBJ_INVALID;
+    key += n->len;
+    len -= n->len;
+  }
+  return n->has_obj ? n->obj : FIO_RADIX_OBJ_INVALID;
+}
+
+/** Locates the object stored using the longest key that prefixes `key`. */
+FIO_FUNC inline FIO_RADIX_OBJ_TYPE FIO_NAME(find_prefix)(FIO_NAME(s) * tree,
+                                                         const char *key_,
+                                                         size_t len,
+                                                         size_t *match_len) {
+  const uint8_t *key = (const uint8_t *)key_;
+  FIO_NAME(_node_s) *n = tree->root;
+  FIO_NAME(_node_s) *found = NULL;
+  size_t pos = 0, found_len = 0;
+  while (n) {
+    if (n->has_obj) {
+      found = n;
+      found_len = pos;
+    }
+    if (pos == len)
+      break;
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[pos]);
+    if (!pc)
+      break;
+    n = *pc;
+    if (n->len > len - pos || memcmp(n->label, key + pos, n->len))
+      break;
+    pos += n->len;
+  }
+  if (match_len)
+    *match_len = found_len;
+  return found ? found->obj : FIO_RADIX_OBJ_INVALID;
+}
+
+/** Iteration using a callback for each key that is a prefix of `key`. */
+FIO_FUNC size_t FIO_NAME(each_prefix)(FIO_NAME(s) * tree, const char *key_,
+                                      size_t len,
+                                      int (*task)(size_t len,
+                                                  FIO_RADIX_OBJ_TYPE obj,
+                                                  void *arg),
+                                      void *arg) {
+  const uint8_t *key = (const uint8_t *)key_;
+  FIO_NAME(_node_s) *n = tree->root;
+  size_t pos = 0, count = 0;
+  if (!task)
+    return 0;
+  while (n) {
+    if (n->has_obj) {
+      ++count;
+      if (task(pos, n->obj, arg) == -1)
+        break;
+    }
+    if (pos == len)
+      break;
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[pos]);
+    if (!pc)
+      break;
+    n = *pc;
+    if (n->len > len - pos || memcmp(n->label, key + pos, n->len))
+      break;
+    pos += n->len;
+  }
+  return count;
+}
+
+/** Locates the object stored using a key that matches `key` (wildcards). */
+FIO_FUNC FIO_RADIX_OBJ_TYPE FIO_NAME(match)(FIO_NAME(s) * tree, const char *key,
+                                            size_t len) {
+  FIO_NAME(_node_s) *n;
+  if (!tree->root ||
+      !(n = FIO_NAME(_match_)(tree->root, (const uint8_t *)key, len, 1)))
+    return FIO_RADIX_OBJ_INVALID;
+  return n->obj;
+}
+
+/** Inserts an object to the Radix Tree. */
+FIO_FUNC int FIO_NAME(insert)(FIO_NAME(s) * tree, const char *key_, size_t len,
+                              FIO_RADIX_OBJ_TYPE obj, FIO_RADIX_OBJ_TYPE *old) {
+  const uint8_t *key = (const uint8_t *)key_;
+  if (len > (uint32_t)-1)
+    return -1;
+  if (!tree->root) {
+    FIO_NAME(_node_s) *root = FIO_NAME(_node_new_)(NULL, 0, 0);
+    if (!root)
+      return -1;
+    FIO_NAME(_publish_)(&tree->root, root);
+  }
+  FIO_NAME(_node_s) **pn = &tree->root;
+  for (;;) {
+    FIO_NAME(_node_s) *n = *pn;
+    if (!len) {
+#ifdef FIO_RADIX_CONCURRENT
+      /* readers might be reading the object, so a copy is updated */
+      FIO_NAME(_node_s) *tmp = FIO_NAME(_node_copy_)(n, n->capa);
+      if (!tmp)
+        return -1;
+#else
+      FIO_NAME(_node_s) *tmp = n;
+#endif
+      const int had_obj = n->has_obj;
+      FIO_RADIX_OBJ_TYPE retired = n->obj;
+      if (had_obj) {
+        if (old)
+          FIO_RADIX_OBJ_COPY((*old), n->obj);
+      } else {
+        ++tree->count;
+      }
+      FIO_RADIX_OBJ_COPY(tmp->obj, obj);
+      tmp->has_obj = 1;
+      if (tmp != n) {
+        FIO_NAME(_publish_)(pn, tmp);
+        FIO_NAME(_retire_)(n);
+      }
+      /* destroyed once unreachable (`fio_rcu_defer` might release it) */
+      if (had_obj)
+        FIO_NAME(_destroy_obj_)(retired);
+      return 0;
+    }
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, key[0]);
+    if (!pc) {
+      FIO_NAME(_node_s) *leaf = FIO_NAME(_node_new_)(key, len, 0);
+      if (!leaf)
+        return -1;
+      FIO_RADIX_OBJ_COPY(leaf->obj, obj);
+      leaf->has_obj = 1;
+      if (FIO_NAME(_child_add_)(pn, leaf)) {
+        FIO_RADIX_OBJ_DESTROY(leaf->obj);
+        FIO_RADIX_FREE(leaf, FIO_RADIX_NODE_SIZE(leaf->len, 0));
+        return -1;
+      }
+      ++tree->count;
+      return 0;
+    }
+    FIO_NAME(_node_s) *c = *pc;
+    const size_t limit = c->len < len ? c->len : len;
+    size_t i = 1;
+    while (i < limit && c->label[i] == key[i])
+      ++i;
+    if (i < c->len && FIO_NAME(_split_)(pc, i))
+      return -1;
+    pn = pc;
+    key += i;
+    len -= i;
+  }
+}
+
+/** Removes an object from the Radix Tree. */
+FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * tree, const char *key, size_t len,
+                              FIO_RADIX_OBJ_TYPE *old) {
+  if (!tree->root)
+    return -1;
+  return FIO_NAME(_remove_)(tree, &tree->root, (const uint8_t *)key, len, old);
+}
+
+/** Iteration using a callback for each key starting with `prefix`. */
+FIO_FUNC size_t FIO_NAME(each)(FIO_NAME(s) * tree, const char *prefix_,
+                               size_t prefix_len,
+                               int (*task)(const char *key, size_t len,
+                                           FIO_RADIX_OBJ_TYPE obj, void *arg),
+                               void *arg) {
+  const uint8_t *prefix = (const uint8_t *)prefix_;
+  FIO_NAME(_node_s) *n = tree->root;
+  size_t pos = 0;
+  uint8_t tmp[256];
+  if (!n || !task)
+    return 0;
+  /* find the first node covering the prefix (it might end mid-label) */
+  while (pos < prefix_len) {
+    FIO_NAME(_node_s) **pc = FIO_NAME(_child_)(n, prefix[pos]);
+    if (!pc)
+      return 0;
+    n = *pc;
+    const size_t cmp = n->len < prefix_len - pos ? n->len : prefix_len - pos;
+    if (memcmp(n->label, prefix + pos, cmp))
+      return 0;
+    pos += n->len;
+  }
+  FIO_NAME(_each_s) e = {
+      .buf = tmp,
+      .len = pos - n->len,
+      .capa = sizeof(tmp),
+      .task = task,
+      .arg = arg,
+  };
+  if (FIO_NAME(_each_require_)(&e, e.len))
+    return 0;
+  if (e.len)
+    memcpy(e.buf, prefix, e.len);
+  FIO_NAME(_each_)(&e, n);
+  if (e.allocated)
+    FIO_RADIX_FREE(e.buf, e.capa);
+  return e.count;
+}
+
+/* *****************************************************************************
+Done
+***************************************************************************** */
+
+#undef FIO_NAME_FROM_MACRO_STEP2
+#undef FIO_NAME_FROM_MACRO_STEP1
+#undef FIO_NAME
+#undef FIO_NAME_FROM_MACRO_STEP4
+#undef FIO_NAME_FROM_MACRO_STEP3
+#undef FIO_NAME_FREE
+#undef FIO_RADIX_NAME
+#undef FIO_RADIX_OBJ_TYPE
+#undef FIO_RADIX_OBJ_INVALID
+#undef FIO_RADIX_OBJ_COPY
+#undef FIO_RADIX_OBJ_DESTROY
+#undef FIO_RADIX_WILDCARD
+#undef FIO_RADIX_SEPARATOR
+#undef FIO_RADIX_MALLOC
+#undef FIO_RADIX_FREE
+#undef FIO_RADIX_CHILDREN
+#undef FIO_RADIX_CHILD_KEYS
+#undef FIO_RADIX_NODE_SIZE
+#undef FIO_RADIX_CONCURRENT
+
+#endif
+
+/* *****************************************************************************
+
+
+
+
+
+
+
+
+
+
+
+                      Bounded Cache (LRU / TinyLFU)
+
+
+
+
+
+
+
+
+
+
+
+***************************************************************************** */
+
+#if defined(FIO_CACHE_NAME) && !defined(FIO_CACHE_MAP_INCLUDE)
+
+/**
+ * A memory bounded cache, built on top of a FIO_SET Set, with O(1) `get` and
+ * `put` operations.
+ *
+ * Entries are evicted in Least Recently Used order whenever the cache exceeds
+ * its object count limit or its byte limit (the byte size of each entry is
+ * provided by the caller). Entries might also expire after a Time To Live
+ * (TTL), measured using `fio_last_tick` (the time is only updated by the
+ * reactor, so TTL accuracy depends on the reactor's cycle).
+ *
+ * To create a Cache type, define the macro FIO_CACHE_NAME. i.e.:
+ *
+ *         #define FIO_CACHE_NAME fio_fragment_cache
+ *         #define FIO_CACHE_KEY_TYPE fio_str_s *
+ *         #define FIO_CACHE_KEY_COMPARE(k1, k2) (fio_str_iseq((k1), (k2)))
+ *         #define FIO_CACHE_KEY_COPY(dest, key) ((dest) = fio_str_dup((key)))
+ *         #define FIO_CACHE_KEY_DESTROY(key) fio_str_free2((key))
+ *         #define FIO_CACHE_OBJ_TYPE FIOBJ
+ *         #define FIO_CACHE_OBJ_COPY(dest, obj) ((dest) = fiobj_dup((obj)))
+ *         #define FIO_CACHE_OBJ_DESTROY(obj) fiobj_free((obj))
+ *         #include <fio.h>
+ *
+ *         // up to 1024 objects and 1MiB
+ *         fio_fragment_cache_s cache = FIO_CACHE_INIT(1024, (1 << 20));
+ *         // stores the object for 30 seconds (30,000 ms)
+ *         fio_fragment_cache_put(&cache, hash, key, obj, obj_size, 30000);
+ *         FIOBJ o = fio_fragment_cache_get(&cache, hash, key);
+ *         fio_fragment_cache_free(&cache);
+ *
+ * A missing object is reported as FIO_CACHE_OBJ_INVALID (all bytes are 0 by
+ * default).
+ *
+ * Defining FIO_CACHE_TINYLFU adds TinyLFU admission: the access frequency of
+ * keys is estimated using a small (aging) Count-Min sketch and a new entry is
+ * only admitted if it's accessed more frequently than the entry it would evict.
+ * This protects the cache from one-time scans.
+ *
+ * The default time source (FIO_CACHE_TIME_MS) is `fio_last_tick`, in
+ * milliseconds.
+ *
+ * Note: Objects returned by `get` are valid only until the cache is altered.
+ *
+ * Note: The cache isn't thread safe. Concurrent access requires a lock.
+ */
+
+/* The default Cache key type is `uintptr_t` */
+#if !defined(FIO_CACHE_KEY_TYPE)
+#define FIO_CACHE_KEY_TYPE uintptr_t
+#endif
+
+#ifndef FIO_CACHE_KEY_COMPARE
+#define FIO_CACHE_KEY_COMPARE(k1, k2) ((k1) == (k2))
+#endif
+
+#ifndef FIO_CACHE_KEY_COPY
+#define FIO_CACHE_KEY_COPY(dest, key) ((dest) = (key))
+#endif
+
+#ifndef FIO_CACHE_KEY_DESTROY
+#define FIO_CACHE_KEY_DESTROY(key) ((void)0)
+#endif
+
+/* The default Cache object type is `void *` */
+#if !defined(FIO_CACHE_OBJ_TYPE)
+#define FIO_CACHE_OBJ_TYPE void *
+#endif
+
+#ifndef FIO_CACHE_OBJ_COPY
+#define FIO_CACHE_OBJ_COPY(dest, obj) ((dest) = (obj))
+#endif
+
+#ifndef FIO_CACHE_OBJ_DESTROY
+#define FIO_CACHE_OBJ_DESTROY(obj) ((void)0)
+#endif
+
+/* Customizable memory management */
+#ifndef FIO_CACHE_MALLOC
+#define FIO_CACHE_MALLOC(size) FIO_MALLOC((size))
+#endif
+
+#ifndef FIO_CACHE_FREE
+#define FIO_CACHE_FREE(ptr, size) FIO_FREE((ptr))
+#endif
+
+/* The time source, in milliseconds */
+#ifndef FIO_CACHE_TIME_MS
+#define FIO_CACHE_TIME_MS()                                                    \
+  ((uint64_t)fio_last_tick().tv_sec * 1000 +                                   \
+   (uint64_t)fio_last_tick().tv_nsec / 1000000)
+#endif
+
+/* The number of Count-Min sketch counters per row, when there's no count limit
+ */
+#ifndef FIO_CACHE_TINYLFU_DEFAULT_WIDTH
+#define FIO_CACHE_TINYLFU_DEFAULT_WIDTH 4096
+#endif
+
+/* Used for naming functions and types, prefixing FIO_CACHE_NAME to the name */
+#define FIO_NAME_FROM_MACRO_STEP2(name, postfix) name##_##postfix
+#define FIO_NAME_FROM_MACRO_STEP1(name, postfix)                               \
+  FIO_NAME_FROM_MACRO_STEP2(name, postfix)
+#define FIO_NAME(postfix) FIO_NAME_FROM_MACRO_STEP1(FIO_CACHE_NAME, postfix)
+
+/* An invalid object has all bytes set to 0 - a static constant will do. */
+#if !defined(FIO_CACHE_OBJ_INVALID)
+static FIO_CACHE_OBJ_TYPE const FIO_NAME(s___const_invalid_object);
+#define FIO_CACHE_OBJ_INVALID FIO_NAME(s___const_invalid_object)
+#endif
+
+/* *****************************************************************************
+Cache Internal Data Structures (and the underlying Set)
+***************************************************************************** */
+
+typedef struct FIO_NAME(_entry_s) FIO_NAME(_entry_s);
+
+struct FIO_NAME(_entry_s) {
+  FIO_NAME(_entry_s) * prev; /* more recently used */
+  FIO_NAME(_entry_s) * next; /* less recently used */
+  uint64_t hash;
+  uint64_t expires; /* 0 == never */
+  size_t size;
+  FIO_CACHE_KEY_TYPE key;
+  FIO_CACHE_OBJ_TYPE obj;
+};
+
+/* The Set maps the entries using their key (entry lifetime is managed here) */
+#define FIO_CACHE_MAP_NAME_STEP2(name) name##__map
+#define FIO_CACHE_MAP_NAME_STEP1(name) FIO_CACHE_MAP_NAME_STEP2(name)
+#define FIO_SET_NAME FIO_CACHE_MAP_NAME_STEP1(FIO_CACHE_NAME)
+#define FIO_CACHE_ENTRY_TYPE_STEP2(name) name##__entry_s *
+#define FIO_CACHE_ENTRY_TYPE_STEP1(name) FIO_CACHE_ENTRY_TYPE_STEP2(name)
+#define FIO_SET_OBJ_TYPE FIO_CACHE_ENTRY_TYPE_STEP1(FIO_CACHE_NAME)
+#define FIO_SET_OBJ_COMPARE(e1, e2)                                            \
+  ((e1) == (e2) ||                                                             \
+   ((e1) && (e2) && FIO_CACHE_KEY_COMPARE((e1)->key, (e2)->key)))
+
+#undef FIO_NAME
+#define FIO_CACHE_MAP_INCLUDE 1
+#include "fio.h"
+#undef FIO_CACHE_MAP_INCLUDE
+#undef FIO_CACHE_MAP_NAME_STEP2
+#undef FIO_CACHE_MAP_NAME_STEP1
+#undef FIO_CACHE_ENTRY_TYPE_STEP2
+#undef FIO_CACHE_ENTRY_TYPE_STEP1
+
+#define FIO_NAME_FROM_MACRO_STEP2(name, postfix) name##_##postfix
+#define FIO_NAME_FROM_MACRO_STEP1(name, postfix)                               \
+  FIO_NAME_FROM_MACRO_STEP2(name, postfix)
+#define FIO_NAME(postfix) FIO_NAME_FROM_MACRO_STEP1(FIO_CACHE_NAME, postfix)
+
+/* Used for naming the `free` function */
+#define FIO_NAME_FROM_MACRO_STEP4(name) name##_free
+#define FIO_NAME_FROM_MACRO_STEP3(name) FIO_NAME_FROM_MACRO_STEP4(name)
+#define FIO_NAME_FREE() FIO_NAME_FROM_MACRO_STEP3(FIO_CACHE_NAME)
+
+/** Cache statistics. */
+typedef struct {
+  /** successful `get` calls. */
+  size_t hits;
+  /** `get` calls that found nothing (including expired entries). */
+  size_t misses;
+  /** entries evicted to honor the count / byte limits. */
+  size_t evictions;
+  /** entries removed because their TTL passed. */
+  size_t expired;
+  /** `put` calls refused (TinyLFU admission or an oversized entry). */
+  size_t rejected;
+} FIO_NAME(stats_s);
+
+/** The Cache container type. */
+typedef struct FIO_NAME(s) FIO_NAME(s);
+
+struct FIO_NAME(s) {
+  FIO_NAME(_map_s) map;
+  FIO_NAME(_entry_s) * head; /* most recently used */
+  FIO_NAME(_entry_s) * tail; /* least recently used */
+  size_t max_count;          /* 0 == unlimited */
+  size_t max_bytes;          /* 0 == unlimited */
+  size_t bytes;
+  FIO_NAME(stats_s) stats;
+#ifdef FIO_CACHE_TINYLFU
+  uint8_t *sketch; /* 4 rows of (sketch_mask + 1) counters */
+  size_t sketch_mask;
+  size_t sketch_ops;
+#endif
+};
+
+/* *****************************************************************************
+Cache API
+***************************************************************************** */
+
+#ifndef FIO_CACHE_INIT
+/** Initializes a Cache limited to `max_count` objects and `max_bytes` bytes (0
+ * == unlimited). */
+#define FIO_CACHE_INIT(max_count_, max_bytes_)                                 \
+  { .max_count = (max_count_), .max_bytes = (max_bytes_) }
+#endif
+
+/** Frees all the objects in the Cache and deallocates any internal resources.
+ */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * cache);
+
+/**
+ * Returns the object cached using `key` (marking it as recently used), or
+ * FIO_CACHE_OBJ_INVALID if the object is missing or expired.
+ */
+FIO_FUNC inline FIO_CACHE_OBJ_TYPE FIO_NAME(get)(FIO_NAME(s) * cache,
+                                                 uint64_t hash,
+                                                 FIO_CACHE_KEY_TYPE key);
+
+/**
+ * Caches a copy of `obj` using `key`, replacing any existing object.
+ *
+ * `size` is the object's byte size (as far as the byte limit is concerned) and
+ * `ttl_ms` is the object's Time To Live, in milliseconds (0 == no expiration).
+ *
+ * Least recently used objects are evicted until the new object fits.
+ *
+ * Returns 0 on success and -1 if the object wasn't cached (the object is
+ * larger than the byte limit, TinyLFU admission refused it or memory
+ * allocation failed).
+ */
+FIO_FUNC int FIO_NAME(put)(FIO_NAME(s) * cache, uint64_t hash,
+                           FIO_CACHE_KEY_TYPE key, FIO_CACHE_OBJ_TYPE obj,
+                           size_t size, size_t ttl_ms);
+
+/**
+ * Removes an object from the Cache.
+ *
+ * If `old` is set, the existing object will be copied to the location pointed
+ * to by `old` before it is destroyed.
+ *
+ * Returns 0 on success and -1 if the object wasn't found.
+ */
+FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * cache, uint64_t hash,
+                              FIO_CACHE_KEY_TYPE key, FIO_CACHE_OBJ_TYPE *old);
+
+/** Removes all the expired objects, returning the number of objects removed. */
+FIO_FUNC size_t FIO_NAME(expire)(FIO_NAME(s) * cache);
+
+/** Returns the number of objects currently in the Cache. */
+FIO_FUNC inline size_t FIO_NAME(count)(FIO_NAME(s) * cache);
+
+/** Returns the number of bytes currently accounted for by the Cache. */
+FIO_FUNC inline size_t FIO_NAME(bytes)(FIO_NAME(s) * cache);
+
+/** Returns the Cache statistics. */
+FIO_FUNC inline FIO_NAME(stats_s) FIO_NAME(stats)(FIO_NAME(s) * cache);
+
+/* *****************************************************************************
+Cache Internal Helpers
+***************************************************************************** */
+
+/** Unlinks an entry from the LRU list. */
+FIO_FUNC inline void FIO_NAME(_unlink_)(FIO_NAME(s) * cache,
+                                        FIO_NAME(_entry_s) * e) {
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    cache->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+/** Links an entry as the most recently used entry. */
+FIO_FUNC inline void FIO_NAME(_link_)(FIO_NAME(s) * cache,
+                                      FIO_NAME(_entry_s) * e) {
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head)
+    cache->head->prev = e;
+  else
+    cache->tail = e;
+  cache->head = e;
+}
+
+/** Removes an entry from the Cache, destroying the key and the object. */
+FIO_FUNC void FIO_NAME(_drop_)(FIO_NAME(s) * cache, FIO_NAME(_entry_s) * e,
+                               FIO_CACHE_OBJ_TYPE *old) {
+  FIO_NAME(_map_remove)(&cache->map, (uintptr_t)e->hash, e, NULL);
+  FIO_NAME(_unlink_)(cache, e);
+  cache->bytes -= e->size;
+  if (old)
+    FIO_CACHE_OBJ_COPY((*old), e->obj);
+  FIO_CACHE_OBJ_DESTROY(e->obj);
+  FIO_CACHE_KEY_DESTROY(e->key);
+  FIO_CACHE_FREE(e, sizeof(*e));
+}
+
+/** Locates an entry using its key. */
+FIO_FUNC inline FIO_NAME(_entry_s) *
+    FIO_NAME(_find_)(FIO_NAME(s) * cache, uint64_t hash,
+                     FIO_CACHE_KEY_TYPE key) {
+  FIO_NAME(_entry_s) tmp;
+  tmp.key = key;
+  return FIO_NAME(_map_find)(&cache->map, (uintptr_t)hash, &tmp);
+}
+
+#ifdef FIO_CACHE_TINYLFU
+/** Count-Min sketch index for each of the 4 rows (a splitmix64 finalizer). */
+FIO_FUNC inline size_t FIO_NAME(_sketch_pos_)(FIO_NAME(s) * cache,
+                                             uint64_t hash, uint64_t row) {
+  hash ^= (row + 1) * 0x9E3779B97F4A7C15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+  hash ^= (hash >> 31);
+  return (size_t)(row * (cache->sketch_mask + 1)) +
+         (size_t)(hash & cache->sketch_mask);
+}
+
+/** Records an access to `hash`, aging the sketch every 10 * width accesses. */
+FIO_FUNC void FIO_NAME(_sketch_add_)(FIO_NAME(s) * cache, uint64_t hash) {
+  if (!cache->sketch) {
+    size_t width = 64;
+    const size_t want =
+        cache->max_count ? cache->max_count : FIO_CACHE_TINYLFU_DEFAULT_WIDTH;
+    while (width < want)
+      width <<= 1;
+    cache->sketch = (uint8_t *)FIO_CACHE_MALLOC(width << 2);
+    if (!cache->sketch)
+      return;
+    memset(cache->sketch, 0, width << 2);
+    cache->sketch_mask = width - 1;
+  }
+  for (uint64_t row = 0; row < 4; ++row) {
+    uint8_t *c = cache->sketch + FIO_NAME(_sketch_pos_)(cache, hash, row);
+    if (*c < 15)
+      ++*c;
+  }
+  if (++cache->sketch_ops >= (cache->sketch_mask + 1) * 10) {
+    /* aging: halve all counters, so old popularity fades */
+    for (size_t i = 0; i < ((cache->sketch_mask + 1) << 2); ++i)
+      cache->sketch[i] >>= 1;
+    cache->sketch_ops = 0;
+  }
+}
+
+/** Estimates the access frequency of `hash`. */
+FIO_FUNC uint8_t FIO_NAME(_sketch_get_)(FIO_NAME(s) * cache, uint64_t hash) {
+  uint8_t r = 255;
+  if (!cache->sketch)
+    return 0;
+  for (uint64_t row = 0; row < 4; ++row) {
+    uint8_t c = cache->sketch[FIO_NAME(_sketch_pos_)(cache, hash, row)];
+    if (c < r)
+      r = c;
+  }
+  return r;
+}
+#endif
+
+/** Tests if the Cache must evict entries to make room for `size` bytes. */
+FIO_FUNC inline int FIO_NAME(_is_full_)(FIO_NAME(s) * cache, size_t size) {
+  return (cache->max_count &&
+          FIO_NAME(_map_count)(&cache->map) >= cache->max_count) ||
+         (cache->max_bytes && cache->bytes + size > cache->max_bytes);
+}
+
+/* *****************************************************************************
+Cache Implementation
+***************************************************************************** */
+
+/** Frees all the objects in the Cache and deallocates any internal resources.
+ */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * cache) {
+  while (cache->head) {
+    FIO_NAME(_entry_s) *e = cache->head;
+    cache->head = e->next;
+    FIO_CACHE_OBJ_DESTROY(e->obj);
+    FIO_CACHE_KEY_DESTROY(e->key);
+    FIO_CACHE_FREE(e, sizeof(*e));
+  }
+  FIO_NAME(_map_free)(&cache->map);
+#ifdef FIO_CACHE_TINYLFU
+  if (cache->sketch)
+    FIO_CACHE_FREE(cache->sketch, (cache->sketch_mask + 1) << 2);
+  cache->sketch = NULL;
+  cache->sketch_mask = 0;
+  cache->sketch_ops = 0;
+#endif
+  cache->head = cache->tail = NULL;
+  cache->bytes = 0;
+}
+
+/** Returns the object cached using `key`, or FIO_CACHE_OBJ_INVALID. */
+FIO_FUNC inline FIO_CACHE_OBJ_TYPE FIO_NAME(get)(FIO_NAME(s) * cache,
+                                                 uint64_t hash,
+                                                 FIO_CACHE_KEY_TYPE key) {
+#ifdef FIO_CACHE_TINYLFU
+  FIO_NAME(_sketch_add_)(cache, hash);
+#endif
+  FIO_NAME(_entry_s) *e = FIO_NAME(_find_)(cache, hash, key);
+  if (!e)
+    goto miss;
+  if (e->expires && e->expires <= FIO_CACHE_TIME_MS()) {
+    FIO_NAME(_drop_)(cache, e, NULL);
+    ++cache->stats.expired;
+    goto miss;
+  }
+  ++cache->stats.hits;
+  if (cache->head != e) {
+    FIO_NAME(_unlink_)(cache, e);
+    FIO_NAME(_link_)(cache, e);
+  }
+  return e->obj;
+miss:
+  ++cache->stats.misses;
+  return FIO_CACHE_OBJ_INVALID;
+}
+
+/** Caches a copy of `obj` using `key`, replacing any existing object. */
+FIO_FUNC int FIO_NAME(put)(FIO_NAME(s) * cache, uint64_t hash,
+                           FIO_CACHE_KEY_TYPE key, FIO_CACHE_OBJ_TYPE obj,
+                           size_t size, size_t ttl_ms) {
+  FIO_NAME(_entry_s) *e = FIO_NAME(_find_)(cache, hash, key);
+  if (cache->max_bytes && size > cache->max_bytes) {
+    /* never fits, but it must not leave a stale object behind */
+    if (e)
+      FIO_NAME(_drop_)(cache, e, NULL);
+    ++cache->stats.rejected;
+    return -1;
+  }
+  if (e) {
+    /* replace in place */
+    FIO_CACHE_OBJ_DESTROY(e->obj);
+    FIO_CACHE_OBJ_COPY(e->obj, obj);
+    cache->bytes = cache->bytes - e->size + size;
+    e->size = size;
+    e->expires = ttl_ms ? FIO_CACHE_TIME_MS() + ttl_ms : 0;
+    if (cache->head != e) {
+      FIO_NAME(_unlink_)(cache, e);
+      FIO_NAME(_link_)(cache, e);
+    }
+    /* the entry grew, evict from the tail (not this entry, it fits) */
+    while (cache->max_bytes && cache->bytes > cache->max_bytes &&
+           cache->tail != e) {
+      FIO_NAME(_drop_)(cache, cache->tail, NULL);
+      ++cache->stats.evictions;
+    }
+    return 0;
+  }
+#ifdef FIO_CACHE_TINYLFU
+  FIO_NAME(_sketch_add_)(cache, hash);
+  if (cache->tail && FIO_NAME(_is_full_)(cache, size) &&
+      FIO_NAME(_sketch_get_)(cache, hash) <=
+          FIO_NAME(_sketch_get_)(cache, cache->tail->hash) &&
+      !(cache->tail->expires &&
+        cache->tail->expires <= FIO_CACHE_TIME_MS())) {
+    /* the candidate isn't more popular than the eviction victim */
+    ++cache->stats.rejected;
+    return -1;
+  }
+#endif
+  while (cache->tail && FIO_NAME(_is_full_)(cache, size)) {
+    if (cache->tail->expires && cache->tail->expires <= FIO_CACHE_TIME_MS())
+      ++cache->stats.expired;
+    else
+      ++cache->stats.evictions;
+    FIO_NAME(_drop_)(cache, cache->tail, NULL);
+  }
+  e = (FIO_NAME(_entry_s) *)FIO_CACHE_MALLOC(sizeof(*e));
+  if (!e)
+    return -1;
+  e->hash = hash;
+  e->size = size;
+  e->expires = ttl_ms ? FIO_CACHE_TIME_MS() + ttl_ms : 0;
+  FIO_CACHE_KEY_COPY(e->key, key);
+  FIO_CACHE_OBJ_COPY(e->obj, obj);
+  FIO_NAME(_map_insert)(&cache->map, (uintptr_t)hash, e);
+  FIO_NAME(_link_)(cache, e);
+  cache->bytes += size;
+  return 0;
+}
+
+/** Removes an object from the Cache. */
+FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * cache, uint64_t hash,
+                              FIO_CACHE_KEY_TYPE key, FIO_CACHE_OBJ_TYPE *old) {
+  FIO_NAME(_entry_s) *e = FIO_NAME(_find_)(cache, hash, key);
+  if (!e)
+    return -1;
+  FIO_NAME(_drop_)(cache, e, old);
+  return 0;
+}
+
+/** Removes all the expired objects, returning the number of objects removed. */
+FIO_FUNC size_t FIO_NAME(expire)(FIO_NAME(s) * cache) {
+  const uint64_t now = FIO_CACHE_TIME_MS();
+  size_t count = 0;
+  FIO_NAME(_entry_s) *e = cache->head;
+  while (e) {
+    FIO_NAME(_entry_s) *next = e->next;
+    if (e->expires && e->expires <= now) {
+      FIO_NAME(_drop_)(cache, e, NULL);
+      ++count;
+    }
+    e = next;
+  }
+  cache->stats.expired += count;
+  return count;
+}
+
+/** Returns the number of objects currently in the Cache. */
+FIO_FUNC inline size_t FIO_NAME(count)(FIO_NAME(s) * cache) {
+  return FIO_NAME(_map_count)(&cache->map);
+}
+
+/** Returns the number of bytes currently accounted for by the Cache. */
+FIO_FUNC inline size_t FIO_NAME(bytes)(FIO_NAME(s) * cache) {
+  return cache->bytes;
+}
+
+/** Returns the Cache statistics. */
+FIO_FUNC inline FIO_NAME(stats_s) FIO_NAME(stats)(FIO_NAME(s) * cache) {
+  return cache->stats;
+}
+
+/* *****************************************************************************
+Done
+***************************************************************************** */
+
+#undef FIO_NAME_FROM_MACRO_STEP2
+#undef FIO_NAME_FROM_MACRO_STEP1
+#undef FIO_NAME
+#undef FIO_NAME_FROM_MACRO_STEP4
+#undef FIO_NAME_FROM_MACRO_STEP3
+#undef FIO_NAME_FREE
+#undef FIO_CACHE_NAME
+#undef FIO_CACHE_KEY_TYPE
+#undef FIO_CACHE_KEY_COMPARE
+#undef FIO_CACHE_KEY_COPY
+#undef FIO_CACHE_KEY_DESTROY
+#undef FIO_CACHE_OBJ_TYPE
+#undef FIO_CACHE_OBJ_INVALID
+#undef FIO_CACHE_OBJ_COPY
+#undef FIO_CACHE_OBJ_DESTROY
+#undef FIO_CACHE_MALLOC
+#undef FIO_CACHE_FREE
+#undef FIO_CACHE_TIME_MS
+#undef FIO_CACHE_TINYLFU
+
+#endif
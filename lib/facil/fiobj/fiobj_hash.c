@@ -14,6 +14,7 @@ License: MIT
 #define FIO_SET_FREE(ptr, size) fio_free((ptr))
 
 #define FIO_SET_NAME fio_hash__
+#define FIO_SET_SWISS 1
 #define FIO_SET_KEY_TYPE FIOBJ
 #define FIO_SET_KEY_COMPARE(o1, o2)                                            \
   ((o2) == ((FIOBJ)-1) || (o1) == ((FIOBJ)-1) || fiobj_iseq((o1), (o2)))
@@ -2468,6 +2468,7 @@ Lookup Tables / functions
 
 #define FIO_FORCE_MALLOC_TMP 1 /* use malloc for the mime registry */
 #define FIO_SET_NAME fio_mime_set
+#define FIO_SET_SWISS 1
 #define FIO_SET_OBJ_TYPE FIOBJ
 #define FIO_SET_OBJ_COMPARE(o1, o2) (1)
 #define FIO_SET_OBJ_COPY(dest, o) (dest) = fiobj_dup((o))
@@ -401,6 +401,17 @@ struct http_settings_s {
   uint8_t ws_timeout;
   /** Logging flag - set to TRUE to log HTTP requests. */
   uint8_t log;
+  /**
+   * Memory region flag - set to TRUE to allocate the request's data (headers,
+   * parameters, cookies, etc') from a per-connection memory region.
+   *
+   * The region is reset once the received data was parsed, so requests reuse
+   * the connection's memory block (a 32Kb block per connection). Allocations
+   * performed by the `on_request` callback are also sliced from the region, so
+   * long lived objects should be allocated elsewhere, or they keep the block
+   * and a new block is used (see `fio_region_s`).
+   */
+  uint8_t request_region;
   /** a read only flag set automatically to indicate the protocol's mode. */
   uint8_t is_client;
 };
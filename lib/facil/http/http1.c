@@ -22,6 +22,7 @@ typedef struct http1pr_s {
   http_fio_protocol_s p;
   http1_parser_s parser;
   http_s request;
+  fio_region_s region;
   uintptr_t buf_len;
   uintptr_t max_header_size;
   uintptr_t header_size;
@@ -683,13 +684,21 @@ static inline void http1_consume_data(intptr_t uuid, http1pr_s *p) {
   ssize_t i = 0;
   size_t org_len = p->buf_len;
   int pipeline_limit = 8;
+  fio_region_s *old_region = NULL;
   if (!p->buf_len)
     return;
+  if (p->p.settings->request_region)
+    old_region = fio_region_enter(&p->region);
   do {
     i = http1_parse(&p->parser, p->buf + (org_len - p->buf_len), p->buf_len);
     p->buf_len -= i;
     --pipeline_limit;
   } while (i && p->buf_len && pipeline_limit && !p->stop);
+  if (p->p.settings->request_region) {
+    /* the connection keeps the block, reusing it for the next requests */
+    fio_region_enter(old_region);
+    fio_region_reset(&p->region);
+  }
 
   if (p->buf_len && org_len != p->buf_len) {
     memmove(p->buf, p->buf + (org_len - p->buf_len), p->buf_len);
@@ -817,6 +826,7 @@ void http1_destroy(fio_protocol_s *pr) {
   http1pr_s *p = (http1pr_s *)pr;
   http1_pr2handle(p).status = 0;
   http_s_destroy(&http1_pr2handle(p), 0);
+  fio_region_release(&p->region);
   fio_free(p);
   // FIO_LOG_DEBUG("Deallocated HTTP/1.1 protocol at. %p", (void *)p);
 }
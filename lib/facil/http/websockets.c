@@ -117,7 +117,7 @@ struct ws_s {
   void *udata;
   /** The maximum websocket message size */
   size_t max_msg_size;
-  /** active pub/sub subscriptions */
+  /** active pub/sub subscriptions (`websocket_sub_data_s` objects) */
   fio_ls_s subscriptions;
   fio_lock_i sub_lock;
   /** socket buffer. */
@@ -136,13 +136,10 @@ struct ws_s {
 Create/Destroy the websocket subscription objects
 ***************************************************************************** */
 
-static inline void clear_subscriptions(ws_s *ws) {
-  fio_lock(&ws->sub_lock);
-  while (fio_ls_any(&ws->subscriptions)) {
-    fio_unsubscribe(fio_ls_pop(&ws->subscriptions));
-  }
-  fio_unlock(&ws->sub_lock);
-}
+static inline void clear_subscriptions(ws_s *ws);
+
+/** sends held pub/sub messages (see `max_pending`) */
+static void websocket_flush_held(ws_s *ws);
 
 /* *****************************************************************************
 Callbacks - Required functions for websocket_parser.h
@@ -226,6 +223,7 @@ static void on_close(intptr_t uuid, fio_protocol_s *_ws) {
 
 static void on_ready(intptr_t fduuid, fio_protocol_s *ws) {
   (void)(fduuid);
+  websocket_flush_held((ws_s *)ws);
   if (((ws_s *)ws)->on_ready)
     ((ws_s *)ws)->on_ready((ws_s *)ws);
 }
@@ -522,13 +520,108 @@ void websocket_optimize4broadcasts(intptr_t type, int enable) {
 Subscription handling
 ***************************************************************************** */
 
+/* a held (wrapped) message, waiting for the connection to catch up */
+typedef struct {
+  FIOBJ frame;
+  uint64_t key;
+} websocket_held_s;
+
 typedef struct {
   void (*on_message)(ws_s *ws, fio_str_info_s channel, fio_str_info_s msg,
                      void *udata);
   void (*on_unsubscribe)(void *udata);
   void *udata;
+  subscription_s *sub;
+  /* a ring buffer of held messages (`max_pending` long, allocated on demand) */
+  websocket_held_s *held;
+  size_t held_start;
+  size_t held_count;
+  size_t max_pending;
+  websocket_slow_policy_e on_slow;
 } websocket_sub_data_s;
 
+static inline void clear_subscriptions(ws_s *ws) {
+  fio_lock(&ws->sub_lock);
+  while (fio_ls_any(&ws->subscriptions)) {
+    websocket_sub_data_s *d = fio_ls_pop(&ws->subscriptions);
+    fio_unsubscribe(d->sub);
+  }
+  fio_unlock(&ws->sub_lock);
+}
+
+/* wraps a message in a single WebSocket frame, so it could be held */
+static FIOBJ websocket_wrap2fiobj(ws_s *ws, fio_str_info_s msg, uint8_t txt) {
+  FIOBJ out = fiobj_str_buf(msg.len + 16);
+  char *buf = fiobj_obj2cstr(out).data;
+  fiobj_str_resize(out, (ws->is_client
+                             ? websocket_client_wrap(buf, msg.data, msg.len,
+                                                     (txt ? 1 : 2), 1, 1, 0)
+                             : websocket_server_wrap(buf, msg.data, msg.len,
+                                                     (txt ? 1 : 2), 1, 1, 0)));
+  return out;
+}
+
+/* sends held messages while the outgoing queue is below the limit */
+static void websocket_sub_flush(intptr_t fd, websocket_sub_data_s *d) {
+  while (d->held_count && fio_pending(fd) < d->max_pending) {
+    fiobj_send_free(fd, d->held[d->held_start].frame);
+    d->held_start = (d->held_start + 1) % d->max_pending;
+    --d->held_count;
+  }
+}
+
+/* called within the connection's write lock (from `on_ready`) */
+static void websocket_flush_held(ws_s *ws) {
+  fio_lock(&ws->sub_lock);
+  FIO_LS_FOR(&ws->subscriptions, pos) {
+    websocket_sub_data_s *d = (websocket_sub_data_s *)pos->obj;
+    if (d->held_count)
+      websocket_sub_flush(ws->fd, d);
+  }
+  fio_unlock(&ws->sub_lock);
+}
+
+/* returns true if a message should be handled by the `on_slow` policy */
+static inline int websocket_sub_is_slow(intptr_t fd, websocket_sub_data_s *d) {
+  if (!d->max_pending)
+    return 0;
+  if (d->held_count)
+    websocket_sub_flush(fd, d);
+  return d->held_count || fio_pending(fd) >= d->max_pending;
+}
+
+/* holds a wrapped message until the connection catches up */
+static void websocket_sub_hold(websocket_sub_data_s *d, fio_str_info_s channel,
+                               FIOBJ frame) {
+  websocket_held_s *pos;
+  uint64_t key = 0;
+  if (d->on_slow == WEBSOCKET_SLOW_COALESCE) {
+    /* replace a held message published to the same channel */
+    key = fio_siphash(channel.data, channel.len, 0, 0);
+    for (size_t i = 0; i < d->held_count; ++i) {
+      pos = d->held + ((d->held_start + i) % d->max_pending);
+      if (pos->key == key) {
+        fiobj_free(pos->frame);
+        pos->frame = frame;
+        return;
+      }
+    }
+  }
+  if (!d->held) {
+    d->held = malloc(sizeof(*d->held) * d->max_pending);
+    FIO_ASSERT_ALLOC(d->held);
+  }
+  if (d->held_count == d->max_pending) {
+    /* drop the oldest held message */
+    fiobj_free(d->held[d->held_start].frame);
+    d->held_start = (d->held_start + 1) % d->max_pending;
+    --d->held_count;
+  }
+  pos = d->held + ((d->held_start + d->held_count) % d->max_pending);
+  ++d->held_count;
+  *pos = (websocket_held_s){.frame = frame, .key = key};
+}
+
 static inline void websocket_on_pubsub_message_direct_internal(fio_msg_s *msg,
                                                                uint8_t txt) {
   fio_protocol_s *pr =
@@ -541,6 +634,23 @@ static inline void websocket_on_pubsub_message_direct_internal(fio_msg_s *msg,
   }
   FIOBJ message = FIOBJ_INVALID;
   FIOBJ pre_wrapped = FIOBJ_INVALID;
+  websocket_sub_data_s *d = msg->udata2;
+  uint8_t hold = 0;
+  if (websocket_sub_is_slow((intptr_t)msg->udata1, d)) {
+    switch (d->on_slow) {
+    case WEBSOCKET_SLOW_DROP_OLDEST: /* fallthrough */
+    case WEBSOCKET_SLOW_COALESCE:
+      hold = 1;
+      break;
+    case WEBSOCKET_SLOW_DISCONNECT:
+      FIO_LOG_DEBUG("(websocket) disconnecting slow client %p", msg->udata1);
+      fio_force_close((intptr_t)msg->udata1);
+      goto finish;
+    case WEBSOCKET_SLOW_DROP_NEWEST: /* fallthrough */
+    default:
+      goto finish;
+    }
+  }
   if (!((ws_s *)pr)->is_client) {
     /* pre-wrapping is only for client data */
     switch (txt) {
@@ -561,7 +671,10 @@ static inline void websocket_on_pubsub_message_direct_internal(fio_msg_s *msg,
     if (pre_wrapped) {
       // FIO_LOG_DEBUG(
       //     "pub/sub WebSocket optimization route for pre-wrapped message.");
-      fiobj_send_free((intptr_t)msg->udata1, fiobj_dup(pre_wrapped));
+      if (hold)
+        websocket_sub_hold(d, msg->channel, fiobj_dup(pre_wrapped));
+      else
+        fiobj_send_free((intptr_t)msg->udata1, fiobj_dup(pre_wrapped));
       goto finish;
     }
   }
@@ -571,7 +684,11 @@ static inline void websocket_on_pubsub_message_direct_internal(fio_msg_s *msg,
         FIO_STR_INIT_STATIC2(msg->msg.data, msg->msg.len); // don't free
     txt = (tmp.len >= (2 << 14) ? 0 : fio_str_utf8_valid(&tmp));
   }
-  websocket_write((ws_s *)pr, msg->msg, txt & 1);
+  if (hold)
+    websocket_sub_hold(d, msg->channel,
+                       websocket_wrap2fiobj((ws_s *)pr, msg->msg, txt & 1));
+  else
+    websocket_write((ws_s *)pr, msg->msg, txt & 1);
   fiobj_free(message);
 finish:
   fio_protocol_unlock(pr, FIO_PR_LOCK_WRITE);
@@ -620,6 +737,12 @@ static void websocket_on_unsubscribe(void *u1, void *u2) {
              (intptr_t)WEBSOCKET_OPTIMIZE_PUBSUB_BINARY) {
     websocket_optimize4broadcasts(WEBSOCKET_OPTIMIZE_PUBSUB_BINARY, 0);
   }
+  while (d->held_count) {
+    fiobj_free(d->held[d->held_start].frame);
+    d->held_start = (d->held_start + 1) % d->max_pending;
+    --d->held_count;
+  }
+  free(d->held);
   free(d);
   (void)u1;
 }
@@ -654,6 +777,8 @@ uintptr_t websocket_subscribe(struct websocket_subscribe_s args) {
     websocket_optimize4broadcasts(br_type, 1);
     d->on_message =
         (void (*)(ws_s *, fio_str_info_s, fio_str_info_s, void *))br_type;
+    d->max_pending = args.max_pending;
+    d->on_slow = args.on_slow;
   }
   subscription_s *sub =
       fio_subscribe(.channel = args.channel, .match = args.match,
@@ -665,8 +790,9 @@ uintptr_t websocket_subscribe(struct websocket_subscribe_s args) {
     return 0;
   }
   fio_ls_s *pos;
+  d->sub = sub;
   fio_lock(&args.ws->sub_lock);
-  pos = fio_ls_push(&args.ws->subscriptions, sub);
+  pos = fio_ls_push(&args.ws->subscriptions, d);
   fio_unlock(&args.ws->sub_lock);
 
   return (uintptr_t)pos;
@@ -680,12 +806,11 @@ error:
  * Unsubscribes from a channel.
  */
 void websocket_unsubscribe(ws_s *ws, uintptr_t subscription_id) {
-  fio_unsubscribe((subscription_s *)((fio_ls_s *)subscription_id)->obj);
+  /* remove the data from the list before it could be freed */
   fio_lock(&ws->sub_lock);
-  fio_ls_remove((fio_ls_s *)subscription_id);
+  websocket_sub_data_s *d = fio_ls_remove((fio_ls_s *)subscription_id);
   fio_unlock(&ws->sub_lock);
-
-  (void)ws;
+  fio_unsubscribe(d->sub);
 }
 
 /*******************************************************************************
@@ -72,6 +72,22 @@ to the process cluster (all the processes in `fio_run`).
 To publish to a channel, use the API provided in {pubsub.h}.
 ***************************************************************************** */
 
+/**
+ * The slow client policies available for direct message forwarding, used once
+ * a subscription's `max_pending` limit is reached.
+ */
+typedef enum {
+  /** New messages are dropped until the connection catches up. */
+  WEBSOCKET_SLOW_DROP_NEWEST = 0,
+  /** New messages are held (up to `max_pending`), dropping the oldest. */
+  WEBSOCKET_SLOW_DROP_OLDEST,
+  /** Same as DROP_OLDEST, but a newer message replaces a held message that was
+   * published to the same channel. */
+  WEBSOCKET_SLOW_COALESCE,
+  /** The connection is closed and the data waiting to be sent is discarded. */
+  WEBSOCKET_SLOW_DISCONNECT,
+} websocket_slow_policy_e;
+
 /** Possible arguments for the {websocket_subscribe} function. */
 struct websocket_subscribe_s {
   /** the websocket receiving the message. REQUIRED. */
@@ -112,6 +128,23 @@ struct websocket_subscribe_s {
    *
    */
   unsigned force_text : 1;
+  /**
+   * When using client forwarding (no `on_message` callback), this limits the
+   * number of packets waiting in the connection's outgoing queue (see
+   * `fio_pending`). Once the limit is reached, messages are handled according
+   * to the `on_slow` policy, so slow clients can't consume unbounded memory.
+   *
+   * Held messages are sent once the connection's outgoing queue is drained.
+   *
+   * Default: 0 (no limit).
+   */
+  size_t max_pending;
+  /**
+   * The policy used once the `max_pending` limit is reached.
+   *
+   * Default: WEBSOCKET_SLOW_DROP_NEWEST.
+   */
+  websocket_slow_policy_e on_slow;
 };
 
 /**
@@ -633,6 +633,47 @@ static void redis_on_unsubscribe_root(const fio_pubsub_engine_s *eng,
   }
 }
 
+/* sends one (P)(UN)SUBSCRIBE command for each run of similar changes */
+static void redis_on_subscribe_batch_root(const fio_pubsub_engine_s *eng,
+                                          const fio_pubsub_change_s *changes,
+                                          size_t count) {
+  static const fio_str_info_s commands[] = {
+      {.data = (char *)"$11\r\nUNSUBSCRIBE\r\n", .len = 18},
+      {.data = (char *)"$9\r\nSUBSCRIBE\r\n", .len = 15},
+      {.data = (char *)"$12\r\nPUNSUBSCRIBE\r\n", .len = 19},
+      {.data = (char *)"$10\r\nPSUBSCRIBE\r\n", .len = 17},
+  };
+  redis_engine_s *r = (redis_engine_s *)eng;
+  if (r->sub_data.uuid == -1)
+    return;
+  size_t i = 0;
+  while (i < count) {
+    const size_t kind = (changes[i].subscribe ? 1 : 0) |
+                        (changes[i].match == FIO_MATCH_GLOB ? 2 : 0);
+    size_t end = i;
+    size_t len = 0;
+    while (end < count &&
+           kind == ((changes[end].subscribe ? 1 : 0) |
+                    (changes[end].match == FIO_MATCH_GLOB ? 2 : 0))) {
+      len += changes[end].channel.len + 24;
+      ++end;
+    }
+    FIOBJ cmd = fiobj_str_buf(48 + len);
+    fiobj_str_write(cmd, "*", 1);
+    fiobj_str_write_i(cmd, (end - i) + 1);
+    fiobj_str_write(cmd, "\r\n", 2);
+    fiobj_str_write(cmd, commands[kind].data, commands[kind].len);
+    for (; i < end; ++i) {
+      fiobj_str_write(cmd, "$", 1);
+      fiobj_str_write_i(cmd, changes[i].channel.len);
+      fiobj_str_write(cmd, "\r\n", 2);
+      fiobj_str_write(cmd, changes[i].channel.data, changes[i].channel.len);
+      fiobj_str_write(cmd, "\r\n", 2);
+    }
+    fiobj_send_free(r->sub_data.uuid, cmd);
+  }
+}
+
 static void redis_on_publish_root(const fio_pubsub_engine_s *eng,
                                   fio_str_info_s channel, fio_str_info_s msg,
                                   uint8_t is_json) {
@@ -877,6 +918,7 @@ FIO_IGNORE_MACRO(struct redis_engine_create_args args) {
               .subscribe = redis_on_subscribe_root,
               .unsubscribe = redis_on_unsubscribe_root,
               .publish = redis_on_publish_root,
+              .subscribe_batch = redis_on_subscribe_batch_root,
           },
       .pub_data =
           {
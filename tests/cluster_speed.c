@@ -0,0 +1,293 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Measures pub/sub throughput between forked worker processes, using each of
+ * the cluster's transports:
+ *
+ * * direct - workers push publications to the subscribers' rings.
+ * * relay  - the root process relays publications using the rings.
+ * * socket - everything travels over the cluster's Unix socket (using the
+ *            coalesced writes and compact frames).
+ *
+ * Every subscriber validates the order of each publisher's messages, including
+ * messages large enough to be passed through the rings in pieces.
+ *
+ * The library is compiled in, so the transport is selected at runtime:
+ *
+ *       make test/cluster_speed
+ */
+static int cluster_speed_direct = 1;
+#define FIO_CLUSTER_DIRECT cluster_speed_direct
+#include "fio.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#ifndef CLUSTER_SPEED_WORKERS
+#define CLUSTER_SPEED_WORKERS 16
+#endif
+#ifndef CLUSTER_SPEED_MESSAGES
+/* messages published by each worker */
+#define CLUSTER_SPEED_MESSAGES 2048
+#endif
+#ifndef CLUSTER_SPEED_TIMEOUT
+/* milliseconds */
+#define CLUSTER_SPEED_TIMEOUT 60000
+#endif
+
+/* message filters (control messages) */
+#define CLUSTER_SPEED_READY 1
+#define CLUSTER_SPEED_GO 2
+#define CLUSTER_SPEED_DONE 3
+
+/* *****************************************************************************
+Test settings
+***************************************************************************** */
+
+typedef struct {
+  const char *name;
+  int direct;
+  int shm;
+} cluster_speed_mode_s;
+
+typedef struct {
+  const char *name;
+  /* number of subscribed workers */
+  size_t subscribers;
+  /* message length */
+  size_t len;
+  /* if set, every `large`th message is bigger than half a ring */
+  size_t large;
+} cluster_speed_test_s;
+
+static cluster_speed_mode_s cluster_speed_modes[] = {
+    {.name = "direct", .direct = 1, .shm = 1},
+    {.name = "relay", .direct = 0, .shm = 1},
+    {.name = "socket", .direct = 0, .shm = 0},
+};
+
+static cluster_speed_test_s cluster_speed_tests[] = {
+    {.name = "16B, all subscribed",
+     .subscribers = CLUSTER_SPEED_WORKERS,
+     .len = 16},
+    {.name = "16B, 2 subscribed", .subscribers = 2, .len = 16},
+    {.name = "1KB, all subscribed",
+     .subscribers = CLUSTER_SPEED_WORKERS,
+     .len = 1024},
+    {.name = "mixed, 2 subscribed", .subscribers = 2, .len = 64, .large = 256},
+};
+
+static cluster_speed_mode_s *mode;
+static cluster_speed_test_s *test;
+
+/* shared between the processes of a run */
+static struct {
+  volatile size_t index;
+} * shared;
+
+/* *****************************************************************************
+Root process - starts the test and collects the results
+***************************************************************************** */
+
+static size_t root_ready;
+static size_t root_done;
+static size_t root_errors;
+static struct timespec root_start;
+
+/* stops the cluster the way ^C would (the run has it's own process group) */
+static void cluster_speed_stop(void) {
+  fio_stop(); /* before the workers exit, so they aren't respawned */
+  kill(0, SIGINT);
+}
+
+static void cluster_speed_on_ready(fio_msg_s *msg) {
+  if (++root_ready < CLUSTER_SPEED_WORKERS)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &root_start);
+  fio_publish(.filter = CLUSTER_SPEED_GO, .engine = FIO_PUBSUB_CLUSTER);
+  (void)msg;
+}
+
+static void cluster_speed_on_done(fio_msg_s *msg) {
+  uint64_t errors = 0;
+  if (msg->msg.len >= sizeof(errors))
+    memcpy(&errors, msg->msg.data, sizeof(errors));
+  root_errors += errors;
+  if (++root_done < CLUSTER_SPEED_WORKERS)
+    return;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double ms = ((end.tv_sec - root_start.tv_sec) * 1000.0) +
+                    ((end.tv_nsec - root_start.tv_nsec) / 1000000.0);
+  const size_t deliveries =
+      test->subscribers * CLUSTER_SPEED_WORKERS * CLUSTER_SPEED_MESSAGES;
+  fprintf(stderr, "  %-8s %-22s %10.2f ms %12.0f deliveries/sec %6zu %s\n",
+          mode->name, test->name, ms, deliveries * 1000.0 / ms, root_errors,
+          (root_errors ? "ORDER ERRORS" : "in order"));
+  cluster_speed_stop();
+}
+
+static void cluster_speed_timeout(void *ignr_) {
+  fprintf(stderr, "  %-8s %-22s timed out (%zu/%d workers done)\n", mode->name,
+          test->name, root_done, CLUSTER_SPEED_WORKERS);
+  root_errors = 1;
+  cluster_speed_stop();
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Worker processes - publish and validate the messages
+***************************************************************************** */
+
+static size_t worker_index;
+static size_t worker_received;
+static uint64_t worker_errors;
+static uint32_t worker_expected[CLUSTER_SPEED_WORKERS];
+
+static size_t cluster_speed_len(uint32_t seq) {
+  if (test->large && (seq % test->large) == test->large - 1)
+    return (FIO_CLUSTER_SHM_RING_SIZE >> 1) + 1 + seq;
+  return test->len;
+}
+
+static void cluster_speed_done(void) {
+  fio_publish(.filter = CLUSTER_SPEED_DONE, .engine = FIO_PUBSUB_ROOT,
+              .message = {.data = (char *)&worker_errors,
+                          .len = sizeof(worker_errors)});
+}
+
+static void cluster_speed_on_message(fio_msg_s *msg) {
+  uint32_t head[2]; /* publisher, sequence */
+  if (msg->msg.len < sizeof(head)) {
+    ++worker_errors;
+    goto received;
+  }
+  memcpy(head, msg->msg.data, sizeof(head));
+  if (head[0] >= CLUSTER_SPEED_WORKERS ||
+      head[1] != worker_expected[head[0]] ||
+      msg->msg.len != cluster_speed_len(head[1]) ||
+      msg->msg.data[msg->msg.len - 1] != (char)head[1]) {
+    ++worker_errors;
+  }
+  if (head[0] < CLUSTER_SPEED_WORKERS)
+    worker_expected[head[0]] = head[1] + 1;
+received:
+  if (++worker_received == CLUSTER_SPEED_WORKERS * CLUSTER_SPEED_MESSAGES)
+    cluster_speed_done();
+}
+
+static void cluster_speed_on_go(fio_msg_s *msg) {
+  size_t capa = cluster_speed_len(0);
+  for (uint32_t i = 0; i < CLUSTER_SPEED_MESSAGES; ++i) {
+    if (cluster_speed_len(i) > capa)
+      capa = cluster_speed_len(i);
+  }
+  char *buf = malloc(capa);
+  FIO_ASSERT_ALLOC(buf);
+  for (uint32_t i = 0; i < CLUSTER_SPEED_MESSAGES; ++i) {
+    const size_t len = cluster_speed_len(i);
+    const uint32_t head[2] = {(uint32_t)worker_index, i};
+    memcpy(buf, head, sizeof(head));
+    memset(buf + sizeof(head), (char)i, len - sizeof(head));
+    fio_publish(.channel = {.data = "speed", .len = 5},
+                .message = {.data = buf, .len = len},
+                .engine = FIO_PUBSUB_CLUSTER);
+  }
+  free(buf);
+  if (worker_index >= test->subscribers)
+    cluster_speed_done();
+  (void)msg;
+}
+
+/* *****************************************************************************
+Running the tests
+***************************************************************************** */
+
+/* root process (workers don't inherit the timer) */
+static void cluster_speed_on_pre_start(void *ignr_) {
+  fio_subscribe(.filter = CLUSTER_SPEED_READY,
+                .on_message = cluster_speed_on_ready);
+  fio_subscribe(.filter = CLUSTER_SPEED_DONE,
+                .on_message = cluster_speed_on_done);
+  fio_run_every(CLUSTER_SPEED_TIMEOUT, 1, cluster_speed_timeout, NULL, NULL);
+  (void)ignr_;
+}
+
+/* worker processes */
+static void cluster_speed_on_start(void *ignr_) {
+  worker_index = fio_atomic_add(&shared->index, 1) - 1;
+  fio_subscribe(.filter = CLUSTER_SPEED_GO, .on_message = cluster_speed_on_go);
+  if (worker_index < test->subscribers)
+    fio_subscribe(.channel = {.data = "speed", .len = 5},
+                  .on_message = cluster_speed_on_message);
+  fio_publish(.filter = CLUSTER_SPEED_READY, .engine = FIO_PUBSUB_ROOT);
+  (void)ignr_;
+}
+
+/* runs after the cluster's rings were mapped (before forking the workers) */
+static void cluster_speed_socket_only(void *ignr_) {
+  fio_cluster_shm_destroy();
+  (void)ignr_;
+}
+
+/* runs a single test in a new process, so every test starts a fresh cluster */
+static int cluster_speed_run(cluster_speed_mode_s *m, cluster_speed_test_s *t) {
+  shared->index = 0;
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork failed");
+    return -1;
+  }
+  if (!pid) {
+    /* this process is the cluster's root process */
+    fio_data->parent = getpid();
+    setpgid(0, 0);
+    mode = m;
+    test = t;
+    cluster_speed_direct = m->direct;
+    if (!m->shm)
+      fio_state_callback_add(FIO_CALL_PRE_START, cluster_speed_socket_only,
+                             NULL);
+    fio_state_callback_add(FIO_CALL_PRE_START, cluster_speed_on_pre_start,
+                           NULL);
+    fio_state_callback_add(FIO_CALL_ON_START, cluster_speed_on_start, NULL);
+    fio_start(.threads = 1, .workers = CLUSTER_SPEED_WORKERS);
+    exit(fio_is_worker() ? 0 : (root_errors || !root_done ? 1 : 0));
+  }
+  int status = 0;
+  if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+      WEXITSTATUS(status))
+    return -1;
+  return 0;
+}
+
+int main(void) {
+  FIO_LOG_LEVEL = FIO_LOG_LEVEL_WARNING;
+  shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  FIO_ASSERT(shared != MAP_FAILED, "couldn't map shared memory");
+  fprintf(stderr,
+          "* Cluster pub/sub, %d workers (1 thread each), %d messages per "
+          "worker:\n",
+          CLUSTER_SPEED_WORKERS, CLUSTER_SPEED_MESSAGES);
+  int failed = 0;
+  for (size_t t = 0;
+       t < sizeof(cluster_speed_tests) / sizeof(cluster_speed_tests[0]); ++t) {
+    for (size_t m = 0;
+         m < sizeof(cluster_speed_modes) / sizeof(cluster_speed_modes[0]);
+         ++m) {
+      if (cluster_speed_run(cluster_speed_modes + m, cluster_speed_tests + t))
+        failed = 1;
+    }
+  }
+  munmap(shared, sizeof(*shared));
+  if (failed)
+    fprintf(stderr, "* FAILED.\n");
+  return failed;
+}
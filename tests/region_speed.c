@@ -0,0 +1,131 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Measures the cost of a request's allocations using a memory region, with
+ * each thread acting as a connection that handles requests one after the other:
+ *
+ * * arena   - no region, allocations are sliced from the per-CPU arenas.
+ * * release - a region is released after every request (a new block for every
+ *             request, returned to the memory pool once it's objects are freed).
+ * * reset   - the connection's region is reset after every request, reusing the
+ *             same block.
+ *
+ * The "outlives" variation keeps one object from each request until the next
+ * request is done (i.e., a response waiting to be sent), so the region's block
+ * can't be reused.
+ *
+ *       make test/lib/region_speed
+ */
+#include <fio.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef REGION_SPEED_REQUESTS
+/* requests handled by each thread */
+#define REGION_SPEED_REQUESTS (1UL << 18)
+#endif
+#ifndef REGION_SPEED_MAX_THREADS
+#define REGION_SPEED_MAX_THREADS 8
+#endif
+
+/* the allocations of a small request (header objects, strings, hashes, etc') */
+static const size_t region_speed_sizes[] = {
+    64, 32, 48, 128, 32, 96, 256, 48, 32, 64, 512, 32,
+    48, 32, 64, 1024, 32, 48, 96, 32, 64, 128, 48, 2048,
+};
+#define REGION_SPEED_ALLOCATIONS                                               \
+  (sizeof(region_speed_sizes) / sizeof(region_speed_sizes[0]))
+
+typedef enum {
+  REGION_SPEED_ARENA,
+  REGION_SPEED_RELEASE,
+  REGION_SPEED_RESET,
+} region_speed_mode_e;
+
+static const char *region_speed_mode_names[] = {"arena", "release", "reset"};
+
+static region_speed_mode_e mode;
+static int outlives;
+
+static double region_speed_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + ((double)t.tv_nsec / 1000000000.0);
+}
+
+static void *region_speed_connection(void *ignr_) {
+  fio_region_s region = FIO_REGION_INIT;
+  char *mem[REGION_SPEED_ALLOCATIONS];
+  char *kept = NULL;
+  for (size_t r = 0; r < REGION_SPEED_REQUESTS; ++r) {
+    fio_region_s *old = NULL;
+    if (mode != REGION_SPEED_ARENA)
+      old = fio_region_enter(&region);
+    for (size_t i = 0; i < REGION_SPEED_ALLOCATIONS; ++i) {
+      mem[i] = fio_malloc(region_speed_sizes[i]);
+      FIO_ASSERT_ALLOC(mem[i]);
+      mem[i][0] = (char)r;
+      mem[i][region_speed_sizes[i] - 1] = (char)i;
+    }
+    if (mode != REGION_SPEED_ARENA)
+      fio_region_enter(old);
+    /* the request is done, it's objects are freed */
+    fio_free(kept);
+    kept = NULL;
+    for (size_t i = (outlives ? 1 : 0); i < REGION_SPEED_ALLOCATIONS; ++i)
+      fio_free(mem[i]);
+    if (outlives)
+      kept = mem[0];
+    if (mode == REGION_SPEED_RELEASE)
+      fio_region_release(&region);
+    else if (mode == REGION_SPEED_RESET)
+      fio_region_reset(&region);
+  }
+  fio_free(kept);
+  fio_region_release(&region);
+  return ignr_;
+}
+
+static void region_speed_run(size_t threads) {
+  pthread_t thrd[REGION_SPEED_MAX_THREADS];
+  const double start = region_speed_time();
+  for (size_t i = 0; i < threads; ++i)
+    FIO_ASSERT(!pthread_create(thrd + i, NULL, region_speed_connection, NULL),
+               "Couldn't spawn thread.");
+  for (size_t i = 0; i < threads; ++i)
+    FIO_ASSERT(!pthread_join(thrd[i], NULL), "Couldn't join thread");
+  const double seconds = region_speed_time() - start;
+  fprintf(stderr, "  %-8s %-9s %2zu threads: %8.1f ns/request %8.2f M/sec\n",
+          region_speed_mode_names[mode], (outlives ? "outlives" : "released"),
+          threads, (seconds * 1000000000.0) / (double)REGION_SPEED_REQUESTS,
+          ((double)REGION_SPEED_REQUESTS * threads) / (seconds * 1000000.0));
+}
+
+int main(void) {
+#if DEBUG
+  fprintf(stderr, "\n=== WARNING: performance tests using the DEBUG mode are "
+                  "invalid. \n");
+#endif
+  fprintf(stderr,
+          "* Request allocations (%zu objects per request, %lu requests per "
+          "thread), wall clock time:\n",
+          (size_t)REGION_SPEED_ALLOCATIONS, (unsigned long)REGION_SPEED_REQUESTS);
+  for (outlives = 0; outlives < 2; ++outlives) {
+    for (size_t threads = 1; threads <= REGION_SPEED_MAX_THREADS;
+         threads <<= 1) {
+      for (mode = REGION_SPEED_ARENA; mode <= REGION_SPEED_RESET; ++mode)
+        region_speed_run(threads);
+    }
+  }
+  return 0;
+}